@@ -0,0 +1,616 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+// Benchmarks for the distance kernels, index construction and nearest
+// neighbor queries, run on synthetic data without R. Results are written
+// as JSON so that runs on different commits can be compared. Run
+// `bench --help` for the options.
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+	#include <malloc.h>
+#endif
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+#include <ANN/ANNperf.h>
+#include "data.h"
+extern "C" {
+	#include "internal.h"
+}
+#include "nn_search.h"
+
+#ifndef BENCH_REVISION
+	#define BENCH_REVISION ""
+#endif
+
+// Points visited are counted over at most this many queries, in chunks
+// small enough that ANN's (int) counters do not overflow
+static const int BENCH_MAX_COUNTED_QUERIES = 4096;
+static const int BENCH_COUNT_CHUNK = 128;
+
+// Kernels are timed on pairs of this many points, and each timing runs
+// about this many coordinates through the kernel
+static const int BENCH_KERNEL_POINTS = 1024;
+static const double BENCH_KERNEL_COORDINATES = 2e8;
+
+static const double BENCH_MINKOWSKI_P = 3.0;
+
+struct bench_Options {
+	std::vector<std::string> data_kinds;
+	std::vector<int> num_data_points;
+	std::vector<int> num_dimensions;
+	std::vector<int> kernel_dimensions;
+	std::vector<int> k;
+	std::vector<double> radius;
+	std::vector<std::string> indices;
+	int num_queries;
+	int repeats;
+	uint64_t seed;
+	bool exclude_self;
+	bool run_kernels;
+	bool run_searches;
+	std::string output;
+};
+
+// Kernel results are added here so that the compiler cannot drop them
+static volatile double bench_sink = 0.0;
+
+
+static void bench_usage(FILE* const out)
+{
+	fputs("Usage: bench [options]\n"
+	      "\n"
+	      "Lists are comma separated.\n"
+	      "  --data LIST        Data sets: uniform, clustered, lowdim, duplicates\n"
+	      "                     (default: all)\n"
+	      "  --n LIST           Numbers of data points (default: 10000,100000)\n"
+	      "  --d LIST           Numbers of dimensions (default: 2,8,32)\n"
+	      "  --kernel-d LIST    Dimensions for the kernels (default: 2,8,32,128,1024)\n"
+	      "  --k LIST           Numbers of neighbors (default: 1,10)\n"
+	      "  --radius LIST      Search radii, 0 for no radius (default: 0)\n"
+	      "  --index LIST       Indices: kd_tree, ball_tree, hnsw, rp_forest, pq\n"
+	      "                     (default: kd_tree,ball_tree)\n"
+	      "  --queries N        Queries per search (default: 10000)\n"
+	      "  --repeats N        Timings per measurement; the median is reported\n"
+	      "                     (default: 3)\n"
+	      "  --seed N           Seed for the data and queries (default: 123456789)\n"
+	      "  --exclude-self     Do not report queries as their own neighbors\n"
+	      "  --no-kernels       Skip the kernel benchmarks\n"
+	      "  --no-searches      Skip the index and query benchmarks\n"
+	      "  --output FILE      Write the JSON here instead of to stdout\n",
+	      out);
+}
+
+
+static void bench_fail(const std::string& msg)
+{
+	fprintf(stderr, "bench: %s\n", msg.c_str());
+	exit(EXIT_FAILURE);
+}
+
+
+static std::vector<std::string> bench_split(const std::string& list)
+{
+	std::vector<std::string> items;
+	size_t start = 0;
+	while (start <= list.size()) {
+		const size_t end = std::min(list.find(',', start), list.size());
+		if (end > start) items.push_back(list.substr(start, end - start));
+		start = end + 1;
+	}
+	return items;
+}
+
+
+static int bench_parse_int(const std::string& str,
+                           const int min_value)
+{
+	char* end;
+	const long value = strtol(str.c_str(), &end, 10);
+	if (str.empty() || *end != '\0' || value < min_value || value > INT_MAX) {
+		bench_fail("invalid number `" + str + "`");
+	}
+	return (int) value;
+}
+
+
+static std::vector<int> bench_parse_ints(const std::string& list,
+                                         const int min_value)
+{
+	std::vector<int> values;
+	for (const std::string& item : bench_split(list)) values.push_back(bench_parse_int(item, min_value));
+	return values;
+}
+
+
+static std::vector<double> bench_parse_doubles(const std::string& list)
+{
+	std::vector<double> values;
+	for (const std::string& item : bench_split(list)) {
+		char* end;
+		const double value = strtod(item.c_str(), &end);
+		if (*end != '\0' || !(value >= 0.0)) bench_fail("invalid radius `" + item + "`");
+		values.push_back(value);
+	}
+	return values;
+}
+
+
+static bool bench_parse_index(const std::string& name,
+                              idist_NNIndex* const out_index)
+{
+	if (name == "kd_tree") *out_index = IDIST_NN_INDEX_KD_TREE;
+	else if (name == "ball_tree") *out_index = IDIST_NN_INDEX_BALL_TREE;
+	else if (name == "hnsw") *out_index = IDIST_NN_INDEX_HNSW;
+	else if (name == "rp_forest") *out_index = IDIST_NN_INDEX_RP_FOREST;
+	else if (name == "pq") *out_index = IDIST_NN_INDEX_PQ;
+	else return false;
+	return true;
+}
+
+
+static bench_Options bench_parse_options(const int argc,
+                                         char** const argv)
+{
+	bench_Options options;
+	options.data_kinds = bench_split("uniform,clustered,lowdim,duplicates");
+	options.num_data_points = bench_parse_ints("10000,100000", 1);
+	options.num_dimensions = bench_parse_ints("2,8,32", 1);
+	options.kernel_dimensions = bench_parse_ints("2,8,32,128,1024", 1);
+	options.k = bench_parse_ints("1,10", 1);
+	options.radius = bench_parse_doubles("0");
+	options.indices = bench_split("kd_tree,ball_tree");
+	options.num_queries = 10000;
+	options.repeats = 3;
+	options.seed = 123456789;
+	options.exclude_self = false;
+	options.run_kernels = true;
+	options.run_searches = true;
+
+	for (int a = 1; a < argc; ++a) {
+		const std::string arg = argv[a];
+		if (arg == "--help") {
+			bench_usage(stdout);
+			exit(EXIT_SUCCESS);
+		} else if (arg == "--exclude-self") {
+			options.exclude_self = true;
+		} else if (arg == "--no-kernels") {
+			options.run_kernels = false;
+		} else if (arg == "--no-searches") {
+			options.run_searches = false;
+		} else {
+			if (a + 1 == argc) {
+				bench_usage(stderr);
+				bench_fail("missing value for `" + arg + "`");
+			}
+			const std::string value = argv[++a];
+			if (arg == "--data") options.data_kinds = bench_split(value);
+			else if (arg == "--n") options.num_data_points = bench_parse_ints(value, 1);
+			else if (arg == "--d") options.num_dimensions = bench_parse_ints(value, 1);
+			else if (arg == "--kernel-d") options.kernel_dimensions = bench_parse_ints(value, 1);
+			else if (arg == "--k") options.k = bench_parse_ints(value, 1);
+			else if (arg == "--radius") options.radius = bench_parse_doubles(value);
+			else if (arg == "--index") options.indices = bench_split(value);
+			else if (arg == "--queries") options.num_queries = bench_parse_int(value, 1);
+			else if (arg == "--repeats") options.repeats = bench_parse_int(value, 1);
+			else if (arg == "--seed") options.seed = (uint64_t) bench_parse_int(value, 0);
+			else if (arg == "--output") options.output = value;
+			else {
+				bench_usage(stderr);
+				bench_fail("unknown option `" + arg + "`");
+			}
+		}
+	}
+
+	for (const std::string& kind : options.data_kinds) {
+		if (!bench_is_data_kind(kind)) bench_fail("unknown data set `" + kind + "`");
+	}
+	for (const std::string& name : options.indices) {
+		idist_NNIndex index;
+		if (!bench_parse_index(name, &index)) bench_fail("unknown index `" + name + "`");
+	}
+	return options;
+}
+
+
+static double bench_seconds(void)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static double bench_median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	const size_t mid = values.size() / 2;
+	return (values.size() % 2 == 1) ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+
+// Bytes currently allocated with malloc (and thus new), or -1 if the C
+// library cannot tell
+static long long bench_heap_bytes(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	const struct mallinfo2 info = mallinfo2();
+	return (long long) (info.uordblks + info.hblkhd);
+#else
+	return -1;
+#endif
+}
+
+
+static long long bench_peak_rss_bytes(void)
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#ifdef __APPLE__
+	return (long long) usage.ru_maxrss;
+#else
+	return (long long) usage.ru_maxrss * 1024;
+#endif
+}
+
+
+// JSON helpers. Numbers that JSON cannot represent (and negative byte
+// counts, which mean unknown) are written as null.
+
+static std::string bench_json_string(const std::string& str)
+{
+	std::string out = "\"";
+	for (const char c : str) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if ((unsigned char) c >= 0x20) {
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+
+static std::string bench_json_number(const double value)
+{
+	if (!std::isfinite(value)) return "null";
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.6g", value);
+	return buffer;
+}
+
+
+static std::string bench_json_integer(const long long value)
+{
+	if (value < 0) return "null";
+	return std::to_string(value);
+}
+
+
+static std::string bench_json_list(const std::vector<std::string>& entries)
+{
+	if (entries.empty()) return "[]";
+	std::string out = "[\n";
+	for (size_t i = 0; i < entries.size(); ++i) {
+		out += "    " + entries[i] + ((i + 1 < entries.size()) ? ",\n" : "\n");
+	}
+	return out + "  ]";
+}
+
+
+// Nanoseconds per distance of `idist_get_pow_dist_points` with `METRIC`
+// known at compile time, as it is in the searches
+template <idist_Metric METRIC>
+static double bench_time_kernel(const std::vector<double>& points,
+                                const int num_dimensions,
+                                const long long num_evaluations)
+{
+	const double* const data = points.data();
+	const size_t d = (size_t) num_dimensions;
+	double sum = 0.0;
+	int i = 0;
+	int j = BENCH_KERNEL_POINTS / 2 + 1;
+
+	const double start = bench_seconds();
+	for (long long e = 0; e < num_evaluations; ++e) {
+		sum += idist_get_pow_dist_points(data + i * d, data + j * d, num_dimensions, METRIC, BENCH_MINKOWSKI_P);
+		if (++i == BENCH_KERNEL_POINTS) i = 0;
+		if (++j == BENCH_KERNEL_POINTS) j = 0;
+	}
+	const double elapsed = bench_seconds() - start;
+
+	bench_sink = bench_sink + sum;
+	return elapsed * 1e9 / (double) num_evaluations;
+}
+
+
+static double bench_time_hamming_kernel(const std::vector<unsigned char>& bits,
+                                        const size_t num_words,
+                                        const long long num_evaluations)
+{
+	long long sum = 0;
+	int i = 0;
+	int j = BENCH_KERNEL_POINTS / 2 + 1;
+
+	const double start = bench_seconds();
+	for (long long e = 0; e < num_evaluations; ++e) {
+		sum += idist_get_hamming_dist(bits.data(), num_words, i, j);
+		if (++i == BENCH_KERNEL_POINTS) i = 0;
+		if (++j == BENCH_KERNEL_POINTS) j = 0;
+	}
+	const double elapsed = bench_seconds() - start;
+
+	bench_sink = bench_sink + (double) sum;
+	return elapsed * 1e9 / (double) num_evaluations;
+}
+
+
+static std::vector<std::string> bench_run_kernels(const bench_Options& options)
+{
+	static const char* const metrics[] = { "euclidean", "manhattan", "maximum", "minkowski", "hamming" };
+
+	std::vector<std::string> entries;
+	for (const int d : options.kernel_dimensions) {
+		const std::vector<double> points = bench_make_data("uniform", BENCH_KERNEL_POINTS, d, options.seed);
+		// Hamming points have `d` bits, packed into 64-bit words
+		const size_t num_words = ((size_t) d + 63) / 64;
+		std::vector<unsigned char> bits(BENCH_KERNEL_POINTS * num_words * 8);
+		for (size_t b = 0; b < bits.size(); ++b) bits[b] = (unsigned char) (points[b % points.size()] * 256.0);
+
+		const long long num_evaluations = std::max(100000LL, (long long) (BENCH_KERNEL_COORDINATES / d));
+		for (const char* const metric : metrics) {
+			fprintf(stderr, "kernel %s, d = %d\n", metric, d);
+			std::vector<double> timings;
+			for (int r = 0; r < options.repeats; ++r) {
+				if (strcmp(metric, "euclidean") == 0) {
+					timings.push_back(bench_time_kernel<IDIST_METRIC_EUCLIDEAN>(points, d, num_evaluations));
+				} else if (strcmp(metric, "manhattan") == 0) {
+					timings.push_back(bench_time_kernel<IDIST_METRIC_MANHATTAN>(points, d, num_evaluations));
+				} else if (strcmp(metric, "maximum") == 0) {
+					timings.push_back(bench_time_kernel<IDIST_METRIC_MAXIMUM>(points, d, num_evaluations));
+				} else if (strcmp(metric, "minkowski") == 0) {
+					timings.push_back(bench_time_kernel<IDIST_METRIC_MINKOWSKI>(points, d, num_evaluations));
+				} else {
+					timings.push_back(bench_time_hamming_kernel(bits, num_words, num_evaluations));
+				}
+			}
+			entries.push_back("{\"metric\": " + bench_json_string(metric) +
+			                  ", \"d\": " + std::to_string(d) +
+			                  ", \"ns_per_distance\": " + bench_json_number(bench_median(timings)) + "}");
+		}
+	}
+	return entries;
+}
+
+
+// A Euclidean `distances` object with the data points and no
+// normalization or weights
+static SEXP bench_make_distances(const std::vector<double>& data,
+                                 const int num_data_points,
+                                 const int num_dimensions)
+{
+	SEXP R_distances = allocMatrix(REALSXP, num_dimensions, num_data_points);
+	std::copy(data.begin(), data.end(), REAL(R_distances));
+	setAttrib(R_distances, R_ClassSymbol, mkString("distances"));
+
+	const char* const identity_names[] = { "normalization", "weights" };
+	for (const char* const name : identity_names) {
+		SEXP R_identity = allocMatrix(REALSXP, num_dimensions, num_dimensions);
+		for (int i = 0; i < num_dimensions; ++i) REAL(R_identity)[i * num_dimensions + i] = 1.0;
+		setAttrib(R_distances, install(name), R_identity);
+	}
+	return R_distances;
+}
+
+
+static idist_NNSearch* bench_init_search(SEXP R_distances,
+                                         const idist_NNSearchOptions& search_options)
+{
+	idist_NNSearch* nn_search_object = NULL;
+	if (!idist_init_nearest_neighbor_search_opt(R_distances, 0, NULL, &search_options, &nn_search_object)) {
+		bench_fail("could not build the search index");
+	}
+	return nn_search_object;
+}
+
+
+static void bench_close_search(idist_NNSearch** const nn_search_object)
+{
+	if (!idist_close_nearest_neighbor_search(nn_search_object)) bench_fail("could not close the search index");
+	rshim_free_alloc();
+}
+
+
+// Runs one query configuration and returns its JSON entry, with the
+// build statistics of the index prefixed in `build_json`
+static std::string bench_run_queries(const bench_Options& options,
+                                     idist_NNSearch* const nn_search_object,
+                                     const std::string& index_name,
+                                     const std::vector<int>& query_indices,
+                                     const int k,
+                                     const double radius,
+                                     const std::string& build_json)
+{
+	const size_t num_queries = query_indices.size();
+	const bool radius_search = (radius > 0.0);
+	std::vector<int> nn_indices(num_queries * (size_t) k);
+	size_t num_ok_queries = 0;
+
+	std::vector<double> timings;
+	for (int r = 0; r < options.repeats; ++r) {
+		const double start = bench_seconds();
+		if (!idist_nearest_neighbor_search_na(nn_search_object, num_queries, query_indices.data(),
+		                                      (uint32_t) k, radius_search, radius,
+		                                      &num_ok_queries, nn_indices.data())) {
+			bench_fail("nearest neighbor search failed");
+		}
+		timings.push_back(bench_seconds() - start);
+	}
+	const double query_seconds = bench_median(timings);
+
+	double points_visited = NAN;
+	double nodes_visited = NAN;
+#ifdef ANN_PERF
+	// HNSW graphs compute their distances outside of ANN's counters
+	if (index_name != "hnsw") {
+		const size_t num_counted = std::min(num_queries, (size_t) BENCH_MAX_COUNTED_QUERIES);
+		long long sum_points = 0;
+		long long sum_nodes = 0;
+		size_t num_chunk_ok;
+		for (size_t first = 0; first < num_counted; first += BENCH_COUNT_CHUNK) {
+			const size_t len_chunk = std::min(num_counted - first, (size_t) BENCH_COUNT_CHUNK);
+			annResetCounts();
+			if (!idist_nearest_neighbor_search_na(nn_search_object, len_chunk, query_indices.data() + first,
+			                                      (uint32_t) k, radius_search, radius,
+			                                      &num_chunk_ok, nn_indices.data())) {
+				bench_fail("nearest neighbor search failed");
+			}
+			sum_points += ann_Nvisit_pts;
+			sum_nodes += ann_Nvisit_lfs + ann_Nvisit_spl;
+		}
+		points_visited = (double) sum_points / (double) num_counted;
+		nodes_visited = (double) sum_nodes / (double) num_counted;
+	}
+#endif
+
+	return "{" + build_json +
+		", \"k\": " + std::to_string(k) +
+		", \"radius\": " + (radius_search ? bench_json_number(radius) : std::string("null")) +
+		", \"queries\": " + std::to_string(num_queries) +
+		", \"query_seconds\": " + bench_json_number(query_seconds) +
+		", \"queries_per_second\": " + bench_json_number((double) num_queries / query_seconds) +
+		", \"failed_queries\": " + std::to_string(num_queries - num_ok_queries) +
+		", \"points_visited_per_query\": " + bench_json_number(points_visited) +
+		", \"nodes_visited_per_query\": " + bench_json_number(nodes_visited) + "}";
+}
+
+
+static std::vector<std::string> bench_run_searches(const bench_Options& options)
+{
+	std::vector<std::string> entries;
+	for (const std::string& kind : options.data_kinds) {
+		for (const int n : options.num_data_points) {
+			for (const int d : options.num_dimensions) {
+				SEXP R_distances = bench_make_distances(bench_make_data(kind, n, d, options.seed), n, d);
+
+				std::mt19937_64 rng(options.seed + 1);
+				std::uniform_int_distribution<int> pick_point(0, n - 1);
+				std::vector<int> query_indices((size_t) options.num_queries);
+				for (int& query : query_indices) query = pick_point(rng);
+
+				for (const std::string& index_name : options.indices) {
+					fprintf(stderr, "search %s, n = %d, d = %d, %s\n", kind.c_str(), n, d, index_name.c_str());
+					idist_NNSearchOptions search_options = idist_nn_search_default_options();
+					bench_parse_index(index_name, &search_options.index);
+					search_options.exclude_self = options.exclude_self;
+
+					// The last index that is built is kept for the queries
+					std::vector<double> timings;
+					long long index_bytes = -1;
+					idist_NNSearch* nn_search_object = NULL;
+					for (int r = 0; r < options.repeats; ++r) {
+						if (nn_search_object != NULL) bench_close_search(&nn_search_object);
+						const long long heap_before = bench_heap_bytes();
+						const double start = bench_seconds();
+						nn_search_object = bench_init_search(R_distances, search_options);
+						timings.push_back(bench_seconds() - start);
+						if (heap_before >= 0) index_bytes = bench_heap_bytes() - heap_before;
+					}
+
+					const std::string build_json =
+						"\"data\": " + bench_json_string(kind) +
+						", \"n\": " + std::to_string(n) +
+						", \"d\": " + std::to_string(d) +
+						", \"index\": " + bench_json_string(index_name) +
+						", \"build_seconds\": " + bench_json_number(bench_median(timings)) +
+						", \"index_bytes\": " + bench_json_integer(index_bytes);
+
+					for (const int k : options.k) {
+						if (k > n) continue;
+						for (const double radius : options.radius) {
+							entries.push_back(bench_run_queries(options, nn_search_object, index_name,
+							                                    query_indices, k, radius, build_json));
+						}
+					}
+					bench_close_search(&nn_search_object);
+				}
+				rshim_free(R_distances);
+			}
+		}
+	}
+	return entries;
+}
+
+
+int main(int argc, char** argv)
+{
+	const bench_Options options = bench_parse_options(argc, argv);
+
+	const std::vector<std::string> kernels = options.run_kernels ? bench_run_kernels(options) : std::vector<std::string>();
+	const std::vector<std::string> searches = options.run_searches ? bench_run_searches(options) : std::vector<std::string>();
+
+#ifdef _OPENMP
+	const int num_threads = omp_get_max_threads();
+#else
+	const int num_threads = 1;
+#endif
+#ifdef ANN_PERF
+	const bool ann_perf = true;
+#else
+	const bool ann_perf = false;
+#endif
+#ifdef __VERSION__
+	const std::string compiler = __VERSION__;
+#else
+	const std::string compiler = "";
+#endif
+
+	const std::string json = "{\n"
+		"  \"benchmark\": \"distances\",\n"
+		"  \"revision\": " + bench_json_string(BENCH_REVISION) + ",\n"
+		"  \"compiler\": " + bench_json_string(compiler) + ",\n"
+		"  \"ann_perf\": " + (ann_perf ? "true" : "false") + ",\n"
+		"  \"threads\": " + std::to_string(num_threads) + ",\n"
+		"  \"seed\": " + std::to_string(options.seed) + ",\n"
+		"  \"repeats\": " + std::to_string(options.repeats) + ",\n"
+		"  \"exclude_self\": " + (options.exclude_self ? "true" : "false") + ",\n"
+		"  \"kernels\": " + bench_json_list(kernels) + ",\n"
+		"  \"searches\": " + bench_json_list(searches) + ",\n"
+		"  \"peak_rss_bytes\": " + bench_json_integer(bench_peak_rss_bytes()) + "\n"
+		"}\n";
+
+	FILE* const out = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+	if (out == NULL) bench_fail("cannot open `" + options.output + "`");
+	fputs(json.c_str(), out);
+	if (out != stdout) fclose(out);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+// Checks searches on sets changed by `idist_nearest_neighbor_search_remove`
+// and `idist_nearest_neighbor_search_insert` against a brute force search.
+// Removes and inserts are interleaved in batches of varying size, so that
+// points are deleted from the trees (kd_delete.cpp), blocks are merged on
+// insert and half-live blocks are rebuilt. The data are on an integer grid
+// with repeated points, so many points lie on the cutting planes of the
+// trees and many distances are tied. Exits with a non-zero status on the
+// first mismatch.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+extern "C" {
+	#include "internal.h"
+}
+#include "nn_search.h"
+
+// Rounds of removes and inserts per configuration; the set is searched
+// after each round
+static const int CHECK_ROUNDS = 120;
+static const int CHECK_QUERIES = 200;
+
+
+struct check_Data {
+	std::vector<double> points;
+	int num_data_points;
+	int num_dimensions;
+};
+
+
+static void check_fail(const std::string& msg)
+{
+	fprintf(stderr, "check_dynamic: %s\n", msg.c_str());
+	exit(EXIT_FAILURE);
+}
+
+
+// Points on the grid {0, ..., side - 1}^d, each repeated `copies` times,
+// in random order
+static check_Data check_make_grid(const int side,
+                                  const int num_dimensions,
+                                  const int copies,
+                                  std::mt19937_64& rng)
+{
+	int num_positions = 1;
+	for (int t = 0; t < num_dimensions; ++t) num_positions *= side;
+
+	std::vector<int> positions;
+	for (int p = 0; p < num_positions; ++p) {
+		for (int c = 0; c < copies; ++c) positions.push_back(p);
+	}
+	std::shuffle(positions.begin(), positions.end(), rng);
+
+	check_Data data;
+	data.num_data_points = (int) positions.size();
+	data.num_dimensions = num_dimensions;
+	for (int p : positions) {
+		for (int t = 0; t < num_dimensions; ++t, p /= side) data.points.push_back((double) (p % side));
+	}
+	return data;
+}
+
+
+// A Euclidean `distances` object with the data points and no
+// normalization or weights
+static SEXP check_make_distances(const check_Data& data)
+{
+	SEXP R_distances = allocMatrix(REALSXP, data.num_dimensions, data.num_data_points);
+	std::copy(data.points.begin(), data.points.end(), REAL(R_distances));
+	setAttrib(R_distances, R_ClassSymbol, mkString("distances"));
+
+	const char* const identity_names[] = { "normalization", "weights" };
+	for (const char* const name : identity_names) {
+		SEXP R_identity = allocMatrix(REALSXP, data.num_dimensions, data.num_dimensions);
+		for (int i = 0; i < data.num_dimensions; ++i) REAL(R_identity)[i * data.num_dimensions + i] = 1.0;
+		setAttrib(R_distances, install(name), R_identity);
+	}
+	return R_distances;
+}
+
+
+static double check_dist2(const check_Data& data,
+                          const int a,
+                          const int b)
+{
+	double dist2 = 0.0;
+	for (int t = 0; t < data.num_dimensions; ++t) {
+		const double diff = data.points[a * data.num_dimensions + t] - data.points[b * data.num_dimensions + t];
+		dist2 += diff * diff;
+	}
+	return dist2;
+}
+
+
+// Compares the neighbors of each query with the live points. Ties make the
+// indices ambiguous, so the sorted distances are compared, and the indices
+// must be distinct live points.
+static void check_queries(const check_Data& data,
+                          idist_NNSearch* const nn_search_object,
+                          const std::vector<char>& live,
+                          const std::vector<int>& query_indices,
+                          const uint32_t k,
+                          const bool radius_search,
+                          const double radius,
+                          const bool exclude_self,
+                          const std::string& label)
+{
+	// Searches without a radius require k live points besides the query
+	if (!radius_search &&
+	    std::count(live.begin(), live.end(), 1) < (long) k + (exclude_self ? 1 : 0)) return;
+
+	const size_t num_queries = query_indices.size();
+	std::vector<int> nn_indices(num_queries * k);
+	size_t num_ok_queries;
+	if (!idist_nearest_neighbor_search_na(nn_search_object, num_queries, query_indices.data(), k,
+	                                      radius_search, radius, &num_ok_queries, nn_indices.data())) {
+		check_fail(label + ": search failed");
+	}
+
+	size_t expected_ok_queries = 0;
+	std::vector<double> expected;
+	std::vector<double> found;
+	for (size_t q = 0; q < num_queries; ++q) {
+		const int query = query_indices[q];
+		expected.clear();
+		for (int j = 0; j < data.num_data_points; ++j) {
+			if (!live[j] || (exclude_self && j == query)) continue;
+			const double dist2 = check_dist2(data, query, j);
+			if (!radius_search || dist2 <= radius * radius) expected.push_back(dist2);
+		}
+		std::sort(expected.begin(), expected.end());
+
+		const int* const nn = &nn_indices[q * k];
+		if (expected.size() < k) {
+			for (uint32_t i = 0; i < k; ++i) {
+				if (nn[i] != NA_INTEGER) check_fail(label + ": neighbors of query " + std::to_string(query) + " should be NA");
+			}
+			continue;
+		}
+		++expected_ok_queries;
+
+		found.clear();
+		for (uint32_t i = 0; i < k; ++i) {
+			if (nn[i] < 0 || nn[i] >= data.num_data_points || !live[nn[i]]) {
+				check_fail(label + ": query " + std::to_string(query) + " found a point not in the set");
+			}
+			if (exclude_self && nn[i] == query) check_fail(label + ": query " + std::to_string(query) + " found itself");
+			for (uint32_t j = 0; j < i; ++j) {
+				if (nn[j] == nn[i]) check_fail(label + ": query " + std::to_string(query) + " found a point twice");
+			}
+			found.push_back(check_dist2(data, query, nn[i]));
+		}
+		std::sort(found.begin(), found.end());
+		if (!std::equal(found.begin(), found.end(), expected.begin())) {
+			check_fail(label + ": wrong neighbors of query " + std::to_string(query));
+		}
+	}
+	if (num_ok_queries != expected_ok_queries) check_fail(label + ": wrong number of found queries");
+}
+
+
+static void check_configuration(const check_Data& data,
+                                const idist_NNIndex index,
+                                const bool exclude_self,
+                                std::mt19937_64& rng,
+                                const std::string& label)
+{
+	SEXP R_distances = check_make_distances(data);
+	const int n = data.num_data_points;
+
+	// Start from a random half of the points
+	std::vector<int> search_indices;
+	std::vector<char> live(n, 0);
+	for (int i = 0; i < n; ++i) {
+		if (rng() % 2 == 0) {
+			search_indices.push_back(i);
+			live[i] = 1;
+		}
+	}
+
+	idist_NNSearchOptions options = idist_nn_search_default_options();
+	options.index = index;
+	options.exclude_self = exclude_self;
+	idist_NNSearch* nn_search_object = NULL;
+	if (!idist_init_nearest_neighbor_search_opt(R_distances, search_indices.size(), search_indices.data(),
+	                                            &options, &nn_search_object)) {
+		check_fail(label + ": could not build the search index");
+	}
+
+	std::vector<int> batch;
+	std::vector<int> query_indices(CHECK_QUERIES);
+	for (int round = 0; round < CHECK_ROUNDS; ++round) {
+		const std::string round_label = label + " round " + std::to_string(round);
+
+		// Mostly small batches, with occasional large ones that leave
+		// blocks less than half live or merge many blocks
+		const int max_batch = (rng() % 8 == 0) ? n / 2 : 16;
+
+		batch.clear();
+		const int num_remove = (int) (rng() % (max_batch + 1));
+		for (int i = 0; i < n && (int) batch.size() < num_remove; ++i) {
+			const int point = (int) (rng() % n);
+			if (live[point] && std::find(batch.begin(), batch.end(), point) == batch.end()) batch.push_back(point);
+		}
+		if (!idist_nearest_neighbor_search_remove(nn_search_object, batch.size(), batch.data())) {
+			check_fail(round_label + ": remove failed");
+		}
+		for (int point : batch) live[point] = 0;
+
+		// Removing a point twice is rejected and leaves the set unchanged
+		if (!batch.empty()) {
+			const int again[] = { batch[0] };
+			if (idist_nearest_neighbor_search_remove(nn_search_object, 1, again)) {
+				check_fail(round_label + ": removed a point not in the set");
+			}
+		}
+
+		batch.clear();
+		const int num_insert = (int) (rng() % (max_batch + 1));
+		for (int i = 0; i < n && (int) batch.size() < num_insert; ++i) {
+			const int point = (int) (rng() % n);
+			if (!live[point] && std::find(batch.begin(), batch.end(), point) == batch.end()) batch.push_back(point);
+		}
+		if (!idist_nearest_neighbor_search_insert(nn_search_object, batch.size(), batch.data())) {
+			check_fail(round_label + ": insert failed");
+		}
+		for (int point : batch) live[point] = 1;
+
+		// Inserting a point already in the set is rejected
+		if (!batch.empty()) {
+			const int again[] = { batch[0] };
+			if (idist_nearest_neighbor_search_insert(nn_search_object, 1, again)) {
+				check_fail(round_label + ": inserted a point already in the set");
+			}
+		}
+
+		for (int& query : query_indices) query = (int) (rng() % n);
+		check_queries(data, nn_search_object, live, query_indices, 1, false, 0.0, exclude_self, round_label + " k = 1");
+		check_queries(data, nn_search_object, live, query_indices, 7, false, 0.0, exclude_self, round_label + " k = 7");
+		check_queries(data, nn_search_object, live, query_indices, 4, true, 1.5, exclude_self, round_label + " radius");
+	}
+
+	// Emptying the set and filling it again
+	batch.clear();
+	for (int i = 0; i < n; ++i) {
+		if (live[i]) batch.push_back(i);
+	}
+	if (!idist_nearest_neighbor_search_remove(nn_search_object, batch.size(), batch.data())) {
+		check_fail(label + ": removing all points failed");
+	}
+	std::fill(live.begin(), live.end(), 0);
+	for (int& query : query_indices) query = (int) (rng() % n);
+	check_queries(data, nn_search_object, live, query_indices, 1, true, 1.5, exclude_self, label + " empty");
+	for (int point : batch) {
+		if (!idist_nearest_neighbor_search_insert(nn_search_object, 1, &point)) {
+			check_fail(label + ": inserting one point failed");
+		}
+		live[point] = 1;
+	}
+	check_queries(data, nn_search_object, live, query_indices, 7, false, 0.0, exclude_self, label + " refilled");
+
+	if (!idist_close_nearest_neighbor_search(&nn_search_object)) check_fail(label + ": could not close the search index");
+	rshim_free_alloc();
+}
+
+
+int main()
+{
+	std::mt19937_64 rng(123456789);
+
+	struct {
+		int side;
+		int num_dimensions;
+		int copies;
+	} grids[] = { { 24, 2, 3 }, { 8, 3, 2 }, { 4, 5, 1 } };
+
+	const struct {
+		idist_NNIndex index;
+		const char* name;
+	} indices[] = { { IDIST_NN_INDEX_KD_TREE, "kd_tree" }, { IDIST_NN_INDEX_BALL_TREE, "ball_tree" } };
+
+	int num_configurations = 0;
+	for (const auto& grid : grids) {
+		const check_Data data = check_make_grid(grid.side, grid.num_dimensions, grid.copies, rng);
+		for (const auto& index : indices) {
+			for (int exclude_self = 0; exclude_self < 2; ++exclude_self) {
+				const std::string label = std::string(index.name) +
+					" n = " + std::to_string(data.num_data_points) +
+					" d = " + std::to_string(data.num_dimensions) +
+					(exclude_self ? " exclude_self" : "");
+				check_configuration(data, index.index, exclude_self, rng, label);
+				++num_configurations;
+			}
+		}
+	}
+
+	printf("check_dynamic: %d configurations passed\n", num_configurations);
+	return EXIT_SUCCESS;
+}
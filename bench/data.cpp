@@ -0,0 +1,138 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#include "data.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+static const int BENCH_NUM_CLUSTERS = 20;
+static const double BENCH_CLUSTER_SD = 0.02;
+static const int BENCH_LOWDIM_DIMENSIONS = 3;
+static const double BENCH_LOWDIM_NOISE_SD = 0.001;
+static const int BENCH_COPIES_PER_POINT = 20;
+
+
+static void bench_fill_uniform(std::mt19937_64& rng,
+                               const size_t len,
+                               double* const out)
+{
+	std::uniform_real_distribution<double> unif(0.0, 1.0);
+	for (size_t i = 0; i < len; ++i) out[i] = unif(rng);
+}
+
+
+static std::vector<double> bench_make_clustered(std::mt19937_64& rng,
+                                                const int num_data_points,
+                                                const int num_dimensions)
+{
+	const size_t d = (size_t) num_dimensions;
+	std::vector<double> centers(BENCH_NUM_CLUSTERS * d);
+	bench_fill_uniform(rng, centers.size(), centers.data());
+
+	std::uniform_int_distribution<int> pick_cluster(0, BENCH_NUM_CLUSTERS - 1);
+	std::normal_distribution<double> noise(0.0, BENCH_CLUSTER_SD);
+	std::vector<double> data((size_t) num_data_points * d);
+	for (size_t i = 0; i < (size_t) num_data_points; ++i) {
+		const double* const center = &centers[(size_t) pick_cluster(rng) * d];
+		for (size_t j = 0; j < d; ++j) data[i * d + j] = center[j] + noise(rng);
+	}
+	return data;
+}
+
+
+static std::vector<double> bench_make_lowdim(std::mt19937_64& rng,
+                                             const int num_data_points,
+                                             const int num_dimensions)
+{
+	const size_t d = (size_t) num_dimensions;
+	const size_t m = (size_t) std::min(num_dimensions, BENCH_LOWDIM_DIMENSIONS);
+
+	// Random embedding with unit-length columns
+	std::normal_distribution<double> gauss(0.0, 1.0);
+	std::vector<double> embedding(d * m);
+	for (size_t c = 0; c < m; ++c) {
+		double sq_norm = 0.0;
+		for (size_t j = 0; j < d; ++j) {
+			embedding[c * d + j] = gauss(rng);
+			sq_norm += embedding[c * d + j] * embedding[c * d + j];
+		}
+		for (size_t j = 0; j < d; ++j) embedding[c * d + j] /= std::sqrt(sq_norm);
+	}
+
+	std::normal_distribution<double> noise(0.0, BENCH_LOWDIM_NOISE_SD);
+	std::vector<double> latent(m);
+	std::vector<double> data((size_t) num_data_points * d);
+	for (size_t i = 0; i < (size_t) num_data_points; ++i) {
+		bench_fill_uniform(rng, m, latent.data());
+		for (size_t j = 0; j < d; ++j) {
+			double value = noise(rng);
+			for (size_t c = 0; c < m; ++c) value += embedding[c * d + j] * latent[c];
+			data[i * d + j] = value;
+		}
+	}
+	return data;
+}
+
+
+static std::vector<double> bench_make_duplicates(std::mt19937_64& rng,
+                                                 const int num_data_points,
+                                                 const int num_dimensions)
+{
+	const size_t d = (size_t) num_dimensions;
+	const int num_distinct = std::max(1, num_data_points / BENCH_COPIES_PER_POINT);
+	std::vector<double> distinct((size_t) num_distinct * d);
+	bench_fill_uniform(rng, distinct.size(), distinct.data());
+
+	std::uniform_int_distribution<int> pick_point(0, num_distinct - 1);
+	std::vector<double> data((size_t) num_data_points * d);
+	for (size_t i = 0; i < (size_t) num_data_points; ++i) {
+		const double* const point = &distinct[(size_t) pick_point(rng) * d];
+		std::copy(point, point + d, &data[i * d]);
+	}
+	return data;
+}
+
+
+bool bench_is_data_kind(const std::string& kind)
+{
+	return kind == "uniform" || kind == "clustered" ||
+		kind == "lowdim" || kind == "duplicates";
+}
+
+
+std::vector<double> bench_make_data(const std::string& kind,
+                                    const int num_data_points,
+                                    const int num_dimensions,
+                                    const uint64_t seed)
+{
+	std::mt19937_64 rng(seed);
+	if (kind == "clustered") return bench_make_clustered(rng, num_data_points, num_dimensions);
+	if (kind == "lowdim") return bench_make_lowdim(rng, num_data_points, num_dimensions);
+	if (kind == "duplicates") return bench_make_duplicates(rng, num_data_points, num_dimensions);
+
+	std::vector<double> data((size_t) num_data_points * (size_t) num_dimensions);
+	bench_fill_uniform(rng, data.size(), data.data());
+	return data;
+}
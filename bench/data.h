@@ -0,0 +1,48 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_BENCH_DATA_HG
+#define DIST_BENCH_DATA_HG
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Synthetic data sets. Points are stored one after the other (as in the
+// data matrix of a `distances` object), with `num_dimensions` coordinates
+// each. The kinds are:
+//
+//   uniform     Uniform in the unit cube.
+//   clustered   Gaussian clusters (sd 0.02) around 20 uniform centers.
+//   lowdim      Uniform points in a 3-dimensional unit cube, embedded by a
+//               random linear map and with Gaussian noise (sd 0.001).
+//   duplicates  About 20 exact copies of each of n / 20 uniform points.
+//
+// The same kind, size and seed always give the same points with the same
+// standard library.
+bool bench_is_data_kind(const std::string& kind);
+
+std::vector<double> bench_make_data(const std::string& kind,
+                                    int num_data_points,
+                                    int num_dimensions,
+                                    uint64_t seed);
+
+#endif // ifndef DIST_BENCH_DATA_HG
@@ -0,0 +1,44 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+// The parts of R's API that the search code in `../src` uses, for
+// building the benchmarks without R (see `rshim.c`)
+
+#ifndef DIST_RSHIM_R_HG
+#define DIST_RSHIM_R_HG
+
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <R_ext/Error.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void* R_alloc(size_t n, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_RSHIM_R_HG
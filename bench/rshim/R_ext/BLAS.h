@@ -0,0 +1,47 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_RSHIM_BLAS_HG
+#define DIST_RSHIM_BLAS_HG
+
+#include <R_ext/RS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void F77_NAME(dgemm)(const char* transa, const char* transb,
+                     const int* m, const int* n, const int* k,
+                     const double* alpha, const double* a, const int* lda,
+                     const double* b, const int* ldb,
+                     const double* beta, double* c, const int* ldc
+                     FCLEN FCLEN);
+
+void F77_NAME(dsyrk)(const char* uplo, const char* trans,
+                     const int* n, const int* k,
+                     const double* alpha, const double* a, const int* lda,
+                     const double* beta, double* c, const int* ldc
+                     FCLEN FCLEN);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_RSHIM_BLAS_HG
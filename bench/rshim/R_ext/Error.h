@@ -0,0 +1,44 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_RSHIM_ERROR_HG
+#define DIST_RSHIM_ERROR_HG
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Prints the message and exits, as there is no R session to return to
+void Rf_error(const char* format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+	__attribute__((noreturn, format(printf, 1, 2)))
+#endif
+	;
+
+void Rf_warning(const char* format, ...);
+
+#define error Rf_error
+#define warning Rf_warning
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_RSHIM_ERROR_HG
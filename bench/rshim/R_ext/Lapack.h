@@ -0,0 +1,39 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_RSHIM_LAPACK_HG
+#define DIST_RSHIM_LAPACK_HG
+
+#include <R_ext/RS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void F77_NAME(dsyev)(const char* jobz, const char* uplo,
+                     const int* n, double* a, const int* lda, double* w,
+                     double* work, const int* lwork, int* info
+                     FCLEN FCLEN);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_RSHIM_LAPACK_HG
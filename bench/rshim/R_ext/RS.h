@@ -0,0 +1,38 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_RSHIM_RS_HG
+#define DIST_RSHIM_RS_HG
+
+#include <stddef.h>
+
+// Fortran routines are called with a trailing underscore and, with
+// USE_FC_LEN_T, the lengths of character arguments passed last
+#define F77_NAME(x) x ## _
+#define F77_CALL(x) x ## _
+
+#ifdef USE_FC_LEN_T
+	#define FCLEN , size_t
+	#define FCONE , (size_t) 1
+#else
+	#define FCLEN
+#endif
+
+#endif // ifndef DIST_RSHIM_RS_HG
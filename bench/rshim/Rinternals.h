@@ -0,0 +1,126 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_RSHIM_RINTERNALS_HG
+#define DIST_RSHIM_RINTERNALS_HG
+
+#include <stddef.h>
+#include <R.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct SEXPREC* SEXP;
+typedef ptrdiff_t R_xlen_t;
+typedef unsigned int SEXPTYPE;
+typedef unsigned char Rbyte;
+typedef enum { FALSE = 0, TRUE } Rboolean;
+
+#define NILSXP  0
+#define SYMSXP  1
+#define CHARSXP 9
+#define LGLSXP  10
+#define INTSXP  13
+#define REALSXP 14
+#define STRSXP  16
+#define VECSXP  19
+#define RAWSXP  24
+
+extern SEXP R_NilValue;
+extern SEXP R_DimSymbol;
+extern SEXP R_ClassSymbol;
+extern int R_NaInt;
+extern double R_PosInf;
+extern double R_NegInf;
+
+#define NA_INTEGER R_NaInt
+
+SEXP Rf_install(const char* name);
+SEXP Rf_getAttrib(SEXP x, SEXP name);
+SEXP Rf_setAttrib(SEXP x, SEXP name, SEXP value);
+
+SEXP Rf_allocVector(SEXPTYPE type, R_xlen_t length);
+SEXP Rf_allocMatrix(SEXPTYPE type, int nrow, int ncol);
+SEXP Rf_ScalarInteger(int value);
+SEXP Rf_ScalarLogical(int value);
+SEXP Rf_ScalarReal(double value);
+SEXP Rf_mkChar(const char* str);
+SEXP Rf_mkString(const char* str);
+
+int TYPEOF(SEXP x);
+R_xlen_t Rf_xlength(SEXP x);
+int* INTEGER(SEXP x);
+int* LOGICAL(SEXP x);
+double* REAL(SEXP x);
+Rbyte* RAW(SEXP x);
+SEXP STRING_ELT(SEXP x, R_xlen_t i);
+void SET_STRING_ELT(SEXP x, R_xlen_t i, SEXP value);
+SEXP VECTOR_ELT(SEXP x, R_xlen_t i);
+SEXP SET_VECTOR_ELT(SEXP x, R_xlen_t i, SEXP value);
+const char* R_CHAR(SEXP x);
+
+SEXP Rf_asChar(SEXP x);
+int Rf_asInteger(SEXP x);
+Rboolean Rf_isInteger(SEXP x);
+Rboolean Rf_isMatrix(SEXP x);
+Rboolean Rf_isNull(SEXP x);
+Rboolean Rf_isReal(SEXP x);
+Rboolean Rf_isString(SEXP x);
+
+// Objects are never collected, so protection does nothing
+SEXP Rf_protect(SEXP x);
+void Rf_unprotect(int n);
+
+#define CHAR(x) R_CHAR(x)
+#define PROTECT(x) Rf_protect(x)
+#define UNPROTECT(n) Rf_unprotect(n)
+
+#define allocMatrix Rf_allocMatrix
+#define allocVector Rf_allocVector
+#define asChar Rf_asChar
+#define asInteger Rf_asInteger
+#define getAttrib Rf_getAttrib
+#define install Rf_install
+#define isInteger Rf_isInteger
+#define isMatrix Rf_isMatrix
+#define isNull Rf_isNull
+#define isReal Rf_isReal
+#define isString Rf_isString
+#define mkChar Rf_mkChar
+#define mkString Rf_mkString
+#define ScalarInteger Rf_ScalarInteger
+#define ScalarLogical Rf_ScalarLogical
+#define ScalarReal Rf_ScalarReal
+#define setAttrib Rf_setAttrib
+#define xlength Rf_xlength
+
+// Not part of R: frees `x` together with its elements and attributes
+void rshim_free(SEXP x);
+
+// Not part of R: frees all memory from `R_alloc`, which R does when a
+// `.Call` returns
+void rshim_free_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_RSHIM_RINTERNALS_HG
@@ -0,0 +1,350 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+// A minimal stand-in for the R objects and functions that the search
+// code uses. Vectors are plain heap blocks with a linked list of
+// attributes. Nothing is garbage collected: the benchmarks free the
+// objects they make with `rshim_free` and the memory from `R_alloc` with
+// `rshim_free_alloc`.
+
+#include <R.h>
+#include <Rinternals.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RSHIM_MAX_SYMBOLS 64
+
+typedef struct rshim_Attribute {
+	SEXP name;
+	SEXP value;
+	struct rshim_Attribute* next;
+} rshim_Attribute;
+
+struct SEXPREC {
+	SEXPTYPE type;
+	R_xlen_t length;
+	void* data;
+	char* str;
+	rshim_Attribute* attributes;
+};
+
+typedef struct rshim_Alloc {
+	struct rshim_Alloc* next;
+} rshim_Alloc;
+
+static struct SEXPREC rshim_nil = { NILSXP, 0, NULL, NULL, NULL };
+static struct SEXPREC rshim_dim = { SYMSXP, 0, NULL, "dim", NULL };
+static struct SEXPREC rshim_class = { SYMSXP, 0, NULL, "class", NULL };
+
+static SEXP rshim_symbols[RSHIM_MAX_SYMBOLS] = { &rshim_dim, &rshim_class };
+static int rshim_num_symbols = 2;
+static rshim_Alloc* rshim_allocs = NULL;
+
+SEXP R_NilValue = &rshim_nil;
+SEXP R_DimSymbol = &rshim_dim;
+SEXP R_ClassSymbol = &rshim_class;
+int R_NaInt = INT_MIN;
+double R_PosInf = HUGE_VAL;
+double R_NegInf = -HUGE_VAL;
+
+
+static void* rshim_calloc(const size_t n,
+                          const size_t size)
+{
+	void* const ptr = calloc((n > 0) ? n : 1, size);
+	if (ptr == NULL) Rf_error("Out of memory.");
+	return ptr;
+}
+
+
+static size_t rshim_element_size(const SEXPTYPE type)
+{
+	switch (type) {
+	case LGLSXP:
+	case INTSXP:
+		return sizeof(int);
+	case REALSXP:
+		return sizeof(double);
+	case STRSXP:
+	case VECSXP:
+		return sizeof(SEXP);
+	case RAWSXP:
+		return sizeof(Rbyte);
+	default:
+		Rf_error("Unsupported vector type %u.", type);
+	}
+}
+
+
+void Rf_error(const char* const format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fputs("Error: ", stderr);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+	exit(EXIT_FAILURE);
+}
+
+
+void Rf_warning(const char* const format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fputs("Warning: ", stderr);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+}
+
+
+void* R_alloc(const size_t n,
+              const int size)
+{
+	rshim_Alloc* const block = rshim_calloc(1, sizeof(rshim_Alloc) + n * (size_t) size);
+	block->next = rshim_allocs;
+	rshim_allocs = block;
+	return block + 1;
+}
+
+
+void rshim_free_alloc(void)
+{
+	while (rshim_allocs != NULL) {
+		rshim_Alloc* const next = rshim_allocs->next;
+		free(rshim_allocs);
+		rshim_allocs = next;
+	}
+}
+
+
+SEXP Rf_install(const char* const name)
+{
+	for (int s = 0; s < rshim_num_symbols; ++s) {
+		if (strcmp(rshim_symbols[s]->str, name) == 0) return rshim_symbols[s];
+	}
+	if (rshim_num_symbols == RSHIM_MAX_SYMBOLS) Rf_error("Too many symbols.");
+	SEXP symbol = rshim_calloc(1, sizeof(struct SEXPREC));
+	symbol->type = SYMSXP;
+	symbol->str = rshim_calloc(strlen(name) + 1, 1);
+	strcpy(symbol->str, name);
+	rshim_symbols[rshim_num_symbols++] = symbol;
+	return symbol;
+}
+
+
+SEXP Rf_getAttrib(const SEXP x,
+                  const SEXP name)
+{
+	for (const rshim_Attribute* attr = x->attributes; attr != NULL; attr = attr->next) {
+		if (attr->name == name) return attr->value;
+	}
+	return R_NilValue;
+}
+
+
+SEXP Rf_setAttrib(const SEXP x,
+                  const SEXP name,
+                  const SEXP value)
+{
+	for (rshim_Attribute* attr = x->attributes; attr != NULL; attr = attr->next) {
+		if (attr->name == name) {
+			rshim_free(attr->value);
+			attr->value = value;
+			return value;
+		}
+	}
+	rshim_Attribute* const attr = rshim_calloc(1, sizeof(rshim_Attribute));
+	attr->name = name;
+	attr->value = value;
+	attr->next = x->attributes;
+	x->attributes = attr;
+	return value;
+}
+
+
+SEXP Rf_allocVector(const SEXPTYPE type,
+                    const R_xlen_t length)
+{
+	SEXP x = rshim_calloc(1, sizeof(struct SEXPREC));
+	x->type = type;
+	x->length = length;
+	x->data = rshim_calloc((size_t) length, rshim_element_size(type));
+	if (type == STRSXP || type == VECSXP) {
+		for (R_xlen_t i = 0; i < length; ++i) ((SEXP*) x->data)[i] = R_NilValue;
+	}
+	return x;
+}
+
+
+SEXP Rf_allocMatrix(const SEXPTYPE type,
+                    const int nrow,
+                    const int ncol)
+{
+	SEXP x = Rf_allocVector(type, (R_xlen_t) nrow * (R_xlen_t) ncol);
+	SEXP dim = Rf_allocVector(INTSXP, 2);
+	INTEGER(dim)[0] = nrow;
+	INTEGER(dim)[1] = ncol;
+	Rf_setAttrib(x, R_DimSymbol, dim);
+	return x;
+}
+
+
+SEXP Rf_ScalarInteger(const int value)
+{
+	SEXP x = Rf_allocVector(INTSXP, 1);
+	INTEGER(x)[0] = value;
+	return x;
+}
+
+
+SEXP Rf_ScalarLogical(const int value)
+{
+	SEXP x = Rf_allocVector(LGLSXP, 1);
+	LOGICAL(x)[0] = value;
+	return x;
+}
+
+
+SEXP Rf_ScalarReal(const double value)
+{
+	SEXP x = Rf_allocVector(REALSXP, 1);
+	REAL(x)[0] = value;
+	return x;
+}
+
+
+SEXP Rf_mkChar(const char* const str)
+{
+	SEXP x = rshim_calloc(1, sizeof(struct SEXPREC));
+	x->type = CHARSXP;
+	x->length = (R_xlen_t) strlen(str);
+	x->str = rshim_calloc((size_t) x->length + 1, 1);
+	strcpy(x->str, str);
+	return x;
+}
+
+
+SEXP Rf_mkString(const char* const str)
+{
+	SEXP x = Rf_allocVector(STRSXP, 1);
+	SET_STRING_ELT(x, 0, Rf_mkChar(str));
+	return x;
+}
+
+
+void rshim_free(const SEXP x)
+{
+	if (x == R_NilValue || x->type == SYMSXP) return;
+	if (x->type == STRSXP || x->type == VECSXP) {
+		for (R_xlen_t i = 0; i < x->length; ++i) rshim_free(((SEXP*) x->data)[i]);
+	}
+	rshim_Attribute* attr = x->attributes;
+	while (attr != NULL) {
+		rshim_Attribute* const next = attr->next;
+		rshim_free(attr->value);
+		free(attr);
+		attr = next;
+	}
+	free(x->data);
+	free(x->str);
+	free(x);
+}
+
+
+int TYPEOF(const SEXP x) { return (int) x->type; }
+
+R_xlen_t Rf_xlength(const SEXP x) { return x->length; }
+
+int* INTEGER(const SEXP x) { return (int*) x->data; }
+
+int* LOGICAL(const SEXP x) { return (int*) x->data; }
+
+double* REAL(const SEXP x) { return (double*) x->data; }
+
+Rbyte* RAW(const SEXP x) { return (Rbyte*) x->data; }
+
+SEXP STRING_ELT(const SEXP x, const R_xlen_t i) { return ((SEXP*) x->data)[i]; }
+
+SEXP VECTOR_ELT(const SEXP x, const R_xlen_t i) { return ((SEXP*) x->data)[i]; }
+
+const char* R_CHAR(const SEXP x) { return x->str; }
+
+SEXP Rf_protect(const SEXP x) { return x; }
+
+void Rf_unprotect(const int n) { (void) n; }
+
+
+void SET_STRING_ELT(const SEXP x,
+                    const R_xlen_t i,
+                    const SEXP value)
+{
+	((SEXP*) x->data)[i] = value;
+}
+
+
+SEXP SET_VECTOR_ELT(const SEXP x,
+                    const R_xlen_t i,
+                    const SEXP value)
+{
+	((SEXP*) x->data)[i] = value;
+	return value;
+}
+
+
+SEXP Rf_asChar(const SEXP x)
+{
+	if (x->type == STRSXP && x->length > 0) return STRING_ELT(x, 0);
+	return Rf_mkChar("NA");
+}
+
+
+int Rf_asInteger(const SEXP x)
+{
+	if (x->length < 1) return NA_INTEGER;
+	switch (x->type) {
+	case LGLSXP:
+	case INTSXP:
+		return INTEGER(x)[0];
+	case REALSXP:
+		return (int) REAL(x)[0];
+	default:
+		return NA_INTEGER;
+	}
+}
+
+
+Rboolean Rf_isInteger(const SEXP x) { return (x->type == INTSXP) ? TRUE : FALSE; }
+
+Rboolean Rf_isNull(const SEXP x) { return (x->type == NILSXP) ? TRUE : FALSE; }
+
+Rboolean Rf_isReal(const SEXP x) { return (x->type == REALSXP) ? TRUE : FALSE; }
+
+Rboolean Rf_isString(const SEXP x) { return (x->type == STRSXP) ? TRUE : FALSE; }
+
+
+Rboolean Rf_isMatrix(const SEXP x)
+{
+	SEXP dim = Rf_getAttrib(x, R_DimSymbol);
+	return (dim->type == INTSXP && dim->length == 2) ? TRUE : FALSE;
+}
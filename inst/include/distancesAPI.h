@@ -62,6 +62,18 @@ static SEXP dist_get_dist_matrix(SEXP R_distances,
 }
 
 
+static SEXP dist_get_dist_matrix_opt(SEXP R_distances,
+                                     SEXP R_indices,
+                                     SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_get_dist_matrix_opt");
+	}
+	return func(R_distances, R_indices, R_labels);
+}
+
+
 static SEXP dist_get_dist_columns(SEXP R_distances,
                                   SEXP R_column_indices,
                                   SEXP R_row_indices)
@@ -74,6 +86,32 @@ static SEXP dist_get_dist_columns(SEXP R_distances,
 }
 
 
+static SEXP dist_get_dist_columns_opt(SEXP R_distances,
+                                      SEXP R_column_indices,
+                                      SEXP R_row_indices,
+                                      SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_get_dist_columns_opt");
+	}
+	return func(R_distances, R_column_indices, R_row_indices, R_labels);
+}
+
+
+static SEXP dist_get_dist_columns_points(SEXP R_distances,
+                                         SEXP R_query_points,
+                                         SEXP R_row_indices,
+                                         SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_get_dist_columns_points");
+	}
+	return func(R_distances, R_query_points, R_row_indices, R_labels);
+}
+
+
 static SEXP dist_max_distance_search(SEXP R_distances,
                                      SEXP R_query_indices,
                                      SEXP R_search_indices)
@@ -86,6 +124,19 @@ static SEXP dist_max_distance_search(SEXP R_distances,
 }
 
 
+static SEXP dist_max_distance_search_opt(SEXP R_distances,
+                                         SEXP R_query_indices,
+                                         SEXP R_search_indices,
+                                         SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_max_distance_search_opt");
+	}
+	return func(R_distances, R_query_indices, R_search_indices, R_labels);
+}
+
+
 static SEXP dist_nearest_neighbor_search(SEXP R_distances,
                                          SEXP R_k,
                                          SEXP R_query_indices,
@@ -100,6 +151,112 @@ static SEXP dist_nearest_neighbor_search(SEXP R_distances,
 }
 
 
+static SEXP dist_nearest_neighbor_search_opt(SEXP R_distances,
+                                             SEXP R_k,
+                                             SEXP R_query_indices,
+                                             SEXP R_search_indices,
+                                             SEXP R_radius,
+                                             SEXP R_exclude_self,
+                                             SEXP R_index,
+                                             SEXP R_index_options,
+                                             SEXP R_rotate,
+                                             SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_nearest_neighbor_search_opt");
+	}
+	return func(R_distances, R_k, R_query_indices, R_search_indices, R_radius, R_exclude_self, R_index, R_index_options, R_rotate, R_labels);
+}
+
+
+static SEXP dist_nearest_neighbor_search_chunks(SEXP R_distances,
+                                                SEXP R_k,
+                                                SEXP R_query_indices,
+                                                SEXP R_search_indices,
+                                                SEXP R_radius,
+                                                SEXP R_exclude_self,
+                                                SEXP R_index,
+                                                SEXP R_index_options,
+                                                SEXP R_rotate,
+                                                SEXP R_labels,
+                                                SEXP R_chunk_size,
+                                                SEXP R_callback)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_nearest_neighbor_search_chunks");
+	}
+	return func(R_distances, R_k, R_query_indices, R_search_indices, R_radius, R_exclude_self, R_index, R_index_options, R_rotate, R_labels, R_chunk_size, R_callback);
+}
+
+
+static SEXP dist_nearest_neighbor_search_points(SEXP R_distances,
+                                                SEXP R_k,
+                                                SEXP R_query_points,
+                                                SEXP R_search_indices,
+                                                SEXP R_radius,
+                                                SEXP R_index,
+                                                SEXP R_index_options,
+                                                SEXP R_rotate)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_nearest_neighbor_search_points");
+	}
+	return func(R_distances, R_k, R_query_points, R_search_indices, R_radius, R_index, R_index_options, R_rotate);
+}
+
+
+static SEXP dist_count_within_radius(SEXP R_distances,
+                                     SEXP R_radius,
+                                     SEXP R_query_indices,
+                                     SEXP R_search_indices,
+                                     SEXP R_exclude_self,
+                                     SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_count_within_radius");
+	}
+	return func(R_distances, R_radius, R_query_indices, R_search_indices, R_exclude_self, R_labels);
+}
+
+
+static SEXP dist_kernel_sums(SEXP R_distances,
+                             SEXP R_bandwidth,
+                             SEXP R_kernel,
+                             SEXP R_weights,
+                             SEXP R_query_indices,
+                             SEXP R_search_indices,
+                             SEXP R_exclude_self,
+                             SEXP R_tolerance,
+                             SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_kernel_sums");
+	}
+	return func(R_distances, R_bandwidth, R_kernel, R_weights, R_query_indices, R_search_indices, R_exclude_self, R_tolerance, R_labels);
+}
+
+
+static SEXP dist_greedy_match(SEXP R_distances,
+                              SEXP R_treated,
+                              SEXP R_controls,
+                              SEXP R_k,
+                              SEXP R_radius,
+                              SEXP R_order,
+                              SEXP R_labels)
+{
+	static SEXP(*func)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP) = NULL;
+	if (func == NULL) {
+		func = (SEXP(*)(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP)) R_GetCCallable("distances", "dist_greedy_match");
+	}
+	return func(R_distances, R_treated, R_controls, R_k, R_radius, R_order, R_labels);
+}
+
+
 #ifdef __cplusplus
 }
 #endif
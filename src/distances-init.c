@@ -20,19 +20,41 @@
 
 #include <R_ext/Rdynload.h>
 #include "get_dists.h"
+#include "gower.h"
+#include "greedy_match.h"
+#include "hamming.h"
+#include "internal.h"
+#include "make_dists.h"
 #include "max_dists.h"
 #include "nn_search.h"
 #include "utils.h"
 
 
 static const R_CallMethodDef callMethods[] = {
-	{"dist_check_distance_object",    (DL_FUNC) &dist_check_distance_object,    1},
-	{"dist_num_data_points",          (DL_FUNC) &dist_num_data_points,          1},
-	{"dist_get_dist_columns",         (DL_FUNC) &dist_get_dist_columns,         3},
-	{"dist_get_dist_matrix",          (DL_FUNC) &dist_get_dist_matrix,          2},
-	{"dist_max_distance_search",      (DL_FUNC) &dist_max_distance_search,      3},
-	{"dist_nearest_neighbor_search",  (DL_FUNC) &dist_nearest_neighbor_search,  5},
-	{NULL,                            NULL,                                     0}
+	{"dist_check_distance_object",           (DL_FUNC) &dist_check_distance_object,           1},
+	{"dist_num_data_points",                 (DL_FUNC) &dist_num_data_points,                 1},
+	{"dist_get_dist_columns",                (DL_FUNC) &dist_get_dist_columns,                3},
+	{"dist_get_dist_columns_opt",            (DL_FUNC) &dist_get_dist_columns_opt,            4},
+	{"dist_get_dist_columns_points",         (DL_FUNC) &dist_get_dist_columns_points,         4},
+	{"dist_get_dist_matrix",                 (DL_FUNC) &dist_get_dist_matrix,                 2},
+	{"dist_get_dist_matrix_opt",             (DL_FUNC) &dist_get_dist_matrix_opt,             3},
+	{"dist_make_data_matrix",                (DL_FUNC) &dist_make_data_matrix,                1},
+	{"dist_data_covariance",                 (DL_FUNC) &dist_data_covariance,                 2},
+	{"dist_transform_data_matrix",           (DL_FUNC) &dist_transform_data_matrix,           2},
+	{"dist_normalize_data_points",           (DL_FUNC) &dist_normalize_data_points,           1},
+	{"dist_pack_binary_data",                (DL_FUNC) &dist_pack_binary_data,                1},
+	{"dist_make_category_matrix",            (DL_FUNC) &dist_make_category_matrix,            2},
+	{"dist_scale_to_unit_range",             (DL_FUNC) &dist_scale_to_unit_range,             1},
+	{"dist_max_distance_search",             (DL_FUNC) &dist_max_distance_search,             3},
+	{"dist_max_distance_search_opt",         (DL_FUNC) &dist_max_distance_search_opt,         4},
+	{"dist_nearest_neighbor_search",         (DL_FUNC) &dist_nearest_neighbor_search,         5},
+	{"dist_nearest_neighbor_search_opt",     (DL_FUNC) &dist_nearest_neighbor_search_opt,     10},
+	{"dist_nearest_neighbor_search_chunks",  (DL_FUNC) &dist_nearest_neighbor_search_chunks,  12},
+	{"dist_nearest_neighbor_search_points",  (DL_FUNC) &dist_nearest_neighbor_search_points,  8},
+	{"dist_count_within_radius",             (DL_FUNC) &dist_count_within_radius,             6},
+	{"dist_kernel_sums",                     (DL_FUNC) &dist_kernel_sums,                     9},
+	{"dist_greedy_match",                    (DL_FUNC) &dist_greedy_match,                    7},
+	{NULL,                                   NULL,                                            0}
 };
 
 
@@ -41,13 +63,25 @@ void R_init_distances(DllInfo *info) {
 	R_registerRoutines(info, NULL, callMethods, NULL, NULL);
 	R_useDynamicSymbols(info, FALSE);
 
+	idist_init_compact_labels(info);
+
 	// Register R level functions
 	R_RegisterCCallable("distances", "dist_check_distance_object", (DL_FUNC) &dist_check_distance_object);
 	R_RegisterCCallable("distances", "dist_num_data_points", (DL_FUNC) &dist_num_data_points);
 	R_RegisterCCallable("distances", "dist_get_dist_matrix", (DL_FUNC) &dist_get_dist_matrix);
+	R_RegisterCCallable("distances", "dist_get_dist_matrix_opt", (DL_FUNC) &dist_get_dist_matrix_opt);
 	R_RegisterCCallable("distances", "dist_get_dist_columns", (DL_FUNC) &dist_get_dist_columns);
+	R_RegisterCCallable("distances", "dist_get_dist_columns_opt", (DL_FUNC) &dist_get_dist_columns_opt);
+	R_RegisterCCallable("distances", "dist_get_dist_columns_points", (DL_FUNC) &dist_get_dist_columns_points);
 	R_RegisterCCallable("distances", "dist_max_distance_search", (DL_FUNC) &dist_max_distance_search);
+	R_RegisterCCallable("distances", "dist_max_distance_search_opt", (DL_FUNC) &dist_max_distance_search_opt);
 	R_RegisterCCallable("distances", "dist_nearest_neighbor_search", (DL_FUNC) &dist_nearest_neighbor_search);
+	R_RegisterCCallable("distances", "dist_nearest_neighbor_search_opt", (DL_FUNC) &dist_nearest_neighbor_search_opt);
+	R_RegisterCCallable("distances", "dist_nearest_neighbor_search_chunks", (DL_FUNC) &dist_nearest_neighbor_search_chunks);
+	R_RegisterCCallable("distances", "dist_nearest_neighbor_search_points", (DL_FUNC) &dist_nearest_neighbor_search_points);
+	R_RegisterCCallable("distances", "dist_count_within_radius", (DL_FUNC) &dist_count_within_radius);
+	R_RegisterCCallable("distances", "dist_kernel_sums", (DL_FUNC) &dist_kernel_sums);
+	R_RegisterCCallable("distances", "dist_greedy_match", (DL_FUNC) &dist_greedy_match);
 
 
 	// Register C level functions
@@ -55,10 +89,22 @@ void R_init_distances(DllInfo *info) {
 	R_RegisterCCallable("distances", "idist_num_data_points", (DL_FUNC) &idist_num_data_points);
 	R_RegisterCCallable("distances", "idist_get_dist_matrix", (DL_FUNC) &idist_get_dist_matrix);
 	R_RegisterCCallable("distances", "idist_get_dist_columns", (DL_FUNC) &idist_get_dist_columns);
+	R_RegisterCCallable("distances", "idist_get_dist_columns_points", (DL_FUNC) &idist_get_dist_columns_points);
 	R_RegisterCCallable("distances", "idist_init_max_distance_search", (DL_FUNC) &idist_init_max_distance_search);
 	R_RegisterCCallable("distances", "idist_max_distance_search", (DL_FUNC) &idist_max_distance_search);
 	R_RegisterCCallable("distances", "idist_close_max_distance_search", (DL_FUNC) &idist_close_max_distance_search);
+	R_RegisterCCallable("distances", "idist_nn_search_default_options", (DL_FUNC) &idist_nn_search_default_options);
 	R_RegisterCCallable("distances", "idist_init_nearest_neighbor_search", (DL_FUNC) &idist_init_nearest_neighbor_search);
+	R_RegisterCCallable("distances", "idist_init_nearest_neighbor_search_opt", (DL_FUNC) &idist_init_nearest_neighbor_search_opt);
 	R_RegisterCCallable("distances", "idist_nearest_neighbor_search", (DL_FUNC) &idist_nearest_neighbor_search);
+	R_RegisterCCallable("distances", "idist_nearest_neighbor_search_na", (DL_FUNC) &idist_nearest_neighbor_search_na);
+	R_RegisterCCallable("distances", "idist_nearest_neighbor_search_chunks", (DL_FUNC) &idist_nearest_neighbor_search_chunks);
+	R_RegisterCCallable("distances", "idist_nearest_neighbor_search_points", (DL_FUNC) &idist_nearest_neighbor_search_points);
+	R_RegisterCCallable("distances", "idist_nearest_neighbor_search_points_na", (DL_FUNC) &idist_nearest_neighbor_search_points_na);
+	R_RegisterCCallable("distances", "idist_count_within_radius", (DL_FUNC) &idist_count_within_radius);
+	R_RegisterCCallable("distances", "idist_kernel_sums", (DL_FUNC) &idist_kernel_sums);
 	R_RegisterCCallable("distances", "idist_close_nearest_neighbor_search", (DL_FUNC) &idist_close_nearest_neighbor_search);
+	R_RegisterCCallable("distances", "idist_nearest_neighbor_search_remove", (DL_FUNC) &idist_nearest_neighbor_search_remove);
+	R_RegisterCCallable("distances", "idist_nearest_neighbor_search_insert", (DL_FUNC) &idist_nearest_neighbor_search_insert);
+	R_RegisterCCallable("distances", "idist_greedy_match", (DL_FUNC) &idist_greedy_match);
 }
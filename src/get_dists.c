@@ -18,35 +18,89 @@
  * along with this program. If not, see http://www.gnu.org/licenses/
  * ========================================================================== */
 
+// Pass the lengths of character arguments to BLAS
+#define USE_FC_LEN_T
 #include "get_dists.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <R.h>
 #include <Rinternals.h>
+#include <R_ext/BLAS.h>
 #include "error.h"
+#include "gower.h"
+#include "hamming.h"
 #include "internal.h"
 #include "utils.h"
 
+#ifndef FCONE
+	#define FCONE
+#endif
 
+// Cosine distances are computed in tiles of dot products of this many
+// rows and columns
+static const int DIST_COSINE_TILE_ROWS = 4096;
+static const int DIST_COSINE_TILE_COLUMNS = 64;
+
+
+// The functions below read indices as `indices[i] - index_base`, so that
+// R indices (with `index_base = 1`) need not be translated
+static bool idist_dist_matrix(SEXP R_distances,
+                              size_t len_indices,
+                              const int indices[],
+                              int index_base,
+                              double output_dists[]);
+
+static bool idist_dist_columns(SEXP R_distances,
+                               size_t len_column_indices,
+                               const int column_indices[],
+                               size_t len_row_indices,
+                               const int row_indices[],
+                               int index_base,
+                               double output_dists[]);
+
+static bool idist_dist_columns_points(SEXP R_distances,
+                                      size_t num_query_points,
+                                      const double query_points[],
+                                      size_t len_row_indices,
+                                      const int row_indices[],
+                                      int index_base,
+                                      double output_dists[]);
+
+
+// The signature of distances 0.1.12 and earlier, with labels
 SEXP dist_get_dist_matrix(const SEXP R_distances,
                           const SEXP R_indices)
+{
+	SEXP R_true = PROTECT(ScalarLogical(1));
+	SEXP R_output_dists = dist_get_dist_matrix_opt(R_distances, R_indices, R_true);
+	UNPROTECT(1);
+	return R_output_dists;
+}
+
+
+SEXP dist_get_dist_matrix_opt(const SEXP R_distances,
+                              const SEXP R_indices,
+                              const SEXP R_labels)
 {
 	idist_assert(idist_check_distance_object(R_distances));
 	idist_assert(isNull(R_indices) || isInteger(R_indices));
+	idist_assert(isLogical(R_labels));
 
 	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
 
-	SEXP R_indices_local = PROTECT(translate_R_index_vector(R_indices, num_data_points));
-	const size_t len_indices = isInteger(R_indices_local) ? (size_t) xlength(R_indices_local) : (size_t) num_data_points;
-	int* const indices = isInteger(R_indices_local) ? INTEGER(R_indices_local) : NULL;
+	const int* const indices = get_R_index_subset(R_indices, num_data_points);
+	const size_t len_indices = (indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_indices);
 
 	SEXP R_output_dists = PROTECT(allocVector(REALSXP, (R_xlen_t) (((len_indices - 1) * len_indices) / 2)));
 	double* const output_dists = REAL(R_output_dists);
 
-	idist_get_dist_matrix(R_distances,
-	                      len_indices,
-	                      indices,
-	                      output_dists);
+	idist_assert(idist_dist_matrix(R_distances,
+	                               len_indices,
+	                               indices,
+	                               1,
+	                               output_dists));
 
 	setAttrib(R_output_dists, install("Size"), PROTECT(ScalarInteger((int) len_indices)));
 	setAttrib(R_output_dists, install("Diag"), PROTECT(ScalarLogical(0)));
@@ -55,87 +109,345 @@ SEXP dist_get_dist_matrix(const SEXP R_distances,
 	classgets(R_output_dists, mkString("dist"));
 
 	SEXP R_ids = getAttrib(R_distances, install("ids"));
-	if (isInteger(R_indices) || isString(R_ids)) {
+	if (asLogical(R_labels) && (isInteger(R_indices) || isString(R_ids))) {
 		setAttrib(R_output_dists, install("Labels"), PROTECT(get_labels(R_distances, R_indices)));
 		UNPROTECT(1);
 	}
 
-	UNPROTECT(6);
+	UNPROTECT(5);
 	return R_output_dists;
 }
 
 
+// The signature of distances 0.1.12 and earlier, with labels
 SEXP dist_get_dist_columns(const SEXP R_distances,
                            const SEXP R_column_indices,
                            const SEXP R_row_indices)
+{
+	SEXP R_true = PROTECT(ScalarLogical(1));
+	SEXP R_output_dists = dist_get_dist_columns_opt(R_distances, R_column_indices, R_row_indices, R_true);
+	UNPROTECT(1);
+	return R_output_dists;
+}
+
+
+SEXP dist_get_dist_columns_opt(const SEXP R_distances,
+                               const SEXP R_column_indices,
+                               const SEXP R_row_indices,
+                               const SEXP R_labels)
 {
 	idist_assert(idist_check_distance_object(R_distances));
 	idist_assert(isInteger(R_column_indices));
 	idist_assert(isNull(R_row_indices) || isInteger(R_row_indices));
+	idist_assert(isLogical(R_labels));
 
 	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
 
-	SEXP R_column_indices_local = PROTECT(translate_R_index_vector(R_column_indices, num_data_points));
-	const size_t len_column_indices = (size_t) xlength(R_column_indices_local);
-	const int* const column_indices = INTEGER(R_column_indices_local);
+	const int* const column_indices = get_R_index_vector(R_column_indices, num_data_points);
+	const size_t len_column_indices = (size_t) xlength(R_column_indices);
 
-	SEXP R_row_indices_local = PROTECT(translate_R_index_vector(R_row_indices, num_data_points));
-	const size_t len_row_indices = isInteger(R_row_indices_local) ? (size_t) xlength(R_row_indices_local) : (size_t) num_data_points;
-	const int* const row_indices = isInteger(R_row_indices_local) ? INTEGER(R_row_indices_local) : NULL;
+	const int* const row_indices = get_R_index_subset(R_row_indices, num_data_points);
+	const size_t len_row_indices = (row_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_row_indices);
 
 	SEXP R_output_dists = PROTECT(allocMatrix(REALSXP, len_row_indices, len_column_indices));
 	double* const output_dists = REAL(R_output_dists);
 
-	idist_get_dist_columns(R_distances,
-	                       len_column_indices,
-	                       column_indices,
-	                       len_row_indices,
-	                       row_indices,
-	                       output_dists);
+	idist_assert(idist_dist_columns(R_distances,
+	                                len_column_indices,
+	                                column_indices,
+	                                len_row_indices,
+	                                row_indices,
+	                                1,
+	                                output_dists));
 
-	SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
-	SET_VECTOR_ELT(dimnames, 0, get_labels(R_distances, R_row_indices));
-	SET_VECTOR_ELT(dimnames, 1, get_labels(R_distances, R_column_indices));
-	setAttrib(R_output_dists, R_DimNamesSymbol, dimnames);
+	if (asLogical(R_labels)) {
+		SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
+		SET_VECTOR_ELT(dimnames, 0, get_labels(R_distances, R_row_indices));
+		SET_VECTOR_ELT(dimnames, 1, get_labels(R_distances, R_column_indices));
+		setAttrib(R_output_dists, R_DimNamesSymbol, dimnames);
+		UNPROTECT(1);
+	}
 
-	UNPROTECT(4);
+	UNPROTECT(1);
 	return R_output_dists;
 }
 
 
-// `output_dists` must be of length `(len_indices - 1) len_indices / 2`
-bool idist_get_dist_matrix(const SEXP R_distances,
-                           const size_t len_indices,
-                           const int indices[const],
-                           double output_dists[])
+SEXP dist_get_dist_columns_points(const SEXP R_distances,
+                                  const SEXP R_query_points,
+                                  const SEXP R_row_indices,
+                                  const SEXP R_labels)
 {
 	idist_assert(idist_check_distance_object(R_distances));
-	idist_assert(output_dists != NULL);
+	idist_assert(isMatrix(R_query_points) && isReal(R_query_points));
+	idist_assert(isNull(R_row_indices) || isInteger(R_row_indices));
+	idist_assert(isLogical(R_labels));
 
-	const double* const raw_data_matrix = REAL(R_distances);
 	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
 	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+	idist_assert(INTEGER(getAttrib(R_query_points, R_DimSymbol))[0] == num_dimensions);
+	const size_t num_query_points = (size_t) INTEGER(getAttrib(R_query_points, R_DimSymbol))[1];
+
+	const int* const row_indices = get_R_index_subset(R_row_indices, num_data_points);
+	const size_t len_row_indices = (row_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_row_indices);
 
+	SEXP R_output_dists = PROTECT(allocMatrix(REALSXP, len_row_indices, num_query_points));
+	double* const output_dists = REAL(R_output_dists);
+
+	idist_assert(idist_dist_columns_points(R_distances,
+	                                       num_query_points,
+	                                       REAL(R_query_points),
+	                                       len_row_indices,
+	                                       row_indices,
+	                                       1,
+	                                       output_dists));
+
+	if (asLogical(R_labels)) {
+		SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
+		SET_VECTOR_ELT(dimnames, 0, get_labels(R_distances, R_row_indices));
+		SET_VECTOR_ELT(dimnames, 1, R_NilValue);
+		setAttrib(R_output_dists, R_DimNamesSymbol, dimnames);
+		UNPROTECT(1);
+	}
+
+	UNPROTECT(1);
+	return R_output_dists;
+}
+
+
+// The loops below are inlined once for each metric by passing `metric`
+// as a constant, so the metric is never checked in the inner loops
+static inline void idist_dist_matrix_loop(const double* const raw_data_matrix,
+                                          const int num_dimensions,
+                                          const int num_data_points,
+                                          const size_t len_indices,
+                                          const int indices[const],
+                                          const int index_base,
+                                          const idist_Metric metric,
+                                          const double p,
+                                          double output_dists[])
+{
 	if (indices == NULL) {
 		for (int p1 = 0; p1 < num_data_points; ++p1) {
 			for (int p2 = p1 + 1; p2 < num_data_points; ++p2) {
-				*output_dists = sqrt(idist_get_sq_dist(raw_data_matrix, num_dimensions, p1, p2));
+				*output_dists = idist_pow_to_dist(idist_get_pow_dist(raw_data_matrix, num_dimensions, p1, p2, metric, p), metric, p);
 				++output_dists;
 			}
 		}
 	} else {
 		for (size_t p1 = 0; p1 < len_indices; ++p1) {
 			for (size_t p2 = p1 + 1; p2 < len_indices; ++p2) {
-				*output_dists = sqrt(idist_get_sq_dist(raw_data_matrix, num_dimensions, indices[p1], indices[p2]));
+				*output_dists = idist_pow_to_dist(idist_get_pow_dist(raw_data_matrix, num_dimensions, indices[p1] - index_base, indices[p2] - index_base, metric, p), metric, p);
+				++output_dists;
+			}
+		}
+	}
+}
+
+
+static inline void idist_dist_columns_loop(const double* const raw_data_matrix,
+                                           const int num_dimensions,
+                                           const int num_data_points,
+                                           const size_t len_column_indices,
+                                           const int column_indices[const],
+                                           const size_t len_row_indices,
+                                           const int row_indices[const],
+                                           const int index_base,
+                                           const idist_Metric metric,
+                                           const double p,
+                                           double output_dists[])
+{
+	if (row_indices == NULL) {
+		for (size_t c = 0; c < len_column_indices; ++c) {
+			for (int r = 0; r < num_data_points; ++r) {
+				*output_dists = idist_pow_to_dist(idist_get_pow_dist(raw_data_matrix, num_dimensions, column_indices[c] - index_base, r, metric, p), metric, p);
+				++output_dists;
+			}
+		}
+	} else {
+		for (size_t c = 0; c < len_column_indices; ++c) {
+			for (size_t r = 0; r < len_row_indices; ++r) {
+				*output_dists = idist_pow_to_dist(idist_get_pow_dist(raw_data_matrix, num_dimensions, column_indices[c] - index_base, row_indices[r] - index_base, metric, p), metric, p);
+				++output_dists;
+			}
+		}
+	}
+}
+
+
+// As `idist_dist_columns_loop`, but the columns are the points in
+// `query_points` rather than data points in `raw_data_matrix`
+static inline void idist_dist_points_loop(const double* const raw_data_matrix,
+                                          const int num_dimensions,
+                                          const int num_data_points,
+                                          const size_t num_query_points,
+                                          const double query_points[const],
+                                          const size_t len_row_indices,
+                                          const int row_indices[const],
+                                          const int index_base,
+                                          const idist_Metric metric,
+                                          const double p,
+                                          double output_dists[])
+{
+	for (size_t c = 0; c < num_query_points; ++c) {
+		const double* const query = query_points + c * (size_t) num_dimensions;
+		if (row_indices == NULL) {
+			for (int r = 0; r < num_data_points; ++r) {
+				*output_dists = idist_pow_to_dist(idist_get_pow_dist_points(query, &raw_data_matrix[r * num_dimensions], num_dimensions, metric, p), metric, p);
+				++output_dists;
+			}
+		} else {
+			for (size_t r = 0; r < len_row_indices; ++r) {
+				*output_dists = idist_pow_to_dist(idist_get_pow_dist_points(query, &raw_data_matrix[(row_indices[r] - index_base) * num_dimensions], num_dimensions, metric, p), metric, p);
 				++output_dists;
 			}
 		}
 	}
+}
+
+
+// The data points of cosine objects have unit length, so their cosine
+// distances are one minus their dot products. Dot products of many
+// points are matrix products, which BLAS computes much faster than the
+// point-by-point loops above. Rounding can make the dot product of
+// nearly parallel points exceed one, so distances are truncated at zero.
+static inline double idist_dot_to_cosine(const double dot)
+{
+	return (dot < 1.0) ? 1.0 - dot : 0.0;
+}
+
+
+// Copies the data points in `indices` into consecutive columns of a new
+// matrix. Returns NULL if memory could not be allocated.
+static double* idist_gather_points(const double* const raw_data_matrix,
+                                   const int num_dimensions,
+                                   const size_t len_indices,
+                                   const int indices[const],
+                                   const int index_base)
+{
+	double* const points = malloc(sizeof(double) * (size_t) num_dimensions * len_indices);
+	if (points == NULL) return NULL;
+	for (size_t i = 0; i < len_indices; ++i) {
+		memcpy(points + i * (size_t) num_dimensions,
+		       raw_data_matrix + (size_t) (indices[i] - index_base) * (size_t) num_dimensions,
+		       sizeof(double) * (size_t) num_dimensions);
+	}
+	return points;
+}
+
+
+// `points` holds `num_points` data points as columns. Each tile of the
+// lower triangle is computed as one matrix product and then copied into
+// `output_dists` in the order of `dist` objects.
+static bool idist_cosine_dist_matrix(const double* const points,
+                                     const int num_dimensions,
+                                     const int num_points,
+                                     double output_dists[])
+{
+	double* const tile = malloc(sizeof(double) * (size_t) DIST_COSINE_TILE_ROWS * (size_t) DIST_COSINE_TILE_COLUMNS);
+	if (tile == NULL) return false;
+
+	const double one = 1.0;
+	const double zero = 0.0;
+	for (int c0 = 0; c0 < num_points - 1; c0 += DIST_COSINE_TILE_COLUMNS) {
+		const int num_columns = (num_points - 1 - c0 < DIST_COSINE_TILE_COLUMNS) ? num_points - 1 - c0 : DIST_COSINE_TILE_COLUMNS;
+		for (int r0 = c0 + 1; r0 < num_points; r0 += DIST_COSINE_TILE_ROWS) {
+			const int num_rows = (num_points - r0 < DIST_COSINE_TILE_ROWS) ? num_points - r0 : DIST_COSINE_TILE_ROWS;
+			F77_CALL(dgemm)("T", "N", &num_rows, &num_columns, &num_dimensions, &one,
+			                points + (size_t) r0 * (size_t) num_dimensions, &num_dimensions,
+			                points + (size_t) c0 * (size_t) num_dimensions, &num_dimensions,
+			                &zero, tile, &num_rows FCONE FCONE);
+			for (int c = 0; c < num_columns; ++c) {
+				const size_t p1 = (size_t) (c0 + c);
+				// Position of the distance between `p1` and `p1 + 1`
+				const size_t column_start = p1 * (size_t) (num_points - 1) - p1 * (p1 - 1) / 2;
+				const int first_row = (r0 > c0 + c) ? 0 : c0 + c + 1 - r0;
+				for (int r = first_row; r < num_rows; ++r) {
+					output_dists[column_start + (size_t) (r0 + r) - p1 - 1] = idist_dot_to_cosine(tile[(size_t) c * (size_t) num_rows + (size_t) r]);
+				}
+			}
+		}
+	}
 
+	free(tile);
 	return true;
 }
 
 
+// `columns` holds `num_columns` data points as columns, and each is
+// compared to the data points in `row_indices` (all if NULL)
+static bool idist_cosine_dist_points(const double* const raw_data_matrix,
+                                     const int num_dimensions,
+                                     const int num_data_points,
+                                     const int num_columns,
+                                     const double* const columns,
+                                     const size_t len_row_indices,
+                                     const int row_indices[const],
+                                     const int index_base,
+                                     double output_dists[])
+{
+	double* const rows = (row_indices == NULL) ? NULL : idist_gather_points(raw_data_matrix, num_dimensions, len_row_indices, row_indices, index_base);
+	if (row_indices != NULL && rows == NULL) return false;
+
+	const int num_rows = (row_indices == NULL) ? num_data_points : (int) len_row_indices;
+	const double one = 1.0;
+	const double zero = 0.0;
+	F77_CALL(dgemm)("T", "N", &num_rows, &num_columns, &num_dimensions, &one,
+	                (row_indices == NULL) ? raw_data_matrix : rows, &num_dimensions,
+	                columns, &num_dimensions,
+	                &zero, output_dists, &num_rows FCONE FCONE);
+
+	const size_t len_output = (size_t) num_rows * (size_t) num_columns;
+	for (size_t i = 0; i < len_output; ++i) {
+		output_dists[i] = idist_dot_to_cosine(output_dists[i]);
+	}
+
+	free(rows);
+	return true;
+}
+
+
+static bool idist_cosine_dist_columns(const double* const raw_data_matrix,
+                                      const int num_dimensions,
+                                      const int num_data_points,
+                                      const size_t len_column_indices,
+                                      const int column_indices[const],
+                                      const size_t len_row_indices,
+                                      const int row_indices[const],
+                                      const int index_base,
+                                      double output_dists[])
+{
+	double* const columns = idist_gather_points(raw_data_matrix, num_dimensions, len_column_indices, column_indices, index_base);
+	if (columns == NULL) return false;
+
+	const bool ok = idist_cosine_dist_points(raw_data_matrix, num_dimensions, num_data_points, (int) len_column_indices, columns,
+	                                         len_row_indices, row_indices, index_base, output_dists);
+	free(columns);
+	if (!ok) return false;
+
+	// A point's distance to itself is exactly zero
+	const int num_rows = (row_indices == NULL) ? num_data_points : (int) len_row_indices;
+	for (size_t c = 0; c < len_column_indices; ++c) {
+		for (int r = 0; r < num_rows; ++r) {
+			const int row = (row_indices == NULL) ? r : row_indices[r] - index_base;
+			if (row == column_indices[c] - index_base) output_dists[c * (size_t) num_rows + (size_t) r] = 0.0;
+		}
+	}
+
+	return true;
+}
+
+
+// `output_dists` must be of length `(len_indices - 1) len_indices / 2`
+bool idist_get_dist_matrix(const SEXP R_distances,
+                           const size_t len_indices,
+                           const int indices[const],
+                           double output_dists[])
+{
+	return idist_dist_matrix(R_distances, len_indices, indices, 0, output_dists);
+}
+
+
 // `output_dists` must be of length `len_column_indices * len_row_indices`
 bool idist_get_dist_columns(const SEXP R_distances,
                             const size_t len_column_indices,
@@ -143,30 +455,181 @@ bool idist_get_dist_columns(const SEXP R_distances,
                             const size_t len_row_indices,
                             const int row_indices[const],
                             double output_dists[])
+{
+	return idist_dist_columns(R_distances, len_column_indices, column_indices,
+	                          len_row_indices, row_indices, 0, output_dists);
+}
+
+
+// `query_points` holds `num_query_points` points as columns in the
+// coordinates of the data matrix of `R_distances`, i.e., with the
+// normalization and weights applied (and of unit length for cosine
+// objects). `output_dists` must be of length
+// `num_query_points * len_row_indices`.
+bool idist_get_dist_columns_points(const SEXP R_distances,
+                                   const size_t num_query_points,
+                                   const double query_points[const],
+                                   const size_t len_row_indices,
+                                   const int row_indices[const],
+                                   double output_dists[])
+{
+	return idist_dist_columns_points(R_distances, num_query_points, query_points,
+	                                 len_row_indices, row_indices, 0, output_dists);
+}
+
+
+static bool idist_dist_matrix(const SEXP R_distances,
+                              const size_t len_indices,
+                              const int indices[const],
+                              const int index_base,
+                              double output_dists[])
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(output_dists != NULL);
+
+	if (idist_get_metric(R_distances) == IDIST_METRIC_HAMMING) {
+		idist_hamming_dist_matrix(R_distances, len_indices, indices, index_base, output_dists);
+		return true;
+	}
+	if (idist_get_metric(R_distances) == IDIST_METRIC_GOWER) {
+		idist_gower_dist_matrix(R_distances, len_indices, indices, index_base, output_dists);
+		return true;
+	}
+
+	const double* const raw_data_matrix = REAL(R_distances);
+	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+	const double p = idist_get_minkowski_p(R_distances);
+
+	switch (idist_get_metric(R_distances)) {
+	case IDIST_METRIC_COSINE:
+		if (indices == NULL) {
+			return idist_cosine_dist_matrix(raw_data_matrix, num_dimensions, num_data_points, output_dists);
+		} else {
+			if (len_indices < 2) return true;
+			double* const points = idist_gather_points(raw_data_matrix, num_dimensions, len_indices, indices, index_base);
+			if (points == NULL) return false;
+			const bool ok = idist_cosine_dist_matrix(points, num_dimensions, (int) len_indices, output_dists);
+			free(points);
+			return ok;
+		}
+	case IDIST_METRIC_MANHATTAN:
+		idist_dist_matrix_loop(raw_data_matrix, num_dimensions, num_data_points, len_indices, indices, index_base,
+		                       IDIST_METRIC_MANHATTAN, p, output_dists);
+		break;
+	case IDIST_METRIC_MAXIMUM:
+		idist_dist_matrix_loop(raw_data_matrix, num_dimensions, num_data_points, len_indices, indices, index_base,
+		                       IDIST_METRIC_MAXIMUM, p, output_dists);
+		break;
+	case IDIST_METRIC_MINKOWSKI:
+		idist_dist_matrix_loop(raw_data_matrix, num_dimensions, num_data_points, len_indices, indices, index_base,
+		                       IDIST_METRIC_MINKOWSKI, p, output_dists);
+		break;
+	default:
+		idist_dist_matrix_loop(raw_data_matrix, num_dimensions, num_data_points, len_indices, indices, index_base,
+		                       IDIST_METRIC_EUCLIDEAN, p, output_dists);
+		break;
+	}
+
+	return true;
+}
+
+
+static bool idist_dist_columns(const SEXP R_distances,
+                               const size_t len_column_indices,
+                               const int column_indices[const],
+                               const size_t len_row_indices,
+                               const int row_indices[const],
+                               const int index_base,
+                               double output_dists[])
 {
 	idist_assert(idist_check_distance_object(R_distances));
 	idist_assert(len_column_indices > 0);
 	idist_assert(column_indices != NULL);
 	idist_assert(output_dists != NULL);
 
+	if (idist_get_metric(R_distances) == IDIST_METRIC_HAMMING) {
+		idist_hamming_dist_columns(R_distances, len_column_indices, column_indices,
+		                           len_row_indices, row_indices, index_base, output_dists);
+		return true;
+	}
+	if (idist_get_metric(R_distances) == IDIST_METRIC_GOWER) {
+		idist_gower_dist_columns(R_distances, len_column_indices, column_indices,
+		                         len_row_indices, row_indices, index_base, output_dists);
+		return true;
+	}
+
 	const double* const raw_data_matrix = REAL(R_distances);
 	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
 	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
+	const double p = idist_get_minkowski_p(R_distances);
 
-	if (row_indices == NULL) {
-		for (size_t c = 0; c < len_column_indices; ++c) {
-			for (int r = 0; r < num_data_points; ++r) {
-				*output_dists = sqrt(idist_get_sq_dist(raw_data_matrix, num_dimensions, column_indices[c], r));
-				++output_dists;
-			}
-		}
-	} else {
-		for (size_t c = 0; c < len_column_indices; ++c) {
-			for (size_t r = 0; r < len_row_indices; ++r) {
-				*output_dists = sqrt(idist_get_sq_dist(raw_data_matrix, num_dimensions, column_indices[c], row_indices[r]));
-				++output_dists;
-			}
-		}
+	switch (idist_get_metric(R_distances)) {
+	case IDIST_METRIC_COSINE:
+		return idist_cosine_dist_columns(raw_data_matrix, num_dimensions, num_data_points, len_column_indices, column_indices,
+		                                 len_row_indices, row_indices, index_base, output_dists);
+	case IDIST_METRIC_MANHATTAN:
+		idist_dist_columns_loop(raw_data_matrix, num_dimensions, num_data_points, len_column_indices, column_indices,
+		                        len_row_indices, row_indices, index_base, IDIST_METRIC_MANHATTAN, p, output_dists);
+		break;
+	case IDIST_METRIC_MAXIMUM:
+		idist_dist_columns_loop(raw_data_matrix, num_dimensions, num_data_points, len_column_indices, column_indices,
+		                        len_row_indices, row_indices, index_base, IDIST_METRIC_MAXIMUM, p, output_dists);
+		break;
+	case IDIST_METRIC_MINKOWSKI:
+		idist_dist_columns_loop(raw_data_matrix, num_dimensions, num_data_points, len_column_indices, column_indices,
+		                        len_row_indices, row_indices, index_base, IDIST_METRIC_MINKOWSKI, p, output_dists);
+		break;
+	default:
+		idist_dist_columns_loop(raw_data_matrix, num_dimensions, num_data_points, len_column_indices, column_indices,
+		                        len_row_indices, row_indices, index_base, IDIST_METRIC_EUCLIDEAN, p, output_dists);
+		break;
+	}
+
+	return true;
+}
+
+
+static bool idist_dist_columns_points(const SEXP R_distances,
+                                      const size_t num_query_points,
+                                      const double query_points[const],
+                                      const size_t len_row_indices,
+                                      const int row_indices[const],
+                                      const int index_base,
+                                      double output_dists[])
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(idist_get_metric(R_distances) != IDIST_METRIC_HAMMING);
+	idist_assert(idist_get_metric(R_distances) != IDIST_METRIC_GOWER);
+	idist_assert(num_query_points > 0);
+	idist_assert(query_points != NULL);
+	idist_assert(output_dists != NULL);
+
+	const double* const raw_data_matrix = REAL(R_distances);
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
+	const double p = idist_get_minkowski_p(R_distances);
+
+	switch (idist_get_metric(R_distances)) {
+	case IDIST_METRIC_COSINE:
+		return idist_cosine_dist_points(raw_data_matrix, num_dimensions, num_data_points, (int) num_query_points, query_points,
+		                                len_row_indices, row_indices, index_base, output_dists);
+	case IDIST_METRIC_MANHATTAN:
+		idist_dist_points_loop(raw_data_matrix, num_dimensions, num_data_points, num_query_points, query_points,
+		                       len_row_indices, row_indices, index_base, IDIST_METRIC_MANHATTAN, p, output_dists);
+		break;
+	case IDIST_METRIC_MAXIMUM:
+		idist_dist_points_loop(raw_data_matrix, num_dimensions, num_data_points, num_query_points, query_points,
+		                       len_row_indices, row_indices, index_base, IDIST_METRIC_MAXIMUM, p, output_dists);
+		break;
+	case IDIST_METRIC_MINKOWSKI:
+		idist_dist_points_loop(raw_data_matrix, num_dimensions, num_data_points, num_query_points, query_points,
+		                       len_row_indices, row_indices, index_base, IDIST_METRIC_MINKOWSKI, p, output_dists);
+		break;
+	default:
+		idist_dist_points_loop(raw_data_matrix, num_dimensions, num_data_points, num_query_points, query_points,
+		                       len_row_indices, row_indices, index_base, IDIST_METRIC_EUCLIDEAN, p, output_dists);
+		break;
 	}
 
 	return true;
@@ -29,10 +29,24 @@
 SEXP dist_get_dist_matrix(SEXP R_distances,
                           SEXP R_indices);
 
+SEXP dist_get_dist_matrix_opt(SEXP R_distances,
+                              SEXP R_indices,
+                              SEXP R_labels);
+
 SEXP dist_get_dist_columns(SEXP R_distances,
                            SEXP R_column_indices,
                            SEXP R_row_indices);
 
+SEXP dist_get_dist_columns_opt(SEXP R_distances,
+                               SEXP R_column_indices,
+                               SEXP R_row_indices,
+                               SEXP R_labels);
+
+SEXP dist_get_dist_columns_points(SEXP R_distances,
+                                  SEXP R_query_points,
+                                  SEXP R_row_indices,
+                                  SEXP R_labels);
+
 bool idist_get_dist_matrix(SEXP R_distances,
                            size_t len_indices,
                            const int indices[],
@@ -45,4 +59,11 @@ bool idist_get_dist_columns(SEXP R_distances,
                             const int row_indices[],
                             double output_dists[]);
 
+bool idist_get_dist_columns_points(SEXP R_distances,
+                                   size_t num_query_points,
+                                   const double query_points[],
+                                   size_t len_row_indices,
+                                   const int row_indices[],
+                                   double output_dists[]);
+
 #endif // ifndef DIST_GET_DISTS_HG
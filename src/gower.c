@@ -0,0 +1,325 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+
+#include "gower.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <R.h>
+#include <Rinternals.h>
+#include "error.h"
+#include "internal.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Category matrices are written in blocks of this many data points
+static const size_t DIST_GOWER_BLOCK_SIZE = 256;
+
+// Distance columns are computed in tiles of this many rows, so the rows
+// of a tile stay in cache while all columns are computed
+static const size_t DIST_GOWER_TILE_ROWS = 1024;
+
+// Loops over fewer data points or queries than this are not run in
+// parallel
+static const size_t DIST_GOWER_PAR_MIN_POINTS = 2048;
+static const int DIST_GOWER_PAR_MIN_QUERIES = 64;
+
+
+static inline int idist_num_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+static inline int idist_thread_num(void)
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+
+// The numeric and categorical coordinates of a Gower object. The
+// pointers are read before loops run in parallel, as the R API may only
+// be called from the main thread.
+typedef struct {
+	const double* numeric;
+	int num_numeric;
+	const int* categories;
+	int num_categorical;
+	int num_data_points;
+} idist_GowerData;
+
+
+static inline idist_GowerData idist_gower_data(const SEXP R_distances)
+{
+	SEXP R_categories = getAttrib(R_distances, install("categories"));
+	return (idist_GowerData) {
+		.numeric = REAL(R_distances),
+		.num_numeric = INTEGER(getAttrib(R_distances, R_DimSymbol))[0],
+		.categories = INTEGER(R_categories),
+		.num_categorical = INTEGER(getAttrib(R_categories, R_DimSymbol))[0],
+		.num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1],
+	};
+}
+
+
+static inline double idist_gower_dist(const idist_GowerData* const data,
+                                      const int index1,
+                                      const int index2)
+{
+	return idist_get_gower_dist(data->numeric, data->num_numeric,
+	                            data->categories, data->num_categorical,
+	                            index1, index2);
+}
+
+
+// `R_categories` is a list of integer columns of length
+// `R_num_data_points` (the codes of the categorical columns of a data
+// frame). Returns an integer matrix with the codes of each data point as
+// a column, or `R_NilValue` if the codes contain NAs.
+SEXP dist_make_category_matrix(const SEXP R_categories,
+                               const SEXP R_num_data_points)
+{
+	idist_assert(TYPEOF(R_categories) == VECSXP);
+	idist_assert(isInteger(R_num_data_points));
+
+	const int num_categorical = (int) xlength(R_categories);
+	const size_t num_data_points = (size_t) asInteger(R_num_data_points);
+
+	const int** const columns = (const int**) R_alloc((size_t) num_categorical + 1, sizeof(const int*));
+	for (int c = 0; c < num_categorical; ++c) {
+		const SEXP R_column = VECTOR_ELT(R_categories, c);
+		idist_assert(isInteger(R_column) && (size_t) xlength(R_column) == num_data_points);
+		columns[c] = INTEGER(R_column);
+	}
+
+	SEXP R_category_matrix = PROTECT(allocMatrix(INTSXP, num_categorical, (int) num_data_points));
+	int* const category_matrix = INTEGER(R_category_matrix);
+
+	const size_t num_blocks = (num_data_points + DIST_GOWER_BLOCK_SIZE - 1) / DIST_GOWER_BLOCK_SIZE;
+	int has_na = 0;
+
+	#pragma omp parallel for schedule(static) reduction(|:has_na) if(num_data_points >= DIST_GOWER_PAR_MIN_POINTS)
+	for (size_t b = 0; b < num_blocks; ++b) {
+		const size_t block_start = b * DIST_GOWER_BLOCK_SIZE;
+		const size_t block_stop = (block_start + DIST_GOWER_BLOCK_SIZE < num_data_points) ?
+			block_start + DIST_GOWER_BLOCK_SIZE : num_data_points;
+		for (int c = 0; c < num_categorical; ++c) {
+			const int* const column = columns[c];
+			int* write = category_matrix + block_start * (size_t) num_categorical + c;
+			for (size_t i = block_start; i < block_stop; ++i, write += num_categorical) {
+				has_na |= (column[i] == NA_INTEGER);
+				*write = column[i];
+			}
+		}
+	}
+
+	UNPROTECT(1);
+	return has_na ? R_NilValue : R_category_matrix;
+}
+
+
+// Scales each coordinate of the data points in `R_data_matrix` (points as
+// columns) in place to the unit interval, by subtracting its minimum and
+// dividing by its range. Coordinates with zero range are set to zero.
+// Returns a matrix with the minimum and maximum of each coordinate as
+// columns, as `range` does for a single coordinate.
+SEXP dist_scale_to_unit_range(const SEXP R_data_matrix)
+{
+	idist_assert(isMatrix(R_data_matrix) && isReal(R_data_matrix));
+
+	const size_t d = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[0];
+	const size_t num_data_points = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[1];
+	double* const data_matrix = REAL(R_data_matrix);
+
+	SEXP R_ranges = PROTECT(allocMatrix(REALSXP, 2, (int) d));
+	double* const ranges = REAL(R_ranges);
+	for (size_t j = 0; j < d; ++j) {
+		ranges[2 * j] = R_PosInf;
+		ranges[2 * j + 1] = R_NegInf;
+	}
+	for (size_t i = 0; i < num_data_points; ++i) {
+		const double* const point = data_matrix + i * d;
+		for (size_t j = 0; j < d; ++j) {
+			if (point[j] < ranges[2 * j]) ranges[2 * j] = point[j];
+			if (point[j] > ranges[2 * j + 1]) ranges[2 * j + 1] = point[j];
+		}
+	}
+
+	double* const scale = (double*) R_alloc(d + 1, sizeof(double));
+	for (size_t j = 0; j < d; ++j) {
+		const double range = ranges[2 * j + 1] - ranges[2 * j];
+		scale[j] = (range > 0.0) ? 1.0 / range : 0.0;
+	}
+
+	#pragma omp parallel for schedule(static) if(num_data_points >= DIST_GOWER_PAR_MIN_POINTS)
+	for (size_t i = 0; i < num_data_points; ++i) {
+		double* const point = data_matrix + i * d;
+		for (size_t j = 0; j < d; ++j) {
+			point[j] = (point[j] - ranges[2 * j]) * scale[j];
+		}
+	}
+
+	UNPROTECT(1);
+	return R_ranges;
+}
+
+
+// Each row of the lower triangle is written by one thread, at the
+// position of the distance between `p1` and `p1 + 1` in `dist` objects
+void idist_gower_dist_matrix(const SEXP R_distances,
+                             const size_t len_indices,
+                             const int indices[const],
+                             const int index_base,
+                             double output_dists[const])
+{
+	const idist_GowerData data = idist_gower_data(R_distances);
+	const size_t num_points = (indices == NULL) ? (size_t) data.num_data_points : len_indices;
+	if (num_points < 2) return;
+
+	#pragma omp parallel for schedule(dynamic, 16) if(num_points >= DIST_GOWER_PAR_MIN_POINTS)
+	for (size_t p1 = 0; p1 < num_points - 1; ++p1) {
+		const int point1 = (indices == NULL) ? (int) p1 : indices[p1] - index_base;
+		double* write = output_dists + p1 * (num_points - 1) - p1 * (p1 - 1) / 2;
+		for (size_t p2 = p1 + 1; p2 < num_points; ++p2, ++write) {
+			const int point2 = (indices == NULL) ? (int) p2 : indices[p2] - index_base;
+			*write = idist_gower_dist(&data, point1, point2);
+		}
+	}
+}
+
+
+void idist_gower_dist_columns(const SEXP R_distances,
+                              const size_t len_column_indices,
+                              const int column_indices[const],
+                              const size_t len_row_indices,
+                              const int row_indices[const],
+                              const int index_base,
+                              double output_dists[const])
+{
+	const idist_GowerData data = idist_gower_data(R_distances);
+	const size_t num_rows = (row_indices == NULL) ? (size_t) data.num_data_points : len_row_indices;
+	const size_t num_tiles = (num_rows + DIST_GOWER_TILE_ROWS - 1) / DIST_GOWER_TILE_ROWS;
+
+	#pragma omp parallel for schedule(static) if(num_rows * len_column_indices >= DIST_GOWER_PAR_MIN_POINTS)
+	for (size_t t = 0; t < num_tiles; ++t) {
+		const size_t r0 = t * DIST_GOWER_TILE_ROWS;
+		const size_t r1 = (r0 + DIST_GOWER_TILE_ROWS < num_rows) ? r0 + DIST_GOWER_TILE_ROWS : num_rows;
+		for (size_t c = 0; c < len_column_indices; ++c) {
+			double* const output_column = output_dists + c * num_rows;
+			for (size_t r = r0; r < r1; ++r) {
+				const int row = (row_indices == NULL) ? (int) r : row_indices[r] - index_base;
+				output_column[r] = idist_gower_dist(&data, column_indices[c] - index_base, row);
+			}
+		}
+	}
+}
+
+
+void idist_gower_max_dist(const SEXP R_distances,
+                          const int num_queries,
+                          const int query_indices[const],
+                          const size_t len_search_indices,
+                          const int search_indices[const],
+                          const int index_base,
+                          int out_max_indices[const],
+                          double out_max_dists[const])
+{
+	const idist_GowerData data = idist_gower_data(R_distances);
+	const size_t num_search = (search_indices == NULL) ? (size_t) data.num_data_points : len_search_indices;
+
+	#pragma omp parallel for schedule(static) if(num_queries >= DIST_GOWER_PAR_MIN_QUERIES)
+	for (int q = 0; q < num_queries; ++q) {
+		const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+		double max_dist = -1.0;
+		for (size_t s = 0; s < num_search; ++s) {
+			const int point = (search_indices == NULL) ? (int) s : search_indices[s] - index_base;
+			const double tmp_dist = idist_gower_dist(&data, query, point);
+			if (max_dist < tmp_dist) {
+				max_dist = tmp_dist;
+				out_max_indices[q] = point;
+			}
+		}
+		out_max_dists[q] = max_dist;
+	}
+}
+
+
+// Searches by scanning `points` as `idist_hamming_nn_search` does (see
+// `hamming.c`), with distances in the unit interval
+bool idist_gower_nn_search(const SEXP R_distances,
+                           const size_t num_points,
+                           const int points[const],
+                           const unsigned char removed[const],
+                           const int num_queries,
+                           const int query_indices[const],
+                           const uint32_t k,
+                           const bool radius_search,
+                           const double radius,
+                           const bool exclude_self,
+                           unsigned char out_query_ok[const],
+                           int out_nn_indices[const])
+{
+	const idist_GowerData data = idist_gower_data(R_distances);
+	const double max_dist = radius_search ? radius : R_PosInf;
+
+	double* const dist_scratch = malloc(sizeof(double) * k * (size_t) idist_num_threads());
+	if (dist_scratch == NULL) return false;
+
+	#pragma omp parallel for schedule(dynamic, 16) if(num_queries >= DIST_GOWER_PAR_MIN_QUERIES)
+	for (int q = 0; q < num_queries; ++q) {
+		const int query = (query_indices == NULL) ? q : query_indices[q];
+		double* const nn_dists = dist_scratch + (size_t) k * (size_t) idist_thread_num();
+		int* const nn_indices = out_nn_indices + (size_t) k * (size_t) q;
+
+		uint32_t num_found = 0;
+		double bound = max_dist;
+		for (size_t s = 0; s < num_points; ++s) {
+			if (removed != NULL && removed[s]) continue;
+			const int point = points[s];
+			if (exclude_self && point == query) continue;
+			const double tmp_dist = idist_gower_dist(&data, query, point);
+			if (tmp_dist > bound || (num_found == k && tmp_dist == bound)) continue;
+
+			uint32_t write = (num_found < k) ? num_found++ : k - 1;
+			for (; write > 0 && nn_dists[write - 1] > tmp_dist; --write) {
+				nn_dists[write] = nn_dists[write - 1];
+				nn_indices[write] = nn_indices[write - 1];
+			}
+			nn_dists[write] = tmp_dist;
+			nn_indices[write] = point;
+			if (num_found == k) bound = nn_dists[k - 1];
+		}
+		out_query_ok[q] = (num_found == k);
+	}
+
+	free(dist_scratch);
+	return true;
+}
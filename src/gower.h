@@ -0,0 +1,80 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+
+#ifndef DIST_GOWER_HG
+#define DIST_GOWER_HG
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <R.h>
+#include <Rinternals.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SEXP dist_make_category_matrix(SEXP R_categories,
+                               SEXP R_num_data_points);
+
+SEXP dist_scale_to_unit_range(SEXP R_data_matrix);
+
+void idist_gower_dist_matrix(SEXP R_distances,
+                             size_t len_indices,
+                             const int indices[],
+                             int index_base,
+                             double output_dists[]);
+
+void idist_gower_dist_columns(SEXP R_distances,
+                              size_t len_column_indices,
+                              const int column_indices[],
+                              size_t len_row_indices,
+                              const int row_indices[],
+                              int index_base,
+                              double output_dists[]);
+
+void idist_gower_max_dist(SEXP R_distances,
+                          int num_queries,
+                          const int query_indices[],
+                          size_t len_search_indices,
+                          const int search_indices[],
+                          int index_base,
+                          int out_max_indices[],
+                          double out_max_dists[]);
+
+bool idist_gower_nn_search(SEXP R_distances,
+                           size_t num_points,
+                           const int points[],
+                           const unsigned char removed[],
+                           int num_queries,
+                           const int query_indices[],
+                           uint32_t k,
+                           bool radius_search,
+                           double radius,
+                           bool exclude_self,
+                           unsigned char out_query_ok[],
+                           int out_nn_indices[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_GOWER_HG
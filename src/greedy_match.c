@@ -0,0 +1,382 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#include "greedy_match.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <R.h>
+#include <Rinternals.h>
+#include "error.h"
+#include "internal.h"
+#include "nn_search.h"
+#include "utils.h"
+
+
+static bool idist_greedy_match_base(SEXP R_distances,
+                                    size_t len_treated,
+                                    const int treated[],
+                                    size_t len_controls,
+                                    const int controls[],
+                                    int index_base,
+                                    uint32_t k,
+                                    bool radius_search,
+                                    double radius,
+                                    idist_MatchOrder order,
+                                    int out_matches[]);
+
+
+// Treated units waiting to be matched. `nn_indices` points to the unit's
+// current k nearest controls, and `key` is the squared distance to the
+// farthest of them (or the unit's position when matching in input order).
+typedef struct idist_MatchCandidate {
+	double key;
+	int position;
+	int* nn_indices;
+} idist_MatchCandidate;
+
+
+static inline bool idist_candidate_before(const idist_MatchCandidate* const a,
+                                          const idist_MatchCandidate* const b)
+{
+	return (a->key < b->key) || (a->key == b->key && a->position < b->position);
+}
+
+
+static void idist_heap_sift_down(idist_MatchCandidate* const heap,
+                                 const size_t len_heap,
+                                 size_t node)
+{
+	const idist_MatchCandidate tmp = heap[node];
+	for (size_t child = 2 * node + 1; child < len_heap; child = 2 * node + 1) {
+		if (child + 1 < len_heap && idist_candidate_before(&heap[child + 1], &heap[child])) ++child;
+		if (!idist_candidate_before(&heap[child], &tmp)) break;
+		heap[node] = heap[child];
+		node = child;
+	}
+	heap[node] = tmp;
+}
+
+
+static double idist_match_key(const SEXP R_distances,
+                              const int num_dimensions,
+                              const int query,
+                              const uint32_t k,
+                              const int nn_indices[const],
+                              const idist_Metric metric,
+                              const double p)
+{
+	double max_dist = 0.0;
+	if (metric == IDIST_METRIC_HAMMING) {
+		const size_t num_words = (size_t) num_dimensions / 8;
+		for (uint32_t i = 0; i < k; ++i) {
+			const double tmp_dist = (double) idist_get_hamming_dist(RAW(R_distances), num_words, query, nn_indices[i]);
+			if (tmp_dist > max_dist) max_dist = tmp_dist;
+		}
+		return max_dist;
+	}
+	if (metric == IDIST_METRIC_GOWER) {
+		SEXP R_categories = getAttrib(R_distances, install("categories"));
+		const int num_categorical = INTEGER(getAttrib(R_categories, R_DimSymbol))[0];
+		for (uint32_t i = 0; i < k; ++i) {
+			const double tmp_dist = idist_get_gower_dist(REAL(R_distances), num_dimensions,
+			                                             INTEGER(R_categories), num_categorical,
+			                                             query, nn_indices[i]);
+			if (tmp_dist > max_dist) max_dist = tmp_dist;
+		}
+		return max_dist;
+	}
+
+	const double* const raw_data_matrix = REAL(R_distances);
+	for (uint32_t i = 0; i < k; ++i) {
+		const double tmp_dist = idist_get_pow_dist(raw_data_matrix, num_dimensions, query, nn_indices[i], metric, p);
+		if (tmp_dist > max_dist) max_dist = tmp_dist;
+	}
+	return max_dist;
+}
+
+
+SEXP dist_greedy_match(const SEXP R_distances,
+                       const SEXP R_treated,
+                       const SEXP R_controls,
+                       const SEXP R_k,
+                       const SEXP R_radius,
+                       const SEXP R_order,
+                       const SEXP R_labels)
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(isInteger(R_treated));
+	idist_assert(isNull(R_controls) || isInteger(R_controls));
+	idist_assert(isInteger(R_k));
+	idist_assert(isNull(R_radius) || isReal(R_radius));
+	idist_assert(isString(R_order));
+	idist_assert(isLogical(R_labels));
+
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+
+	const int k_int = asInteger(R_k);
+	idist_assert(k_int > 0);
+	const uint32_t k = (uint32_t) k_int;
+
+	// Indices are read as R indices
+	const size_t len_treated = (size_t) xlength(R_treated);
+	const int* const treated = get_R_index_vector(R_treated, num_data_points);
+
+	SEXP R_controls_local = PROTECT(R_controls);
+	if (isNull(R_controls_local)) {
+		// Default to all data points that are not treated
+		UNPROTECT(1);
+		R_controls_local = PROTECT(allocVector(LGLSXP, num_data_points));
+		int* const is_control = LOGICAL(R_controls_local);
+		for (int i = 0; i < num_data_points; ++i) is_control[i] = TRUE;
+		for (size_t t = 0; t < len_treated; ++t) is_control[treated[t] - 1] = FALSE;
+		int num_controls = 0;
+		for (int i = 0; i < num_data_points; ++i) num_controls += is_control[i];
+		SEXP R_tmp_controls = PROTECT(allocVector(INTSXP, num_controls));
+		int* write = INTEGER(R_tmp_controls);
+		for (int i = 0; i < num_data_points; ++i) {
+			if (is_control[i]) *(write++) = i + 1;
+		}
+		UNPROTECT(2);
+		R_controls_local = PROTECT(R_tmp_controls);
+	}
+	const size_t len_controls = (size_t) xlength(R_controls_local);
+	const int* const controls = get_R_index_vector(R_controls_local, num_data_points);
+
+	// The controls make up the search set, so none may repeat
+	if (!isNull(R_controls)) {
+		char* const seen = R_alloc((size_t) num_data_points, sizeof(char));
+		memset(seen, 0, (size_t) num_data_points);
+		for (size_t c = 0; c < len_controls; ++c) {
+			if (seen[controls[c] - 1]) idist_error("`R_controls` may not contain duplicates.");
+			seen[controls[c] - 1] = 1;
+		}
+	}
+
+	const bool radius_search = isReal(R_radius);
+	const double radius = radius_search ? asReal(R_radius) : 0.0;
+	if (radius_search) idist_assert(radius > 0.0);
+
+	const idist_MatchOrder order = (strcmp(CHAR(asChar(R_order)), "closest") == 0) ?
+		IDIST_MATCH_ORDER_CLOSEST : IDIST_MATCH_ORDER_INPUT;
+
+	SEXP R_out_matches = PROTECT(allocMatrix(INTSXP, k, len_treated));
+	int* const out_matches = INTEGER(R_out_matches);
+
+	idist_assert(idist_greedy_match_base(R_distances,
+	                                     len_treated,
+	                                     treated,
+	                                     len_controls,
+	                                     controls,
+	                                     1,
+	                                     k,
+	                                     radius_search,
+	                                     radius,
+	                                     order,
+	                                     out_matches));
+
+	int* write = out_matches;
+	const int* const write_stop = write + k * len_treated;
+	for (; write != write_stop; ++write) {
+		*write = (*write < 0) ? NA_INTEGER : *write + 1;
+	}
+
+	if (asLogical(R_labels)) {
+		SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
+		SET_VECTOR_ELT(dimnames, 0, R_NilValue);
+		SET_VECTOR_ELT(dimnames, 1, get_labels(R_distances, R_treated));
+		setAttrib(R_out_matches, R_DimNamesSymbol, dimnames);
+		UNPROTECT(1);
+	}
+
+	UNPROTECT(2);
+	return R_out_matches;
+}
+
+
+bool idist_greedy_match(const SEXP R_distances,
+                        const size_t len_treated,
+                        const int treated[const],
+                        const size_t len_controls,
+                        const int controls[const],
+                        const uint32_t k,
+                        const bool radius_search,
+                        const double radius,
+                        const idist_MatchOrder order,
+                        int out_matches[const])
+{
+	return idist_greedy_match_base(R_distances, len_treated, treated, len_controls, controls, 0,
+	                               k, radius_search, radius, order, out_matches);
+}
+
+
+// Treated and control indices are read as `index - index_base`. Matches
+// are written as 0-based indices.
+static bool idist_greedy_match_base(const SEXP R_distances,
+                                    const size_t len_treated,
+                                    const int treated[const],
+                                    const size_t len_controls,
+                                    const int controls[const],
+                                    const int index_base,
+                                    const uint32_t k,
+                                    const bool radius_search,
+                                    const double radius,
+                                    const idist_MatchOrder order,
+                                    int out_matches[const])
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(treated != NULL || len_treated == 0);
+	idist_assert(k > 0);
+	idist_assert(out_matches != NULL || len_treated == 0);
+
+	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+	const size_t num_controls = (controls == NULL) ? (size_t) num_data_points : len_controls;
+	const idist_Metric metric = idist_get_metric(R_distances);
+	const double p = idist_get_minkowski_p(R_distances);
+
+	for (size_t i = 0; i < k * len_treated; ++i) {
+		out_matches[i] = -1;
+	}
+	if (len_treated == 0 || num_controls < k) return true;
+
+	// A treated unit that is also a control is never matched to itself
+
+	idist_NNSearchOptions options = idist_nn_search_default_options();
+	options.exclude_self = true;
+	options.index_base = index_base;
+
+	idist_NNSearch* nn_search_object;
+	if (!idist_init_nearest_neighbor_search_opt(R_distances,
+	                                            num_controls,
+	                                            controls,
+	                                            &options,
+	                                            &nn_search_object)) return false;
+
+	int* const nn_indices = malloc(sizeof(int) * k * len_treated);
+	int* const ok_treated = malloc(sizeof(int) * len_treated);
+	idist_MatchCandidate* const heap = malloc(sizeof(idist_MatchCandidate) * len_treated);
+	bool* const matched = calloc((size_t) num_data_points, sizeof(bool));
+	if (nn_indices == NULL || ok_treated == NULL || heap == NULL || matched == NULL) {
+		free(nn_indices);
+		free(ok_treated);
+		free(heap);
+		free(matched);
+		idist_close_nearest_neighbor_search(&nn_search_object);
+		return false;
+	}
+
+	// Search for all treated units at once. A unit's neighbors stay its
+	// nearest live controls until one of them is matched, so most units
+	// never need to search again. Units without neighbors here will not
+	// find any later, as controls are only removed.
+
+	size_t num_ok_treated;
+	bool ok = idist_nearest_neighbor_search(nn_search_object,
+	                                        len_treated,
+	                                        treated,
+	                                        k,
+	                                        radius_search,
+	                                        radius,
+	                                        &num_ok_treated,
+	                                        ok_treated,
+	                                        nn_indices);
+
+	size_t len_heap = 0;
+	for (size_t t = 0, ok_t = 0; ok && t < len_treated && ok_t < num_ok_treated; ++t) {
+		if (ok_treated[ok_t] != treated[t] - index_base) continue;
+		int* const candidate_nn = nn_indices + k * ok_t;
+		heap[len_heap++] = (idist_MatchCandidate) {
+			.key = (order == IDIST_MATCH_ORDER_CLOSEST) ?
+				idist_match_key(R_distances, num_dimensions, treated[t] - index_base, k, candidate_nn, metric, p) : (double) t,
+			.position = (int) t,
+			.nn_indices = candidate_nn,
+		};
+		++ok_t;
+	}
+
+	// Match the candidate with the smallest key. Keys never decrease when
+	// controls are removed, so a candidate whose neighbors were taken is
+	// searched again and put back in the heap with its new key.
+
+	for (size_t node = len_heap / 2; node > 0; --node) {
+		idist_heap_sift_down(heap, len_heap, node - 1);
+	}
+
+	size_t num_live_controls = num_controls;
+	while (ok && len_heap > 0) {
+		if (!radius_search && num_live_controls < k) break;
+		if (num_live_controls == 0) break;
+
+		idist_MatchCandidate candidate = heap[0];
+		const int query = treated[candidate.position];
+
+		bool taken = false;
+		for (uint32_t i = 0; i < k; ++i) {
+			taken = taken || matched[candidate.nn_indices[i]];
+		}
+
+		if (taken) {
+			size_t num_ok_query;
+			int ok_query;
+			ok = idist_nearest_neighbor_search(nn_search_object,
+			                                   1,
+			                                   &query,
+			                                   k,
+			                                   radius_search,
+			                                   radius,
+			                                   &num_ok_query,
+			                                   &ok_query,
+			                                   candidate.nn_indices);
+			if (!ok) break;
+			if (num_ok_query == 0) {
+				heap[0] = heap[--len_heap];
+				idist_heap_sift_down(heap, len_heap, 0);
+				continue;
+			}
+			if (order == IDIST_MATCH_ORDER_CLOSEST) {
+				heap[0].key = idist_match_key(R_distances, num_dimensions, query - index_base, k, candidate.nn_indices, metric, p);
+				idist_heap_sift_down(heap, len_heap, 0);
+				if (heap[0].position != candidate.position) continue;
+			}
+		}
+
+		int* const write = out_matches + k * (size_t) candidate.position;
+		for (uint32_t i = 0; i < k; ++i) {
+			write[i] = candidate.nn_indices[i];
+			matched[candidate.nn_indices[i]] = true;
+		}
+		ok = idist_nearest_neighbor_search_remove(nn_search_object, k, candidate.nn_indices);
+		num_live_controls -= k;
+
+		heap[0] = heap[--len_heap];
+		idist_heap_sift_down(heap, len_heap, 0);
+	}
+
+	free(nn_indices);
+	free(ok_treated);
+	free(heap);
+	free(matched);
+	idist_close_nearest_neighbor_search(&nn_search_object);
+
+	return ok;
+}
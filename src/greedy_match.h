@@ -0,0 +1,62 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_GREEDY_MATCH_HG
+#define DIST_GREEDY_MATCH_HG
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <R.h>
+#include <Rinternals.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	IDIST_MATCH_ORDER_INPUT,
+	IDIST_MATCH_ORDER_CLOSEST
+} idist_MatchOrder;
+
+SEXP dist_greedy_match(SEXP R_distances,
+                       SEXP R_treated,
+                       SEXP R_controls,
+                       SEXP R_k,
+                       SEXP R_radius,
+                       SEXP R_order,
+                       SEXP R_labels);
+
+bool idist_greedy_match(SEXP R_distances,
+                        size_t len_treated,
+                        const int treated[],
+                        size_t len_controls,
+                        const int controls[],
+                        uint32_t k,
+                        bool radius_search,
+                        double radius,
+                        idist_MatchOrder order,
+                        int out_matches[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ifndef DIST_GREEDY_MATCH_HG
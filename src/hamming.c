@@ -0,0 +1,249 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#include "hamming.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <R.h>
+#include <Rinternals.h>
+#include "error.h"
+#include "internal.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// On x86-64, the loops below are compiled both with and without the
+// POPCNT instruction, and the dynamic linker picks the version that the
+// CPU supports. Elsewhere, `__builtin_popcountll` uses the instruction
+// when the compiler targets it.
+#if defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute)
+	#if __has_attribute(target_clones)
+		#define DIST_POPCNT_CLONES __attribute__((target_clones("popcnt", "default")))
+	#endif
+#endif
+#ifndef DIST_POPCNT_CLONES
+	#define DIST_POPCNT_CLONES
+#endif
+
+// Nearest neighbor searches with fewer queries than this are not run
+// in parallel
+static const int DIST_HAMMING_PAR_MIN_QUERIES = 64;
+
+
+static inline int idist_num_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+static inline int idist_thread_num(void)
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+
+static inline size_t idist_num_words(const SEXP R_distances)
+{
+	return (size_t) INTEGER(getAttrib(R_distances, R_DimSymbol))[0] / 8;
+}
+
+
+// `R_data_matrix` holds data points as columns (see `dist_make_data_matrix`).
+// Returns a raw matrix with the coordinates of each data point packed as
+// bits, bit `j % 8` of byte `j / 8` holding coordinate `j`, padded with
+// zeros to a multiple of 64 bits. Returns `R_NilValue` if the data contain
+// other values than zero and one.
+SEXP dist_pack_binary_data(const SEXP R_data_matrix)
+{
+	idist_assert(isMatrix(R_data_matrix) && isReal(R_data_matrix));
+
+	const size_t num_dimensions = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[0];
+	const int num_data_points = INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[1];
+	const size_t num_bytes = 8 * ((num_dimensions + 63) / 64);
+	const double* const data_matrix = REAL(R_data_matrix);
+
+	SEXP R_bits = PROTECT(allocMatrix(RAWSXP, (int) num_bytes, num_data_points));
+	unsigned char* const bits = RAW(R_bits);
+	memset(bits, 0, num_bytes * (size_t) num_data_points);
+
+	for (size_t i = 0; i < (size_t) num_data_points; ++i) {
+		const double* const point = data_matrix + i * num_dimensions;
+		unsigned char* const point_bits = bits + i * num_bytes;
+		for (size_t j = 0; j < num_dimensions; ++j) {
+			if (point[j] == 1.0) {
+				point_bits[j / 8] |= (unsigned char) (1U << (j % 8));
+			} else if (point[j] != 0.0) {
+				UNPROTECT(1);
+				return R_NilValue;
+			}
+		}
+	}
+
+	UNPROTECT(1);
+	return R_bits;
+}
+
+
+DIST_POPCNT_CLONES
+void idist_hamming_dist_matrix(const SEXP R_distances,
+                               const size_t len_indices,
+                               const int indices[const],
+                               const int index_base,
+                               double output_dists[])
+{
+	const unsigned char* const raw_bits = RAW(R_distances);
+	const size_t num_words = idist_num_words(R_distances);
+	const size_t num_points = (indices == NULL) ? (size_t) INTEGER(getAttrib(R_distances, R_DimSymbol))[1] : len_indices;
+
+	for (size_t p1 = 0; p1 < num_points; ++p1) {
+		const int point1 = (indices == NULL) ? (int) p1 : indices[p1] - index_base;
+		for (size_t p2 = p1 + 1; p2 < num_points; ++p2) {
+			const int point2 = (indices == NULL) ? (int) p2 : indices[p2] - index_base;
+			*output_dists = (double) idist_get_hamming_dist(raw_bits, num_words, point1, point2);
+			++output_dists;
+		}
+	}
+}
+
+
+DIST_POPCNT_CLONES
+void idist_hamming_dist_columns(const SEXP R_distances,
+                                const size_t len_column_indices,
+                                const int column_indices[const],
+                                const size_t len_row_indices,
+                                const int row_indices[const],
+                                const int index_base,
+                                double output_dists[])
+{
+	const unsigned char* const raw_bits = RAW(R_distances);
+	const size_t num_words = idist_num_words(R_distances);
+	const size_t num_rows = (row_indices == NULL) ? (size_t) INTEGER(getAttrib(R_distances, R_DimSymbol))[1] : len_row_indices;
+
+	for (size_t c = 0; c < len_column_indices; ++c) {
+		for (size_t r = 0; r < num_rows; ++r) {
+			const int row = (row_indices == NULL) ? (int) r : row_indices[r] - index_base;
+			*output_dists = (double) idist_get_hamming_dist(raw_bits, num_words, column_indices[c] - index_base, row);
+			++output_dists;
+		}
+	}
+}
+
+
+DIST_POPCNT_CLONES
+void idist_hamming_max_dist(const SEXP R_distances,
+                            const int num_queries,
+                            const int query_indices[const],
+                            const size_t len_search_indices,
+                            const int search_indices[const],
+                            const int index_base,
+                            int out_max_indices[const],
+                            double out_max_dists[const])
+{
+	const unsigned char* const raw_bits = RAW(R_distances);
+	const size_t num_words = idist_num_words(R_distances);
+	const size_t num_search = (search_indices == NULL) ? (size_t) INTEGER(getAttrib(R_distances, R_DimSymbol))[1] : len_search_indices;
+
+	for (int q = 0; q < num_queries; ++q) {
+		const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+		int max_dist = -1;
+		for (size_t s = 0; s < num_search; ++s) {
+			const int point = (search_indices == NULL) ? (int) s : search_indices[s] - index_base;
+			const int tmp_dist = idist_get_hamming_dist(raw_bits, num_words, query, point);
+			if (max_dist < tmp_dist) {
+				max_dist = tmp_dist;
+				out_max_indices[q] = point;
+			}
+		}
+		out_max_dists[q] = (double) max_dist;
+	}
+}
+
+
+// Searches by scanning `points`, skipping those marked in `removed` (if
+// not NULL). The `k` nearest points found so far are kept sorted by
+// distance in an insertion buffer; a point replaces the current `k`th
+// only if it is strictly closer, so ties go to points earlier in
+// `points`. The neighbors of query `q` are written at `out_nn_indices +
+// q * k`, and `out_query_ok[q]` is set if `k` neighbors were found.
+DIST_POPCNT_CLONES
+bool idist_hamming_nn_search(const SEXP R_distances,
+                             const size_t num_points,
+                             const int points[const],
+                             const unsigned char removed[const],
+                             const int num_queries,
+                             const int query_indices[const],
+                             const uint32_t k,
+                             const bool radius_search,
+                             const double radius,
+                             const bool exclude_self,
+                             unsigned char out_query_ok[const],
+                             int out_nn_indices[const])
+{
+	const unsigned char* const raw_bits = RAW(R_distances);
+	const size_t num_words = idist_num_words(R_distances);
+
+	// Distances are whole numbers, so the radius can be rounded down
+	const int max_dist = (radius_search && radius < INT_MAX) ? (int) radius : INT_MAX;
+
+	int* const dist_scratch = malloc(sizeof(int) * k * (size_t) idist_num_threads());
+	if (dist_scratch == NULL) return false;
+
+	#pragma omp parallel for schedule(dynamic, 16) if(num_queries >= DIST_HAMMING_PAR_MIN_QUERIES)
+	for (int q = 0; q < num_queries; ++q) {
+		const int query = (query_indices == NULL) ? q : query_indices[q];
+		int* const nn_dists = dist_scratch + (size_t) k * (size_t) idist_thread_num();
+		int* const nn_indices = out_nn_indices + (size_t) k * (size_t) q;
+
+		uint32_t num_found = 0;
+		int bound = max_dist;
+		for (size_t s = 0; s < num_points; ++s) {
+			if (removed != NULL && removed[s]) continue;
+			const int point = points[s];
+			if (exclude_self && point == query) continue;
+			const int tmp_dist = idist_get_hamming_dist(raw_bits, num_words, query, point);
+			if (tmp_dist > bound || (num_found == k && tmp_dist == bound)) continue;
+
+			uint32_t write = (num_found < k) ? num_found++ : k - 1;
+			for (; write > 0 && nn_dists[write - 1] > tmp_dist; --write) {
+				nn_dists[write] = nn_dists[write - 1];
+				nn_indices[write] = nn_indices[write - 1];
+			}
+			nn_dists[write] = tmp_dist;
+			nn_indices[write] = point;
+			if (num_found == k) bound = nn_dists[k - 1];
+		}
+		out_query_ok[q] = (num_found == k);
+	}
+
+	free(dist_scratch);
+	return true;
+}
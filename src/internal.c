@@ -23,8 +23,179 @@
 #include <stdio.h>
 #include <R.h>
 #include <Rinternals.h>
+#include <Rversion.h>
+#include <R_ext/Rdynload.h>
 #include "error.h"
 
+// ALTREP vectors can be read by region from R 3.5.0, and ALTREP string
+// vectors can be made from R 3.6.0
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0)
+	#define DIST_INDEX_REGIONS
+#endif
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+	#define DIST_COMPACT_LABELS
+	#include <R_ext/Altrep.h>
+#endif
+
+// Unmaterialized index vectors are read in regions of this many elements
+#define DIST_INDEX_REGION_SIZE 4096
+
+// Index vectors shorter than this are not checked in parallel
+static const R_xlen_t DIST_INDEX_PAR_MIN_LENGTH = 65536;
+
+
+// Without IDs, the label of a data point is its R index as a string.
+// Compact label vectors produce these strings when their elements are
+// accessed rather than when the vector is made, so that large outputs do
+// not allocate (and cache) one string per data point unless the labels
+// are used. `data1` holds the R indices of the labels as an integer
+// vector, or the number of data points as a double scalar for the labels
+// "1" to "n". `data2` holds the string vector once it has been
+// materialized.
+
+#ifdef DIST_COMPACT_LABELS
+
+static R_altrep_class_t dist_compact_labels_class;
+
+
+static int idist_compact_label_index(const SEXP x,
+                                     const R_xlen_t i)
+{
+	const SEXP data1 = R_altrep_data1(x);
+	return isInteger(data1) ? INTEGER_ELT(data1, i) : (int) (i + 1);
+}
+
+
+static SEXP idist_compact_label(const int index)
+{
+	char tmp_str[32];
+	snprintf(tmp_str, 32, "%d", index);
+	return mkChar(tmp_str);
+}
+
+
+static R_xlen_t idist_compact_labels_length(const SEXP x)
+{
+	const SEXP data1 = R_altrep_data1(x);
+	return isInteger(data1) ? xlength(data1) : (R_xlen_t) REAL(data1)[0];
+}
+
+
+static SEXP idist_compact_labels_materialize(const SEXP x)
+{
+	SEXP data2 = R_altrep_data2(x);
+	if (data2 == R_NilValue) {
+		const R_xlen_t len_labels = idist_compact_labels_length(x);
+		data2 = PROTECT(allocVector(STRSXP, len_labels));
+		for (R_xlen_t i = 0; i < len_labels; ++i) {
+			SET_STRING_ELT(data2, i, idist_compact_label(idist_compact_label_index(x, i)));
+		}
+		R_set_altrep_data2(x, data2);
+		UNPROTECT(1);
+	}
+	return data2;
+}
+
+
+static SEXP idist_compact_labels_elt(const SEXP x,
+                                     const R_xlen_t i)
+{
+	const SEXP data2 = R_altrep_data2(x);
+	if (data2 != R_NilValue) return STRING_ELT(data2, i);
+	return idist_compact_label(idist_compact_label_index(x, i));
+}
+
+
+static void idist_compact_labels_set_elt(const SEXP x,
+                                         const R_xlen_t i,
+                                         const SEXP value)
+{
+	SET_STRING_ELT(idist_compact_labels_materialize(x), i, value);
+}
+
+
+static void* idist_compact_labels_dataptr(const SEXP x,
+                                          const Rboolean writeable)
+{
+	return (void*) STRING_PTR_RO(idist_compact_labels_materialize(x));
+}
+
+
+static const void* idist_compact_labels_dataptr_or_null(const SEXP x)
+{
+	const SEXP data2 = R_altrep_data2(x);
+	return (data2 == R_NilValue) ? NULL : (const void*) STRING_PTR_RO(data2);
+}
+
+
+static int idist_compact_labels_no_na(const SEXP x)
+{
+	return 1;
+}
+
+
+static Rboolean idist_compact_labels_inspect(const SEXP x,
+                                             const int pre,
+                                             const int deep,
+                                             const int pvec,
+                                             void (*inspect_subtree)(SEXP, int, int, int))
+{
+	Rprintf("distances compact labels (len=%d, materialized=%s)\n",
+	        (int) idist_compact_labels_length(x),
+	        (R_altrep_data2(x) == R_NilValue) ? "F" : "T");
+	return TRUE;
+}
+
+#endif // ifdef DIST_COMPACT_LABELS
+
+
+void idist_init_compact_labels(DllInfo* const info)
+{
+#ifdef DIST_COMPACT_LABELS
+	dist_compact_labels_class = R_make_altstring_class("dist_compact_labels", "distances", info);
+	R_set_altrep_Length_method(dist_compact_labels_class, idist_compact_labels_length);
+	R_set_altrep_Inspect_method(dist_compact_labels_class, idist_compact_labels_inspect);
+	R_set_altvec_Dataptr_method(dist_compact_labels_class, idist_compact_labels_dataptr);
+	R_set_altvec_Dataptr_or_null_method(dist_compact_labels_class, idist_compact_labels_dataptr_or_null);
+	R_set_altstring_Elt_method(dist_compact_labels_class, idist_compact_labels_elt);
+	R_set_altstring_Set_elt_method(dist_compact_labels_class, idist_compact_labels_set_elt);
+	R_set_altstring_No_NA_method(dist_compact_labels_class, idist_compact_labels_no_na);
+#endif
+}
+
+
+// Labels of the data points with (R) indices in `R_indices`, or of all
+// data points when `R_indices` is NULL and `num_data_points` is the
+// number of data points
+static SEXP idist_make_index_labels(const SEXP R_indices,
+                                    const int num_data_points)
+{
+#ifdef DIST_COMPACT_LABELS
+	if (isInteger(R_indices)) {
+		// The labels refer to their own copy of `R_indices`, so that the
+		// caller's vector stays mutable (compact sequences stay compact)
+		SEXP R_indices_copy = PROTECT(duplicate(R_indices));
+		SEXP out_labels = R_new_altrep(dist_compact_labels_class, R_indices_copy, R_NilValue);
+		UNPROTECT(1);
+		return out_labels;
+	}
+	SEXP R_num_data_points = PROTECT(ScalarReal((double) num_data_points));
+	SEXP out_labels = R_new_altrep(dist_compact_labels_class, R_num_data_points, R_NilValue);
+	UNPROTECT(1);
+	return out_labels;
+#else
+	const R_xlen_t len_labels = isInteger(R_indices) ? xlength(R_indices) : (R_xlen_t) num_data_points;
+	SEXP out_labels = PROTECT(allocVector(STRSXP, len_labels));
+	char tmp_str[32];
+	for (R_xlen_t p = 0; p < len_labels; ++p) {
+		snprintf(tmp_str, 32, "%d", isInteger(R_indices) ? INTEGER(R_indices)[p] : (int) (p + 1));
+		SET_STRING_ELT(out_labels, p, mkChar(tmp_str));
+	}
+	UNPROTECT(1);
+	return out_labels;
+#endif
+}
+
 
 SEXP get_labels(const SEXP R_distances,
                 const SEXP R_indices) {
@@ -34,21 +205,16 @@ SEXP get_labels(const SEXP R_distances,
 
 	SEXP out_labels;
 	if (isInteger(R_indices)) {
-		const size_t len_indices = (size_t) xlength(R_indices);
-		const int* const indices = INTEGER(R_indices);
-		out_labels = PROTECT(allocVector(STRSXP, (R_xlen_t) len_indices));
-
 		if (isString(R_ids)) {
+			const size_t len_indices = (size_t) xlength(R_indices);
+			const int* const indices = INTEGER(R_indices);
+			out_labels = PROTECT(allocVector(STRSXP, (R_xlen_t) len_indices));
 			for (size_t p = 0; p < len_indices; ++p) {
 				SET_STRING_ELT(out_labels, p, STRING_ELT(R_ids, indices[p] - 1));
 			}
 		} else {
 			idist_assert(isNull(R_ids));
-			char tmp_str[255];
-			for (size_t p = 0; p < len_indices; ++p) {
-				snprintf(tmp_str, 255, "%d", indices[p]);
-				SET_STRING_ELT(out_labels, p, mkChar(tmp_str));
-			}
+			out_labels = PROTECT(idist_make_index_labels(R_indices, num_data_points));
 		}
 
 	} else {
@@ -57,12 +223,7 @@ SEXP get_labels(const SEXP R_distances,
 			out_labels = PROTECT(R_ids);
 		} else {
 			idist_assert(isNull(R_ids));
-			out_labels = PROTECT(allocVector(STRSXP, (R_xlen_t) num_data_points));
-			char tmp_str[255];
-			for (int p = 0; p < num_data_points; ++p) {
-				snprintf(tmp_str, 255, "%d", p + 1);
-				SET_STRING_ELT(out_labels, p, mkChar(tmp_str));
-			}
+			out_labels = PROTECT(idist_make_index_labels(R_NilValue, num_data_points));
 		}
 	}
 
@@ -71,24 +232,90 @@ SEXP get_labels(const SEXP R_distances,
 }
 
 
-SEXP translate_R_index_vector__(const SEXP R_indices,
+// The elements of `R_indices`, or NULL if they are not in memory (e.g., the
+// compact sequence `1:n` before anything has asked for its data pointer).
+// Such vectors are read by region so that they are never expanded.
+static const int* idist_index_ptr_or_null(const SEXP R_indices)
+{
+#ifdef DIST_INDEX_REGIONS
+	return (const int*) DATAPTR_OR_NULL(R_indices);
+#else
+	return INTEGER(R_indices);
+#endif
+}
+
+
+// Whether `R_indices` is `1:upper_bound`
+static bool idist_is_all_indices(const SEXP R_indices,
+                                 const int upper_bound)
+{
+	const R_xlen_t len_indices = xlength(R_indices);
+	if (len_indices != (R_xlen_t) upper_bound) return false;
+
+	const int* const indices = idist_index_ptr_or_null(R_indices);
+	if (indices != NULL) {
+		for (R_xlen_t i = 0; i < len_indices; ++i) {
+			if (indices[i] != i + 1) return false;
+		}
+		return true;
+	}
+
+#ifdef DIST_INDEX_REGIONS
+	int region[DIST_INDEX_REGION_SIZE];
+	for (R_xlen_t start = 0; start < len_indices; start += DIST_INDEX_REGION_SIZE) {
+		const R_xlen_t len_region = INTEGER_GET_REGION(R_indices, start, DIST_INDEX_REGION_SIZE, region);
+		for (R_xlen_t i = 0; i < len_region; ++i) {
+			if (region[i] != start + i + 1) return false;
+		}
+	}
+#endif
+	return true;
+}
+
+
+// Stands in for the elements of empty index vectors, so that these are
+// not mistaken for NULL
+static const int idist_no_indices[1] = { 0 };
+
+
+// The (one-based) R indices in `R_indices`, after checking that they are
+// within bounds. Kernels read them with an index base of one, so the
+// vector is not copied. Returns NULL if `R_indices` is NULL, or if
+// `null_if_all` is true and `R_indices` is `1:upper_bound`. Vectors that
+// are not in memory (e.g., compact sequences other than `1:upper_bound`)
+// are read by region into memory that R frees when the call returns.
+const int* get_R_index_vector__(const SEXP R_indices,
                                 const int upper_bound,
+                                const bool null_if_all,
                                 const char* const msg,
                                 const char* const file,
                                 const int line)
 {
-	SEXP R_indices_local = PROTECT(duplicate(R_indices));
-	if (isInteger(R_indices_local)) {
-		int out_of_bounds = 0;
-		const int* const i_stop = INTEGER(R_indices_local) + xlength(R_indices_local);
-		for (int* i = INTEGER(R_indices_local); i != i_stop; ++i) {
-			--(*i);
-			out_of_bounds += (*i < 0) + (*i >= upper_bound);
-		}
-		if (out_of_bounds != 0) {
-			idist_error__(msg, file, line);
+	if (!isInteger(R_indices)) return NULL;
+	if (null_if_all && idist_is_all_indices(R_indices, upper_bound)) return NULL;
+
+	const R_xlen_t len_indices = xlength(R_indices);
+	if (len_indices == 0) return idist_no_indices;
+
+	const int* indices = idist_index_ptr_or_null(R_indices);
+#ifdef DIST_INDEX_REGIONS
+	if (indices == NULL) {
+		int* const read_indices = (int*) R_alloc((size_t) len_indices, sizeof(int));
+		for (R_xlen_t start = 0; start < len_indices; start += DIST_INDEX_REGION_SIZE) {
+			INTEGER_GET_REGION(R_indices, start, DIST_INDEX_REGION_SIZE, read_indices + start);
 		}
+		indices = read_indices;
 	}
-	UNPROTECT(1);
-	return R_indices_local;
+#endif
+
+	int out_of_bounds = 0;
+	#pragma omp parallel for schedule(static) reduction(|:out_of_bounds) if(len_indices >= DIST_INDEX_PAR_MIN_LENGTH)
+	for (R_xlen_t i = 0; i < len_indices; ++i) {
+		out_of_bounds |= (indices[i] < 1) | (indices[i] > upper_bound);
+	}
+
+	if (out_of_bounds != 0) {
+		idist_error__(msg, file, line);
+	}
+	return indices;
 }
@@ -21,16 +21,31 @@
 #ifndef DIST_INTERNAL_HG
 #define DIST_INTERNAL_HG
 
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <R.h>
 #include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+#include "utils.h"
 
-#define translate_R_index_vector(R_indices, upper_bound) (translate_R_index_vector__(R_indices, upper_bound, "Out of bounds: `" #R_indices "`.", __FILE__, __LINE__))
+// The indices in `R_indices` (see `get_R_index_vector__`), or NULL if it
+// is NULL
+#define get_R_index_vector(R_indices, upper_bound) (get_R_index_vector__(R_indices, upper_bound, false, "Out of bounds: `" #R_indices "`.", __FILE__, __LINE__))
+
+// As `get_R_index_vector`, but also returns NULL (all data points) when
+// `R_indices` is `1:upper_bound`
+#define get_R_index_subset(R_indices, upper_bound) (get_R_index_vector__(R_indices, upper_bound, true, "Out of bounds: `" #R_indices "`.", __FILE__, __LINE__))
+
+void idist_init_compact_labels(DllInfo* info);
 
 SEXP get_labels(SEXP R_distances,
                 SEXP R_indices);
 
-SEXP translate_R_index_vector__(SEXP R_indices,
+const int* get_R_index_vector__(SEXP R_indices,
                                 int upper_bound,
+                                bool null_if_all,
                                 const char* msg,
                                 const char* file,
                                 int line);
@@ -54,4 +69,148 @@ static inline double idist_get_sq_dist(const double* const raw_data_matrix,
 	return tmp_dist;
 }
 
+// The distance between two points raised to the power of the metric:
+// squared for Euclidean distances, to the `p`th power for Minkowski
+// distances and unchanged for Manhattan and maximum distances. These are
+// monotone in the distance, so searches compare them directly and only
+// reported distances are converted with `idist_pow_to_dist`.
+//
+// Cosine objects store data points of unit length, and the squared
+// Euclidean distance between two such points is twice their cosine
+// distance (one minus the cosine of the angle between them).
+//
+// Callers pass `metric` as a constant (see `get_dists.c`) so that the
+// switch is resolved when the function is inlined.
+static inline double idist_get_pow_dist_points(const double* data1,
+                                               const double* data2,
+                                               const int num_dimensions,
+                                               const idist_Metric metric,
+                                               const double p)
+{
+	const double* const data1_stop = data1 + num_dimensions;
+
+	double tmp_dist = 0.0;
+	if (metric == IDIST_METRIC_EUCLIDEAN || metric == IDIST_METRIC_COSINE) {
+		while (data1 != data1_stop) {
+			const double value_diff = (*data1 - *data2);
+			tmp_dist += value_diff * value_diff;
+			++data1;
+			++data2;
+		}
+		return tmp_dist;
+	}
+
+	while (data1 != data1_stop) {
+		const double value_diff = fabs(*data1 - *data2);
+		switch (metric) {
+		case IDIST_METRIC_MAXIMUM:
+			if (tmp_dist < value_diff) tmp_dist = value_diff;
+			break;
+		case IDIST_METRIC_MINKOWSKI:
+			tmp_dist += pow(value_diff, p);
+			break;
+		default:
+			tmp_dist += value_diff;
+			break;
+		}
+		++data1;
+		++data2;
+	}
+	return tmp_dist;
+}
+
+// `idist_get_pow_dist_points` for two data points in `raw_data_matrix`
+static inline double idist_get_pow_dist(const double* const raw_data_matrix,
+                                        const int num_dimensions,
+                                        const int index1,
+                                        const int index2,
+                                        const idist_Metric metric,
+                                        const double p)
+{
+	return idist_get_pow_dist_points(&raw_data_matrix[index1 * num_dimensions],
+	                                 &raw_data_matrix[index2 * num_dimensions],
+	                                 num_dimensions, metric, p);
+}
+
+// Hamming objects store each data point as bits packed into bytes, with
+// a multiple of eight bytes per point. The bytes are read as 64-bit words
+// (with `memcpy`, which compiles to a plain load), and the distance is
+// the number of set bits in their exclusive or.
+static inline int idist_popcount64(const uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(x);
+#else
+	uint64_t y = x - ((x >> 1) & 0x5555555555555555ULL);
+	y = (y & 0x3333333333333333ULL) + ((y >> 2) & 0x3333333333333333ULL);
+	y = (y + (y >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int) ((y * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline int idist_get_hamming_dist(const unsigned char* const raw_bits,
+                                         const size_t num_words,
+                                         const int index1,
+                                         const int index2)
+{
+	const unsigned char* const data1 = raw_bits + (size_t) index1 * num_words * 8;
+	const unsigned char* const data2 = raw_bits + (size_t) index2 * num_words * 8;
+
+	int tmp_dist = 0;
+	for (size_t w = 0; w < num_words; ++w) {
+		uint64_t word1, word2;
+		memcpy(&word1, data1 + 8 * w, 8);
+		memcpy(&word2, data2 + 8 * w, 8);
+		tmp_dist += idist_popcount64(word1 ^ word2);
+	}
+	return tmp_dist;
+}
+
+// Gower objects store numeric coordinates scaled to the unit interval
+// in the data matrix and categorical coordinates as integer codes in a
+// separate matrix. The distance is the mean over all coordinates of
+// the absolute differences of numeric coordinates and the mismatches
+// of categorical coordinates.
+static inline double idist_get_gower_dist(const double* const raw_data_matrix,
+                                          const int num_numeric,
+                                          const int* const categories,
+                                          const int num_categorical,
+                                          const int index1,
+                                          const int index2)
+{
+	if (num_numeric + num_categorical == 0) return 0.0;
+
+	const double* data1 = raw_data_matrix + (size_t) index1 * (size_t) num_numeric;
+	const double* data2 = raw_data_matrix + (size_t) index2 * (size_t) num_numeric;
+	double tmp_dist = 0.0;
+	for (int d = 0; d < num_numeric; ++d) {
+		tmp_dist += fabs(data1[d] - data2[d]);
+	}
+
+	const int* const codes1 = categories + (size_t) index1 * (size_t) num_categorical;
+	const int* const codes2 = categories + (size_t) index2 * (size_t) num_categorical;
+	int num_mismatches = 0;
+	for (int d = 0; d < num_categorical; ++d) {
+		num_mismatches += (codes1[d] != codes2[d]);
+	}
+
+	return (tmp_dist + (double) num_mismatches) / (double) (num_numeric + num_categorical);
+}
+
+static inline double idist_pow_to_dist(const double pow_dist,
+                                       const idist_Metric metric,
+                                       const double p)
+{
+	switch (metric) {
+	case IDIST_METRIC_EUCLIDEAN:
+		return sqrt(pow_dist);
+	case IDIST_METRIC_MINKOWSKI:
+		return pow(pow_dist, 1.0 / p);
+	case IDIST_METRIC_COSINE:
+		return pow_dist / 2.0;
+	default:
+		return pow_dist;
+	}
+}
+
 #endif // ifndef DIST_INTERNAL_HG
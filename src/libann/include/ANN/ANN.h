@@ -326,41 +326,33 @@ const ANNbool	ANN_ALLOW_SELF_MATCH	= ANNtrue;
 //				#				= max
 //				DIFF(x,y)		= y
 //
-//		By default the Euclidean norm is assumed.  To change the norm,
-//		uncomment the appropriate set of macros below.
+//		The macros below give the Euclidean norm, which is used by all
+//		search structures.  The L_1, L_inf and general L_p norms are
+//		also available in the standard and fixed-radius searches of
+//		kd-trees and bd-trees.  They are selected at run time by
+//		annSetMetric() (see below), and the searches then run versions
+//		of the routines that are instantiated for the chosen norm with
+//		the functions of the table above (see kd_metric.h).  As with
+//		the Euclidean norm, distances are given and returned raised to
+//		the power POW (i.e., without taking ROOT).
 //----------------------------------------------------------------------
 
-//----------------------------------------------------------------------
-//	Use the following for the Euclidean norm
-//----------------------------------------------------------------------
 #define ANN_POW(v)			((v)*(v))
 #define ANN_ROOT(x)			sqrt(x)
 #define ANN_SUM(x,y)		((x) + (y))
 #define ANN_DIFF(x,y)		((y) - (x))
 
 //----------------------------------------------------------------------
-//	Use the following for the L_1 (Manhattan) norm
+//	Metrics
+//		The norms that can be selected with annSetMetric().  The
+//		exponent p is only used by ANN_METRIC_LP.
 //----------------------------------------------------------------------
-// #define ANN_POW(v)		fabs(v)
-// #define ANN_ROOT(x)		(x)
-// #define ANN_SUM(x,y)		((x) + (y))
-// #define ANN_DIFF(x,y)	((y) - (x))
 
-//----------------------------------------------------------------------
-//	Use the following for a general L_p norm
-//----------------------------------------------------------------------
-// #define ANN_POW(v)		pow(fabs(v),p)
-// #define ANN_ROOT(x)		pow(fabs(x),1/p)
-// #define ANN_SUM(x,y)		((x) + (y))
-// #define ANN_DIFF(x,y)	((y) - (x))
-
-//----------------------------------------------------------------------
-//	Use the following for the L_infinity (Max) norm
-//----------------------------------------------------------------------
-// #define ANN_POW(v)		fabs(v)
-// #define ANN_ROOT(x)		(x)
-// #define ANN_SUM(x,y)		((x) > (y) ? (x) : (y))
-// #define ANN_DIFF(x,y)	(y)
+enum ANNmetric {
+		ANN_METRIC_L2			= 0,	// Euclidean norm (default)
+		ANN_METRIC_L1			= 1,	// Manhattan norm
+		ANN_METRIC_LINF			= 2,	// max norm
+		ANN_METRIC_LP			= 3};	// Minkowski norm with exponent p
 
 //----------------------------------------------------------------------
 //	Array types
@@ -483,6 +475,21 @@ DLL_API ANNpoint annCopyPt(
 //		outside a ball of radius r/(1+epsilon), where r is the given
 //		(unsquared) radius bound.
 //
+//		annCountRange only counts the points within a (squared) radius
+//		of the query point.  The trees (kd-, bd- and ball trees) do this
+//		exactly without visiting the points of subtrees whose cells lie
+//		inside the query ball (see kd_count.cpp).  The other structures
+//		call annkFRSearch with k = 0.
+//
+//		The trees also compute kernel sums, the sums over all points
+//		of a weight times a kernel of the distance to the query (see
+//		annKernelSum below and kd_kernel.cpp).
+//
+//		Some structures (the kd- and bd-trees) also allow points to be
+//		removed after construction with annDeletePt.  A removed point
+//		is never reported by later searches.  The other structures
+//		return ANNfalse.
+//
 //		The generic object from which all the search structures are
 //		dervied is given below.  It is a virtual object, and is useless
 //		by itself.
@@ -509,10 +516,19 @@ public:
 		double			eps=0.0			// error bound
 		) = 0;							// pure virtual (defined elsewhere)
 
+	virtual int annCountRange(			// count points in range
+		ANNpoint		q,				// query point
+		ANNdist			sqRad)			// squared radius
+		{ return annkFRSearch(q, sqRad, 0); }	// (by default, FR search)
+
 	virtual int theDim() = 0;			// return dimension of space
 	virtual int nPoints() = 0;			// return number of points
 										// return pointer to points
 	virtual ANNpointArray thePoints() = 0;
+
+	virtual ANNbool annDeletePt(		// remove point from the set
+		ANNidx			idx)			// index of point to remove
+		{ return ANNfalse; }			// (not supported by default)
 };
 
 //----------------------------------------------------------------------
@@ -535,10 +551,13 @@ public:
 //		performed by a simple linear scan of all the points.
 //----------------------------------------------------------------------
 
+class ANNmin_k;					// k-closest set (see src/pr_queue_k.h)
+
 class DLL_API ANNbruteForce: public ANNpointSet {
 	int				dim;				// dimension
 	int				n_pts;				// number of points
 	ANNpointArray	pts;				// point array
+	ANNmin_k		*search_mk;			// k-closest set (reused by searches)
 public:
 	ANNbruteForce(						// constructor from point array
 		ANNpointArray	pa,				// point array
@@ -609,6 +628,21 @@ enum ANNshrinkRule {
 		ANN_BD_SUGGEST			= 3};	// the authors' suggested choice
 const int ANN_N_SHRINK_RULES	= 4;	// number of shrink rules
 
+//----------------------------------------------------------------------
+//	Kernels for kernel sums
+//		annKernelSum (see below) sums weighted kernel values over the
+//		points of a kd-tree.  The kernels are functions of the squared
+//		distance s from the query, scaled by the squared bandwidth h^2.
+//		They are not normalized; both equal 1 at the query point.
+//
+//		ANN_KERN_GAUSS			exp(-s / (2 h^2))
+//		ANN_KERN_EPAN			max(0, 1 - s / h^2)  (Epanechnikov)
+//----------------------------------------------------------------------
+
+enum ANNkernel {
+		ANN_KERN_GAUSS			= 0,	// Gaussian kernel
+		ANN_KERN_EPAN			= 1};	// Epanechnikov kernel
+
 //----------------------------------------------------------------------
 //	kd-tree:
 //		The main search data structure supported by ANN is a kd-tree.
@@ -691,6 +725,10 @@ const int ANN_N_SHRINK_RULES	= 4;	// number of shrink rules
 //		bnd_box_lo				Bounding box low point
 //		bnd_box_hi				Bounding box high point
 //		splitRule				Splitting method used
+//		search_mk, search_pq	Search scratch, allocated on first
+//								search and reused by later ones
+//		kern_wts, kern_wt		Point weights for kernel sums and
+//								their total (see annSetWeights)
 //
 //----------------------------------------------------------------------
 
@@ -701,6 +739,7 @@ const int ANN_N_SHRINK_RULES	= 4;	// number of shrink rules
 class ANNkdStats;				// stats on kd-tree
 class ANNkd_node;				// generic node in a kd-tree
 typedef ANNkd_node*	ANNkd_ptr;	// pointer to a kd-tree node
+class ANNpr_queue;				// box queue (see src/pr_queue.h)
 
 class DLL_API ANNkd_tree: public ANNpointSet {
 protected:
@@ -712,6 +751,12 @@ protected:
 	ANNkd_ptr		root;				// root of kd-tree
 	ANNpoint		bnd_box_lo;			// bounding box low point
 	ANNpoint		bnd_box_hi;			// bounding box high point
+	ANNmin_k		*search_mk;			// k-closest set (reused by searches)
+	ANNpr_queue		*search_pq;			// box queue (reused by pri search)
+	ANNdist			*count_far;			// cell extents (reused by counts)
+	ANNdist			*kern_wts;			// point weights (NULL for unit)
+	ANNdist			kern_wt;			// total weight of live points
+	ANNbool			kern_weighed;		// node weights up to date?
 
 	void SkeletonTree(					// construct skeleton tree
 		int				n,				// number of points
@@ -760,6 +805,19 @@ public:
 		ANNdistArray	dd = NULL,		// dist to near neighbors (modified)
 		double			eps=0.0);		// error bound
 
+	int annCountRange(					// count points in range
+		ANNpoint		q,				// query point
+		ANNdist			sqRad);			// squared radius
+
+	void annSetWeights(					// set weights for kernel sums
+		ANNdistArray	wts);			// weights (NULL for unit weights)
+
+	ANNdist annKernelSum(				// weighted kernel sum
+		ANNpoint		q,				// query point
+		ANNkernel		kern,			// the kernel
+		ANNdist			sqBw,			// squared bandwidth
+		double			tol=0.0);		// error bound (per unit weight)
+
 	int theDim()						// return dimension of space
 		{ return dim; }
 
@@ -779,6 +837,9 @@ public:
 								
 	virtual void getStats(				// compute tree statistics
 		ANNkdStats&		st);			// the statistics (modified)
+
+	ANNbool annDeletePt(				// remove point from the tree
+		ANNidx			idx);			// index of point to remove
 };								
 
 //----------------------------------------------------------------------
@@ -814,10 +875,313 @@ public:
 		std::istream&	in);			// input stream for dump file
 };
 
+//----------------------------------------------------------------------
+//	Ball tree
+//		The ball tree is inherited from a kd-tree, and is searched with
+//		the same methods.  Its internal nodes bound each child by a ball
+//		rather than by a box, which prunes better than boxes in higher
+//		dimensions (say, beyond 20).  A node is split by projecting its
+//		points on the line through an approximately farthest pair of
+//		points, and cutting at the median of the projections.  See
+//		src/ball_tree.h for further information.
+//
+//		Ball trees cannot be dumped and read back.
+//----------------------------------------------------------------------
+
+class DLL_API ANNball_tree: public ANNkd_tree {
+public:
+	ANNball_tree(						// build from point array
+		ANNpointArray	pa,				// point array
+		int				n,				// number of points
+		int				dd,				// dimension
+		int				bs = 1);		// bucket size
+};
+
+//----------------------------------------------------------------------
+//	Hierarchical navigable small world graph (HNSW)
+//		The HNSW index of Malkov and Yashunin (IEEE TPAMI, 2020) is a
+//		layered proximity graph.  Every point is a node in layer 0, and
+//		each layer above holds a random subset of the layer below (each
+//		point reaches level l with probability 1/M^l).  Searches descend
+//		greedily through the upper layers and finish with a best-first
+//		search of layer 0 that keeps the ef closest points seen.
+//
+//		Unlike the trees above, searches are approximate even when eps
+//		is zero: a true neighbor may be missed.  Larger ef gives higher
+//		recall and slower searches.  (The value of eps is ignored.)
+//		A k-nearest neighbor search that finds fewer than k points
+//		(which can happen after many deletions) falls back to a scan
+//		of all points.  The count returned by annkFRSearch() is the
+//		number of points within the radius among those visited, so it
+//		is at most max(k, ef).
+//
+//		Construction:
+//		-------------
+//		The constructor is given the point array, number of points,
+//		dimension, the number of links per node M (2M in layer 0), the
+//		size of the candidate list used while inserting points
+//		(ef_construction), and the ef used by searches.  Points are
+//		inserted in parallel when ANN is compiled with OpenMP.  With
+//		several threads, the graph depends on the order in which the
+//		threads insert the points.  The point array is not copied.
+//
+//		There is also a "load" constructor that reads a graph written
+//		by Dump().  As for kd-trees, the dump must contain the points,
+//		which are allocated by the load constructor and are not
+//		deallocated with the graph.
+//
+//		Deletion:
+//		---------
+//		Deleted points are kept in the graph to route searches, but are
+//		not reported.
+//----------------------------------------------------------------------
+
+class ANNhnsw_scratch;			// search scratch (see src/hnsw.cpp)
+
+class DLL_API ANNhnsw: public ANNpointSet {
+	int				dim;				// dimension
+	int				n_pts;				// number of points
+	int				n_live;				// number of points not deleted
+	ANNpointArray	pts;				// point array
+	int				M;					// links per node (2M in layer 0)
+	int				ef_constr;			// candidates kept while building
+	int				ef_search;			// candidates kept while searching
+	int				max_level;			// highest layer
+	ANNidx			entry;				// entry point in highest layer
+	int				*level;				// highest layer of each point
+	ANNidx			**links;			// links of each point, by layer
+	ANNbool			*deleted;			// deleted points
+	ANNhnsw_scratch	*search_scr;		// search scratch (reused)
+
+	void Build();						// insert all points
+public:
+	ANNhnsw(							// build from point array
+		ANNpointArray	pa,				// point array
+		int				n,				// number of points
+		int				dd,				// dimension
+		int				m = 16,			// links per node
+		int				ef_construction = 200,	// candidates while building
+		int				ef = 50);		// candidates while searching
+
+	ANNhnsw(							// build from dump file
+		std::istream&	in);			// input stream for dump file
+
+	~ANNhnsw();							// destructor
+
+	void annkSearch(					// approx k near neighbor search
+		ANNpoint		q,				// query point
+		int				k,				// number of near neighbors to return
+		ANNidxArray		nn_idx,			// nearest neighbor array (modified)
+		ANNdistArray	dd,				// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound (ignored)
+
+	int annkFRSearch(					// approx fixed-radius kNN search
+		ANNpoint		q,				// query point
+		ANNdist			sqRad,			// squared radius
+		int				k = 0,			// number of near neighbors to return
+		ANNidxArray		nn_idx = NULL,	// nearest neighbor array (modified)
+		ANNdistArray	dd = NULL,		// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound (ignored)
+
+	void setEf(							// set candidates kept in searches
+		int				ef);			// the number of candidates
+
+	int theDim()						// return dimension of space
+		{ return dim; }
+
+	int nPoints()						// return number of points
+		{ return n_pts; }
+
+	ANNpointArray thePoints()			// return pointer to points
+		{  return pts;  }
+
+	void Dump(							// dump the graph
+		ANNbool			with_pts,		// print points as well?
+		std::ostream&	out);			// output stream
+
+	ANNbool annDeletePt(				// remove point from the graph
+		ANNidx			idx);			// index of point to remove
+};
+
+//----------------------------------------------------------------------
+//	Random-projection forest
+//		A forest of random-projection trees.  Each tree splits a set of
+//		points by the hyperplane halfway between two of its points,
+//		picked at random, until at most leaf_size points are left.  A
+//		search descends every tree to the leaf holding the query, and
+//		the exact distances to the union of these leaves' points give
+//		the result.
+//
+//		Like the HNSW graph, the forest is approximate: a true neighbor
+//		is missed if it is in none of the query's leaves.  More trees
+//		and larger leaves give higher recall and slower searches.  (The
+//		value of eps is ignored.)  A k-nearest neighbor search with
+//		fewer than k candidates falls back to a scan of all points, and
+//		annkFRSearch() counts only the points in range among the
+//		candidates.
+//
+//		The forest is much cheaper to build than an HNSW graph.  Each
+//		tree is built in O(n log n) time from its own fixed seed, and
+//		the trees are built in parallel when ANN is compiled with
+//		OpenMP; the forest is the same for any number of threads.
+//		The point array is not copied.  Deleted points are skipped by
+//		searches.
+//----------------------------------------------------------------------
+
+class ANNrp_tree;				// random-projection tree (see src/rp_forest.cpp)
+
+class DLL_API ANNrp_forest: public ANNpointSet {
+	int				dim;				// dimension
+	int				n_pts;				// number of points
+	int				n_live;				// number of points not deleted
+	ANNpointArray	pts;				// point array
+	int				n_trees;			// number of trees
+	int				leaf_size;			// max points per leaf
+	ANNrp_tree		**trees;			// the trees
+	ANNbool			*deleted;			// deleted points
+	unsigned		*mark;				// candidate marks (reused by searches)
+	unsigned		mark_tag;			// mark of current search
+	ANNidxArray		cand;				// candidates (reused by searches)
+	ANNmin_k		*search_mk;			// k-closest set (reused by searches)
+
+	int Candidates(						// collect candidates for query
+		ANNpoint		q);				// query point
+public:
+	ANNrp_forest(						// build from point array
+		ANNpointArray	pa,				// point array
+		int				n,				// number of points
+		int				dd,				// dimension
+		int				nt = 20,		// number of trees
+		int				ls = 64);		// max points per leaf
+
+	~ANNrp_forest();					// destructor
+
+	void annkSearch(					// approx k near neighbor search
+		ANNpoint		q,				// query point
+		int				k,				// number of near neighbors to return
+		ANNidxArray		nn_idx,			// nearest neighbor array (modified)
+		ANNdistArray	dd,				// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound (ignored)
+
+	int annkFRSearch(					// approx fixed-radius kNN search
+		ANNpoint		q,				// query point
+		ANNdist			sqRad,			// squared radius
+		int				k = 0,			// number of near neighbors to return
+		ANNidxArray		nn_idx = NULL,	// nearest neighbor array (modified)
+		ANNdistArray	dd = NULL,		// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound (ignored)
+
+	int theDim()						// return dimension of space
+		{ return dim; }
+
+	int nPoints()						// return number of points
+		{ return n_pts; }
+
+	ANNpointArray thePoints()			// return pointer to points
+		{  return pts;  }
+
+	ANNbool annDeletePt(				// remove point from the forest
+		ANNidx			idx);			// index of point to remove
+};
+
+//----------------------------------------------------------------------
+//	Product quantization
+//		The coordinates are split into n_sub groups (subspaces), and the
+//		part of each point in a subspace is replaced by the closest of
+//		at most 256 centroids, which are found with k-means on a sample
+//		of the points.  A point is then stored as n_sub one-byte codes,
+//		which for doubles is 8*dim/n_sub times smaller than the point.
+//
+//		A search computes the squared distances from the query to every
+//		centroid, and scans the codes adding up these distances (the
+//		asymmetric distance).  The n_rerank points with the smallest
+//		asymmetric distances are then ranked by their exact distances,
+//		which are computed from the point array.  The search is
+//		approximate: a true neighbor is missed if it is not in this
+//		short list.  (The value of eps is ignored.)  annkFRSearch()
+//		counts only the points in range in the short list.
+//
+//		The codebooks are trained from a fixed seed, and the training
+//		and the encoding of the points are done in parallel when ANN is
+//		compiled with OpenMP.  The point array is not copied; only the
+//		codes are stored, so the point array may be stored compactly
+//		elsewhere as long as it is available to re-rank the short list.
+//		Deleted points are skipped by searches.
+//----------------------------------------------------------------------
+
+class DLL_API ANNpq: public ANNpointSet {
+	int				dim;				// dimension
+	int				n_pts;				// number of points
+	int				n_live;				// number of points not deleted
+	ANNpointArray	pts;				// point array
+	int				n_sub;				// number of subspaces
+	int				n_cent;				// centroids per subspace
+	int				n_rerank;			// size of the short list
+	int				*sub_lo;			// first coordinate of each subspace
+	ANNcoord		*cents;				// centroids, by subspace
+	unsigned char	*codes;				// codes, n_sub per point
+	ANNbool			*deleted;			// deleted points
+	ANNdist			*lut;				// distances to centroids (reused)
+	ANNmin_k		*short_mk;			// short list (reused by searches)
+	ANNmin_k		*search_mk;			// k-closest set (reused by searches)
+
+	int ShortList(						// find the short list for query
+		ANNpoint		q,				// query point
+		int				k);				// number of near neighbors
+public:
+	ANNpq(								// build from point array
+		ANNpointArray	pa,				// point array
+		int				n,				// number of points
+		int				dd,				// dimension
+		int				m = 0,			// subspaces (0 = dd/4)
+		int				rerank = 100);	// size of the short list
+
+	~ANNpq();							// destructor
+
+	void annkSearch(					// approx k near neighbor search
+		ANNpoint		q,				// query point
+		int				k,				// number of near neighbors to return
+		ANNidxArray		nn_idx,			// nearest neighbor array (modified)
+		ANNdistArray	dd,				// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound (ignored)
+
+	int annkFRSearch(					// approx fixed-radius kNN search
+		ANNpoint		q,				// query point
+		ANNdist			sqRad,			// squared radius
+		int				k = 0,			// number of near neighbors to return
+		ANNidxArray		nn_idx = NULL,	// nearest neighbor array (modified)
+		ANNdistArray	dd = NULL,		// dist to near neighbors (modified)
+		double			eps=0.0);		// error bound (ignored)
+
+	int theDim()						// return dimension of space
+		{ return dim; }
+
+	int nPoints()						// return number of points
+		{ return n_pts; }
+
+	ANNpointArray thePoints()			// return pointer to points
+		{  return pts;  }
+
+	int codeSize()						// return bytes per point
+		{ return n_sub; }
+
+	ANNbool annDeletePt(				// remove point from the index
+		ANNidx			idx);			// index of point to remove
+};
+
 //----------------------------------------------------------------------
 //	Other functions
 //	annMaxPtsVisit		Sets a limit on the maximum number of points
 //						to visit in the search.
+//	annSetMetric		Sets the norm used by the following searches
+//						of kd-trees and bd-trees (see ANNmetric).
+//						Other searches and structures require
+//						ANN_METRIC_L2, its default.
+//	annExcludeIdx		Sets the index of a data point that the
+//						following searches skip (e.g., the query
+//						point itself). Unlike ANN_ALLOW_SELF_MATCH,
+//						other points at distance zero are kept.
+//						Pass ANN_NULL_IDX to exclude nothing.
 //  annClose			Can be called when all use of ANN is finished.
 //						It clears up a minor memory leak.
 //----------------------------------------------------------------------
@@ -825,6 +1189,13 @@ public:
 DLL_API void annMaxPtsVisit(	// max. pts to visit in search
 	int				maxPts);	// the limit
 
+DLL_API void annSetMetric(		// norm used in search
+	ANNmetric		metric,		// the norm
+	double			p = 2);		// exponent (ANN_METRIC_LP only)
+
+DLL_API void annExcludeIdx(		// data point to skip in search
+	ANNidx			idx);		// its index (or ANN_NULL_IDX)
+
 DLL_API void annClose();		// called to end use of ANN
 
 #endif
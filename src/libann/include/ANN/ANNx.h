@@ -58,6 +58,23 @@ enum ANNerr {ANNwarn = 0, ANNabort = 1};
 extern int		ANNmaxPtsVisited;	// maximum number of pts visited
 extern int		ANNptsVisited;		// number of pts visited in search
 
+//----------------------------------------------------------------------
+//	Excluded point
+//	Index of a data point that searches skip in the leaf scans. It
+//	is ANN_NULL_IDX (its default) when no point is excluded.
+//----------------------------------------------------------------------
+
+extern ANNidx	ANNexcludeIdx;		// index of point to skip
+
+//----------------------------------------------------------------------
+//	Metric
+//	Norm used by the standard and fixed-radius searches of kd-trees
+//	and bd-trees (see annSetMetric), and the exponent of the L_p norm.
+//----------------------------------------------------------------------
+
+extern ANNmetric	ANNactiveMetric;	// norm used in search
+extern double		ANNminkowskiP;		// exponent of L_p norm
+
 //----------------------------------------------------------------------
 //	Global function declarations
 //----------------------------------------------------------------------
@@ -71,6 +88,24 @@ void annPrintPt(				// print a point
 	int				dim,		// the dimension
 	std::ostream	&out);		// output stream
 
+//----------------------------------------------------------------------
+//	Random numbers
+//	annRanBits returns 64 random bits from the splitmix64 generator
+//	with state x. The randomized search structures (HNSW graphs and
+//	random-projection forests) draw from fixed seeds, so that they
+//	are reproducible and do not disturb R's random number generator.
+//----------------------------------------------------------------------
+
+inline unsigned long long annRanBits(	// next random bits
+	unsigned long long &x)		// generator state (modified)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	unsigned long long z = x;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
 //----------------------------------------------------------------------
 //	Orthogonal (axis aligned) rectangle
 //	Orthogonal rectangles are represented by two points, one
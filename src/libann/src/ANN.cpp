@@ -190,6 +190,26 @@ void annError(const char* msg, ANNerr level)
 int	ANNmaxPtsVisited = 0;	// maximum number of pts visited
 int	ANNptsVisited;			// number of pts visited in search
 
+//----------------------------------------------------------------------
+//	Excluded point
+//		A search can be told to skip one data point by its index. This
+//		is used for "all nearest neighbors" style queries where the
+//		query is itself a data point. Only the index is checked, so
+//		duplicates of the query point are still reported.
+//----------------------------------------------------------------------
+
+ANNidx	ANNexcludeIdx = ANN_NULL_IDX;	// index of point to skip
+
+//----------------------------------------------------------------------
+//	Metric
+//		The norm used by the standard and fixed-radius searches of
+//		kd-trees and bd-trees.  The Euclidean norm is the default; the
+//		others are handled by the routines in kd_metric_search.cpp.
+//----------------------------------------------------------------------
+
+ANNmetric	ANNactiveMetric = ANN_METRIC_L2;	// norm used in search
+double		ANNminkowskiP = 2;					// exponent of L_p norm
+
 //----------------------------------------------------------------------
 //	Global function declarations
 //----------------------------------------------------------------------
@@ -199,3 +219,20 @@ void annMaxPtsVisit(			// set limit on max. pts to visit in search
 {
 	ANNmaxPtsVisited = maxPts;
 }
+
+void annSetMetric(				// set norm used in search
+	ANNmetric			metric,			// the norm
+	double				p)				// exponent (ANN_METRIC_LP only)
+{
+	if (metric == ANN_METRIC_LP && !(p >= 1)) {
+		annError("Minkowski exponent must be at least 1", ANNabort);
+	}
+	ANNactiveMetric = metric;
+	ANNminkowskiP = p;
+}
+
+void annExcludeIdx(				// set index of point to skip in search
+	ANNidx				idx)			// the index (or ANN_NULL_IDX)
+{
+	ANNexcludeIdx = idx;
+}
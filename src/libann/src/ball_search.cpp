@@ -0,0 +1,168 @@
+//----------------------------------------------------------------------
+// File:			ball_search.cpp
+// Description:		Standard, priority and fixed-radius ball-tree search
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include "ball_tree.h"					// ball-tree declarations
+#include "kd_search.h"					// kd-tree search declarations
+#include "kd_pr_search.h"				// kd priority search declarations
+#include "kd_fix_rad_search.h"			// kd fixed-radius search declarations
+#include "kd_count.h"					// kd range count declarations
+#include "kd_kernel.h"					// kd kernel sum declarations
+
+//----------------------------------------------------------------------
+//	Approximate searching for ball trees.
+//		Ball trees are searched with the kd-tree search routines (see
+//		kd_search.cpp, kd_pr_search.cpp and kd_fix_rad_search.cpp),
+//		which set up the global search state and handle the leaves.
+//		Here we include the extensions for ball nodes.
+//
+//		The distance passed to a ball node is a lower bound for the
+//		node itself.  The node computes lower bounds for its children
+//		from their balls, and visits the closer child first.
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+//	ball_split::ann_search - search a ball node
+//----------------------------------------------------------------------
+
+void ANNball_split::ann_search(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+										// check dist calc term condition
+	if (ANNmaxPtsVisited != 0 && ANNptsVisited > ANNmaxPtsVisited) return;
+
+	ANNdist lo_dist = annBallDist(ANNkdQ, ctr[ANN_LO], rad[ANN_LO], dim);
+	ANNdist hi_dist = annBallDist(ANNkdQ, ctr[ANN_HI], rad[ANN_HI], dim);
+	int near = (lo_dist <= hi_dist) ? ANN_LO : ANN_HI;
+	ANNdist near_dist = (near == ANN_LO) ? lo_dist : hi_dist;
+	ANNdist far_dist = (near == ANN_LO) ? hi_dist : lo_dist;
+
+										// visit closer child if close enough
+	if (near_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
+		child[near]->ann_search(near_dist);
+										// visit further child if close enough
+	if (far_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
+		child[1-near]->ann_search(far_dist);
+
+	ANN_FLOP(6*dim)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	ball_split::ann_pri_search - search a ball node
+//----------------------------------------------------------------------
+
+void ANNball_split::ann_pri_search(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	ANNdist lo_dist = annBallDist(ANNprQ, ctr[ANN_LO], rad[ANN_LO], dim);
+	ANNdist hi_dist = annBallDist(ANNprQ, ctr[ANN_HI], rad[ANN_HI], dim);
+	int near = (lo_dist <= hi_dist) ? ANN_LO : ANN_HI;
+	ANNdist near_dist = (near == ANN_LO) ? lo_dist : hi_dist;
+	ANNdist far_dist = (near == ANN_LO) ? hi_dist : lo_dist;
+
+	if (child[1-near] != KD_TRIVIAL)	// enqueue further if not trivial
+		ANNprBoxPQ->insert(far_dist, child[1-near]);
+										// continue with closer child
+	if (near_dist * ANNprMaxErr < ANNprPointMK->max_key())
+		child[near]->ann_pri_search(near_dist);
+
+	ANN_FLOP(6*dim)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	ball_split::ann_FR_search - search a ball node
+//----------------------------------------------------------------------
+
+void ANNball_split::ann_FR_search(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+										// check dist calc term condition
+	if (ANNmaxPtsVisited != 0 && ANNkdFRPtsVisited > ANNmaxPtsVisited) return;
+
+	ANNdist lo_dist = annBallDist(ANNkdFRQ, ctr[ANN_LO], rad[ANN_LO], dim);
+	ANNdist hi_dist = annBallDist(ANNkdFRQ, ctr[ANN_HI], rad[ANN_HI], dim);
+
+										// visit children if in range
+	if (lo_dist * ANNkdFRMaxErr <= ANNkdFRSqRad)
+		child[ANN_LO]->ann_FR_search(lo_dist);
+	if (hi_dist * ANNkdFRMaxErr <= ANNkdFRSqRad)
+		child[ANN_HI]->ann_FR_search(hi_dist);
+
+	ANN_FLOP(6*dim)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	ball_split::ann_count - count in a ball node
+//		The squared distance from q to the farthest point of a ball
+//		with center c and radius r is (|q - c| + r)^2.  A child may
+//		hold the excluded point if the point is in the child's ball.
+//		(The upper bound for the cell of this node is not needed.)
+//----------------------------------------------------------------------
+
+void ANNball_split::ann_count(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	for (int c = ANN_LO; c <= ANN_HI; c++) {
+		ANNdist ctr_dist = annDist(dim, ANNkdCntQ, ctr[c]);
+		ANNdist gap = ANN_ROOT(ctr_dist) - rad[c];
+		ANNdist near_dist = (gap > 0) ? ANN_POW(gap) : 0;
+		if (near_dist > ANNkdCntSqRad) continue;	// child outside the ball
+
+		ANNdist far_dist = ANN_POW(ANN_ROOT(ctr_dist) + rad[c]);
+		ANNbool ex_c = (ex_in &&
+			annDist(dim, ANNkdCntEx, ctr[c]) <= ANN_POW(rad[c])) ? ANNtrue : ANNfalse;
+		if (!ex_c && ANN_ALLOW_SELF_MATCH &&
+			far_dist * ANN_CNT_SLACK <= ANNkdCntSqRad)	// child inside the ball
+			ANNkdCntInRange += child[c]->n_live();
+		else
+			child[c]->ann_count(near_dist, far_dist, ex_c);
+	}
+
+	ANN_FLOP(8*dim)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	ball_split::ann_weigh, ann_kernel - kernel sums in a ball node
+//		The bounds on the distances to a child are those of the range
+//		count.  The upper bound is computed directly, so it is exact.
+//----------------------------------------------------------------------
+
+ANNdist ANNball_split::ann_weigh(ANNdistArray wts)
+{
+	wt[ANN_LO] = child[ANN_LO]->ann_weigh(wts);
+	wt[ANN_HI] = child[ANN_HI]->ann_weigh(wts);
+	return wt[ANN_LO] + wt[ANN_HI];
+}
+
+void ANNball_split::ann_kernel(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	for (int c = ANN_LO; c <= ANN_HI; c++) {
+		ANNdist ctr_dist = annDist(dim, ANNkdKerQ, ctr[c]);
+		ANNdist gap = ANN_ROOT(ctr_dist) - rad[c];
+		ANNdist near_dist = (gap > 0) ? ANN_POW(gap) : 0;
+		if (near_dist >= ANNkdKerCut) continue;	// child beyond the support
+
+		ANNdist far_dist = ANN_POW(ANN_ROOT(ctr_dist) + rad[c]);
+		ANNbool ex_c = (ex_in &&
+			annDist(dim, ANNkdKerEx, ctr[c]) <= ANN_POW(rad[c])) ? ANNtrue : ANNfalse;
+		if (!annKerCell(near_dist, far_dist, ANNtrue, wt[c], ex_c))
+			child[c]->ann_kernel(near_dist, far_dist, ex_c);
+	}
+
+	ANN_FLOP(8*dim)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
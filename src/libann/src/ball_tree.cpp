@@ -0,0 +1,294 @@
+//----------------------------------------------------------------------
+// File:			ball_tree.cpp
+// Description:		Basic methods for ball trees.
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include "ball_tree.h"					// ball-tree declarations
+#include "kd_util.h"					// kd-tree utilities
+#include <ANN/ANNperf.h>				// performance evaluation
+
+#include <algorithm>					// std::nth_element
+#include <new>							// std::bad_alloc
+#ifdef _OPENMP
+#include <omp.h>						// OpenMP (parallel build)
+#endif
+
+//----------------------------------------------------------------------
+//	Printing and dumping
+//		Ball trees cannot be read back from a dump file, so dumping a
+//		ball node is an error.
+//----------------------------------------------------------------------
+
+void ANNball_split::print(				// print ball node
+		int level,						// depth of node in tree
+		ostream &out)					// output stream
+{
+	child[ANN_HI]->print(level+1, out);	// print high child
+	out << "    ";
+	for (int i = 0; i < level; i++)		// print indentation
+		out << "..";
+	out << "Ball lrad=" << rad[ANN_LO];
+	out << " hrad=" << rad[ANN_HI];
+	out << "\n";
+	child[ANN_LO]->print(level+1, out);	// print low child
+}
+
+void ANNball_split::dump(				// dump ball node
+		ostream &out)					// output stream
+{
+	annError("Ball trees cannot be dumped", ANNabort);
+}
+
+//----------------------------------------------------------------------
+//	ball_split::getStats - get subtree statistics
+//		Leaves are given the bounding box of the whole tree, so their
+//		aspect ratios are not meaningful.
+//----------------------------------------------------------------------
+
+void ANNball_split::getStats(					// get subtree statistics
+	int					dim,					// dimension of space
+	ANNkdStats			&st,					// stats (modified)
+	ANNorthRect			&bnd_box)				// bounding box
+{
+	ANNkdStats ch_stats;						// stats for children
+	ch_stats.reset();							// reset
+	child[ANN_LO]->getStats(dim, ch_stats, bnd_box);
+	st.merge(ch_stats);							// merge them
+	ch_stats.reset();							// reset
+	child[ANN_HI]->getStats(dim, ch_stats, bnd_box);
+	st.merge(ch_stats);							// merge them
+
+	st.depth++;									// increment depth
+	st.n_spl++;									// increment number of splits
+}
+
+//----------------------------------------------------------------------
+//	annBallBound - compute the ball of a set of points
+//		The center is the centroid of the points, and the radius is the
+//		largest distance from it to a point (inflated by
+//		ANN_BALL_RAD_SLACK).
+//----------------------------------------------------------------------
+
+static void annBallBound(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	ANNpoint			&ctr,			// center (returned)
+	ANNdist				&rad)			// radius (returned)
+{
+	ctr = annAllocPt(dim, 0);
+	for (int i = 0; i < n; i++) {		// sum of the points
+		ANNpoint pp = pa[pidx[i]];
+		for (int d = 0; d < dim; d++) ctr[d] += pp[d];
+	}
+	for (int d = 0; d < dim; d++) ctr[d] /= n;
+
+	ANNdist max_dist = 0;				// farthest point from center
+	for (int i = 0; i < n; i++) {
+		ANNdist dist = annDist(dim, ctr, pa[pidx[i]]);
+		if (dist > max_dist) max_dist = dist;
+	}
+	rad = ANN_ROOT(max_dist) * ANN_BALL_RAD_SLACK;
+}
+
+//----------------------------------------------------------------------
+//	annBallSplit - split a set of points in two halves
+//		Finds an approximately farthest pair of points a and b (a is
+//		the point farthest from the first point, and b the point
+//		farthest from a), projects the points on the line through a
+//		and b, and partitions pidx at the median projection.  Returns
+//		the number of points on the low side, which is n/2.
+//----------------------------------------------------------------------
+
+struct ANNball_proj {					// projection of a point
+	ANNcoord			val;			// projected value
+	ANNidx				idx;			// point index
+	bool operator<(const ANNball_proj &o) const
+		{ return val < o.val || (val == o.val && idx < o.idx); }
+};
+
+static int annBallFarthest(				// index of farthest point from p
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	ANNpoint			p)				// the point
+{
+	ANNidx far_idx = pidx[0];
+	ANNdist far_dist = -1;
+	for (int i = 0; i < n; i++) {
+		ANNdist dist = annDist(dim, p, pa[pidx[i]]);
+		if (dist > far_dist) {
+			far_dist = dist;
+			far_idx = pidx[i];
+		}
+	}
+	return far_idx;
+}
+
+static int annBallSplit(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices (permuted on return)
+	int					n,				// number of points
+	int					dim)			// dimension of space
+{
+	ANNpoint a = pa[annBallFarthest(pa, pidx, n, dim, pa[pidx[0]])];
+	ANNpoint b = pa[annBallFarthest(pa, pidx, n, dim, a)];
+
+	ANNball_proj *proj = new ANNball_proj[n];
+	for (int i = 0; i < n; i++) {		// project on line through a and b
+		ANNpoint pp = pa[pidx[i]];
+		ANNcoord val = 0;
+		for (int d = 0; d < dim; d++) val += (pp[d] - a[d]) * (b[d] - a[d]);
+		proj[i].val = val;
+		proj[i].idx = pidx[i];
+	}
+	int n_lo = n/2;						// split at the median
+	std::nth_element(proj, proj + n_lo, proj + n);
+	for (int i = 0; i < n; i++) pidx[i] = proj[i].idx;
+	delete [] proj;
+	return n_lo;
+}
+
+//----------------------------------------------------------------------
+//	rball_tree - recursive procedure to build a ball tree
+//		Builds a ball tree for points in pa as indexed through the
+//		array pidx[0..n-1], in the same way as rkd_tree() builds a
+//		kd-tree.  Subtrees with many points are built in parallel.
+//----------------------------------------------------------------------
+
+static ANNkd_ptr rball_tree(			// recursive construction of ball tree
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices to store in subtree
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	int					bsp)			// bucket space
+{
+	if (n <= bsp) {						// n small, make a leaf node
+		if (n == 0)						// empty leaf node
+			return KD_TRIVIAL;			// return (canonical) empty leaf
+		else							// construct the node and return
+			return new ANNkd_leaf(n, pidx, pa, dim);
+	}
+
+	int n_lo = annBallSplit(pa, pidx, n, dim);
+
+	ANNpoint lo_ctr, hi_ctr;			// balls of the children
+	ANNdist lo_rad, hi_rad;
+	annBallBound(pa, pidx, n_lo, dim, lo_ctr, lo_rad);
+	try {
+		annBallBound(pa, pidx + n_lo, n-n_lo, dim, hi_ctr, hi_rad);
+	}
+	catch (...) {
+		annDeallocPt(lo_ctr);
+		throw;
+	}
+
+	ANNkd_node *lo = NULL, *hi = NULL;	// low and high children
+	try {
+#ifdef _OPENMP
+		if (n >= ANN_PAR_BUILD_MIN_PTS && omp_in_parallel()) {
+			ANNbool lo_failed = ANNfalse;
+			#pragma omp task shared(lo, lo_failed)
+			{
+				try {					// build low subtree as a task
+					lo = rball_tree(pa, pidx, n_lo, dim, bsp);
+				}
+				catch (...) {
+					lo = NULL;
+					lo_failed = ANNtrue;
+				}
+			}
+			try {						// build high subtree ourselves
+				hi = rball_tree(pa, pidx + n_lo, n-n_lo, dim, bsp);
+			}
+			catch (...) {
+				#pragma omp taskwait
+				throw;
+			}
+			#pragma omp taskwait
+			if (lo_failed) throw std::bad_alloc();
+		}
+		else
+#endif
+		{
+			lo = rball_tree(pa, pidx, n_lo, dim, bsp);
+			hi = rball_tree(pa, pidx + n_lo, n-n_lo, dim, bsp);
+		}
+										// create the ball node
+		return new ANNball_split(dim, lo_ctr, lo_rad, hi_ctr, hi_rad, lo, hi);
+	}
+	catch (...) {
+		annDeleteSubtree(lo);
+		annDeleteSubtree(hi);
+		annDeallocPt(lo_ctr);
+		annDeallocPt(hi_ctr);
+		throw;
+	}
+}
+
+//----------------------------------------------------------------------
+//	rball_tree_root - build a ball tree from the root
+//		Opens a parallel region for large point sets, as rkd_tree_root()
+//		does for kd-trees.
+//----------------------------------------------------------------------
+
+static ANNkd_ptr rball_tree_root(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices to store in tree
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	int					bsp)			// bucket space
+{
+#ifdef _OPENMP
+	if (n >= 2*ANN_PAR_BUILD_MIN_PTS && omp_get_max_threads() > 1) {
+		ANNkd_ptr root = NULL;
+		ANNbool failed = ANNfalse;
+		#pragma omp parallel shared(root, failed)
+		#pragma omp single
+		{
+			try {
+				root = rball_tree(pa, pidx, n, dim, bsp);
+			}
+			catch (...) {
+				failed = ANNtrue;
+			}
+		}
+		if (failed) throw std::bad_alloc();
+		return root;
+	}
+#endif
+	return rball_tree(pa, pidx, n, dim, bsp);
+}
+
+//----------------------------------------------------------------------
+// ball-tree constructor
+//		The bounding box of the points is computed as for kd-trees, since
+//		the searches inherited from the kd-tree start from it.
+//----------------------------------------------------------------------
+
+ANNball_tree::ANNball_tree(				// construct from point array
+	ANNpointArray		pa,				// point array (with at least n pts)
+	int					n,				// number of points
+	int					dd,				// dimension
+	int					bs)				// bucket size
+	: ANNkd_tree(n, dd, bs)				// build skeleton base tree
+{
+	pts = pa;							// where the points are
+	if (n == 0) return;					// no points--no sweat
+
+	ANNorthRect bnd_box(dd);			// bounding box for points
+										// construct bounding rectangle
+	annEnclRect(pa, pidx, n, dd, bnd_box);
+										// copy to tree structure
+	bnd_box_lo = annCopyPt(dd, bnd_box.lo);
+	bnd_box_hi = annCopyPt(dd, bnd_box.hi);
+
+	root = rball_tree_root(pa, pidx, n, dd, bs);
+}
@@ -0,0 +1,117 @@
+//----------------------------------------------------------------------
+// File:			ball_tree.h
+// Description:		Declarations for ball-tree routines
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#ifndef ANN_ball_tree_H
+#define ANN_ball_tree_H
+
+#include <ANN/ANNx.h>					// all ANN includes
+#include "kd_tree.h"					// kd-tree includes
+
+//----------------------------------------------------------------------
+//	Ball-tree splitting node.
+//		The ball tree is inherited from a kd-tree.  It uses the kd-tree's
+//		leaves, but its internal nodes bound each child by a ball (a
+//		center and a radius) instead of by an orthogonal box.  Boxes
+//		are poor bounds in high dimensions, where nearly every box
+//		crossed by the query ball touches it along some axis.
+//
+//		A ball node stores the balls of both of its children, so the
+//		distance from the query to each child is found when the node
+//		is visited.  The lower bound on the squared distance from q to
+//		any point in a child with center c and radius r is
+//
+//			max(0, |q - c| - r)^2.
+//
+//		The radii are inflated by the factor ANN_BALL_RAD_SLACK when
+//		the tree is built, so that rounding in |q - c| never makes the
+//		bound exceed the computed distance to a point in the ball.
+//
+//		BEWARE: As with the bd-tree's shrinking nodes, the constructor
+//		just copies the pointer to the centers, but the destructor
+//		deallocates them.
+//----------------------------------------------------------------------
+
+const double ANN_BALL_RAD_SLACK	= 1.0 + 1e-9;	// radius inflation
+
+class ANNball_split : public ANNkd_node	// splitting node of a ball tree
+{
+	ANNpoint			ctr[2];			// centers of children's balls
+	ANNdist				rad[2];			// radii of children's balls
+	ANNkd_ptr			child[2];		// low and high children
+	int					n_lv;			// no. of live points below
+	ANNdist				wt[2];			// weights of children (kernel sums)
+	int					dim;			// dimension of centers
+public:
+	ANNball_split(						// constructor
+		int dd,							// dimension of space
+		ANNpoint lc_ctr, ANNdist lc_rad,		// ball of low child
+		ANNpoint hc_ctr, ANNdist hc_rad,		// ball of high child
+		ANNkd_ptr lc=NULL, ANNkd_ptr hc=NULL)	// children
+		{
+			dim				= dd;
+			ctr[ANN_LO]		= lc_ctr;			// set balls
+			rad[ANN_LO]		= lc_rad;
+			ctr[ANN_HI]		= hc_ctr;
+			rad[ANN_HI]		= hc_rad;
+			child[ANN_LO]	= lc;				// set children
+			child[ANN_HI]	= hc;
+			wt[ANN_LO]		= wt[ANN_HI] = 0;	// no weights yet
+			n_lv = (lc != NULL ? lc->n_live() : 0)
+				 + (hc != NULL ? hc->n_live() : 0);
+		}
+
+	~ANNball_split()					// destructor
+		{
+			if (child[ANN_LO]!= NULL && child[ANN_LO]!= KD_TRIVIAL)
+				delete child[ANN_LO];
+			if (child[ANN_HI]!= NULL && child[ANN_HI]!= KD_TRIVIAL)
+				delete child[ANN_HI];
+			annDeallocPt(ctr[ANN_LO]);			// delete centers
+			annDeallocPt(ctr[ANN_HI]);
+		}
+
+	virtual void getStats(						// get tree statistics
+				int dim,						// dimension of space
+				ANNkdStats &st,					// statistics
+				ANNorthRect &bnd_box);			// bounding box
+	virtual void print(int level, ostream &out);// print node
+	virtual void dump(ostream &out);			// dump node
+
+	virtual void ann_search(ANNdist);			// standard search
+	virtual void ann_pri_search(ANNdist);		// priority search
+	virtual void ann_FR_search(ANNdist); 		// fixed-radius search
+	virtual void ann_count(ANNdist, ANNdist, ANNbool);	// range count
+	virtual void ann_kernel(ANNdist, ANNdist, ANNbool);	// kernel sum
+	virtual ANNdist ann_weigh(ANNdistArray);	// total weight
+
+	virtual int n_live() { return n_lv; }
+	virtual ANNbool ann_delete(ANNidx i, ANNpoint p);
+};
+
+//----------------------------------------------------------------------
+//	annBallDist - lower bound on squared distance from q to a ball
+//----------------------------------------------------------------------
+
+inline ANNdist annBallDist(
+	const ANNcoord		*q,				// query point
+	const ANNcoord		*c,				// center of ball
+	ANNdist				r,				// radius of ball
+	int					dim)			// dimension of space
+{
+	ANNdist dist = 0;
+	for (int d = 0; d < dim; d++) {
+		ANNcoord t = q[d] - c[d];
+		dist = ANN_SUM(dist, ANN_POW(t));
+	}
+	ANNdist gap = ANN_ROOT(dist) - r;	// distance to surface of ball
+	return (gap > 0) ? ANN_POW(gap) : 0;
+}
+
+#endif
@@ -24,6 +24,8 @@
 
 #include "bd_tree.h"					// bd-tree declarations
 #include "kd_fix_rad_search.h"			// kd-tree FR search declarations
+#include "kd_count.h"					// kd-tree range count declarations
+#include "kd_kernel.h"					// kd-tree kernel sum declarations
 
 //----------------------------------------------------------------------
 //	Approximate searching for bd-trees.
@@ -38,6 +40,7 @@
 
 void ANNbd_shrink::ann_FR_search(ANNdist box_dist)
 {
+	if (n_lv == 0) return;				// all points below deleted
 												// check dist calc term cond.
 	if (ANNmaxPtsVisited != 0 && ANNptsVisited > ANNmaxPtsVisited) return;
 
@@ -59,3 +62,58 @@ void ANNbd_shrink::ann_FR_search(ANNdist box_dist)
 	ANN_FLOP(3*n_bnds)							// increment floating ops
 	ANN_SHR(1)									// one more shrinking node
 }
+
+//----------------------------------------------------------------------
+//	bd_shrink::ann_count - count in a shrinking node
+//		Both children lie in the cell of this node, so its upper bound
+//		is passed to both, and both may hold the excluded point.
+//----------------------------------------------------------------------
+
+void ANNbd_shrink::ann_count(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	ANNdist inner_dist = 0;						// distance to inner box
+	for (int i = 0; i < n_bnds; i++) {			// is query point in the box?
+		if (bnds[i].out(ANNkdCntQ)) {			// outside this bounding side?
+												// add to inner distance
+			inner_dist = (ANNdist) ANN_SUM(inner_dist, bnds[i].dist(ANNkdCntQ));
+		}
+	}
+	if (inner_dist <= ANNkdCntSqRad)			// inner box in range
+		child[ANN_IN]->ann_count(inner_dist, box_far, ex_in);
+	child[ANN_OUT]->ann_count(box_dist, box_far, ex_in);
+	ANN_FLOP(3*n_bnds)							// increment floating ops
+	ANN_SHR(1)									// one more shrinking node
+}
+
+//----------------------------------------------------------------------
+//	bd_shrink::ann_weigh, ann_kernel - kernel sums in a shrinking node
+//		The bounds are those of the range count.
+//----------------------------------------------------------------------
+
+ANNdist ANNbd_shrink::ann_weigh(ANNdistArray wts)
+{
+	wt[ANN_IN] = child[ANN_IN]->ann_weigh(wts);
+	wt[ANN_OUT] = child[ANN_OUT]->ann_weigh(wts);
+	return wt[ANN_IN] + wt[ANN_OUT];
+}
+
+void ANNbd_shrink::ann_kernel(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	ANNdist inner_dist = 0;						// distance to inner box
+	for (int i = 0; i < n_bnds; i++) {			// is query point in the box?
+		if (bnds[i].out(ANNkdKerQ)) {			// outside this bounding side?
+												// add to inner distance
+			inner_dist = (ANNdist) ANN_SUM(inner_dist, bnds[i].dist(ANNkdKerQ));
+		}
+	}
+	if (!annKerCell(inner_dist, box_far, ANNfalse, wt[ANN_IN], ex_in))
+		child[ANN_IN]->ann_kernel(inner_dist, box_far, ex_in);
+	if (!annKerCell(box_dist, box_far, ANNfalse, wt[ANN_OUT], ex_in))
+		child[ANN_OUT]->ann_kernel(box_dist, box_far, ex_in);
+	ANN_FLOP(3*n_bnds)							// increment floating ops
+	ANN_SHR(1)									// one more shrinking node
+}
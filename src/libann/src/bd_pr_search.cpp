@@ -38,6 +38,7 @@
 
 void ANNbd_shrink::ann_pri_search(ANNdist box_dist)
 {
+	if (n_lv == 0) return;				// all points below deleted
 	ANNdist inner_dist = 0;						// distance to inner box
 	for (int i = 0; i < n_bnds; i++) {			// is query point in the box?
 		if (bnds[i].out(ANNprQ)) {				// outside this bounding side?
@@ -38,6 +38,7 @@
 
 void ANNbd_shrink::ann_search(ANNdist box_dist)
 {
+	if (n_lv == 0) return;				// all points below deleted
 												// check dist calc term cond.
 	if (ANNmaxPtsVisited != 0 && ANNptsVisited > ANNmaxPtsVisited) return;
 
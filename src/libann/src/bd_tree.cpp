@@ -32,6 +32,11 @@
 
 #include <ANN/ANNperf.h>				// performance evaluation
 
+#include <new>							// std::bad_alloc
+#ifdef _OPENMP
+#include <omp.h>						// OpenMP (parallel build)
+#endif
+
 //----------------------------------------------------------------------
 //	Printing a bd-tree 
 //		These routines print a bd-tree.   See the analogous procedure
@@ -113,6 +118,47 @@ ANNkd_ptr rbd_tree(						// recursive construction of bd-tree
 	ANNkd_splitter		splitter,		// splitting routine
 	ANNshrinkRule		shrink);		// shrinking rule
 
+//----------------------------------------------------------------------
+//	rbd_tree_root - build a bd-tree from the root
+//		As rkd_tree_root() in kd_tree.cpp.
+//----------------------------------------------------------------------
+
+static ANNkd_ptr rbd_tree_root(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices to store in tree
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	int					bsp,			// bucket space
+	ANNorthRect			&bnd_box,		// bounding box
+	ANNkd_splitter		splitter,		// splitting routine
+	ANNshrinkRule		shrink)			// shrinking rule
+{
+	if (shrink != ANN_BD_NONE && shrink != ANN_BD_SIMPLE &&
+		shrink != ANN_BD_CENTROID && shrink != ANN_BD_SUGGEST) {
+										// check here, not inside tasks
+		annError("Illegal shrinking rule", ANNabort);
+	}
+#ifdef _OPENMP
+	if (n >= 2*ANN_PAR_BUILD_MIN_PTS && omp_get_max_threads() > 1) {
+		ANNkd_ptr root = NULL;
+		ANNbool failed = ANNfalse;
+		#pragma omp parallel shared(root, failed)
+		#pragma omp single
+		{
+			try {
+				root = rbd_tree(pa, pidx, n, dim, bsp, bnd_box, splitter, shrink);
+			}
+			catch (...) {
+				failed = ANNtrue;
+			}
+		}
+		if (failed) throw std::bad_alloc();
+		return root;
+	}
+#endif
+	return rbd_tree(pa, pidx, n, dim, bsp, bnd_box, splitter, shrink);
+}
+
 ANNbd_tree::ANNbd_tree(					// construct from point array
 	ANNpointArray		pa,				// point array (with at least n pts)
 	int					n,				// number of points
@@ -134,20 +180,20 @@ ANNbd_tree::ANNbd_tree(					// construct from point array
 
 	switch (split) {					// build by rule
 	case ANN_KD_STD:					// standard kd-splitting rule
-		root = rbd_tree(pa, pidx, n, dd, bs, bnd_box, kd_split, shrink);
+		root = rbd_tree_root(pa, pidx, n, dd, bs, bnd_box, kd_split, shrink);
 		break;
 	case ANN_KD_MIDPT:					// midpoint split
-		root = rbd_tree(pa, pidx, n, dd, bs, bnd_box, midpt_split, shrink);
+		root = rbd_tree_root(pa, pidx, n, dd, bs, bnd_box, midpt_split, shrink);
 		break;
 	case ANN_KD_SUGGEST:				// best (in our opinion)
 	case ANN_KD_SL_MIDPT:				// sliding midpoint split
-		root = rbd_tree(pa, pidx, n, dd, bs, bnd_box, sl_midpt_split, shrink);
+		root = rbd_tree_root(pa, pidx, n, dd, bs, bnd_box, sl_midpt_split, shrink);
 		break;
 	case ANN_KD_FAIR:					// fair split
-		root = rbd_tree(pa, pidx, n, dd, bs, bnd_box, fair_split, shrink);
+		root = rbd_tree_root(pa, pidx, n, dd, bs, bnd_box, fair_split, shrink);
 		break;
 	case ANN_KD_SL_FAIR:				// sliding fair split
-		root = rbd_tree(pa, pidx, n, dd, bs,
+		root = rbd_tree_root(pa, pidx, n, dd, bs,
 						bnd_box, sl_fair_split, shrink);
 		break;
 	default:
@@ -350,7 +396,7 @@ ANNkd_ptr rbd_tree(				// recursive construction of bd-tree
 		if (n == 0)						// empty leaf node
 			return KD_TRIVIAL;			// return (canonical) empty leaf
 		else							// construct the node and return
-			return new ANNkd_leaf(n, pidx); 
+			return new ANNkd_leaf(n, pidx, pa, dim);
 	}
 	
 	decomp = selectDecomp(				// select decomposition method
@@ -369,18 +415,57 @@ ANNkd_ptr rbd_tree(				// recursive construction of bd-tree
 
 		ANNcoord lv = bnd_box.lo[cd];	// save bounds for cutting dimension
 		ANNcoord hv = bnd_box.hi[cd];
-
-		bnd_box.hi[cd] = cv;			// modify bounds for left subtree
-		ANNkd_ptr lo = rbd_tree(		// build left subtree
-				pa, pidx, n_lo,			// ...from pidx[0..n_lo-1]
-				dim, bsp, bnd_box, splitter, shrink);
-		bnd_box.hi[cd] = hv;			// restore bounds
-
-		bnd_box.lo[cd] = cv;			// modify bounds for right subtree
-		ANNkd_ptr hi = rbd_tree(		// build right subtree
-				pa, pidx + n_lo, n-n_lo,// ...from pidx[n_lo..n-1]
-				dim, bsp, bnd_box, splitter, shrink);
-		bnd_box.lo[cd] = lv;			// restore bounds
+		ANNkd_ptr lo, hi;				// low and high children
+
+#ifdef _OPENMP
+		if (n >= ANN_PAR_BUILD_MIN_PTS && omp_in_parallel()) {
+			ANNorthRect lo_box(dim, bnd_box);	// private box for left task
+			ANNbool lo_failed = ANNfalse;
+			lo_box.hi[cd] = cv;
+			#pragma omp task shared(lo, lo_box, lo_failed)
+			{
+				try {					// build left subtree as a task
+					lo = rbd_tree(pa, pidx, n_lo, dim, bsp, lo_box,
+							splitter, shrink);
+				}
+				catch (...) {
+					lo = NULL;
+					lo_failed = ANNtrue;
+				}
+			}
+			bnd_box.lo[cd] = cv;		// build right subtree ourselves
+			try {
+				hi = rbd_tree(pa, pidx + n_lo, n-n_lo, dim, bsp, bnd_box,
+						splitter, shrink);
+			}
+			catch (...) {
+				bnd_box.lo[cd] = lv;
+				#pragma omp taskwait
+				annDeleteSubtree(lo);
+				throw;
+			}
+			bnd_box.lo[cd] = lv;		// restore bounds
+			#pragma omp taskwait
+			if (lo_failed) {
+				annDeleteSubtree(hi);
+				throw std::bad_alloc();
+			}
+		}
+		else
+#endif
+		{
+			bnd_box.hi[cd] = cv;		// modify bounds for left subtree
+			lo = rbd_tree(				// build left subtree
+					pa, pidx, n_lo,		// ...from pidx[0..n_lo-1]
+					dim, bsp, bnd_box, splitter, shrink);
+			bnd_box.hi[cd] = hv;		// restore bounds
+
+			bnd_box.lo[cd] = cv;		// modify bounds for right subtree
+			hi = rbd_tree(				// build right subtree
+					pa, pidx + n_lo, n-n_lo,// ...from pidx[n_lo..n-1]
+					dim, bsp, bnd_box, splitter, shrink);
+			bnd_box.lo[cd] = lv;		// restore bounds
+		}
 										// create the splitting node
 		return new ANNkd_split(cd, cv, lv, hv, lo, hi);
 	}
@@ -396,10 +481,45 @@ ANNkd_ptr rbd_tree(				// recursive construction of bd-tree
 				inner_box,				// inner box
 				n_in);					// number of points inside (returned)
 
-		ANNkd_ptr in = rbd_tree(		// build inner subtree pidx[0..n_in-1]
-				pa, pidx, n_in, dim, bsp, inner_box, splitter, shrink);
-		ANNkd_ptr out = rbd_tree(		// build outer subtree pidx[n_in..n]
-				pa, pidx+n_in, n - n_in, dim, bsp, bnd_box, splitter, shrink);
+		ANNkd_ptr in, out;				// inner and outer children
+
+#ifdef _OPENMP
+		if (n >= ANN_PAR_BUILD_MIN_PTS && omp_in_parallel()) {
+			ANNbool in_failed = ANNfalse;	// inner box is ours already
+			#pragma omp task shared(in, inner_box, in_failed)
+			{
+				try {					// build inner subtree as a task
+					in = rbd_tree(pa, pidx, n_in, dim, bsp, inner_box,
+							splitter, shrink);
+				}
+				catch (...) {
+					in = NULL;
+					in_failed = ANNtrue;
+				}
+			}
+			try {						// build outer subtree ourselves
+				out = rbd_tree(pa, pidx+n_in, n - n_in, dim, bsp, bnd_box,
+						splitter, shrink);
+			}
+			catch (...) {
+				#pragma omp taskwait
+				annDeleteSubtree(in);
+				throw;
+			}
+			#pragma omp taskwait
+			if (in_failed) {
+				annDeleteSubtree(out);
+				throw std::bad_alloc();
+			}
+		}
+		else
+#endif
+		{
+			in = rbd_tree(				// build inner subtree pidx[0..n_in-1]
+					pa, pidx, n_in, dim, bsp, inner_box, splitter, shrink);
+			out = rbd_tree(				// build outer subtree pidx[n_in..n]
+					pa, pidx+n_in, n - n_in, dim, bsp, bnd_box, splitter, shrink);
+		}
 
 		ANNorthHSArray bnds = NULL;		// bounds (alloc in Box2Bnds and
 										// ...freed in bd_shrink destroyer)
@@ -63,6 +63,8 @@ class ANNbd_shrink : public ANNkd_node	// splitting node of a kd-tree
 	int					n_bnds;			// number of bounding halfspaces
 	ANNorthHSArray		bnds;			// list of bounding halfspaces
 	ANNkd_ptr			child[2];		// in and out children
+	int					n_lv;			// no. of live points below
+	ANNdist				wt[2];			// weights of children (kernel sums)
 public:
 	ANNbd_shrink(						// constructor
 		int				nb,				// number of bounding halfspaces
@@ -73,6 +75,9 @@ public:
 			bnds			= bds;				// assign bounds
 			child[ANN_IN]	= ic;				// set children
 			child[ANN_OUT]	= oc;
+			wt[ANN_IN]		= wt[ANN_OUT] = 0;	// no weights yet
+			n_lv = (ic != NULL ? ic->n_live() : 0)
+				 + (oc != NULL ? oc->n_live() : 0);
 		}
 
 	~ANNbd_shrink()						// destructor
@@ -95,6 +100,21 @@ public:
 	virtual void ann_search(ANNdist);			// standard search
 	virtual void ann_pri_search(ANNdist);		// priority search
 	virtual void ann_FR_search(ANNdist); 		// fixed-radius search
+	virtual void ann_count(ANNdist, ANNdist, ANNbool);	// range count
+	virtual void ann_kernel(ANNdist, ANNdist, ANNbool);	// kernel sum
+	virtual ANNdist ann_weigh(ANNdistArray);	// total weight
+
+	virtual void ann_search_l1(ANNdist);		// searches in other metrics
+	virtual void ann_search_linf(ANNdist);
+	virtual void ann_search_lp(ANNdist);
+	virtual void ann_FR_search_l1(ANNdist);
+	virtual void ann_FR_search_linf(ANNdist);
+	virtual void ann_FR_search_lp(ANNdist);
+	template <class M> void ann_msearch(ANNdist);		// instantiated
+	template <class M> void ann_mFR_search(ANNdist);	// ...per metric
+
+	virtual int n_live() { return n_lv; }
+	virtual ANNbool ann_delete(ANNidx i, ANNpoint p);
 };
 
 #endif
@@ -34,7 +34,8 @@
 //		queue (which is implemented in a pretty dumb way as well).
 //
 //		If ANN_ALLOW_SELF_MATCH is ANNfalse then data points at distance
-//		zero are not considered.
+//		zero are not considered. The point with index ANNexcludeIdx is
+//		never considered.
 //
 //		Note that the error bound eps is passed in, but it is ignored.
 //		These routines compute exact nearest neighbors (which is needed
@@ -47,9 +48,13 @@ ANNbruteForce::ANNbruteForce(			// constructor from point array
 	int					dd)				// dimension
 {
 	dim = dd;  n_pts = n;  pts = pa;
+	search_mk = NULL;					// allocated on first search
 }
 
-ANNbruteForce::~ANNbruteForce() { }		// destructor (empty)
+ANNbruteForce::~ANNbruteForce()			// destructor
+{
+	if (search_mk != NULL) delete search_mk;
+}
 
 void ANNbruteForce::annkSearch(			// approx k near neighbor search
 	ANNpoint			q,				// query point
@@ -58,7 +63,7 @@ void ANNbruteForce::annkSearch(			// approx k near neighbor search
 	ANNdistArray		dd,				// dist to near neighbors (returned)
 	double				eps)			// error bound (ignored)
 {
-	ANNmin_k mk(k);						// construct a k-limited priority queue
+	ANNmin_k &mk = *annReuseMinK(search_mk, k);	// k-limited priority queue
 	int i;
 
 	if (k > n_pts) {					// too many near neighbors?
@@ -67,6 +72,7 @@ void ANNbruteForce::annkSearch(			// approx k near neighbor search
 										// run every point through queue
 	for (i = 0; i < n_pts; i++) {
 										// compute distance to point
+		if (i == ANNexcludeIdx) continue;
 		ANNdist sqDist = annDist(dim, pts[i], q);
 		if (ANN_ALLOW_SELF_MATCH || sqDist != 0)
 			mk.insert(sqDist, i);
@@ -85,12 +91,13 @@ int ANNbruteForce::annkFRSearch(		// approx fixed-radius kNN search
 	ANNdistArray		dd,				// dist to near neighbors (returned)
 	double				eps)			// error bound
 {
-	ANNmin_k mk(k);						// construct a k-limited priority queue
+	ANNmin_k &mk = *annReuseMinK(search_mk, k);	// k-limited priority queue
 	int i;
 	int pts_in_range = 0;				// number of points in query range
 										// run every point through queue
 	for (i = 0; i < n_pts; i++) {
 										// compute distance to point
+		if (i == ANNexcludeIdx) continue;
 		ANNdist sqDist = annDist(dim, pts[i], q);
 		if (sqDist <= sqRad &&			// within radius bound
 			(ANN_ALLOW_SELF_MATCH || sqDist != 0)) { // ...and no self match
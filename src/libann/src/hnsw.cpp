@@ -0,0 +1,783 @@
+//----------------------------------------------------------------------
+// File:			hnsw.cpp
+// Description:		Hierarchical navigable small world graphs
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include <ANN/ANNx.h>					// all ANN includes
+#include "pr_queue_k.h"					// k element priority queue
+
+#include <algorithm>					// heaps and sorting
+#include <cmath>						// log
+#include <cstring>						// strcmp
+#include <new>							// std::bad_alloc
+#include <vector>						// candidate lists
+#ifdef _OPENMP
+#include <omp.h>						// OpenMP (parallel build)
+#endif
+
+using namespace std;					// make std:: available
+
+//----------------------------------------------------------------------
+//	Constants
+//		ANN_HNSW_PAR_MIN_PTS	Graphs with fewer points are built by
+//								a single thread.
+//		ANN_HNSW_MAX_LEVEL		Highest layer of any point.
+//		ANN_HNSW_SEED			Seed for drawing the layers of the
+//								points, so that a graph built by one
+//								thread is always the same.
+//----------------------------------------------------------------------
+
+const int		ANN_HNSW_PAR_MIN_PTS	= 8192;
+const int		ANN_HNSW_MAX_LEVEL		= 30;
+const unsigned long long ANN_HNSW_SEED	= 0x2545F4914F6CDD1DULL;
+const int		ANN_HNSW_STRING_LEN		= 500;	// max string length in dump
+
+//----------------------------------------------------------------------
+//	Graph storage
+//		The links of point i are stored in the array links[i].  Layer 0
+//		comes first and holds up to 2M links, and each layer above holds
+//		up to M.  The first entry of a layer is its number of links.
+//----------------------------------------------------------------------
+
+inline int annHnswCap(int l, int m)		// max links in layer l
+	{ return (l == 0) ? 2*m : m; }
+
+inline int annHnswOffset(int l, int m)	// start of layer l in links[i]
+	{ return (l == 0) ? 0 : (2*m + 1) + (l-1)*(m + 1); }
+
+//----------------------------------------------------------------------
+//	Candidates
+//		A candidate is a point and its squared distance from the point
+//		being searched for.  Candidates are ordered by distance, and
+//		ties are broken by point index so that the results do not
+//		depend on the order in which points are visited.
+//----------------------------------------------------------------------
+
+struct ANNhnsw_cand {
+	ANNdist				dist;			// squared distance
+	ANNidx				idx;			// point index
+};
+
+inline bool annHnswCloser(const ANNhnsw_cand &a, const ANNhnsw_cand &b)
+	{ return a.dist < b.dist || (a.dist == b.dist && a.idx < b.idx); }
+
+inline bool annHnswFarther(const ANNhnsw_cand &a, const ANNhnsw_cand &b)
+	{ return annHnswCloser(b, a); }
+
+inline ANNdist annHnswDist(				// squared distance
+	const ANNcoord		*p,
+	const ANNcoord		*q,
+	int					dim)
+{
+	ANNdist dist = 0;
+	for (int d = 0; d < dim; d++) {
+		ANNcoord t = p[d] - q[d];
+		dist = ANN_SUM(dist, ANN_POW(t));
+	}
+	return dist;
+}
+
+//----------------------------------------------------------------------
+//	Search scratch
+//		Visited points are marked with the number of the current search,
+//		so the marks need only be cleared when that number wraps around.
+//		Each thread building the graph has its own scratch, and the graph
+//		keeps one for its searches.
+//----------------------------------------------------------------------
+
+class ANNhnsw_scratch {
+public:
+	unsigned			*mark;			// visit marks
+	unsigned			tag;			// mark of current search
+	int					n;				// number of points
+	vector<ANNhnsw_cand> cand;			// points to expand (min-heap)
+	vector<ANNhnsw_cand> res;			// closest points found (max-heap)
+	vector<ANNhnsw_cand> sel;			// neighbors of an inserted point
+	vector<ANNhnsw_cand> shrink;		// links of a full node
+	vector<ANNidx>		nbrs;			// copy of a node's links
+
+	ANNhnsw_scratch(int nn) : mark(NULL), tag(0), n(nn)
+		{
+			mark = new unsigned[n];
+			fill(mark, mark + n, 0u);
+		}
+
+	~ANNhnsw_scratch()
+		{ delete [] mark; }
+
+	void newSearch()					// start a new search
+		{
+			if (++tag == 0) {			// marks wrapped around
+				fill(mark, mark + n, 0u);
+				tag = 1;
+			}
+		}
+};
+
+//----------------------------------------------------------------------
+//	Node locks
+//		While the graph is built in parallel, the links of a node are
+//		read and written under its lock.  Lock n guards the entry point
+//		and the highest layer.
+//----------------------------------------------------------------------
+
+class ANNhnsw_locks {
+#ifdef _OPENMP
+	omp_lock_t			*lk;			// the locks
+	int					n;				// number of points
+public:
+	ANNhnsw_locks(int nn) : n(nn)
+		{
+			lk = new omp_lock_t[n + 1];
+			for (int i = 0; i <= n; i++) omp_init_lock(&lk[i]);
+		}
+	~ANNhnsw_locks()
+		{
+			for (int i = 0; i <= n; i++) omp_destroy_lock(&lk[i]);
+			delete [] lk;
+		}
+	void set(int i)		{ omp_set_lock(&lk[i]); }
+	void unset(int i)	{ omp_unset_lock(&lk[i]); }
+#else
+public:
+	ANNhnsw_locks(int nn) {}
+	void set(int i)		{}
+	void unset(int i)	{}
+#endif
+};
+
+//----------------------------------------------------------------------
+//	Graph view
+//		The search and insertion routines below work on this view of
+//		the graph.  locks is NULL except during a parallel build.
+//----------------------------------------------------------------------
+
+struct ANNhnsw_graph {
+	int					dim;			// dimension
+	int					n_pts;			// number of points
+	ANNpointArray		pts;			// point array
+	int					M;				// links per node
+	int					*level;			// highest layer of each point
+	ANNidx				**links;		// links of each point
+	ANNbool				*deleted;		// deleted points
+	ANNhnsw_locks		*locks;			// node locks (or NULL)
+};
+
+static void annHnswGetLinks(			// copy links of a node
+	const ANNhnsw_graph	&g,				// the graph
+	ANNidx				i,				// the node
+	int					l,				// layer
+	vector<ANNidx>		&out)			// the links (returned)
+{
+	if (g.locks != NULL) g.locks->set(i);
+	const ANNidx *lk = g.links[i] + annHnswOffset(l, g.M);
+	out.assign(lk + 1, lk + 1 + lk[0]);
+	if (g.locks != NULL) g.locks->unset(i);
+}
+
+inline ANNbool annHnswReport(			// may point be reported?
+	const ANNhnsw_graph	&g,
+	ANNidx				i,
+	ANNdist				dist)
+{
+	return (ANNbool) (!g.deleted[i] && i != ANNexcludeIdx &&
+		(ANN_ALLOW_SELF_MATCH || dist != 0));
+}
+
+//----------------------------------------------------------------------
+//	annHnswGreedy - greedy search of one layer
+//		Moves from ep to its closest neighbor until no neighbor is
+//		closer to q.
+//----------------------------------------------------------------------
+
+static ANNidx annHnswGreedy(
+	const ANNhnsw_graph	&g,				// the graph
+	ANNhnsw_scratch		&scr,			// search scratch
+	const ANNcoord		*q,				// query point
+	ANNidx				ep,				// entry point
+	ANNdist				&ep_dist,		// its distance (modified)
+	int					l)				// layer
+{
+	ANNbool changed = ANNtrue;
+	while (changed) {
+		changed = ANNfalse;
+		annHnswGetLinks(g, ep, l, scr.nbrs);
+		for (size_t j = 0; j < scr.nbrs.size(); j++) {
+			ANNidx e = scr.nbrs[j];
+			ANNdist dist = annHnswDist(q, g.pts[e], g.dim);
+			if (dist < ep_dist) {
+				ep = e;
+				ep_dist = dist;
+				changed = ANNtrue;
+			}
+		}
+	}
+	return ep;
+}
+
+//----------------------------------------------------------------------
+//	annHnswSearchLayer - best-first search of one layer
+//		Expands the closest unexpanded point until the ef closest points
+//		found are all closer than it.  The closest points are left in
+//		the max-heap scr.res.  Unless report_all is set, deleted and
+//		excluded points are expanded but not put in scr.res.
+//----------------------------------------------------------------------
+
+static void annHnswSearchLayer(
+	const ANNhnsw_graph	&g,				// the graph
+	ANNhnsw_scratch		&scr,			// search scratch
+	const ANNcoord		*q,				// query point
+	ANNidx				ep,				// entry point
+	ANNdist				ep_dist,		// its distance
+	int					ef,				// number of points to keep
+	int					l,				// layer
+	ANNbool				report_all)		// report every point?
+{
+	scr.newSearch();
+	scr.cand.clear();
+	scr.res.clear();
+
+	ANNhnsw_cand start = {ep_dist, ep};
+	scr.mark[ep] = scr.tag;
+	scr.cand.push_back(start);
+	if (report_all || annHnswReport(g, ep, ep_dist))
+		scr.res.push_back(start);
+
+	while (!scr.cand.empty()) {
+		ANNhnsw_cand c = scr.cand.front();	// closest unexpanded point
+		if ((int) scr.res.size() >= ef && annHnswCloser(scr.res.front(), c))
+			break;						// nothing closer is left
+		pop_heap(scr.cand.begin(), scr.cand.end(), annHnswFarther);
+		scr.cand.pop_back();
+
+		annHnswGetLinks(g, c.idx, l, scr.nbrs);
+		for (size_t j = 0; j < scr.nbrs.size(); j++) {
+			ANNidx e = scr.nbrs[j];
+			if (scr.mark[e] == scr.tag) continue;
+			scr.mark[e] = scr.tag;
+
+			ANNhnsw_cand ce = {annHnswDist(q, g.pts[e], g.dim), e};
+			if ((int) scr.res.size() < ef || annHnswCloser(ce, scr.res.front())) {
+				scr.cand.push_back(ce);
+				push_heap(scr.cand.begin(), scr.cand.end(), annHnswFarther);
+				if (report_all || annHnswReport(g, e, ce.dist)) {
+					scr.res.push_back(ce);
+					push_heap(scr.res.begin(), scr.res.end(), annHnswCloser);
+					if ((int) scr.res.size() > ef) {
+						pop_heap(scr.res.begin(), scr.res.end(), annHnswCloser);
+						scr.res.pop_back();
+					}
+				}
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+//	annHnswSelect - choose the links of a node
+//		Keeps a candidate only if it is closer to the node than to every
+//		candidate already kept (the heuristic of Malkov and Yashunin).
+//		This spreads the links in different directions.  At most m of
+//		the candidates are kept, sorted by distance.
+//----------------------------------------------------------------------
+
+static void annHnswSelect(
+	const ANNhnsw_graph	&g,				// the graph
+	vector<ANNhnsw_cand> &c,			// candidates (modified)
+	int					m)				// max number to keep
+{
+	sort(c.begin(), c.end(), annHnswCloser);
+	size_t n_sel = 0;
+	for (size_t i = 0; i < c.size() && (int) n_sel < m; i++) {
+		ANNbool good = ANNtrue;
+		for (size_t j = 0; j < n_sel; j++) {
+			if (annHnswDist(g.pts[c[i].idx], g.pts[c[j].idx], g.dim) < c[i].dist) {
+				good = ANNfalse;
+				break;
+			}
+		}
+		if (good) c[n_sel++] = c[i];
+	}
+	c.resize(n_sel);
+}
+
+//----------------------------------------------------------------------
+//	annHnswConnect - add a link from node e to node i in layer l
+//		If e already has the most links allowed, its links are chosen
+//		again from the old ones and i.
+//----------------------------------------------------------------------
+
+static void annHnswConnect(
+	const ANNhnsw_graph	&g,				// the graph
+	ANNhnsw_scratch		&scr,			// search scratch
+	ANNidx				e,				// node to link from
+	ANNidx				i,				// node to link to
+	ANNdist				dist,			// distance between them
+	int					l)				// layer
+{
+	const int cap = annHnswCap(l, g.M);
+	if (g.locks != NULL) g.locks->set(e);
+	ANNidx *lk = g.links[e] + annHnswOffset(l, g.M);
+	if (lk[0] < cap) {					// room for another link
+		lk[1 + lk[0]] = i;
+		lk[0]++;
+	}
+	else {								// choose links again
+		scr.shrink.clear();
+		ANNhnsw_cand ci = {dist, i};
+		scr.shrink.push_back(ci);
+		for (int j = 1; j <= lk[0]; j++) {
+			ANNhnsw_cand cj = {annHnswDist(g.pts[e], g.pts[lk[j]], g.dim), lk[j]};
+			scr.shrink.push_back(cj);
+		}
+		annHnswSelect(g, scr.shrink, cap);
+		lk[0] = (ANNidx) scr.shrink.size();
+		for (size_t j = 0; j < scr.shrink.size(); j++)
+			lk[1 + j] = scr.shrink[j].idx;
+	}
+	if (g.locks != NULL) g.locks->unset(e);
+}
+
+//----------------------------------------------------------------------
+//	annHnswInsert - insert a point in the graph
+//		The point is linked to its neighbors in every layer up to its
+//		own, found by searching from the current entry point.  A point
+//		above the highest layer becomes the new entry point; its thread
+//		holds the entry point lock during the whole insertion.
+//----------------------------------------------------------------------
+
+static void annHnswInsert(
+	const ANNhnsw_graph	&g,				// the graph
+	ANNhnsw_scratch		&scr,			// search scratch
+	ANNidx				i,				// point to insert
+	int					ef_constr,		// candidates to keep
+	int					&max_level,		// highest layer (modified)
+	ANNidx				&entry)			// entry point (modified)
+{
+	const int lvl = g.level[i];
+	if (g.locks != NULL) g.locks->set(g.n_pts);
+	const int top = max_level;
+	ANNidx ep = entry;
+	if (lvl <= top && g.locks != NULL) g.locks->unset(g.n_pts);
+
+	const ANNcoord *q = g.pts[i];
+	ANNdist ep_dist = annHnswDist(q, g.pts[ep], g.dim);
+	for (int l = top; l > lvl; l--)		// descend to the point's layer
+		ep = annHnswGreedy(g, scr, q, ep, ep_dist, l);
+
+	for (int l = (lvl < top ? lvl : top); l >= 0; l--) {
+		annHnswSearchLayer(g, scr, q, ep, ep_dist, ef_constr, l, ANNtrue);
+		scr.sel = scr.res;
+		annHnswSelect(g, scr.sel, g.M);
+		ep = scr.sel[0].idx;			// closest point starts next layer
+		ep_dist = scr.sel[0].dist;
+
+		if (g.locks != NULL) g.locks->set(i);
+		ANNidx *lk = g.links[i] + annHnswOffset(l, g.M);
+		lk[0] = (ANNidx) scr.sel.size();
+		for (size_t j = 0; j < scr.sel.size(); j++)
+			lk[1 + j] = scr.sel[j].idx;
+		if (g.locks != NULL) g.locks->unset(i);
+
+		for (size_t j = 0; j < scr.sel.size(); j++)
+			annHnswConnect(g, scr, scr.sel[j].idx, i, scr.sel[j].dist, l);
+	}
+
+	if (lvl > top) {					// new entry point
+		max_level = lvl;
+		entry = i;
+		if (g.locks != NULL) g.locks->unset(g.n_pts);
+	}
+}
+
+//----------------------------------------------------------------------
+//	annHnswLevels - draw the highest layer of each point
+//		The layer is floor(-ln(u)/ln(M)) for u uniform on (0,1], so a
+//		point reaches layer l with probability 1/M^l.
+//----------------------------------------------------------------------
+
+static void annHnswLevels(
+	int					*level,			// layers (returned)
+	int					n,				// number of points
+	int					m)				// links per node
+{
+	const double mult = 1.0 / log((double) m);
+	unsigned long long x = ANN_HNSW_SEED;
+	for (int i = 0; i < n; i++) {
+		unsigned long long z = annRanBits(x);
+		double u = ((z >> 11) + 1) * (1.0 / 9007199254740992.0);
+		int l = (int) (-log(u) * mult);
+		level[i] = (l > ANN_HNSW_MAX_LEVEL) ? ANN_HNSW_MAX_LEVEL : l;
+	}
+}
+
+static void annHnswFree(				// free the graph storage
+	int					n,				// number of points
+	int					*&level,		// layers (deallocated)
+	ANNidx				**&links,		// links (deallocated)
+	ANNbool				*&deleted)		// deleted points (deallocated)
+{
+	if (links != NULL) {
+		for (int i = 0; i < n; i++) delete [] links[i];
+	}
+	delete [] links;
+	delete [] level;
+	delete [] deleted;
+	links = NULL;
+	level = NULL;
+	deleted = NULL;
+}
+
+static ANNidx *annHnswAllocLinks(		// allocate empty links of a point
+	int					lvl,			// highest layer of the point
+	int					m)				// links per node
+{
+	ANNidx *lk = new ANNidx[annHnswOffset(lvl + 1, m)];
+	for (int l = 0; l <= lvl; l++)
+		lk[annHnswOffset(l, m)] = 0;
+	return lk;
+}
+
+//----------------------------------------------------------------------
+//	HNSW constructor
+//		Draws the layers of the points and inserts them one by one.
+//		Large graphs are built in parallel: point 0 is inserted first,
+//		and the other points are shared among the threads.
+//----------------------------------------------------------------------
+
+ANNhnsw::ANNhnsw(						// build from point array
+	ANNpointArray		pa,				// point array
+	int					n,				// number of points
+	int					dd,				// dimension
+	int					m,				// links per node
+	int					ef_construction,	// candidates while building
+	int					ef)				// candidates while searching
+{
+	dim = dd;  n_pts = n;  n_live = n;  pts = pa;
+	M = (m < 2) ? 2 : m;
+	ef_constr = (ef_construction < M) ? M : ef_construction;
+	ef_search = (ef < 1) ? 1 : ef;
+	max_level = -1;
+	entry = ANN_NULL_IDX;
+	level = NULL;  links = NULL;  deleted = NULL;
+	search_scr = NULL;					// allocated on first search
+
+	try {
+		level = new int[n];
+		deleted = new ANNbool[n];
+		links = new ANNidx*[n];
+		for (int i = 0; i < n; i++) links[i] = NULL;
+		annHnswLevels(level, n, M);
+		for (int i = 0; i < n; i++) {
+			deleted[i] = ANNfalse;
+			links[i] = annHnswAllocLinks(level[i], M);
+		}
+		Build();
+	}
+	catch (...) {
+		annHnswFree(n, level, links, deleted);
+		throw;
+	}
+}
+
+void ANNhnsw::Build()					// insert all points
+{
+	if (n_pts == 0) return;
+	entry = 0;							// first point is the entry point
+	max_level = level[0];
+
+	ANNhnsw_graph g = {dim, n_pts, pts, M, level, links, deleted, NULL};
+#ifdef _OPENMP
+	if (n_pts >= ANN_HNSW_PAR_MIN_PTS && omp_get_max_threads() > 1) {
+		ANNhnsw_locks locks(n_pts);
+		g.locks = &locks;
+		int failed = 0;
+		#pragma omp parallel shared(failed)
+		{
+			ANNhnsw_scratch *scr = NULL;
+			try {
+				scr = new ANNhnsw_scratch(n_pts);
+			}
+			catch (...) {
+				#pragma omp atomic write
+				failed = 1;
+			}
+			#pragma omp for schedule(dynamic, 64)
+			for (int i = 1; i < n_pts; i++) {
+				int stop;
+				#pragma omp atomic read
+				stop = failed;
+				if (stop || scr == NULL) continue;
+				try {
+					annHnswInsert(g, *scr, i, ef_constr, max_level, entry);
+				}
+				catch (...) {
+					#pragma omp atomic write
+					failed = 1;
+				}
+			}
+			delete scr;
+		}
+		if (failed) throw std::bad_alloc();
+		return;
+	}
+#endif
+	ANNhnsw_scratch scr(n_pts);
+	for (int i = 1; i < n_pts; i++)
+		annHnswInsert(g, scr, i, ef_constr, max_level, entry);
+}
+
+ANNhnsw::~ANNhnsw()						// destructor
+{
+	annHnswFree(n_pts, level, links, deleted);
+	delete search_scr;
+}
+
+void ANNhnsw::setEf(					// set candidates kept in searches
+	int					ef)				// the number of candidates
+{
+	ef_search = (ef < 1) ? 1 : ef;
+}
+
+ANNbool ANNhnsw::annDeletePt(			// remove point from the graph
+	ANNidx				idx)			// index of point to remove
+{
+	if (idx < 0 || idx >= n_pts || deleted[idx]) return ANNfalse;
+	deleted[idx] = ANNtrue;				// keep it to route searches
+	n_live--;
+	return ANNtrue;
+}
+
+//----------------------------------------------------------------------
+//	Searching
+//		Both searches descend greedily to layer 0 and then keep the
+//		max(k, ef) closest points in a best-first search, which are left
+//		sorted in search_scr->res.
+//----------------------------------------------------------------------
+
+static void annHnswQuery(
+	const ANNhnsw_graph	&g,				// the graph
+	ANNhnsw_scratch		&scr,			// search scratch
+	const ANNcoord		*q,				// query point
+	ANNidx				entry,			// entry point
+	int					max_level,		// highest layer
+	int					ef)				// candidates to keep
+{
+	ANNdist ep_dist = annHnswDist(q, g.pts[entry], g.dim);
+	ANNidx ep = entry;
+	for (int l = max_level; l > 0; l--)
+		ep = annHnswGreedy(g, scr, q, ep, ep_dist, l);
+	annHnswSearchLayer(g, scr, q, ep, ep_dist, ef, 0, ANNfalse);
+	sort(scr.res.begin(), scr.res.end(), annHnswCloser);
+}
+
+void ANNhnsw::annkSearch(				// approx k near neighbor search
+	ANNpoint			q,				// query point
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	ANNdistArray		dd,				// dist to near neighbors (returned)
+	double				eps)			// error bound (ignored)
+{
+	if (k > n_pts) {					// too many near neighbors?
+		annError("Requesting more near neighbors than data points", ANNabort);
+	}
+
+	int n_found = 0;
+	if (n_live > 0 && k > 0) {
+		if (search_scr == NULL) search_scr = new ANNhnsw_scratch(n_pts);
+		ANNhnsw_graph g = {dim, n_pts, pts, M, level, links, deleted, NULL};
+		annHnswQuery(g, *search_scr, q, entry, max_level, (k > ef_search) ? k : ef_search);
+		const vector<ANNhnsw_cand> &res = search_scr->res;
+		n_found = ((int) res.size() < k) ? (int) res.size() : k;
+		for (int i = 0; i < n_found; i++) {
+			dd[i] = res[i].dist;
+			nn_idx[i] = res[i].idx;
+		}
+	}
+
+	if (n_found < k) {					// too few found, scan all points
+		ANNmin_k mk(k);
+		for (int i = 0; i < n_pts; i++) {
+			if (deleted[i] || i == ANNexcludeIdx) continue;
+			ANNdist sqDist = annHnswDist(pts[i], q, dim);
+			if (ANN_ALLOW_SELF_MATCH || sqDist != 0)
+				mk.insert(sqDist, i);
+		}
+		for (int i = 0; i < k; i++) {	// extract the k closest points
+			dd[i] = mk.ith_smallest_key(i);
+			nn_idx[i] = mk.ith_smallest_info(i);
+		}
+	}
+}
+
+int ANNhnsw::annkFRSearch(				// approx fixed-radius kNN search
+	ANNpoint			q,				// query point
+	ANNdist				sqRad,			// squared radius
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor array (returned)
+	ANNdistArray		dd,				// dist to near neighbors (returned)
+	double				eps)			// error bound (ignored)
+{
+	int pts_in_range = 0;				// number of points in query range
+	if (n_live > 0) {
+		if (search_scr == NULL) search_scr = new ANNhnsw_scratch(n_pts);
+		ANNhnsw_graph g = {dim, n_pts, pts, M, level, links, deleted, NULL};
+		annHnswQuery(g, *search_scr, q, entry, max_level, (k > ef_search) ? k : ef_search);
+		const vector<ANNhnsw_cand> &res = search_scr->res;
+		for (size_t i = 0; i < res.size() && res[i].dist <= sqRad; i++) {
+			if (pts_in_range < k) {
+				if (dd != NULL) dd[pts_in_range] = res[i].dist;
+				if (nn_idx != NULL) nn_idx[pts_in_range] = res[i].idx;
+			}
+			pts_in_range++;
+		}
+	}
+	for (int i = pts_in_range; i < k; i++) {	// fill remaining slots
+		if (dd != NULL) dd[i] = ANN_DIST_INF;
+		if (nn_idx != NULL) nn_idx[i] = ANN_NULL_IDX;
+	}
+	return pts_in_range;
+}
+
+//----------------------------------------------------------------------
+//	ANN HNSW Dump Format
+//		The dump file has the same header and points section as kd-tree
+//		dump files (see kd_dump.cpp), followed by the graph.  Each point
+//		is printed on one line with its highest layer, whether it has
+//		been deleted, and for each layer from 0 up, its number of links
+//		and the links.
+//
+//		Format:
+//		#ANN <version number> <comments> [END_OF_LINE]
+//		points <dim> <n_pts>			(point coordinates: this is optional)
+//		0 <xxx> <xxx> ... <xxx>			(point indices and coordinates)
+//		  ...
+//		hnsw <dim> <n_pts> <M> <ef_construction> <ef> <max_level> <entry>
+//		<level> <deleted> <n_links> <link> ... <n_links> <link> ...
+//		  ...
+//----------------------------------------------------------------------
+
+void ANNhnsw::Dump(						// dump the graph
+		ANNbool with_pts,				// print points as well?
+		ostream &out)					// output stream
+{
+	out << "#ANN " << ANNversion << "\n";
+	out.precision(ANNcoordPrec);		// use full precision in dumping
+	if (with_pts) {						// print point coordinates
+		out << "points " << dim << " " << n_pts << "\n";
+		for (int i = 0; i < n_pts; i++) {
+			out << i << " ";
+			annPrintPt(pts[i], dim, out);
+			out << "\n";
+		}
+	}
+	out << "hnsw "
+		<< dim << " "
+		<< n_pts << " "
+		<< M << " "
+		<< ef_constr << " "
+		<< ef_search << " "
+		<< max_level << " "
+		<< entry << "\n";
+
+	for (int i = 0; i < n_pts; i++) {
+		out << level[i] << " " << (deleted[i] ? 1 : 0);
+		for (int l = 0; l <= level[i]; l++) {
+			const ANNidx *lk = links[i] + annHnswOffset(l, M);
+			out << " " << lk[0];
+			for (int j = 1; j <= lk[0]; j++)
+				out << " " << lk[j];
+		}
+		out << "\n";
+	}
+	out.precision(0);					// restore default precision
+}
+
+//----------------------------------------------------------------------
+//	Load HNSW graph from dump file
+//		As with kd-trees, the dump file must contain the points.  They
+//		are allocated here and are not deallocated with the graph.
+//----------------------------------------------------------------------
+
+ANNhnsw::ANNhnsw(						// build from dump file
+	istream				&in)			// input stream for dump file
+{
+	char str[ANN_HNSW_STRING_LEN];		// storage for string
+	char version[ANN_HNSW_STRING_LEN];	// ANN version number
+
+	level = NULL;  links = NULL;  deleted = NULL;
+	search_scr = NULL;
+
+	in >> str;							// input header
+	if (strcmp(str, "#ANN") != 0) {		// incorrect header
+		annError("Incorrect header for dump file", ANNabort);
+	}
+	in.getline(version, ANN_HNSW_STRING_LEN);	// get version (ignore)
+
+	in >> str;							// get major heading
+	if (strcmp(str, "points") != 0) {	// no points were input
+		annError("Points must be supplied in the dump file", ANNabort);
+	}
+	in >> dim;							// input dimension
+	in >> n_pts;						// number of points
+	pts = annAllocPts(n_pts, dim);		// allocate point storage
+	for (int i = 0; i < n_pts; i++) {	// input point coordinates
+		ANNidx idx;						// point index
+		in >> idx;						// input point index
+		if (idx < 0 || idx >= n_pts) {
+			annError("Point index is out of range", ANNabort);
+		}
+		for (int j = 0; j < dim; j++) {
+			in >> pts[idx][j];			// read point coordinates
+		}
+	}
+
+	in >> str;							// get graph heading
+	if (strcmp(str, "hnsw") != 0) {
+		annError("Illegal dump format.  Expecting section heading", ANNabort);
+	}
+	int the_dim, the_n_pts;
+	in >> the_dim >> the_n_pts;
+	if (the_dim != dim || the_n_pts != n_pts) {
+		annError("Graph does not match the points in the dump file", ANNabort);
+	}
+	in >> M >> ef_constr >> ef_search >> max_level >> entry;
+	if (n_pts > 0 && (entry < 0 || entry >= n_pts)) {
+		annError("Entry point is out of range", ANNabort);
+	}
+
+	level = new int[n_pts];
+	deleted = new ANNbool[n_pts];
+	links = new ANNidx*[n_pts];
+	for (int i = 0; i < n_pts; i++) links[i] = NULL;
+
+	n_live = 0;
+	for (int i = 0; i < n_pts; i++) {	// read links of each point
+		int del;
+		in >> level[i] >> del;
+		if (level[i] < 0 || level[i] > max_level) {
+			annError("Layer is out of range", ANNabort);
+		}
+		deleted[i] = del ? ANNtrue : ANNfalse;
+		if (!deleted[i]) n_live++;
+		links[i] = annHnswAllocLinks(level[i], M);
+		for (int l = 0; l <= level[i]; l++) {
+			ANNidx *lk = links[i] + annHnswOffset(l, M);
+			in >> lk[0];
+			if (lk[0] < 0 || lk[0] > annHnswCap(l, M)) {
+				annError("Too many links in dump file", ANNabort);
+			}
+			for (int j = 1; j <= lk[0]; j++) {
+				in >> lk[j];
+				if (lk[j] < 0 || lk[j] >= n_pts) {
+					annError("Point index is out of range", ANNabort);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,205 @@
+//----------------------------------------------------------------------
+// File:			kd_count.cpp
+// Description:		Range counting in kd-trees
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include "kd_count.h"					// kd range count declarations
+
+//----------------------------------------------------------------------
+//	Range counting
+//		annCountRange() returns the number of points within the squared
+//		radius of the query point, like annkFRSearch() with k = 0 and
+//		eps = 0, but without a k-closest set.  The traversal is that of
+//		the fixed-radius search in kd_fix_rad_search.cpp, with one
+//		addition: a child whose cell lies inside the query ball adds
+//		its number of live points to the count, and is not visited.
+//
+//		To decide this, the search keeps, for every dimension, the
+//		squared distance from the query to the farther side of the
+//		current cell (ANNkdCntFar), and the sum of these, which is the
+//		squared distance to the farthest corner of the cell.  A
+//		splitting node only changes the extent of the cell along its
+//		cutting dimension, so the sum is updated incrementally.
+//
+//		The excluded point (see annExcludeIdx()) must not be counted.
+//		A cell that may contain it is therefore never counted whole.
+//		The flag ex_in is true if the cell may contain the excluded
+//		point, which is decided from its coordinates as the search
+//		descends.
+//----------------------------------------------------------------------
+
+int				ANNkdCntDim;			// dimension of space
+ANNpoint		ANNkdCntQ;				// query point
+ANNdist			ANNkdCntSqRad;			// squared radius
+ANNpointArray	ANNkdCntPts;			// the points
+ANNpoint		ANNkdCntEx;				// excluded point (or NULL)
+ANNdist			*ANNkdCntFar;			// squared extents of the cell
+int				ANNkdCntInRange;		// number of points in range
+
+ANNbool annCntInside(					// is the cell inside the ball?
+	ANNdist				box_far)		// incremental upper bound
+{
+	if (!ANN_ALLOW_SELF_MATCH) return ANNfalse;	// points must be checked
+	if (box_far > ANNkdCntSqRad * ANN_CNT_FILTER) return ANNfalse;
+
+	ANNdist far = 0;					// sum the extents exactly
+	for (int d = 0; d < ANNkdCntDim; d++)
+		far = ANN_SUM(far, ANNkdCntFar[d]);
+	ANN_FLOP(ANNkdCntDim)
+	return (far * ANN_CNT_SLACK <= ANNkdCntSqRad) ? ANNtrue : ANNfalse;
+}
+
+//----------------------------------------------------------------------
+//	annCountRange - count points within a radius
+//----------------------------------------------------------------------
+
+int ANNkd_tree::annCountRange(
+	ANNpoint			q,				// the query point
+	ANNdist				sqRad)			// squared radius
+{
+	if (n_pts == 0 || root == NULL) return 0;
+	if (count_far == NULL) count_far = new ANNdist[dim];
+
+	ANNkdCntDim = dim;					// copy arguments to static equivs
+	ANNkdCntQ = q;
+	ANNkdCntSqRad = sqRad;
+	ANNkdCntPts = pts;
+	ANNkdCntFar = count_far;
+	ANNkdCntInRange = 0;
+
+	ANNbool ex_in = (ANNexcludeIdx >= 0 && ANNexcludeIdx < n_pts) ? ANNtrue : ANNfalse;
+	ANNkdCntEx = ex_in ? pts[ANNexcludeIdx] : NULL;
+
+	ANNdist box_far = 0;				// extents of the bounding box
+	for (int d = 0; d < dim; d++) {
+		ANNcoord t = q[d] - bnd_box_lo[d];
+		if (bnd_box_hi[d] - q[d] > t) t = bnd_box_hi[d] - q[d];
+		count_far[d] = ANN_POW(t);
+		box_far = ANN_SUM(box_far, count_far[d]);
+	}
+
+	ANNdist box_dist = annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim);
+	if (box_dist <= sqRad) {
+		if (!ex_in && annCntInside(box_far))
+			ANNkdCntInRange = root->n_live();
+		else
+			root->ann_count(box_dist, box_far, ex_in);
+	}
+	return ANNkdCntInRange;
+}
+
+//----------------------------------------------------------------------
+//	kd_split::ann_count - count in a splitting node
+//		The distance to the farther child is found as in the
+//		fixed-radius search.  The low child spans [cd_bnds[ANN_LO],
+//		cut_val] along the cutting dimension, and the high child
+//		[cut_val, cd_bnds[ANN_HI]].
+//----------------------------------------------------------------------
+
+static void annCountChild(				// count in child of a split
+	ANNkd_ptr			child,			// the child
+	int					cd,				// cutting dimension
+	ANNdist				box_dist,		// lower bound on distance to child
+	ANNdist				box_far,		// upper bound for parent
+	ANNdist				old_ext,		// parent's extent along cd
+	ANNcoord			ext,			// child's extent along cd
+	ANNbool				ex_in)			// child may hold excluded point?
+{
+	if (box_dist > ANNkdCntSqRad) return;	// child outside the ball
+
+	ANNkdCntFar[cd] = ANN_POW(ext);
+	box_far = ANN_SUM(ANN_DIFF(box_far, old_ext), ANNkdCntFar[cd]);
+	if (!ex_in && annCntInside(box_far))	// child inside the ball
+		ANNkdCntInRange += child->n_live();
+	else
+		child->ann_count(box_dist, box_far, ex_in);
+}
+
+void ANNkd_split::ann_count(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	const ANNcoord q = ANNkdCntQ[cut_dim];
+	ANNcoord cut_diff = q - cut_val;	// distance to cutting plane
+	ANNdist lo_dist = box_dist;
+	ANNdist hi_dist = box_dist;
+	if (cut_diff < 0) {					// left of cutting plane
+		ANNcoord box_diff = cd_bnds[ANN_LO] - q;
+		if (box_diff < 0) box_diff = 0;	// within bounds - ignore
+		hi_dist = (ANNdist) ANN_SUM(box_dist,
+				ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+	}
+	else {								// right of cutting plane
+		ANNcoord box_diff = q - cd_bnds[ANN_HI];
+		if (box_diff < 0) box_diff = 0;	// within bounds - ignore
+		lo_dist = (ANNdist) ANN_SUM(box_dist,
+				ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+	}
+
+	const ANNdist old_ext = ANNkdCntFar[cut_dim];
+	ANNcoord lo_ext = q - cd_bnds[ANN_LO];
+	if (cut_val - q > lo_ext) lo_ext = cut_val - q;
+	ANNcoord hi_ext = q - cut_val;
+	if (cd_bnds[ANN_HI] - q > hi_ext) hi_ext = cd_bnds[ANN_HI] - q;
+
+	annCountChild(child[ANN_LO], cut_dim, lo_dist, box_far, old_ext, lo_ext,
+		(ex_in && ANNkdCntEx[cut_dim] <= cut_val) ? ANNtrue : ANNfalse);
+	annCountChild(child[ANN_HI], cut_dim, hi_dist, box_far, old_ext, hi_ext,
+		(ex_in && ANNkdCntEx[cut_dim] >= cut_val) ? ANNtrue : ANNfalse);
+	ANNkdCntFar[cut_dim] = old_ext;		// restore the parent's extent
+
+	ANN_FLOP(20)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	kd_leaf::ann_count - count points in a leaf node
+//		The distances are computed as in the fixed-radius search.
+//----------------------------------------------------------------------
+
+void ANNkd_leaf::ann_count(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (soa != NULL) {					// blocked leaf copy available
+		ANNdist bdist[ANN_SOA_LANES];	// distances to block points
+		for (int i0 = 0; i0 < n_pts; i0 += ANN_SOA_LANES) {
+			ANN_COORD(ANNkdCntDim*ANN_SOA_LANES)
+			ANN_FLOP(5*ANNkdCntDim*ANN_SOA_LANES)
+			if (!annSoaBlockDist(soa, i0 / ANN_SOA_LANES, ANNkdCntDim,
+					ANNkdCntQ, ANNkdCntSqRad, bdist)) continue;
+			for (int l = 0; l < ANN_SOA_LANES && i0 + l < n_pts; l++) {
+				if (bdist[l] <= ANNkdCntSqRad &&
+				   (ANN_ALLOW_SELF_MATCH || bdist[l]!=0) &&
+				   bkt[i0 + l] != ANNexcludeIdx) {
+					ANNkdCntInRange++;	// increment point count
+				}
+			}
+		}
+		ANN_LEAF(1)						// one more leaf node visited
+		ANN_PTS(n_pts)					// increment points visited
+		return;
+	}
+
+	for (int i = 0; i < n_pts; i++) {	// check points in bucket
+		ANNcoord* pp = ANNkdCntPts[bkt[i]];
+		ANNdist dist = 0;
+		int d;
+		for (d = 0; d < ANNkdCntDim; d++) {
+			ANN_COORD(1)				// one more coordinate hit
+			ANN_FLOP(5)					// increment floating ops
+			ANNcoord t = ANNkdCntQ[d] - pp[d];
+			if ((dist = ANN_SUM(dist, ANN_POW(t))) > ANNkdCntSqRad) break;
+		}
+		if (d >= ANNkdCntDim &&					// within the radius
+		   (ANN_ALLOW_SELF_MATCH || dist!=0) &&	// and no self-match problem
+		   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
+			ANNkdCntInRange++;					// increment point count
+		}
+	}
+	ANN_LEAF(1)							// one more leaf node visited
+	ANN_PTS(n_pts)						// increment points visited
+}
@@ -0,0 +1,49 @@
+//----------------------------------------------------------------------
+// File:			kd_count.h
+// Description:		Range counting in kd-trees
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#ifndef ANN_kd_count_H
+#define ANN_kd_count_H
+
+#include "kd_tree.h"					// kd-tree declarations
+#include "kd_util.h"					// kd-tree utilities
+
+#include <ANN/ANNperf.h>				// performance evaluation
+
+//----------------------------------------------------------------------
+//	Constants
+//		A subtree is counted without visiting its points when the
+//		squared distance from the query to the farthest corner of its
+//		cell, times ANN_CNT_SLACK, is at most the squared radius.  The
+//		slack absorbs rounding in the distances to the points.  The
+//		upper bound passed down the tree is updated incrementally, so
+//		it is only used as a filter (with the factor ANN_CNT_FILTER)
+//		before the corner distance is summed exactly.
+//----------------------------------------------------------------------
+
+const double ANN_CNT_SLACK	= 1.0 + 1e-9;	// rounding slack
+const double ANN_CNT_FILTER	= 1.0 + 1e-6;	// incremental bound slack
+
+//----------------------------------------------------------------------
+//	Global variables
+//		These are active for the life of each call to annCountRange().
+//----------------------------------------------------------------------
+
+extern int				ANNkdCntDim;		// dimension of space
+extern ANNpoint			ANNkdCntQ;			// query point
+extern ANNdist			ANNkdCntSqRad;		// squared radius
+extern ANNpointArray	ANNkdCntPts;		// the points
+extern ANNpoint			ANNkdCntEx;			// excluded point (or NULL)
+extern ANNdist			*ANNkdCntFar;		// squared extents of the cell
+extern int				ANNkdCntInRange;	// number of points in range
+
+ANNbool annCntInside(					// is the cell inside the ball?
+	ANNdist				box_far);		// incremental upper bound
+
+#endif
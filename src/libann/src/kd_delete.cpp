@@ -0,0 +1,124 @@
+//----------------------------------------------------------------------
+// File:			kd_delete.cpp
+// Description:		Point deletion for kd-, bd- and ball trees
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include "kd_tree.h"					// kd-tree declarations
+#include "bd_tree.h"					// bd-tree declarations
+#include "ball_tree.h"					// ball-tree declarations
+
+//----------------------------------------------------------------------
+//	Point deletion
+//		A point is deleted by descending the tree with its coordinates
+//		to the leaf whose bucket holds its index, and removing it from
+//		the bucket.  The removed index is swapped with the last index
+//		of the bucket (which is a segment of the tree's pidx array),
+//		and the bucket is shortened by one.  The leaf's blocked copy
+//		(if any) is updated the same way.
+//
+//		Every internal node counts the live points below it, and the
+//		counts along the path are decremented.  Searches return
+//		immediately from internal nodes with no live points, so dead
+//		subtrees cost one visit.  The tree is never restructured; it
+//		is up to the caller to rebuild it when most points are gone.
+//
+//		Points equal to the cutting value may lie on either side of a
+//		splitting plane, and points on the boundary of a shrinking
+//		box are assigned to the inner box.  In those cases both
+//		children are tried.  Ball nodes try each child whose ball
+//		contains the point.
+//
+//		Deleting is O(depth + bucket size).  The deleted points stay
+//		in the point array, but are unreachable from the tree.  The
+//		weights of the nodes for kernel sums are not updated, and
+//		must be set again (see kd_kernel.cpp).
+//----------------------------------------------------------------------
+
+ANNbool ANNkd_tree::annDeletePt(		// remove point from the tree
+	ANNidx				idx)			// index of point to remove
+{
+	if (root == NULL || idx < 0 || idx >= n_pts) return ANNfalse;
+	ANNbool found = root->ann_delete(idx, pts[idx]);
+	if (found) kern_weighed = ANNfalse;	// node weights are stale
+	return found;
+}
+
+ANNbool ANNkd_split::ann_delete(ANNidx i, ANNpoint p)
+{
+	if (n_lv == 0) return ANNfalse;		// nothing left below
+
+	ANNbool found;
+	if (p[cut_dim] < cut_val) {			// left of cutting plane
+		found = child[ANN_LO]->ann_delete(i, p);
+	}
+	else if (p[cut_dim] > cut_val) {	// right of cutting plane
+		found = child[ANN_HI]->ann_delete(i, p);
+	}
+	else {								// on the plane, try both
+		found = child[ANN_LO]->ann_delete(i, p);
+		if (!found) found = child[ANN_HI]->ann_delete(i, p);
+	}
+	if (found) n_lv--;
+	return found;
+}
+
+ANNbool ANNbd_shrink::ann_delete(ANNidx i, ANNpoint p)
+{
+	if (n_lv == 0) return ANNfalse;		// nothing left below
+
+	int first = ANN_IN;					// inside inner box?
+	for (int j = 0; j < n_bnds; j++) {
+		if (bnds[j].out(p)) {
+			first = ANN_OUT;
+			break;
+		}
+	}
+	ANNbool found = child[first]->ann_delete(i, p);
+	if (!found) found = child[1-first]->ann_delete(i, p);
+	if (found) n_lv--;
+	return found;
+}
+
+ANNbool ANNball_split::ann_delete(ANNidx i, ANNpoint p)
+{
+	if (n_lv == 0) return ANNfalse;		// nothing left below
+
+	ANNbool found = ANNfalse;
+	for (int c = ANN_LO; c <= ANN_HI && !found; c++) {
+		if (annBallDist(p, ctr[c], rad[c], dim) == 0)	// inside ball?
+			found = child[c]->ann_delete(i, p);
+	}
+	if (found) n_lv--;
+	return found;
+}
+
+ANNbool ANNkd_leaf::ann_delete(ANNidx i, ANNpoint p)
+{
+	int j;
+	for (j = 0; j < n_pts; j++) {		// find point in bucket
+		if (bkt[j] == i) break;
+	}
+	if (j == n_pts) return ANNfalse;	// not here
+
+	int last = n_pts - 1;				// move last point into its slot
+	bkt[j] = bkt[last];
+	bkt[last] = i;
+	if (soa != NULL) {
+		int dim = soa_dim;
+		ANNcoord *pj = soa + (size_t) (j / ANN_SOA_LANES) * dim * ANN_SOA_LANES
+						+ j % ANN_SOA_LANES;
+		ANNcoord *pl = soa + (size_t) (last / ANN_SOA_LANES) * dim * ANN_SOA_LANES
+						+ last % ANN_SOA_LANES;
+		for (int d = 0; d < dim; d++) {
+			pj[d * ANN_SOA_LANES] = pl[d * ANN_SOA_LANES];
+			pl[d * ANN_SOA_LANES] = ANN_DBL_MAX;	// pad freed lane
+		}
+	}
+	n_pts--;
+	return ANNtrue;
+}
@@ -23,6 +23,7 @@
 //----------------------------------------------------------------------
 
 #include "kd_fix_rad_search.h"			// kd fixed-radius search decls
+#include "kd_metric.h"					// other norms
 
 //----------------------------------------------------------------------
 //	Approximate fixed-radius k nearest neighbor search
@@ -70,12 +71,18 @@ int ANNkd_tree::annkFRSearch(
 	ANNkdFRPtsVisited = 0;				// initialize count of points visited
 	ANNkdFRPtsInRange = 0;				// ...and points in the range
 
-	ANNkdFRMaxErr = ANN_POW(1.0 + eps);
-	ANN_FLOP(2)							// increment floating op count
+										// get set for closest k points
+	ANNkdFRPointMK = annReuseMinK(search_mk, k);
 
-	ANNkdFRPointMK = new ANNmin_k(k);	// create set for closest k points
+	if (ANNactiveMetric != ANN_METRIC_L2) {	// other norm (see kd_metric.h)
+		annkMetricFRSearch(root, q, bnd_box_lo, bnd_box_hi, dim, eps);
+	}
+	else {
+		ANNkdFRMaxErr = ANN_POW(1.0 + eps);
+		ANN_FLOP(2)						// increment floating op count
 										// search starting at the root
-	root->ann_FR_search(annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim));
+		root->ann_FR_search(annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim));
+	}
 
 	for (int i = 0; i < k; i++) {		// extract the k-th closest points
 		if (dd != NULL)
@@ -84,7 +91,6 @@ int ANNkd_tree::annkFRSearch(
 			nn_idx[i] = ANNkdFRPointMK->ith_smallest_info(i);
 	}
 
-	delete ANNkdFRPointMK;				// deallocate closest point set
 	return ANNkdFRPtsInRange;			// return final point count
 }
 
@@ -99,6 +105,7 @@ int ANNkd_tree::annkFRSearch(
 
 void ANNkd_split::ann_FR_search(ANNdist box_dist)
 {
+	if (n_lv == 0) return;				// all points below deleted
 										// check dist calc term condition
 	if (ANNmaxPtsVisited != 0 && ANNkdFRPtsVisited > ANNmaxPtsVisited) return;
 
@@ -153,6 +160,29 @@ void ANNkd_leaf::ann_FR_search(ANNdist box_dist)
 	ANNcoord t;
 	int d;
 
+	if (soa != NULL) {					// blocked leaf copy available
+		ANNdist bdist[ANN_SOA_LANES];	// distances to block points
+		for (int i0 = 0; i0 < n_pts; i0 += ANN_SOA_LANES) {
+			ANN_COORD(ANNkdFRDim*ANN_SOA_LANES)
+			ANN_FLOP(5*ANNkdFRDim*ANN_SOA_LANES)
+			if (!annSoaBlockDist(soa, i0 / ANN_SOA_LANES, ANNkdFRDim,
+					ANNkdFRQ, ANNkdFRSqRad, bdist)) continue;
+										// insert in bucket order
+			for (int l = 0; l < ANN_SOA_LANES && i0 + l < n_pts; l++) {
+				if (bdist[l] <= ANNkdFRSqRad &&
+				   (ANN_ALLOW_SELF_MATCH || bdist[l]!=0) &&
+				   bkt[i0 + l] != ANNexcludeIdx) {
+					ANNkdFRPointMK->insert(bdist[l], bkt[i0 + l]);
+					ANNkdFRPtsInRange++;		// increment point count
+				}
+			}
+		}
+		ANN_LEAF(1)						// one more leaf node visited
+		ANN_PTS(n_pts)					// increment points visited
+		ANNkdFRPtsVisited += n_pts;		// increment number of points visited
+		return;
+	}
+
 	for (int i = 0; i < n_pts; i++) {	// check points in bucket
 
 		pp = ANNkdFRPts[bkt[i]];		// first coord of next data point
@@ -171,7 +201,8 @@ void ANNkd_leaf::ann_FR_search(ANNdist box_dist)
 		}
 
 		if (d >= ANNkdFRDim &&					// among the k best?
-		   (ANN_ALLOW_SELF_MATCH || dist!=0)) { // and no self-match problem
+		   (ANN_ALLOW_SELF_MATCH || dist!=0) && // and no self-match problem
+		   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
 												// add it to the list
 			ANNkdFRPointMK->insert(dist, bkt[i]);
 			ANNkdFRPtsInRange++;				// increment point count
@@ -39,6 +39,13 @@
 //		procedures.
 //----------------------------------------------------------------------
 
+extern int				ANNkdFRDim;			// dimension of space (static copy)
 extern ANNpoint			ANNkdFRQ;			// query point (static copy)
+extern double			ANNkdFRMaxErr;		// max tolerable squared error
+extern ANNdist			ANNkdFRSqRad;		// squared radius search bound
+extern ANNpointArray	ANNkdFRPts;			// the points (static copy)
+extern ANNmin_k			*ANNkdFRPointMK;	// set of k closest points
+extern int				ANNkdFRPtsVisited;	// total points visited
+extern int				ANNkdFRPtsInRange;	// number of points in the range
 
 #endif
@@ -0,0 +1,271 @@
+//----------------------------------------------------------------------
+// File:			kd_kernel.cpp
+// Description:		Kernel sums in kd-trees
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include "kd_kernel.h"					// kd kernel sum declarations
+
+//----------------------------------------------------------------------
+//	Kernel sums
+//		annKernelSum() returns the sum over the live points p of
+//		w(p) K(|q - p|^2), where w are the weights given with
+//		annSetWeights() and K is one of the kernels of ANNkernel.  The
+//		traversal is that of the range count (see kd_count.cpp), with
+//		lower and upper bounds on the squared distance to each cell.
+//
+//		Every internal node stores the total weights of its children,
+//		which are computed by annSetWeights().  K is decreasing, so
+//		the kernel values of the points in a cell lie between K(far)
+//		and K(near).  A cell is not visited when
+//
+//			K(near) - K(far) <= 2 tol,
+//
+//		and its points are then given the kernel value
+//		(K(near) + K(far)) / 2.  Each point's error is at most tol,
+//		and the error of the sum is at most tol times the sum of the
+//		absolute weights.  Cells beyond the kernel's support (see
+//		ANNkdKerCut) are skipped.  With tol = 0, only those are
+//		skipped, and the sum is exact.
+//
+//		A cell that may contain the excluded point is never added
+//		without visiting it, as in the range count.
+//
+//		Point deletions invalidate the weights of the nodes, and
+//		annSetWeights() must be called again before the next sum.
+//----------------------------------------------------------------------
+
+int				ANNkdKerDim;			// dimension of space
+ANNpoint		ANNkdKerQ;				// query point
+ANNpointArray	ANNkdKerPts;			// the points
+ANNdistArray	ANNkdKerWts;			// point weights (or NULL)
+ANNpoint		ANNkdKerEx;				// excluded point (or NULL)
+ANNdist			*ANNkdKerFar;			// squared extents of the cell
+ANNkernel		ANNkdKerType;			// the kernel
+ANNdist			ANNkdKerScale;			// inverse squared bandwidth
+ANNdist			ANNkdKerCut;			// squared support radius
+ANNdist			ANNkdKerTol;			// twice the error bound
+ANNdist			ANNkdKerSum;			// the sum
+
+//----------------------------------------------------------------------
+//	annKerCell - add a cell without visiting it, if possible
+//		The upper bound of a kd-tree cell is updated incrementally,
+//		so it is only used as a filter before the extents in
+//		ANNkdKerFar are summed exactly (see annCntInside()).  Returns
+//		ANNtrue if the cell has been handled.
+//----------------------------------------------------------------------
+
+ANNbool annKerCell(						// add cell without visiting it?
+	ANNdist				box_dist,		// lower bound on distance
+	ANNdist				box_far,		// upper bound on distance
+	ANNbool				far_exact,		// is box_far exact?
+	ANNdist				wt,				// weight of cell's points
+	ANNbool				ex_in)			// may hold excluded point?
+{
+	if (box_dist >= ANNkdKerCut) return ANNtrue;	// beyond the support
+	if (ex_in || ANNkdKerTol == 0) return ANNfalse;
+
+	ANNdist k_near = annKernel(box_dist);
+
+	if (!far_exact) {
+		if (k_near - annKernel(box_far / ANN_CNT_FILTER) > ANNkdKerTol)
+			return ANNfalse;
+		box_far = 0;					// sum the extents exactly
+		for (int d = 0; d < ANNkdKerDim; d++)
+			box_far = ANN_SUM(box_far, ANNkdKerFar[d]);
+		ANN_FLOP(ANNkdKerDim)
+	}
+	ANNdist k_far = annKernel(box_far * ANN_CNT_SLACK);
+	if (k_near - k_far > ANNkdKerTol) return ANNfalse;
+
+	ANNkdKerSum += wt * 0.5 * (k_near + k_far);
+	return ANNtrue;
+}
+
+//----------------------------------------------------------------------
+//	annSetWeights - set the weights for kernel sums
+//----------------------------------------------------------------------
+
+void ANNkd_tree::annSetWeights(
+	ANNdistArray		wts)			// weights (NULL for unit weights)
+{
+	kern_wts = wts;
+	kern_wt = (root == NULL) ? 0 : root->ann_weigh(wts);
+	kern_weighed = ANNtrue;
+}
+
+//----------------------------------------------------------------------
+//	annKernelSum - weighted kernel sum
+//----------------------------------------------------------------------
+
+ANNdist ANNkd_tree::annKernelSum(
+	ANNpoint			q,				// the query point
+	ANNkernel			kern,			// the kernel
+	ANNdist				sqBw,			// squared bandwidth
+	double				tol)			// error bound (per unit weight)
+{
+	if (n_pts == 0 || root == NULL) return 0;
+	if (!kern_weighed) annError("Kernel sum without weights", ANNabort);
+	if (count_far == NULL) count_far = new ANNdist[dim];
+
+	ANNkdKerDim = dim;					// copy arguments to static equivs
+	ANNkdKerQ = q;
+	ANNkdKerPts = pts;
+	ANNkdKerWts = kern_wts;
+	ANNkdKerFar = count_far;
+	ANNkdKerType = kern;
+	ANNkdKerScale = 1 / sqBw;
+	ANNkdKerCut = (kern == ANN_KERN_GAUSS) ? ANN_KER_GAUSS_CUT * sqBw : sqBw;
+	ANNkdKerTol = 2 * tol;
+	ANNkdKerSum = 0;
+
+	ANNbool ex_in = (ANNexcludeIdx >= 0 && ANNexcludeIdx < n_pts) ? ANNtrue : ANNfalse;
+	ANNkdKerEx = ex_in ? pts[ANNexcludeIdx] : NULL;
+
+	ANNdist box_far = 0;				// extents of the bounding box
+	for (int d = 0; d < dim; d++) {
+		ANNcoord t = q[d] - bnd_box_lo[d];
+		if (bnd_box_hi[d] - q[d] > t) t = bnd_box_hi[d] - q[d];
+		count_far[d] = ANN_POW(t);
+		box_far = ANN_SUM(box_far, count_far[d]);
+	}
+
+	ANNdist box_dist = annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim);
+	if (!annKerCell(box_dist, box_far, ANNfalse, kern_wt, ex_in))
+		root->ann_kernel(box_dist, box_far, ex_in);
+	return ANNkdKerSum;
+}
+
+//----------------------------------------------------------------------
+//	kd_split::ann_weigh - total weight of a splitting node
+//----------------------------------------------------------------------
+
+ANNdist ANNkd_split::ann_weigh(ANNdistArray wts)
+{
+	wt[ANN_LO] = child[ANN_LO]->ann_weigh(wts);
+	wt[ANN_HI] = child[ANN_HI]->ann_weigh(wts);
+	return wt[ANN_LO] + wt[ANN_HI];
+}
+
+//----------------------------------------------------------------------
+//	kd_split::ann_kernel - kernel sum in a splitting node
+//		The bounds for the children are found as in the range count.
+//----------------------------------------------------------------------
+
+static void annKernelChild(				// kernel sum in child of a split
+	ANNkd_ptr			child,			// the child
+	int					cd,				// cutting dimension
+	ANNdist				box_dist,		// lower bound on distance to child
+	ANNdist				box_far,		// upper bound for parent
+	ANNdist				old_ext,		// parent's extent along cd
+	ANNcoord			ext,			// child's extent along cd
+	ANNdist				wt,				// weight of child's points
+	ANNbool				ex_in)			// child may hold excluded point?
+{
+	if (box_dist >= ANNkdKerCut) return;	// child beyond the support
+
+	ANNkdKerFar[cd] = ANN_POW(ext);
+	box_far = ANN_SUM(ANN_DIFF(box_far, old_ext), ANNkdKerFar[cd]);
+	if (!annKerCell(box_dist, box_far, ANNfalse, wt, ex_in))
+		child->ann_kernel(box_dist, box_far, ex_in);
+}
+
+void ANNkd_split::ann_kernel(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (n_lv == 0) return;				// all points below deleted
+
+	const ANNcoord q = ANNkdKerQ[cut_dim];
+	ANNcoord cut_diff = q - cut_val;	// distance to cutting plane
+	ANNdist lo_dist = box_dist;
+	ANNdist hi_dist = box_dist;
+	if (cut_diff < 0) {					// left of cutting plane
+		ANNcoord box_diff = cd_bnds[ANN_LO] - q;
+		if (box_diff < 0) box_diff = 0;	// within bounds - ignore
+		hi_dist = (ANNdist) ANN_SUM(box_dist,
+				ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+	}
+	else {								// right of cutting plane
+		ANNcoord box_diff = q - cd_bnds[ANN_HI];
+		if (box_diff < 0) box_diff = 0;	// within bounds - ignore
+		lo_dist = (ANNdist) ANN_SUM(box_dist,
+				ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+	}
+
+	const ANNdist old_ext = ANNkdKerFar[cut_dim];
+	ANNcoord lo_ext = q - cd_bnds[ANN_LO];
+	if (cut_val - q > lo_ext) lo_ext = cut_val - q;
+	ANNcoord hi_ext = q - cut_val;
+	if (cd_bnds[ANN_HI] - q > hi_ext) hi_ext = cd_bnds[ANN_HI] - q;
+
+	annKernelChild(child[ANN_LO], cut_dim, lo_dist, box_far, old_ext, lo_ext,
+		wt[ANN_LO], (ex_in && ANNkdKerEx[cut_dim] <= cut_val) ? ANNtrue : ANNfalse);
+	annKernelChild(child[ANN_HI], cut_dim, hi_dist, box_far, old_ext, hi_ext,
+		wt[ANN_HI], (ex_in && ANNkdKerEx[cut_dim] >= cut_val) ? ANNtrue : ANNfalse);
+	ANNkdKerFar[cut_dim] = old_ext;		// restore the parent's extent
+
+	ANN_FLOP(20)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	kd_leaf::ann_weigh - total weight of a leaf node
+//----------------------------------------------------------------------
+
+ANNdist ANNkd_leaf::ann_weigh(ANNdistArray wts)
+{
+	if (wts == NULL) return n_pts;
+	ANNdist sum = 0;
+	for (int i = 0; i < n_pts; i++) sum += wts[bkt[i]];
+	return sum;
+}
+
+//----------------------------------------------------------------------
+//	kd_leaf::ann_kernel - kernel sum in a leaf node
+//		Points beyond the kernel's support are skipped as points
+//		outside the radius are in the range count.
+//----------------------------------------------------------------------
+
+void ANNkd_leaf::ann_kernel(ANNdist box_dist, ANNdist box_far, ANNbool ex_in)
+{
+	if (soa != NULL) {					// blocked leaf copy available
+		ANNdist bdist[ANN_SOA_LANES];	// distances to block points
+		for (int i0 = 0; i0 < n_pts; i0 += ANN_SOA_LANES) {
+			ANN_COORD(ANNkdKerDim*ANN_SOA_LANES)
+			ANN_FLOP(5*ANNkdKerDim*ANN_SOA_LANES)
+			if (!annSoaBlockDist(soa, i0 / ANN_SOA_LANES, ANNkdKerDim,
+					ANNkdKerQ, ANNkdKerCut, bdist)) continue;
+			for (int l = 0; l < ANN_SOA_LANES && i0 + l < n_pts; l++) {
+				if (bdist[l] < ANNkdKerCut && bkt[i0 + l] != ANNexcludeIdx) {
+					ANNdist w = (ANNkdKerWts == NULL) ? 1 : ANNkdKerWts[bkt[i0 + l]];
+					ANNkdKerSum += w * annKernel(bdist[l]);
+				}
+			}
+		}
+		ANN_LEAF(1)						// one more leaf node visited
+		ANN_PTS(n_pts)					// increment points visited
+		return;
+	}
+
+	for (int i = 0; i < n_pts; i++) {	// check points in bucket
+		ANNcoord* pp = ANNkdKerPts[bkt[i]];
+		ANNdist dist = 0;
+		int d;
+		for (d = 0; d < ANNkdKerDim; d++) {
+			ANN_COORD(1)				// one more coordinate hit
+			ANN_FLOP(5)					// increment floating ops
+			ANNcoord t = ANNkdKerQ[d] - pp[d];
+			if ((dist = ANN_SUM(dist, ANN_POW(t))) >= ANNkdKerCut) break;
+		}
+		if (d >= ANNkdKerDim &&					// within the support
+		   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
+			ANNdist w = (ANNkdKerWts == NULL) ? 1 : ANNkdKerWts[bkt[i]];
+			ANNkdKerSum += w * annKernel(dist);
+		}
+	}
+	ANN_LEAF(1)							// one more leaf node visited
+	ANN_PTS(n_pts)						// increment points visited
+}
@@ -0,0 +1,66 @@
+//----------------------------------------------------------------------
+// File:			kd_kernel.h
+// Description:		Kernel sums in kd-trees
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#ifndef ANN_kd_kernel_H
+#define ANN_kd_kernel_H
+
+#include "kd_tree.h"					// kd-tree declarations
+#include "kd_util.h"					// kd-tree utilities
+#include "kd_count.h"					// kd range count declarations
+
+#include <cmath>						// exp
+#include <ANN/ANNperf.h>				// performance evaluation
+
+//----------------------------------------------------------------------
+//	Constants
+//		The Gaussian kernel is taken to be zero beyond ANN_KER_GAUSS_CUT
+//		squared bandwidths, where exp(-s / (2 h^2)) underflows.  The
+//		bounds on the distances to a cell are handled with the slack
+//		factors of the range count (see kd_count.h).
+//----------------------------------------------------------------------
+
+const double ANN_KER_GAUSS_CUT	= 1500.0;	// Gaussian support (in h^2)
+
+//----------------------------------------------------------------------
+//	Global variables
+//		These are active for the life of each call to annKernelSum().
+//----------------------------------------------------------------------
+
+extern int				ANNkdKerDim;		// dimension of space
+extern ANNpoint			ANNkdKerQ;			// query point
+extern ANNpointArray	ANNkdKerPts;		// the points
+extern ANNdistArray		ANNkdKerWts;		// point weights (or NULL)
+extern ANNpoint			ANNkdKerEx;			// excluded point (or NULL)
+extern ANNdist			*ANNkdKerFar;		// squared extents of the cell
+extern ANNkernel		ANNkdKerType;		// the kernel
+extern ANNdist			ANNkdKerScale;		// inverse squared bandwidth
+extern ANNdist			ANNkdKerCut;		// squared support radius
+extern ANNdist			ANNkdKerTol;		// twice the error bound
+extern ANNdist			ANNkdKerSum;		// the sum
+
+//----------------------------------------------------------------------
+//	annKernel - kernel value at a squared distance
+//----------------------------------------------------------------------
+
+inline ANNdist annKernel(ANNdist sqDist)
+{
+	if (sqDist >= ANNkdKerCut) return 0;
+	ANNdist u = sqDist * ANNkdKerScale;
+	return (ANNkdKerType == ANN_KERN_GAUSS) ? std::exp(-0.5 * u) : 1 - u;
+}
+
+ANNbool annKerCell(						// add cell without visiting it?
+	ANNdist				box_dist,		// lower bound on distance
+	ANNdist				box_far,		// upper bound on distance
+	ANNbool				far_exact,		// is box_far exact?
+	ANNdist				wt,				// weight of cell's points
+	ANNbool				ex_in);			// may hold excluded point?
+
+#endif
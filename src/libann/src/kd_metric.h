@@ -0,0 +1,133 @@
+//----------------------------------------------------------------------
+// File:			kd_metric.h
+// Description:		Norms for kd-tree search in other metrics
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#ifndef ANN_kd_metric_H
+#define ANN_kd_metric_H
+
+#include <cmath>						// fabs, pow
+#include "kd_tree.h"					// kd-tree declarations
+
+//----------------------------------------------------------------------
+//	Norms
+//		Each norm is a class with the functions POW, # (sum) and DIFF
+//		of the table in ANN.h as static members.  The search routines
+//		in kd_metric_search.cpp are templates over the norm, so each
+//		norm gets its own copy of the routines with the functions
+//		inlined, exactly as the ANN_POW, ANN_SUM and ANN_DIFF macros
+//		are for the Euclidean norm.  The members search and FR_search
+//		visit a node with the routine instantiated for the same norm,
+//		so the norm is chosen once per search and never in the tree.
+//----------------------------------------------------------------------
+
+struct ANNmetric_l1 {					// L_1 (Manhattan) norm
+	static ANNdist power(ANNcoord v)			{ return fabs(v); }
+	static ANNdist sum(ANNdist x, ANNdist y)	{ return x + y; }
+	static ANNdist diff(ANNdist x, ANNdist y)	{ return y - x; }
+	static void search(ANNkd_ptr n, ANNdist d)		{ n->ann_search_l1(d); }
+	static void FR_search(ANNkd_ptr n, ANNdist d)	{ n->ann_FR_search_l1(d); }
+};
+
+struct ANNmetric_linf {					// L_inf (max) norm
+	static ANNdist power(ANNcoord v)			{ return fabs(v); }
+	static ANNdist sum(ANNdist x, ANNdist y)	{ return (x > y) ? x : y; }
+	static ANNdist diff(ANNdist x, ANNdist y)	{ return y; }
+	static void search(ANNkd_ptr n, ANNdist d)		{ n->ann_search_linf(d); }
+	static void FR_search(ANNkd_ptr n, ANNdist d)	{ n->ann_FR_search_linf(d); }
+};
+
+struct ANNmetric_lp {					// L_p (Minkowski) norm
+	static ANNdist power(ANNcoord v)			{ return pow(fabs(v), ANNminkowskiP); }
+	static ANNdist sum(ANNdist x, ANNdist y)	{ return x + y; }
+	static ANNdist diff(ANNdist x, ANNdist y)	{ return y - x; }
+	static void search(ANNkd_ptr n, ANNdist d)		{ n->ann_search_lp(d); }
+	static void FR_search(ANNkd_ptr n, ANNdist d)	{ n->ann_FR_search_lp(d); }
+};
+
+//----------------------------------------------------------------------
+//	annSoaBlockDist<M> - annSoaBlockDist (see kd_tree.h) in norm M
+//----------------------------------------------------------------------
+
+template <class M>
+inline ANNbool annSoaBlockDist(
+	const ANNcoord		*soa,			// leaf copy
+	int					blk,			// block number
+	int					dim,			// dimension of space
+	const ANNcoord		*q,				// query point
+	ANNdist				bound,			// early-exit bound
+	ANNdist				*dist)			// lane distances (returned)
+{
+	const ANNcoord *pp = soa + (size_t) blk * dim * ANN_SOA_LANES;
+	int l;
+	for (l = 0; l < ANN_SOA_LANES; l++) dist[l] = 0;
+
+	for (int d0 = 0; d0 < dim; d0 += ANN_SOA_DIM_BLOCK) {
+		int d1 = d0 + ANN_SOA_DIM_BLOCK < dim ? d0 + ANN_SOA_DIM_BLOCK : dim;
+		for (int d = d0; d < d1; d++) {
+			const ANNcoord qd = q[d];
+			const ANNcoord *pd = pp + d * ANN_SOA_LANES;
+			for (l = 0; l < ANN_SOA_LANES; l++) {
+				dist[l] = M::sum(dist[l], M::power(qd - pd[l]));
+			}
+		}
+		ANNbool live = ANNfalse;
+		for (l = 0; l < ANN_SOA_LANES; l++) {
+			if (dist[l] <= bound) live = ANNtrue;
+		}
+		if (!live) return ANNfalse;
+	}
+	return ANNtrue;
+}
+
+//----------------------------------------------------------------------
+//	annBoxDistance<M> - annBoxDistance (see kd_util.cpp) in norm M
+//----------------------------------------------------------------------
+
+template <class M>
+inline ANNdist annBoxDistance(
+	const ANNpoint		q,				// the point
+	const ANNpoint		lo,				// low point of box
+	const ANNpoint		hi,				// high point of box
+	int					dim)			// dimension of space
+{
+	ANNdist dist = 0.0;
+	for (int d = 0; d < dim; d++) {
+		if (q[d] < lo[d])				// q is left of box
+			dist = M::sum(dist, M::power(lo[d] - q[d]));
+		else if (q[d] > hi[d])			// q is right of box
+			dist = M::sum(dist, M::power(q[d] - hi[d]));
+	}
+	return dist;
+}
+
+//----------------------------------------------------------------------
+//	Entry points
+//		annkMetricSearch and annkMetricFRSearch start the search from
+//		the root in the norm set by annSetMetric().  They are called by
+//		annkSearch() and annkFRSearch() after the global search state
+//		has been set up, and set the error bound themselves.
+//----------------------------------------------------------------------
+
+void annkMetricSearch(					// standard search in other norm
+	ANNkd_ptr			root,			// root of tree
+	ANNpoint			q,				// query point
+	ANNpoint			bnd_box_lo,		// bounding box of tree
+	ANNpoint			bnd_box_hi,
+	int					dim,			// dimension of space
+	double				eps);			// the error bound
+
+void annkMetricFRSearch(				// fixed-radius search in other norm
+	ANNkd_ptr			root,			// root of tree
+	ANNpoint			q,				// query point
+	ANNpoint			bnd_box_lo,		// bounding box of tree
+	ANNpoint			bnd_box_hi,
+	int					dim,			// dimension of space
+	double				eps);			// the error bound
+
+#endif
@@ -0,0 +1,360 @@
+//----------------------------------------------------------------------
+// File:			kd_metric_search.cpp
+// Description:		Standard and fixed-radius kd-tree search in the
+//					L_1, L_inf and L_p norms
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include "kd_metric.h"					// norms
+#include "kd_search.h"					// kd-tree search declarations
+#include "kd_fix_rad_search.h"			// kd fixed-radius search declarations
+#include "bd_tree.h"					// bd-tree declarations
+
+//----------------------------------------------------------------------
+//	Searching in other norms
+//		The routines below are the standard search of kd_search.cpp
+//		and the fixed-radius search of kd_fix_rad_search.cpp, written
+//		as templates over the norm M (see kd_metric.h), for splitting
+//		nodes, leaves and the shrinking nodes of bd-trees.  They use
+//		the same global search state as the Euclidean routines.  Each
+//		node has one virtual function per norm, which calls the
+//		template instantiated for that norm; the search is started
+//		by annkSearch() and annkFRSearch() through the entry points
+//		at the end of this file when a norm other than the Euclidean
+//		has been set with annSetMetric().
+//
+//		The leaves scan their points as the Euclidean routines do,
+//		including the blocked scan of the leaf copy.  Other nodes
+//		(e.g., those of ball trees) do not support other norms.
+//----------------------------------------------------------------------
+
+void ANNkd_node::ann_search_l1(ANNdist)
+	{  annError("Norm not supported by this search structure", ANNabort);  }
+void ANNkd_node::ann_search_linf(ANNdist)
+	{  annError("Norm not supported by this search structure", ANNabort);  }
+void ANNkd_node::ann_search_lp(ANNdist)
+	{  annError("Norm not supported by this search structure", ANNabort);  }
+void ANNkd_node::ann_FR_search_l1(ANNdist)
+	{  annError("Norm not supported by this search structure", ANNabort);  }
+void ANNkd_node::ann_FR_search_linf(ANNdist)
+	{  annError("Norm not supported by this search structure", ANNabort);  }
+void ANNkd_node::ann_FR_search_lp(ANNdist)
+	{  annError("Norm not supported by this search structure", ANNabort);  }
+
+//----------------------------------------------------------------------
+//	kd_split::ann_msearch - search a splitting node
+//----------------------------------------------------------------------
+
+template <class M>
+void ANNkd_split::ann_msearch(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+										// check dist calc term condition
+	if (ANNmaxPtsVisited != 0 && ANNptsVisited > ANNmaxPtsVisited) return;
+
+										// distance to cutting plane
+	ANNcoord cut_diff = ANNkdQ[cut_dim] - cut_val;
+
+	int near = (cut_diff < 0) ? ANN_LO : ANN_HI;
+	M::search(child[near], box_dist);	// visit closer child first
+
+	ANNcoord box_diff = (near == ANN_LO) ?
+			cd_bnds[ANN_LO] - ANNkdQ[cut_dim] : ANNkdQ[cut_dim] - cd_bnds[ANN_HI];
+	if (box_diff < 0)					// within bounds - ignore
+		box_diff = 0;
+										// distance to further box
+	box_dist = M::sum(box_dist, M::diff(M::power(box_diff), M::power(cut_diff)));
+
+										// visit further child if close enough
+	if (box_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
+		M::search(child[1-near], box_dist);
+
+	ANN_FLOP(10)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	kd_leaf::ann_msearch - search points in a leaf node
+//----------------------------------------------------------------------
+
+template <class M>
+void ANNkd_leaf::ann_msearch(ANNdist box_dist)
+{
+	ANNdist min_dist = ANNkdPointMK->max_key(); // k-th smallest distance so far
+
+	if (soa != NULL) {					// blocked leaf copy available
+		ANNdist bdist[ANN_SOA_LANES];	// distances to block points
+		for (int i0 = 0; i0 < n_pts; i0 += ANN_SOA_LANES) {
+			ANN_COORD(ANNkdDim*ANN_SOA_LANES)
+			ANN_FLOP(4*ANNkdDim*ANN_SOA_LANES)
+			if (!annSoaBlockDist<M>(soa, i0 / ANN_SOA_LANES, ANNkdDim,
+					ANNkdQ, min_dist, bdist)) continue;
+										// insert in bucket order
+			for (int l = 0; l < ANN_SOA_LANES && i0 + l < n_pts; l++) {
+				if (bdist[l] <= min_dist &&
+				   (ANN_ALLOW_SELF_MATCH || bdist[l]!=0) &&
+				   bkt[i0 + l] != ANNexcludeIdx) {
+					ANNkdPointMK->insert(bdist[l], bkt[i0 + l]);
+					min_dist = ANNkdPointMK->max_key();
+				}
+			}
+		}
+	}
+	else {
+		for (int i = 0; i < n_pts; i++) {	// check points in bucket
+			const ANNcoord* pp = ANNkdPts[bkt[i]];
+			ANNdist dist = 0;
+			int d;
+			for (d = 0; d < ANNkdDim; d++) {
+				ANN_COORD(1)			// one more coordinate hit
+				ANN_FLOP(4)				// increment floating ops
+										// exceeds dist to k-th smallest?
+				if ((dist = M::sum(dist, M::power(ANNkdQ[d] - pp[d]))) > min_dist)
+					break;
+			}
+
+			if (d >= ANNkdDim &&					// among the k best?
+			   (ANN_ALLOW_SELF_MATCH || dist!=0) && // and no self-match problem
+			   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
+				ANNkdPointMK->insert(dist, bkt[i]);
+				min_dist = ANNkdPointMK->max_key();
+			}
+		}
+	}
+	ANN_LEAF(1)							// one more leaf node visited
+	ANN_PTS(n_pts)						// increment points visited
+	ANNptsVisited += n_pts;				// increment number of points visited
+}
+
+//----------------------------------------------------------------------
+//	bd_shrink::ann_msearch - search a shrinking node
+//----------------------------------------------------------------------
+
+template <class M>
+void ANNbd_shrink::ann_msearch(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+										// check dist calc term cond.
+	if (ANNmaxPtsVisited != 0 && ANNptsVisited > ANNmaxPtsVisited) return;
+
+	ANNdist inner_dist = 0;				// distance to inner box
+	for (int i = 0; i < n_bnds; i++) {	// is query point in the box?
+		if (bnds[i].out(ANNkdQ)) {		// outside this bounding side?
+			inner_dist = M::sum(inner_dist,
+					M::power(ANNkdQ[bnds[i].cd] - bnds[i].cv));
+		}
+	}
+	if (inner_dist <= box_dist) {		// if inner box is closer
+		M::search(child[ANN_IN], inner_dist);
+		M::search(child[ANN_OUT], box_dist);
+	}
+	else {								// if outer box is closer
+		M::search(child[ANN_OUT], box_dist);
+		M::search(child[ANN_IN], inner_dist);
+	}
+	ANN_FLOP(3*n_bnds)					// increment floating ops
+	ANN_SHR(1)							// one more shrinking node
+}
+
+//----------------------------------------------------------------------
+//	kd_split::ann_mFR_search - fixed-radius search of a splitting node
+//----------------------------------------------------------------------
+
+template <class M>
+void ANNkd_split::ann_mFR_search(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+										// check dist calc term condition
+	if (ANNmaxPtsVisited != 0 && ANNkdFRPtsVisited > ANNmaxPtsVisited) return;
+
+										// distance to cutting plane
+	ANNcoord cut_diff = ANNkdFRQ[cut_dim] - cut_val;
+
+	int near = (cut_diff < 0) ? ANN_LO : ANN_HI;
+	M::FR_search(child[near], box_dist);// visit closer child first
+
+	ANNcoord box_diff = (near == ANN_LO) ?
+			cd_bnds[ANN_LO] - ANNkdFRQ[cut_dim] : ANNkdFRQ[cut_dim] - cd_bnds[ANN_HI];
+	if (box_diff < 0)					// within bounds - ignore
+		box_diff = 0;
+										// distance to further box
+	box_dist = M::sum(box_dist, M::diff(M::power(box_diff), M::power(cut_diff)));
+
+										// visit further child if in range
+	if (box_dist * ANNkdFRMaxErr <= ANNkdFRSqRad)
+		M::FR_search(child[1-near], box_dist);
+
+	ANN_FLOP(13)						// increment floating ops
+	ANN_SPL(1)							// one more splitting node visited
+}
+
+//----------------------------------------------------------------------
+//	kd_leaf::ann_mFR_search - fixed-radius search of a leaf node
+//----------------------------------------------------------------------
+
+template <class M>
+void ANNkd_leaf::ann_mFR_search(ANNdist box_dist)
+{
+	if (soa != NULL) {					// blocked leaf copy available
+		ANNdist bdist[ANN_SOA_LANES];	// distances to block points
+		for (int i0 = 0; i0 < n_pts; i0 += ANN_SOA_LANES) {
+			ANN_COORD(ANNkdFRDim*ANN_SOA_LANES)
+			ANN_FLOP(5*ANNkdFRDim*ANN_SOA_LANES)
+			if (!annSoaBlockDist<M>(soa, i0 / ANN_SOA_LANES, ANNkdFRDim,
+					ANNkdFRQ, ANNkdFRSqRad, bdist)) continue;
+										// insert in bucket order
+			for (int l = 0; l < ANN_SOA_LANES && i0 + l < n_pts; l++) {
+				if (bdist[l] <= ANNkdFRSqRad &&
+				   (ANN_ALLOW_SELF_MATCH || bdist[l]!=0) &&
+				   bkt[i0 + l] != ANNexcludeIdx) {
+					ANNkdFRPointMK->insert(bdist[l], bkt[i0 + l]);
+					ANNkdFRPtsInRange++;	// increment point count
+				}
+			}
+		}
+	}
+	else {
+		for (int i = 0; i < n_pts; i++) {	// check points in bucket
+			const ANNcoord* pp = ANNkdFRPts[bkt[i]];
+			ANNdist dist = 0;
+			int d;
+			for (d = 0; d < ANNkdFRDim; d++) {
+				ANN_COORD(1)			// one more coordinate hit
+				ANN_FLOP(5)				// increment floating ops
+										// exceeds radius?
+				if ((dist = M::sum(dist, M::power(ANNkdFRQ[d] - pp[d]))) > ANNkdFRSqRad)
+					break;
+			}
+
+			if (d >= ANNkdFRDim &&					// in the range?
+			   (ANN_ALLOW_SELF_MATCH || dist!=0) && // and no self-match problem
+			   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
+				ANNkdFRPointMK->insert(dist, bkt[i]);
+				ANNkdFRPtsInRange++;				// increment point count
+			}
+		}
+	}
+	ANN_LEAF(1)							// one more leaf node visited
+	ANN_PTS(n_pts)						// increment points visited
+	ANNkdFRPtsVisited += n_pts;			// increment number of points visited
+}
+
+//----------------------------------------------------------------------
+//	bd_shrink::ann_mFR_search - fixed-radius search of a shrinking node
+//----------------------------------------------------------------------
+
+template <class M>
+void ANNbd_shrink::ann_mFR_search(ANNdist box_dist)
+{
+	if (n_lv == 0) return;				// all points below deleted
+										// check dist calc term cond.
+	if (ANNmaxPtsVisited != 0 && ANNkdFRPtsVisited > ANNmaxPtsVisited) return;
+
+	ANNdist inner_dist = 0;				// distance to inner box
+	for (int i = 0; i < n_bnds; i++) {	// is query point in the box?
+		if (bnds[i].out(ANNkdFRQ)) {	// outside this bounding side?
+			inner_dist = M::sum(inner_dist,
+					M::power(ANNkdFRQ[bnds[i].cd] - bnds[i].cv));
+		}
+	}
+	if (inner_dist <= box_dist) {		// if inner box is closer
+		M::FR_search(child[ANN_IN], inner_dist);
+		M::FR_search(child[ANN_OUT], box_dist);
+	}
+	else {								// if outer box is closer
+		M::FR_search(child[ANN_OUT], box_dist);
+		M::FR_search(child[ANN_IN], inner_dist);
+	}
+	ANN_FLOP(3*n_bnds)					// increment floating ops
+	ANN_SHR(1)							// one more shrinking node
+}
+
+//----------------------------------------------------------------------
+//	Virtual functions per norm
+//----------------------------------------------------------------------
+
+void ANNkd_split::ann_search_l1(ANNdist d)		{ ann_msearch<ANNmetric_l1>(d); }
+void ANNkd_split::ann_search_linf(ANNdist d)	{ ann_msearch<ANNmetric_linf>(d); }
+void ANNkd_split::ann_search_lp(ANNdist d)		{ ann_msearch<ANNmetric_lp>(d); }
+void ANNkd_split::ann_FR_search_l1(ANNdist d)	{ ann_mFR_search<ANNmetric_l1>(d); }
+void ANNkd_split::ann_FR_search_linf(ANNdist d)	{ ann_mFR_search<ANNmetric_linf>(d); }
+void ANNkd_split::ann_FR_search_lp(ANNdist d)	{ ann_mFR_search<ANNmetric_lp>(d); }
+
+void ANNkd_leaf::ann_search_l1(ANNdist d)		{ ann_msearch<ANNmetric_l1>(d); }
+void ANNkd_leaf::ann_search_linf(ANNdist d)		{ ann_msearch<ANNmetric_linf>(d); }
+void ANNkd_leaf::ann_search_lp(ANNdist d)		{ ann_msearch<ANNmetric_lp>(d); }
+void ANNkd_leaf::ann_FR_search_l1(ANNdist d)	{ ann_mFR_search<ANNmetric_l1>(d); }
+void ANNkd_leaf::ann_FR_search_linf(ANNdist d)	{ ann_mFR_search<ANNmetric_linf>(d); }
+void ANNkd_leaf::ann_FR_search_lp(ANNdist d)	{ ann_mFR_search<ANNmetric_lp>(d); }
+
+void ANNbd_shrink::ann_search_l1(ANNdist d)		{ ann_msearch<ANNmetric_l1>(d); }
+void ANNbd_shrink::ann_search_linf(ANNdist d)	{ ann_msearch<ANNmetric_linf>(d); }
+void ANNbd_shrink::ann_search_lp(ANNdist d)		{ ann_msearch<ANNmetric_lp>(d); }
+void ANNbd_shrink::ann_FR_search_l1(ANNdist d)	{ ann_mFR_search<ANNmetric_l1>(d); }
+void ANNbd_shrink::ann_FR_search_linf(ANNdist d){ ann_mFR_search<ANNmetric_linf>(d); }
+void ANNbd_shrink::ann_FR_search_lp(ANNdist d)	{ ann_mFR_search<ANNmetric_lp>(d); }
+
+//----------------------------------------------------------------------
+//	Entry points
+//----------------------------------------------------------------------
+
+template <class M>
+static void annkMetricStart(			// start search in norm M
+	ANNkd_ptr			root,			// root of tree
+	ANNpoint			q,				// query point
+	ANNpoint			bnd_box_lo,		// bounding box of tree
+	ANNpoint			bnd_box_hi,
+	int					dim,			// dimension of space
+	double				eps,			// the error bound
+	ANNbool				fixed_rad)		// fixed-radius search?
+{
+	ANNdist box_dist = annBoxDistance<M>(q, bnd_box_lo, bnd_box_hi, dim);
+	if (fixed_rad) {
+		ANNkdFRMaxErr = M::power(1.0 + eps);
+		M::FR_search(root, box_dist);
+	}
+	else {
+		ANNkdMaxErr = M::power(1.0 + eps);
+		M::search(root, box_dist);
+	}
+}
+
+static void annkMetricDispatch(			// start search in active norm
+	ANNkd_ptr			root,
+	ANNpoint			q,
+	ANNpoint			bnd_box_lo,
+	ANNpoint			bnd_box_hi,
+	int					dim,
+	double				eps,
+	ANNbool				fixed_rad)
+{
+	switch (ANNactiveMetric) {
+	case ANN_METRIC_L1:
+		annkMetricStart<ANNmetric_l1>(root, q, bnd_box_lo, bnd_box_hi, dim, eps, fixed_rad);
+		break;
+	case ANN_METRIC_LINF:
+		annkMetricStart<ANNmetric_linf>(root, q, bnd_box_lo, bnd_box_hi, dim, eps, fixed_rad);
+		break;
+	case ANN_METRIC_LP:
+		annkMetricStart<ANNmetric_lp>(root, q, bnd_box_lo, bnd_box_hi, dim, eps, fixed_rad);
+		break;
+	default:
+		annError("Unknown norm", ANNabort);
+	}
+}
+
+void annkMetricSearch(ANNkd_ptr root, ANNpoint q, ANNpoint bnd_box_lo,
+	ANNpoint bnd_box_hi, int dim, double eps)
+{
+	annkMetricDispatch(root, q, bnd_box_lo, bnd_box_hi, dim, eps, ANNfalse);
+}
+
+void annkMetricFRSearch(ANNkd_ptr root, ANNpoint q, ANNpoint bnd_box_lo,
+	ANNpoint bnd_box_hi, int dim, double eps)
+{
+	annkMetricDispatch(root, q, bnd_box_lo, bnd_box_hi, dim, eps, ANNtrue);
+}
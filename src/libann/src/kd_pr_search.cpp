@@ -100,13 +100,17 @@ void ANNkd_tree::annkPriSearch(
 	ANNprPts = pts;
 	ANNptsVisited = 0;					// initialize count of points visited
 
-	ANNprPointMK = new ANNmin_k(k);		// create set for closest k points
+										// get set for closest k points
+	ANNprPointMK = annReuseMinK(search_mk, k);
 
 										// distance to root box
 	ANNdist box_dist = annBoxDistance(q,
 				bnd_box_lo, bnd_box_hi, dim);
 
-	ANNprBoxPQ = new ANNpr_queue(n_pts);// create priority queue for boxes
+	if (search_pq == NULL)				// create priority queue for boxes
+		search_pq = new ANNpr_queue(n_pts);
+	ANNprBoxPQ = search_pq;
+	ANNprBoxPQ->reset();
 	ANNprBoxPQ->insert(box_dist, root); // insert root in priority queue
 
 	while (ANNprBoxPQ->non_empty() &&
@@ -127,9 +131,6 @@ void ANNkd_tree::annkPriSearch(
 		dd[i] = ANNprPointMK->ith_smallest_key(i);
 		nn_idx[i] = ANNprPointMK->ith_smallest_info(i);
 	}
-
-	delete ANNprPointMK;				// deallocate closest point set
-	delete ANNprBoxPQ;					// deallocate priority queue
 }
 
 //----------------------------------------------------------------------
@@ -138,6 +139,7 @@ void ANNkd_tree::annkPriSearch(
 
 void ANNkd_split::ann_pri_search(ANNdist box_dist)
 {
+	if (n_lv == 0) return;				// all points below deleted
 	ANNdist new_dist;					// distance to child visited later
 										// distance to cutting plane
 	ANNcoord cut_diff = ANNprQ[cut_dim] - cut_val;
@@ -207,7 +209,8 @@ void ANNkd_leaf::ann_pri_search(ANNdist box_dist)
 		}
 
 		if (d >= ANNprDim &&					// among the k best?
-		   (ANN_ALLOW_SELF_MATCH || dist!=0)) { // and no self-match problem
+		   (ANN_ALLOW_SELF_MATCH || dist!=0) && // and no self-match problem
+		   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
 												// add it to the list
 			ANNprPointMK->insert(dist, bkt[i]);
 			min_dist = ANNprPointMK->max_key();
@@ -25,6 +25,7 @@
 //----------------------------------------------------------------------
 
 #include "kd_search.h"					// kd-search declarations
+#include "kd_metric.h"					// other norms
 
 //----------------------------------------------------------------------
 //	Approximate nearest neighbor searching by kd-tree search
@@ -103,18 +104,23 @@ void ANNkd_tree::annkSearch(
 		annError("Requesting more near neighbors than data points", ANNabort);
 	}
 
-	ANNkdMaxErr = ANN_POW(1.0 + eps);
-	ANN_FLOP(2)							// increment floating op count
+										// get set for closest k points
+	ANNkdPointMK = annReuseMinK(search_mk, k);
 
-	ANNkdPointMK = new ANNmin_k(k);		// create set for closest k points
+	if (ANNactiveMetric != ANN_METRIC_L2) {	// other norm (see kd_metric.h)
+		annkMetricSearch(root, q, bnd_box_lo, bnd_box_hi, dim, eps);
+	}
+	else {
+		ANNkdMaxErr = ANN_POW(1.0 + eps);
+		ANN_FLOP(2)						// increment floating op count
 										// search starting at the root
-	root->ann_search(annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim));
+		root->ann_search(annBoxDistance(q, bnd_box_lo, bnd_box_hi, dim));
+	}
 
 	for (int i = 0; i < k; i++) {		// extract the k-th closest points
 		dd[i] = ANNkdPointMK->ith_smallest_key(i);
 		nn_idx[i] = ANNkdPointMK->ith_smallest_info(i);
 	}
-	delete ANNkdPointMK;				// deallocate closest point set
 }
 
 //----------------------------------------------------------------------
@@ -123,6 +129,7 @@ void ANNkd_tree::annkSearch(
 
 void ANNkd_split::ann_search(ANNdist box_dist)
 {
+	if (n_lv == 0) return;				// all points below deleted
 										// check dist calc term condition
 	if (ANNmaxPtsVisited != 0 && ANNptsVisited > ANNmaxPtsVisited) return;
 
@@ -180,6 +187,29 @@ void ANNkd_leaf::ann_search(ANNdist box_dist)
 
 	min_dist = ANNkdPointMK->max_key(); // k-th smallest distance so far
 
+	if (soa != NULL) {					// blocked leaf copy available
+		ANNdist bdist[ANN_SOA_LANES];	// distances to block points
+		for (int i0 = 0; i0 < n_pts; i0 += ANN_SOA_LANES) {
+			ANN_COORD(ANNkdDim*ANN_SOA_LANES)
+			ANN_FLOP(4*ANNkdDim*ANN_SOA_LANES)
+			if (!annSoaBlockDist(soa, i0 / ANN_SOA_LANES, ANNkdDim,
+					ANNkdQ, min_dist, bdist)) continue;
+										// insert in bucket order
+			for (int l = 0; l < ANN_SOA_LANES && i0 + l < n_pts; l++) {
+				if (bdist[l] <= min_dist &&
+				   (ANN_ALLOW_SELF_MATCH || bdist[l]!=0) &&
+				   bkt[i0 + l] != ANNexcludeIdx) {
+					ANNkdPointMK->insert(bdist[l], bkt[i0 + l]);
+					min_dist = ANNkdPointMK->max_key();
+				}
+			}
+		}
+		ANN_LEAF(1)						// one more leaf node visited
+		ANN_PTS(n_pts)					// increment points visited
+		ANNptsVisited += n_pts;			// increment number of points visited
+		return;
+	}
+
 	for (int i = 0; i < n_pts; i++) {	// check points in bucket
 
 		pp = ANNkdPts[bkt[i]];			// first coord of next data point
@@ -198,7 +228,8 @@ void ANNkd_leaf::ann_search(ANNdist box_dist)
 		}
 
 		if (d >= ANNkdDim &&					// among the k best?
-		   (ANN_ALLOW_SELF_MATCH || dist!=0)) { // and no self-match problem
+		   (ANN_ALLOW_SELF_MATCH || dist!=0) && // and no self-match problem
+		   bkt[i] != ANNexcludeIdx) {			// and not the excluded point
 												// add it to the list
 			ANNkdPointMK->insert(dist, bkt[i]);
 			min_dist = ANNkdPointMK->max_key();
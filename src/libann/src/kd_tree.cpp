@@ -31,8 +31,15 @@
 #include "kd_tree.h"					// kd-tree declarations
 #include "kd_split.h"					// kd-tree splitting rules
 #include "kd_util.h"					// kd-tree utilities
+#include "pr_queue.h"					// priority queue (search scratch)
+#include "pr_queue_k.h"					// k-closest set (search scratch)
 #include <ANN/ANNperf.h>				// performance evaluation
 
+#include <new>							// std::bad_alloc
+#ifdef _OPENMP
+#include <omp.h>						// OpenMP (parallel build)
+#endif
+
 //----------------------------------------------------------------------
 //	Global data
 //
@@ -49,6 +56,34 @@
 static int				IDX_TRIVIAL[] = {0};	// trivial point index
 ANNkd_leaf				*KD_TRIVIAL = NULL;		// trivial leaf node
 
+//----------------------------------------------------------------------
+//	annSoaCopy - build the blocked leaf copy
+//		Copies the n points of bucket bkt into a freshly allocated
+//		array in the blocked layout described in kd_tree.h.  Lanes
+//		beyond the last point are padded with ANN_DBL_MAX.
+//----------------------------------------------------------------------
+
+ANNcoord *annSoaCopy(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			bkt,			// bucket of point indices
+	int					n,				// number of points
+	int					dim)			// dimension of space
+{
+	int n_blk = (n + ANN_SOA_LANES - 1) / ANN_SOA_LANES;
+	ANNcoord *soa = new ANNcoord[(size_t) n_blk * dim * ANN_SOA_LANES];
+
+	for (int blk = 0; blk < n_blk; blk++) {
+		ANNcoord *pp = soa + (size_t) blk * dim * ANN_SOA_LANES;
+		for (int l = 0; l < ANN_SOA_LANES; l++) {
+			int i = blk * ANN_SOA_LANES + l;
+			for (int d = 0; d < dim; d++) {
+				pp[d * ANN_SOA_LANES + l] = (i < n) ? pa[bkt[i]][d] : ANN_DBL_MAX;
+			}
+		}
+	}
+	return soa;
+}
+
 //----------------------------------------------------------------------
 //	Printing the kd-tree 
 //		These routines print a kd-tree in reverse inorder (high then
@@ -212,6 +247,19 @@ ANNkd_tree::~ANNkd_tree()				// tree destructor
 	if (pidx != NULL) delete [] pidx;
 	if (bnd_box_lo != NULL) annDeallocPt(bnd_box_lo);
 	if (bnd_box_hi != NULL) annDeallocPt(bnd_box_hi);
+	if (search_mk != NULL) delete search_mk;
+	if (search_pq != NULL) delete search_pq;
+	if (count_far != NULL) delete [] count_far;
+}
+
+//----------------------------------------------------------------------
+//	annDeleteSubtree - delete a (partially built) subtree
+//		Used to clean up when construction fails part way.
+//----------------------------------------------------------------------
+
+void annDeleteSubtree(ANNkd_ptr t)
+{
+	if (t != NULL && t != KD_TRIVIAL) delete t;
 }
 
 //----------------------------------------------------------------------
@@ -254,6 +302,12 @@ void ANNkd_tree::SkeletonTree(			// construct skeleton tree
 	pts = pa;							// initialize points array
 
 	root = NULL;						// no associated tree yet
+	search_mk = NULL;					// search scratch allocated on use
+	search_pq = NULL;
+	count_far = NULL;
+	kern_wts = NULL;					// no weights for kernel sums yet
+	kern_wt = 0;
+	kern_weighed = ANNfalse;
 
 	if (pi == NULL) {					// point indices provided?
 		pidx = new ANNidx[n];			// no, allocate space for point indices
@@ -324,7 +378,7 @@ ANNkd_ptr rkd_tree(				// recursive construction of kd-tree
 		if (n == 0)						// empty leaf node
 			return KD_TRIVIAL;			// return (canonical) empty leaf
 		else							// construct the node and return
-			return new ANNkd_leaf(n, pidx); 
+			return new ANNkd_leaf(n, pidx, pa, dim); 
 	}
 	else {								// n large, make a splitting node
 		int cd;							// cutting dimension
@@ -338,17 +392,53 @@ ANNkd_ptr rkd_tree(				// recursive construction of kd-tree
 		ANNcoord lv = bnd_box.lo[cd];	// save bounds for cutting dimension
 		ANNcoord hv = bnd_box.hi[cd];
 
-		bnd_box.hi[cd] = cv;			// modify bounds for left subtree
-		lo = rkd_tree(					// build left subtree
-				pa, pidx, n_lo,			// ...from pidx[0..n_lo-1]
-				dim, bsp, bnd_box, splitter);
-		bnd_box.hi[cd] = hv;			// restore bounds
-
-		bnd_box.lo[cd] = cv;			// modify bounds for right subtree
-		hi = rkd_tree(					// build right subtree
-				pa, pidx + n_lo, n-n_lo,// ...from pidx[n_lo..n-1]
-				dim, bsp, bnd_box, splitter);
-		bnd_box.lo[cd] = lv;			// restore bounds
+#ifdef _OPENMP
+		if (n >= ANN_PAR_BUILD_MIN_PTS && omp_in_parallel()) {
+			ANNorthRect lo_box(dim, bnd_box);	// private box for left task
+			ANNbool lo_failed = ANNfalse;
+			lo_box.hi[cd] = cv;
+			#pragma omp task shared(lo, lo_box, lo_failed)
+			{
+				try {					// build left subtree as a task
+					lo = rkd_tree(pa, pidx, n_lo, dim, bsp, lo_box, splitter);
+				}
+				catch (...) {
+					lo = NULL;
+					lo_failed = ANNtrue;
+				}
+			}
+			bnd_box.lo[cd] = cv;		// build right subtree ourselves
+			try {
+				hi = rkd_tree(pa, pidx + n_lo, n-n_lo, dim, bsp, bnd_box, splitter);
+			}
+			catch (...) {
+				bnd_box.lo[cd] = lv;
+				#pragma omp taskwait
+				annDeleteSubtree(lo);
+				throw;
+			}
+			bnd_box.lo[cd] = lv;		// restore bounds
+			#pragma omp taskwait
+			if (lo_failed) {
+				annDeleteSubtree(hi);
+				throw std::bad_alloc();
+			}
+		}
+		else
+#endif
+		{
+			bnd_box.hi[cd] = cv;		// modify bounds for left subtree
+			lo = rkd_tree(				// build left subtree
+					pa, pidx, n_lo,		// ...from pidx[0..n_lo-1]
+					dim, bsp, bnd_box, splitter);
+			bnd_box.hi[cd] = hv;		// restore bounds
+
+			bnd_box.lo[cd] = cv;		// modify bounds for right subtree
+			hi = rkd_tree(				// build right subtree
+					pa, pidx + n_lo, n-n_lo,// ...from pidx[n_lo..n-1]
+					dim, bsp, bnd_box, splitter);
+			bnd_box.lo[cd] = lv;		// restore bounds
+		}
 
 										// create the splitting node
 		ANNkd_split *ptr = new ANNkd_split(cd, cv, lv, hv, lo, hi);
@@ -357,6 +447,43 @@ ANNkd_ptr rkd_tree(				// recursive construction of kd-tree
 	}
 } 
 
+//----------------------------------------------------------------------
+//	rkd_tree_root - build a kd-tree from the root
+//		Opens a parallel region for large point sets (see kd_tree.h),
+//		in which one thread starts the recursion and the others pick
+//		up subtree tasks.
+//----------------------------------------------------------------------
+
+static ANNkd_ptr rkd_tree_root(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices to store in tree
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	int					bsp,			// bucket space
+	ANNorthRect			&bnd_box,		// bounding box
+	ANNkd_splitter		splitter)		// splitting routine
+{
+#ifdef _OPENMP
+	if (n >= 2*ANN_PAR_BUILD_MIN_PTS && omp_get_max_threads() > 1) {
+		ANNkd_ptr root = NULL;
+		ANNbool failed = ANNfalse;
+		#pragma omp parallel shared(root, failed)
+		#pragma omp single
+		{
+			try {
+				root = rkd_tree(pa, pidx, n, dim, bsp, bnd_box, splitter);
+			}
+			catch (...) {
+				failed = ANNtrue;
+			}
+		}
+		if (failed) throw std::bad_alloc();
+		return root;
+	}
+#endif
+	return rkd_tree(pa, pidx, n, dim, bsp, bnd_box, splitter);
+}
+
 //----------------------------------------------------------------------
 // kd-tree constructor
 //		This is the main constructor for kd-trees given a set of points.
@@ -384,20 +511,20 @@ ANNkd_tree::ANNkd_tree(					// construct from point array
 
 	switch (split) {					// build by rule
 	case ANN_KD_STD:					// standard kd-splitting rule
-		root = rkd_tree(pa, pidx, n, dd, bs, bnd_box, kd_split);
+		root = rkd_tree_root(pa, pidx, n, dd, bs, bnd_box, kd_split);
 		break;
 	case ANN_KD_MIDPT:					// midpoint split
-		root = rkd_tree(pa, pidx, n, dd, bs, bnd_box, midpt_split);
+		root = rkd_tree_root(pa, pidx, n, dd, bs, bnd_box, midpt_split);
 		break;
 	case ANN_KD_FAIR:					// fair split
-		root = rkd_tree(pa, pidx, n, dd, bs, bnd_box, fair_split);
+		root = rkd_tree_root(pa, pidx, n, dd, bs, bnd_box, fair_split);
 		break;
 	case ANN_KD_SUGGEST:				// best (in our opinion)
 	case ANN_KD_SL_MIDPT:				// sliding midpoint split
-		root = rkd_tree(pa, pidx, n, dd, bs, bnd_box, sl_midpt_split);
+		root = rkd_tree_root(pa, pidx, n, dd, bs, bnd_box, sl_midpt_split);
 		break;
 	case ANN_KD_SL_FAIR:				// sliding fair split
-		root = rkd_tree(pa, pidx, n, dd, bs, bnd_box, sl_fair_split);
+		root = rkd_tree_root(pa, pidx, n, dd, bs, bnd_box, sl_fair_split);
 		break;
 	default:
 		annError("Illegal splitting method", ANNabort);
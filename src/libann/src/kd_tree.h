@@ -50,6 +50,25 @@ public:
 	virtual void ann_search(ANNdist) = 0;		// tree search
 	virtual void ann_pri_search(ANNdist) = 0;	// priority search
 	virtual void ann_FR_search(ANNdist) = 0;	// fixed-radius search
+	virtual void ann_count(						// range count (see kd_count)
+				ANNdist box_dist,				// lower bound on distance
+				ANNdist box_far,				// upper bound on distance
+				ANNbool ex_in) = 0;				// may hold excluded point?
+	virtual void ann_kernel(					// kernel sum (see kd_kernel)
+				ANNdist box_dist,				// lower bound on distance
+				ANNdist box_far,				// upper bound on distance
+				ANNbool ex_in) = 0;				// may hold excluded point?
+	virtual ANNdist ann_weigh(					// total weight of live points
+				ANNdistArray wts) = 0;			// point weights (or NULL)
+
+												// searches in other metrics
+												// (see kd_metric_search.cpp)
+	virtual void ann_search_l1(ANNdist);		// tree search, L_1
+	virtual void ann_search_linf(ANNdist);		// tree search, L_inf
+	virtual void ann_search_lp(ANNdist);		// tree search, L_p
+	virtual void ann_FR_search_l1(ANNdist);		// fixed-radius search, L_1
+	virtual void ann_FR_search_linf(ANNdist);	// fixed-radius search, L_inf
+	virtual void ann_FR_search_lp(ANNdist);		// fixed-radius search, L_p
 
 	virtual void getStats(						// get tree statistics
 				int dim,						// dimension of space
@@ -59,6 +78,11 @@ public:
 	virtual void print(int level, ostream &out) = 0;
 	virtual void dump(ostream &out) = 0;		// dump node
 
+	virtual int n_live() = 0;					// no. of live points below
+	virtual ANNbool ann_delete(					// delete point (see kd_delete)
+				ANNidx i,						// index of point
+				ANNpoint p) = 0;				// the point
+
 	friend class ANNkd_tree;					// allow kd-tree to access us
 };
 
@@ -86,22 +110,99 @@ typedef void (*ANNkd_splitter)(			// splitting routine for kd-trees
 //		are indices in the array points, which resides with the
 //		root of the kd-tree.  We also store the number of points
 //		that reside in this bucket.
+//
+//		When the bucket holds at least ANN_SOA_MIN_PTS points and the
+//		point array is given at construction, the leaf also keeps a
+//		private copy of its points in a blocked structure-of-arrays
+//		layout.  Points are grouped in blocks of ANN_SOA_LANES, and
+//		within a block the coordinates of dimension d are contiguous:
+//
+//			soa[(blk*dim + d)*ANN_SOA_LANES + lane]
+//
+//		Unused lanes in the last block are padded with ANN_DBL_MAX so
+//		that they never qualify.  The leaf scan then works on whole
+//		blocks with unit-stride loads that the compiler can vectorize,
+//		instead of chasing one pointer per point.  Leaves without the
+//		copy (small buckets, trees read from dump files, and the
+//		trivial leaf) use the scalar scan.
 //----------------------------------------------------------------------
 
+const int ANN_SOA_LANES		= 4;		// points per block in leaf copy
+const int ANN_SOA_MIN_PTS	= 4;		// min bucket size for leaf copy
+const int ANN_SOA_DIM_BLOCK	= 4;		// dims between early-exit checks
+
+ANNcoord *annSoaCopy(					// build blocked copy of bucket
+	ANNpointArray		pa,				// point array
+	ANNidxArray			bkt,			// bucket of point indices
+	int					n,				// number of points
+	int					dim);			// dimension of space
+
+//----------------------------------------------------------------------
+//	annSoaBlockDist - distances from query to one block of a leaf copy
+//		Accumulates the distances from q to the ANN_SOA_LANES points of
+//		block blk into dist[].  Coordinates are summed in the same order
+//		as in the scalar scan, so the distances are bit-identical.  Every
+//		ANN_SOA_DIM_BLOCK dimensions we check whether all lanes already
+//		exceed bound; if so, the block cannot contribute and we return
+//		ANNfalse with dist[] partially filled.
+//----------------------------------------------------------------------
+
+inline ANNbool annSoaBlockDist(
+	const ANNcoord		*soa,			// leaf copy
+	int					blk,			// block number
+	int					dim,			// dimension of space
+	const ANNcoord		*q,				// query point
+	ANNdist				bound,			// early-exit bound
+	ANNdist				*dist)			// lane distances (returned)
+{
+	const ANNcoord *pp = soa + (size_t) blk * dim * ANN_SOA_LANES;
+	int l;
+	for (l = 0; l < ANN_SOA_LANES; l++) dist[l] = 0;
+
+	for (int d0 = 0; d0 < dim; d0 += ANN_SOA_DIM_BLOCK) {
+		int d1 = d0 + ANN_SOA_DIM_BLOCK < dim ? d0 + ANN_SOA_DIM_BLOCK : dim;
+		for (int d = d0; d < d1; d++) {
+			const ANNcoord qd = q[d];
+			const ANNcoord *pd = pp + d * ANN_SOA_LANES;
+			for (l = 0; l < ANN_SOA_LANES; l++) {
+				ANNcoord t = qd - pd[l];
+				dist[l] = ANN_SUM(dist[l], ANN_POW(t));
+			}
+		}
+		ANNbool live = ANNfalse;
+		for (l = 0; l < ANN_SOA_LANES; l++) {
+			if (dist[l] <= bound) live = ANNtrue;
+		}
+		if (!live) return ANNfalse;
+	}
+	return ANNtrue;
+}
+
 class ANNkd_leaf: public ANNkd_node		// leaf node for kd-tree
 {
 	int					n_pts;			// no. points in bucket
 	ANNidxArray			bkt;			// bucket of points
+	ANNcoord			*soa;			// blocked copy of points (or NULL)
+	int					soa_dim;		// dimension of blocked copy
 public:
 	ANNkd_leaf(							// constructor
 		int				n,				// number of points
-		ANNidxArray		b)				// bucket
+		ANNidxArray		b,				// bucket
+		ANNpointArray	pa = NULL,		// point array (for leaf copy)
+		int				dim = 0)		// dimension of space
 		{
 			n_pts		= n;			// number of points in bucket
 			bkt			= b;			// the bucket
+			soa			= NULL;
+			soa_dim		= dim;
+			if (pa != NULL && n >= ANN_SOA_MIN_PTS)
+				soa = annSoaCopy(pa, b, n, dim);
 		}
 
-	~ANNkd_leaf() { }					// destructor (none)
+	~ANNkd_leaf()						// destructor
+		{
+			if (soa != NULL) delete [] soa;
+		}
 
 	virtual void getStats(						// get tree statistics
 				int dim,						// dimension of space
@@ -113,6 +214,21 @@ public:
 	virtual void ann_search(ANNdist);			// standard search
 	virtual void ann_pri_search(ANNdist);		// priority search
 	virtual void ann_FR_search(ANNdist);		// fixed-radius search
+	virtual void ann_count(ANNdist, ANNdist, ANNbool);	// range count
+	virtual void ann_kernel(ANNdist, ANNdist, ANNbool);	// kernel sum
+	virtual ANNdist ann_weigh(ANNdistArray);	// total weight
+
+	virtual void ann_search_l1(ANNdist);		// searches in other metrics
+	virtual void ann_search_linf(ANNdist);
+	virtual void ann_search_lp(ANNdist);
+	virtual void ann_FR_search_l1(ANNdist);
+	virtual void ann_FR_search_linf(ANNdist);
+	virtual void ann_FR_search_lp(ANNdist);
+	template <class M> void ann_msearch(ANNdist);		// instantiated
+	template <class M> void ann_mFR_search(ANNdist);	// ...per metric
+
+	virtual int n_live() { return n_pts; }		// deleted points are removed
+	virtual ANNbool ann_delete(ANNidx i, ANNpoint p);
 };
 
 //----------------------------------------------------------------------
@@ -136,7 +252,8 @@ extern ANNkd_leaf *KD_TRIVIAL;					// trivial (empty) leaf node
 //		cutting dimension is maintained (this is used to speed up point
 //		to box distance calculations) [we do not store the entire bounding
 //		box since this may be wasteful of space in high dimensions].
-//		We also store pointers to the 2 children.
+//		We also store pointers to the 2 children, and the number of
+//		points below that have not been deleted (see kd_delete.cpp).
 //----------------------------------------------------------------------
 
 class ANNkd_split : public ANNkd_node	// splitting node of a kd-tree
@@ -146,6 +263,8 @@ class ANNkd_split : public ANNkd_node	// splitting node of a kd-tree
 	ANNcoord			cd_bnds[2];		// lower and upper bounds of
 										// rectangle along cut_dim
 	ANNkd_ptr			child[2];		// left and right children
+	int					n_lv;			// no. of live points below
+	ANNdist				wt[2];			// weights of children (kernel sums)
 public:
 	ANNkd_split(						// constructor
 		int cd,							// cutting dimension
@@ -159,6 +278,9 @@ public:
 			cd_bnds[ANN_HI] = hv;				// upper bound for rectangle
 			child[ANN_LO]	= lc;				// left child
 			child[ANN_HI]	= hc;				// right child
+			wt[ANN_LO]		= wt[ANN_HI] = 0;	// no weights yet
+			n_lv = (lc != NULL ? lc->n_live() : 0)
+				 + (hc != NULL ? hc->n_live() : 0);
 		}
 
 	~ANNkd_split()						// destructor
@@ -179,8 +301,44 @@ public:
 	virtual void ann_search(ANNdist);			// standard search
 	virtual void ann_pri_search(ANNdist);		// priority search
 	virtual void ann_FR_search(ANNdist);		// fixed-radius search
+	virtual void ann_count(ANNdist, ANNdist, ANNbool);	// range count
+	virtual void ann_kernel(ANNdist, ANNdist, ANNbool);	// kernel sum
+	virtual ANNdist ann_weigh(ANNdistArray);	// total weight
+
+	virtual void ann_search_l1(ANNdist);		// searches in other metrics
+	virtual void ann_search_linf(ANNdist);
+	virtual void ann_search_lp(ANNdist);
+	virtual void ann_FR_search_l1(ANNdist);
+	virtual void ann_FR_search_linf(ANNdist);
+	virtual void ann_FR_search_lp(ANNdist);
+	template <class M> void ann_msearch(ANNdist);		// instantiated
+	template <class M> void ann_mFR_search(ANNdist);	// ...per metric
+
+	virtual int n_live() { return n_lv; }
+	virtual ANNbool ann_delete(ANNidx i, ANNpoint p);
 };
 
+//----------------------------------------------------------------------
+//	Parallel construction
+//		When ANN is compiled with OpenMP, trees over at least
+//		ANN_PAR_BUILD_MIN_PTS points are built inside a parallel
+//		region.  The builders then hand the low subtree of every node
+//		with at least that many points to another thread as a task,
+//		and build the high subtree themselves.  The low task gets its
+//		own copy of the bounding box, since the box is modified in
+//		place during the recursion.  Below the threshold the
+//		recursion is sequential as before.
+//
+//		Exceptions (i.e., failed allocations) must not leave a task,
+//		so each task catches them, the parent deletes what was built
+//		and rethrows, and the root builder rethrows after the region.
+//----------------------------------------------------------------------
+
+const int ANN_PAR_BUILD_MIN_PTS	= 32768;	// min points to fork subtrees
+
+void annDeleteSubtree(					// delete subtree (if not trivial)
+	ANNkd_ptr			t);				// subtree to delete
+
 //----------------------------------------------------------------------
 //		External entry points
 //----------------------------------------------------------------------
@@ -26,6 +26,10 @@
 
 #include <ANN/ANNperf.h>				// performance evaluation
 
+#ifdef _OPENMP
+#include <omp.h>						// OpenMP (parallel scans)
+#endif
+
 //----------------------------------------------------------------------
 // The following routines are utility functions for manipulating
 // points sets, used in determining splitting planes for kd-tree
@@ -43,6 +47,77 @@
 										// accessing a single point
 #define PP(i)			(pa[pidx[(i)]])
 
+//----------------------------------------------------------------------
+//	annParMinMax - min and max coordinates, scanned in parallel
+//		Large point sets are cut into chunks of ANN_PAR_SCAN_CHUNK
+//		points whose min and max are computed in parallel and then
+//		combined.  Inside a parallel region (i.e., while a tree is
+//		being built by several threads) the chunks are run as tasks,
+//		otherwise a parallel loop is started.  Returns ANNfalse (and
+//		does nothing) when the scan should be done sequentially.
+//----------------------------------------------------------------------
+
+const int ANN_PAR_SCAN_CHUNK = 65536;	// points per parallel chunk
+
+static ANNbool annParMinMax(
+	ANNpointArray		pa,				// point array
+	ANNidxArray			pidx,			// point indices
+	int					n,				// number of points
+	int					d,				// dimension to check
+	ANNcoord			&min,			// minimum value (returned)
+	ANNcoord			&max)			// maximum value (returned)
+{
+#ifdef _OPENMP
+	if (n < 2*ANN_PAR_SCAN_CHUNK || omp_get_max_threads() < 2)
+		return ANNfalse;
+
+	int n_chunk = (n + ANN_PAR_SCAN_CHUNK - 1) / ANN_PAR_SCAN_CHUNK;
+	ANNcoord *mm = new ANNcoord[2*n_chunk];	// min and max of each chunk
+
+	if (omp_in_parallel()) {
+		for (int c = 0; c < n_chunk; c++) {
+			#pragma omp task firstprivate(c) shared(mm)
+			{
+				int i0 = c * ANN_PAR_SCAN_CHUNK;
+				int i1 = (i0 + ANN_PAR_SCAN_CHUNK < n) ? i0 + ANN_PAR_SCAN_CHUNK : n;
+				ANNcoord lo = PA(i0,d), hi = PA(i0,d);
+				for (int i = i0 + 1; i < i1; i++) {
+					ANNcoord x = PA(i,d);
+					if (x < lo) lo = x;
+					else if (x > hi) hi = x;
+				}
+				mm[2*c] = lo;  mm[2*c+1] = hi;
+			}
+		}
+		#pragma omp taskwait
+	}
+	else {
+		#pragma omp parallel for schedule(static)
+		for (int c = 0; c < n_chunk; c++) {
+			int i0 = c * ANN_PAR_SCAN_CHUNK;
+			int i1 = (i0 + ANN_PAR_SCAN_CHUNK < n) ? i0 + ANN_PAR_SCAN_CHUNK : n;
+			ANNcoord lo = PA(i0,d), hi = PA(i0,d);
+			for (int i = i0 + 1; i < i1; i++) {
+				ANNcoord x = PA(i,d);
+				if (x < lo) lo = x;
+				else if (x > hi) hi = x;
+			}
+			mm[2*c] = lo;  mm[2*c+1] = hi;
+		}
+	}
+
+	min = mm[0];  max = mm[1];			// combine chunks
+	for (int c = 1; c < n_chunk; c++) {
+		if (mm[2*c] < min) min = mm[2*c];
+		if (mm[2*c+1] > max) max = mm[2*c+1];
+	}
+	delete [] mm;
+	return ANNtrue;
+#else
+	return ANNfalse;
+#endif
+}
+
 //----------------------------------------------------------------------
 //	annAspectRatio
 //		Compute the aspect ratio (ratio of longest to shortest side)
@@ -78,6 +153,8 @@ void annEnclRect(
 	ANNorthRect			&bnds)			// bounding cube (returned)
 {
 	for (int d = 0; d < dim; d++) {		// find smallest enclosing rectangle
+		if (annParMinMax(pa, pidx, n, d, bnds.lo[d], bnds.hi[d]))
+			continue;
 		ANNcoord lo_bnd = PA(0,d);		// lower bound on dimension d
 		ANNcoord hi_bnd = PA(0,d);		// upper bound on dimension d
 		for (int i = 0; i < n; i++) {
@@ -157,8 +234,12 @@ ANNcoord annSpread(				// compute point spread along dimension
 	int					n,				// number of points
 	int					d)				// dimension to check
 {
-	ANNcoord min = PA(0,d);				// compute max and min coords
-	ANNcoord max = PA(0,d);
+	ANNcoord min, max;
+	if (annParMinMax(pa, pidx, n, d, min, max))
+		return (max - min);
+
+	min = PA(0,d);						// compute max and min coords
+	max = PA(0,d);
 	for (int i = 1; i < n; i++) {
 		ANNcoord c = PA(i,d);
 		if (c < min) min = c;
@@ -175,6 +256,9 @@ void annMinMax(					// compute min and max coordinates along dim
 	ANNcoord			&min,			// minimum value (returned)
 	ANNcoord			&max)			// maximum value (returned)
 {
+	if (annParMinMax(pa, pidx, n, d, min, max))
+		return;
+
 	min = PA(0,d);						// compute max and min coords
 	max = PA(0,d);
 	for (int i = 1; i < n; i++) {
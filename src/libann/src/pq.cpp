@@ -0,0 +1,345 @@
+//----------------------------------------------------------------------
+// File:			pq.cpp
+// Description:		Product quantization
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include <ANN/ANNx.h>					// all ANN includes
+#include "pr_queue_k.h"					// k element priority queue
+
+#include <new>							// std::bad_alloc
+#include <vector>						// training buffers
+
+using namespace std;					// make std:: available
+
+//----------------------------------------------------------------------
+//	Constants
+//		ANN_PQ_MAX_CENT			Centroids per subspace (one-byte codes).
+//		ANN_PQ_TRAIN_PTS		Maximum number of points in the training
+//								sample (about 40 per centroid).
+//		ANN_PQ_ITERS			Number of k-means iterations.
+//		ANN_PQ_PAR_MIN_PTS		Point sets with fewer points are encoded
+//								by a single thread.
+//		ANN_PQ_SEED				Seed of the training sample.  The
+//								centroids of subspace s are initialized
+//								from seed ANN_PQ_SEED + s + 1.
+//----------------------------------------------------------------------
+
+const int		ANN_PQ_MAX_CENT		= 256;
+const int		ANN_PQ_TRAIN_PTS	= 10240;
+const int		ANN_PQ_ITERS		= 15;
+const int		ANN_PQ_PAR_MIN_PTS	= 8192;
+const unsigned long long ANN_PQ_SEED = 0xBB67AE8584CAA73BULL;
+
+//----------------------------------------------------------------------
+//	annPqNearest - nearest centroid of a subvector
+//----------------------------------------------------------------------
+
+static int annPqNearest(
+	const ANNcoord		*x,				// subvector
+	const ANNcoord		*cent,			// centroids of the subspace
+	int					n_cent,			// number of centroids
+	int					w)				// width of the subspace
+{
+	int best = 0;
+	ANNdist best_dist = ANN_DIST_INF;
+	for (int c = 0; c < n_cent; c++) {
+		const ANNcoord *cc = cent + c*w;
+		ANNdist dist = 0;
+		for (int d = 0; d < w; d++) {
+			ANNcoord t = x[d] - cc[d];
+			dist = ANN_SUM(dist, ANN_POW(t));
+		}
+		if (dist < best_dist) {
+			best_dist = dist;
+			best = c;
+		}
+	}
+	return best;
+}
+
+//----------------------------------------------------------------------
+//	annPqKmeans - k-means in one subspace
+//		Lloyd's algorithm on the n training subvectors in x (stored
+//		contiguously, w coordinates each), started from n_cent distinct
+//		training subvectors drawn at random.  A centroid that loses all
+//		its subvectors is moved to a random training subvector.
+//----------------------------------------------------------------------
+
+static void annPqKmeans(
+	const ANNcoord		*x,				// training subvectors
+	int					n,				// number of subvectors
+	int					w,				// width of the subspace
+	int					n_cent,			// number of centroids (<= n)
+	unsigned long long	&rng,			// random state (modified)
+	ANNcoord			*cent)			// centroids (returned)
+{
+	vector<int> perm(n);				// partial Fisher-Yates shuffle
+	for (int i = 0; i < n; i++) perm[i] = i;
+	for (int c = 0; c < n_cent; c++) {
+		int j = c + (int) (annRanBits(rng) % (unsigned long long) (n - c));
+		int tmp = perm[c];  perm[c] = perm[j];  perm[j] = tmp;
+		for (int d = 0; d < w; d++) cent[c*w + d] = x[perm[c]*w + d];
+	}
+
+	vector<int> assign(n, -1);
+	vector<int> count(n_cent);
+	vector<ANNcoord> sum((size_t) n_cent * w);
+	for (int it = 0; it < ANN_PQ_ITERS; it++) {
+		bool changed = false;
+		for (int i = 0; i < n; i++) {	// assign to nearest centroids
+			int c = annPqNearest(x + (size_t) i*w, cent, n_cent, w);
+			if (c != assign[i]) {
+				assign[i] = c;
+				changed = true;
+			}
+		}
+		if (!changed) break;
+
+		fill(count.begin(), count.end(), 0);
+		fill(sum.begin(), sum.end(), 0.0);
+		for (int i = 0; i < n; i++) {	// recompute the centroids
+			count[assign[i]]++;
+			for (int d = 0; d < w; d++)
+				sum[(size_t) assign[i]*w + d] += x[(size_t) i*w + d];
+		}
+		for (int c = 0; c < n_cent; c++) {
+			if (count[c] > 0) {
+				for (int d = 0; d < w; d++)
+					cent[c*w + d] = sum[(size_t) c*w + d] / count[c];
+			} else {					// empty cluster
+				int i = (int) (annRanBits(rng) % (unsigned long long) n);
+				for (int d = 0; d < w; d++) cent[c*w + d] = x[(size_t) i*w + d];
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+//	Constructor and destructor
+//		The subspaces have dim/n_sub or dim/n_sub + 1 coordinates.  The
+//		training sample is drawn once, and the codebooks of the
+//		subspaces are trained in parallel, each from its own seed, so
+//		the result does not depend on the number of threads.
+//----------------------------------------------------------------------
+
+ANNpq::ANNpq(							// build from point array
+	ANNpointArray		pa,				// point array
+	int					n,				// number of points
+	int					dd,				// dimension
+	int					m,				// subspaces (0 = dd/4)
+	int					rerank)			// size of the short list
+{
+	dim = dd;  n_pts = n;  n_live = n;  pts = pa;
+	if (m <= 0) m = dd / 4;
+	n_sub = (m < 1) ? 1 : ((m > dd) ? dd : m);
+	n_rerank = (rerank < 1) ? 1 : rerank;
+	n_cent = 0;
+	sub_lo = NULL;  cents = NULL;  codes = NULL;  deleted = NULL;
+	lut = NULL;							// allocated on first search
+	short_mk = NULL;
+	search_mk = NULL;
+
+	try {
+		deleted = new ANNbool[n];
+		for (int i = 0; i < n; i++) deleted[i] = ANNfalse;
+		sub_lo = new int[n_sub + 1];
+		for (int s = 0; s <= n_sub; s++)
+			sub_lo[s] = (int) ((long long) s * dd / n_sub);
+		codes = new unsigned char[(size_t) n * n_sub];
+		if (n == 0) return;
+
+		int n_train = (n < ANN_PQ_TRAIN_PTS) ? n : ANN_PQ_TRAIN_PTS;
+		n_cent = (n_train < ANN_PQ_MAX_CENT) ? n_train : ANN_PQ_MAX_CENT;
+		cents = new ANNcoord[(size_t) n_cent * dd];
+
+		vector<ANNidx> sample(n);		// draw the training sample
+		for (int i = 0; i < n; i++) sample[i] = i;
+		unsigned long long rng = ANN_PQ_SEED;
+		for (int i = 0; i < n_train && n_train < n; i++) {
+			int j = i + (int) (annRanBits(rng) % (unsigned long long) (n - i));
+			ANNidx tmp = sample[i];  sample[i] = sample[j];  sample[j] = tmp;
+		}
+
+		int failed = 0;
+		#pragma omp parallel for schedule(dynamic) if (n >= ANN_PQ_PAR_MIN_PTS)
+		for (int s = 0; s < n_sub; s++) {
+			try {						// train the codebook of subspace s
+				const int lo = sub_lo[s];
+				const int w = sub_lo[s+1] - lo;
+				vector<ANNcoord> x((size_t) n_train * w);
+				for (int i = 0; i < n_train; i++) {
+					for (int d = 0; d < w; d++)
+						x[(size_t) i*w + d] = pa[sample[i]][lo + d];
+				}
+				unsigned long long srng = ANN_PQ_SEED + (unsigned long long) s + 1;
+				annPqKmeans(&x[0], n_train, w, n_cent, srng,
+							cents + (size_t) n_cent * lo);
+			}
+			catch (...) {
+				#pragma omp atomic write
+				failed = 1;
+			}
+		}
+		if (failed) throw std::bad_alloc();
+
+		#pragma omp parallel for if (n >= ANN_PQ_PAR_MIN_PTS)
+		for (int i = 0; i < n; i++) {	// encode the points
+			for (int s = 0; s < n_sub; s++) {
+				const int lo = sub_lo[s];
+				const int w = sub_lo[s+1] - lo;
+				codes[(size_t) i*n_sub + s] = (unsigned char) annPqNearest(
+						pa[i] + lo, cents + (size_t) n_cent * lo, n_cent, w);
+			}
+		}
+	}
+	catch (...) {
+		delete [] deleted;
+		delete [] sub_lo;
+		delete [] codes;
+		delete [] cents;
+		throw;
+	}
+}
+
+ANNpq::~ANNpq()							// destructor
+{
+	delete [] deleted;
+	delete [] sub_lo;
+	delete [] codes;
+	delete [] cents;
+	delete [] lut;
+	if (short_mk != NULL) delete short_mk;
+	if (search_mk != NULL) delete search_mk;
+}
+
+ANNbool ANNpq::annDeletePt(				// remove point from the index
+	ANNidx				idx)			// index of point to remove
+{
+	if (idx < 0 || idx >= n_pts || deleted[idx]) return ANNfalse;
+	deleted[idx] = ANNtrue;
+	n_live--;
+	return ANNtrue;
+}
+
+//----------------------------------------------------------------------
+//	Searching
+//		ShortList() fills the lookup table with the squared distances
+//		from the query to the centroids, scans the codes, and keeps the
+//		max(n_rerank, k) points with the smallest asymmetric distances
+//		in short_mk, and returns their number.  The short list is then
+//		ranked by exact distances.
+//----------------------------------------------------------------------
+
+int ANNpq::ShortList(					// find the short list for query
+	ANNpoint			q,				// query point
+	int					k)				// number of near neighbors
+{
+	if (lut == NULL)					// first search
+		lut = new ANNdist[(size_t) n_sub * n_cent];
+
+	for (int s = 0; s < n_sub; s++) {	// fill the lookup table
+		const int lo = sub_lo[s];
+		const int w = sub_lo[s+1] - lo;
+		const ANNcoord *cent = cents + (size_t) n_cent * lo;
+		for (int c = 0; c < n_cent; c++) {
+			ANNdist dist = 0;
+			for (int d = 0; d < w; d++) {
+				ANNcoord t = q[lo + d] - cent[c*w + d];
+				dist = ANN_SUM(dist, ANN_POW(t));
+			}
+			lut[s*n_cent + c] = dist;
+		}
+	}
+
+	const int n_short = (k > n_rerank) ? k : n_rerank;
+	ANNmin_k &sl = *annReuseMinK(short_mk, n_short);
+	int n_scan = 0;						// number of points scanned
+	const unsigned char *code = codes;
+	for (int i = 0; i < n_pts; i++, code += n_sub) {
+		if (deleted[i] || i == ANNexcludeIdx) continue;
+		ANNdist dist = 0;				// asymmetric distance
+		const ANNdist *tab = lut;
+		for (int s = 0; s < n_sub; s++, tab += n_cent)
+			dist += tab[code[s]];
+		if (dist < sl.max_key()) sl.insert(dist, i);
+		n_scan++;
+	}
+	return (n_scan < n_short) ? n_scan : n_short;
+}
+
+void ANNpq::annkSearch(					// approx k near neighbor search
+	ANNpoint			q,				// query point
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	ANNdistArray		dd,				// dist to near neighbors (returned)
+	double				eps)			// error bound (ignored)
+{
+	if (k > n_pts) {					// too many near neighbors?
+		annError("Requesting more near neighbors than data points", ANNabort);
+	}
+
+	ANNmin_k &mk = *annReuseMinK(search_mk, k);	// k-limited priority queue
+	int n_found = 0;
+	if (n_pts > 0) {
+		int n_short = ShortList(q, k);
+		for (int i = 0; i < n_short; i++) {	// re-rank exactly
+			ANNidx p = short_mk->ith_smallest_info(i);
+			ANNdist sqDist = annDist(dim, pts[p], q);
+			if (ANN_ALLOW_SELF_MATCH || sqDist != 0) {
+				mk.insert(sqDist, p);
+				n_found++;
+			}
+		}
+	}
+
+	if (n_found < k) {					// too few found, scan all points
+		annReuseMinK(search_mk, k);
+		for (int i = 0; i < n_pts; i++) {
+			if (deleted[i] || i == ANNexcludeIdx) continue;
+			ANNdist sqDist = annDist(dim, pts[i], q);
+			if (ANN_ALLOW_SELF_MATCH || sqDist != 0)
+				mk.insert(sqDist, i);
+		}
+	}
+
+	for (int i = 0; i < k; i++) {		// extract the k closest points
+		dd[i] = mk.ith_smallest_key(i);
+		nn_idx[i] = mk.ith_smallest_info(i);
+	}
+}
+
+int ANNpq::annkFRSearch(				// approx fixed-radius kNN search
+	ANNpoint			q,				// query point
+	ANNdist				sqRad,			// squared radius
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor array (returned)
+	ANNdistArray		dd,				// dist to near neighbors (returned)
+	double				eps)			// error bound (ignored)
+{
+	ANNmin_k &mk = *annReuseMinK(search_mk, k);	// k-limited priority queue
+	int pts_in_range = 0;				// number of points in query range
+	if (n_pts > 0) {
+		int n_short = ShortList(q, k);
+		for (int i = 0; i < n_short; i++) {
+			ANNidx p = short_mk->ith_smallest_info(i);
+			ANNdist sqDist = annDist(dim, pts[p], q);
+			if (sqDist <= sqRad &&		// within radius bound
+				(ANN_ALLOW_SELF_MATCH || sqDist != 0)) { // ...and no self match
+				mk.insert(sqDist, p);
+				pts_in_range++;
+			}
+		}
+	}
+	for (int i = 0; i < k; i++) {		// extract the k closest points
+		if (dd != NULL)
+			dd[i] = mk.ith_smallest_key(i);
+		if (nn_idx != NULL)
+			nn_idx[i] = mk.ith_smallest_info(i);
+	}
+	return pts_in_range;
+}
@@ -53,54 +53,144 @@ const PQKinfo	PQ_NULL_INFO =  ANN_NULL_IDX;	// nonexistent info value
 //		PQKinfo).  The special info and key values PQ_NULL_INFO and
 //		PQ_NULL_KEY means that thise entry is empty.
 //
-//		It is currently implemented using an array with k items.
+//		For small k it is implemented using an array with k items.
 //		Items are stored in increasing sorted order, and insertions
-//		are made through standard insertion sort.  (This is quite
-//		inefficient, but current applications call for small values
-//		of k and relatively few insertions.)
+//		are made through standard insertion sort.  This is fast for
+//		small k, but each insertion shifts up to k items.
+//
+//		For k >= ANN_MIN_K_HEAP the array is instead kept as a binary
+//		max-heap, so an insertion costs O(log k).  Items are ordered
+//		by key and then by insertion order, which is exactly the
+//		order the insertion sort produces for equal keys, so both
+//		variants keep and report the same items.  The heap is sorted
+//		in place the first time a result is extracted.
 //		
 //		Note that the list contains k+1 entries, but the last entry
 //		is used as a simple placeholder and is otherwise ignored.
+//
+//		Search structures keep one ANNmin_k around and reset() it for
+//		every query, so that the array is only reallocated when k
+//		grows beyond the largest value seen so far.
 //----------------------------------------------------------------------
 
+const int ANN_MIN_K_HEAP = 32;			// min k for heap representation
+
 class ANNmin_k {
 	struct mk_node {					// node in min_k structure
 		PQKkey			key;			// key value
 		PQKinfo			info;			// info field (user defined)
+		int				seq;			// insertion number (heap only)
 	};
 
 	int			k;						// max number of keys to store
 	int			n;						// number of keys currently active
+	int			cap;					// allocated size of list (minus 1)
+	int			n_ins;					// number of insertions so far
+	ANNbool		heap;					// stored as max-heap?
 	mk_node		*mk;					// the list itself
 
+	static ANNbool after(const mk_node &a, const mk_node &b)
+		{ return (a.key > b.key || (a.key == b.key && a.seq > b.seq))
+				? ANNtrue : ANNfalse; }
+
+	void sift_down(int p, int m)		// restore heap below p in mk[0..m-1]
+		{
+			mk_node x = mk[p];
+			int c;
+			while ((c = 2*p + 1) < m) {
+				if (c + 1 < m && after(mk[c+1], mk[c])) c++;
+				if (!after(mk[c], x)) break;
+				mk[p] = mk[c];
+				p = c;
+			}
+			mk[p] = x;
+		}
+
+	void sort_heap()					// turn heap into sorted list
+		{
+			for (int m = n - 1; m > 0; m--) {
+				mk_node t = mk[0];  mk[0] = mk[m];  mk[m] = t;
+				sift_down(0, m);
+			}
+			heap = ANNfalse;
+		}
+
 public:
 	ANNmin_k(int max)					// constructor (given max size)
 		{
 			n = 0;						// initially no items
 			k = max;					// maximum number of items
+			cap = max;
+			n_ins = 0;
+			heap = (max >= ANN_MIN_K_HEAP) ? ANNtrue : ANNfalse;
 			mk = new mk_node[max+1];	// sorted array of keys
 		}
 
 	~ANNmin_k()							// destructor
 		{ delete [] mk; }
+
+	void reset(int max)					// make empty with new max size
+		{
+			if (max > cap) {			// grow only when needed
+				delete [] mk;
+				mk = new mk_node[max+1];
+				cap = max;
+			}
+			n = 0;
+			k = max;
+			n_ins = 0;
+			heap = (max >= ANN_MIN_K_HEAP) ? ANNtrue : ANNfalse;
+		}
 	
 	PQKkey ANNmin_key()					// return minimum key
-		{ return (n > 0 ? mk[0].key : PQ_NULL_KEY); }
+		{
+			if (heap) sort_heap();
+			return (n > 0 ? mk[0].key : PQ_NULL_KEY);
+		}
 	
 	PQKkey max_key()					// return maximum key
-		{ return (n == k ? mk[k-1].key : PQ_NULL_KEY); }
+		{
+			if (n < k) return PQ_NULL_KEY;
+			return (heap ? mk[0].key : mk[k-1].key);
+		}
 	
 	PQKkey ith_smallest_key(int i)		// ith smallest key (i in [0..n-1])
-		{ return (i < n ? mk[i].key : PQ_NULL_KEY); }
+		{
+			if (heap) sort_heap();
+			return (i < n ? mk[i].key : PQ_NULL_KEY);
+		}
 	
 	PQKinfo ith_smallest_info(int i)	// info for ith smallest (i in [0..n-1])
-		{ return (i < n ? mk[i].info : PQ_NULL_INFO); }
+		{
+			if (heap) sort_heap();
+			return (i < n ? mk[i].info : PQ_NULL_INFO);
+		}
 
 	inline void insert(					// insert item (inlined for speed)
 		PQKkey kv,						// key value
 		PQKinfo inf)					// item info
 		{
 			int i;
+			if (heap) {
+				if (n == k) {			// full: replace max if smaller
+					if (!(kv < mk[0].key)) return;
+					mk[0].key = kv;
+					mk[0].info = inf;
+					mk[0].seq = n_ins++;
+					sift_down(0, n);
+					return;
+				}
+				mk_node x;				// sift new item up
+				x.key = kv;  x.info = inf;  x.seq = n_ins++;
+				for (i = n++; i > 0; ) {
+					int p = (i - 1) / 2;
+					if (!after(x, mk[p])) break;
+					mk[i] = mk[p];
+					i = p;
+				}
+				mk[i] = x;
+				return;
+			}
 										// slide larger values up
 			for (i = n; i > 0; i--) {
 				if (mk[i-1].key > kv)
@@ -115,4 +205,15 @@ public:
 		}
 };
 
+//----------------------------------------------------------------------
+//	annReuseMinK - get a cleared k-closest set, reusing mk if possible
+//----------------------------------------------------------------------
+
+inline ANNmin_k* annReuseMinK(ANNmin_k* &mk, int k)
+{
+	if (mk == NULL) mk = new ANNmin_k(k);
+	else mk->reset(k);
+	return mk;
+}
+
 #endif
@@ -0,0 +1,350 @@
+//----------------------------------------------------------------------
+// File:			rp_forest.cpp
+// Description:		Random-projection forests
+//----------------------------------------------------------------------
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//----------------------------------------------------------------------
+
+#include <ANN/ANNx.h>					// all ANN includes
+#include "pr_queue_k.h"					// k element priority queue
+
+#include <algorithm>					// std::fill
+#include <new>							// std::bad_alloc
+#include <vector>						// tree storage
+
+using namespace std;					// make std:: available
+
+//----------------------------------------------------------------------
+//	Constants
+//		ANN_RP_PAR_MIN_PTS		Forests with fewer points are built by
+//								a single thread.
+//		ANN_RP_SEED				Seed of the first tree.  Tree t is built
+//								from seed ANN_RP_SEED + t.
+//		ANN_RP_SPLIT_TRIES		Number of random hyperplanes tried before
+//								a set of points is made a leaf.
+//----------------------------------------------------------------------
+
+const int		ANN_RP_PAR_MIN_PTS	= 8192;
+const unsigned long long ANN_RP_SEED = 0x6A09E667F3BCC909ULL;
+const int		ANN_RP_SPLIT_TRIES	= 3;
+
+//----------------------------------------------------------------------
+//	Random-projection trees
+//		The nodes of a tree are stored in an array with the root first.
+//		An internal node holds the offset of its hyperplane's normal in
+//		the array planes, and the cut value: points whose projection on
+//		the normal is less than the cut value are in the low child.  A
+//		leaf has plane == -1 and holds the points pidx[lo..hi-1].
+//----------------------------------------------------------------------
+
+struct ANNrp_node {
+	int					plane;			// offset of normal (-1 if leaf)
+	ANNcoord			cut;			// cut value
+	int					lo;				// low child, or first point
+	int					hi;				// high child, or end of points
+};
+
+class ANNrp_tree {
+public:
+	vector<ANNrp_node>	nodes;			// the nodes
+	vector<ANNcoord>	planes;			// normals of the hyperplanes
+	vector<ANNidx>		pidx;			// point indices, by leaf
+
+	ANNrp_tree(int n) : pidx(n)
+		{ for (int i = 0; i < n; i++) pidx[i] = i; }
+
+	const ANNrp_node &leaf(				// leaf holding a point
+		const ANNcoord	*q,				// the point
+		int				dim) const		// dimension of space
+		{
+			int i = 0;
+			while (nodes[i].plane >= 0) {
+				const ANNcoord *nv = &planes[nodes[i].plane];
+				ANNcoord proj = 0;
+				for (int d = 0; d < dim; d++) proj += q[d] * nv[d];
+				i = (proj < nodes[i].cut) ? nodes[i].lo : nodes[i].hi;
+			}
+			return nodes[i];
+		}
+};
+
+//----------------------------------------------------------------------
+//	annRpSplit - split points by a random hyperplane
+//		Picks two distinct points a and b in pidx[0..n-1] at random and
+//		partitions pidx by the hyperplane halfway between them, normal
+//		to b - a.  The normal is stored in nv.  Returns the number of
+//		points on the low side, which is 0 or n if the split failed
+//		(e.g., because a and b are equal).
+//----------------------------------------------------------------------
+
+static int annRpSplit(
+	ANNpointArray		pa,				// point array
+	ANNidx				*pidx,			// point indices (permuted)
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	unsigned long long	&rng,			// random state (modified)
+	ANNcoord			*nv,			// normal (returned)
+	ANNcoord			&cut)			// cut value (returned)
+{
+	int i = (int) (annRanBits(rng) % (unsigned long long) n);
+	int j = (int) (annRanBits(rng) % (unsigned long long) (n - 1));
+	if (j >= i) j++;
+	ANNpoint a = pa[pidx[i]];
+	ANNpoint b = pa[pidx[j]];
+
+	cut = 0;
+	for (int d = 0; d < dim; d++) {
+		nv[d] = b[d] - a[d];
+		cut += nv[d] * (a[d] + b[d]) / 2;
+	}
+
+	int l = 0;							// partition around the cut
+	int r = n - 1;
+	for (;;) {
+		while (l <= r) {				// find a point on the high side
+			ANNpoint pp = pa[pidx[l]];
+			ANNcoord proj = 0;
+			for (int d = 0; d < dim; d++) proj += pp[d] * nv[d];
+			if (proj >= cut) break;
+			l++;
+		}
+		while (l <= r) {				// find a point on the low side
+			ANNpoint pp = pa[pidx[r]];
+			ANNcoord proj = 0;
+			for (int d = 0; d < dim; d++) proj += pp[d] * nv[d];
+			if (proj < cut) break;
+			r--;
+		}
+		if (l >= r) break;
+		ANNidx tmp = pidx[l];			// swap them
+		pidx[l] = pidx[r];
+		pidx[r] = tmp;
+		l++;
+		r--;
+	}
+	return l;
+}
+
+//----------------------------------------------------------------------
+//	annRpBuild - recursive procedure to build a tree
+//		Builds the subtree for the points pidx[lo..lo+n-1] and returns
+//		the index of its root.  Sets of at most leaf_size points become
+//		leaves, as do sets that no random hyperplane splits (which only
+//		happens when many points are equal).
+//----------------------------------------------------------------------
+
+static int annRpBuild(
+	ANNrp_tree			&t,				// the tree (modified)
+	ANNpointArray		pa,				// point array
+	int					lo,				// first point in subtree
+	int					n,				// number of points
+	int					dim,			// dimension of space
+	int					leaf_size,		// max points per leaf
+	unsigned long long	&rng)			// random state (modified)
+{
+	const int node = (int) t.nodes.size();
+	ANNrp_node leaf = {-1, 0, lo, lo + n};
+	t.nodes.push_back(leaf);
+	if (n <= leaf_size) return node;
+
+	const int plane = (int) t.planes.size();
+	t.planes.resize(plane + dim);
+	ANNcoord cut = 0;
+	int n_lo = 0;
+	for (int i = 0; i < ANN_RP_SPLIT_TRIES && (n_lo == 0 || n_lo == n); i++)
+		n_lo = annRpSplit(pa, &t.pidx[lo], n, dim, rng, &t.planes[plane], cut);
+	if (n_lo == 0 || n_lo == n) {		// no split found
+		t.planes.resize(plane);
+		return node;
+	}
+
+	int lo_child = annRpBuild(t, pa, lo, n_lo, dim, leaf_size, rng);
+	int hi_child = annRpBuild(t, pa, lo + n_lo, n - n_lo, dim, leaf_size, rng);
+	t.nodes[node].plane = plane;
+	t.nodes[node].cut = cut;
+	t.nodes[node].lo = lo_child;
+	t.nodes[node].hi = hi_child;
+	return node;
+}
+
+//----------------------------------------------------------------------
+//	Forest constructor and destructor
+//		The trees are independent, so they are built in parallel.  Each
+//		tree draws from its own seed, so the forest does not depend on
+//		the number of threads.
+//----------------------------------------------------------------------
+
+ANNrp_forest::ANNrp_forest(				// build from point array
+	ANNpointArray		pa,				// point array
+	int					n,				// number of points
+	int					dd,				// dimension
+	int					nt,				// number of trees
+	int					ls)				// max points per leaf
+{
+	dim = dd;  n_pts = n;  n_live = n;  pts = pa;
+	n_trees = (nt < 1) ? 1 : nt;
+	leaf_size = (ls < 1) ? 1 : ls;
+	trees = NULL;  deleted = NULL;
+	mark = NULL;  mark_tag = 0;			// allocated on first search
+	cand = NULL;
+	search_mk = NULL;
+
+	try {
+		deleted = new ANNbool[n];
+		for (int i = 0; i < n; i++) deleted[i] = ANNfalse;
+		trees = new ANNrp_tree*[n_trees];
+		for (int t = 0; t < n_trees; t++) trees[t] = NULL;
+
+		int failed = 0;
+		#pragma omp parallel for schedule(dynamic) if (n >= ANN_RP_PAR_MIN_PTS)
+		for (int t = 0; t < n_trees; t++) {
+			try {
+				unsigned long long rng = ANN_RP_SEED + (unsigned long long) t;
+				trees[t] = new ANNrp_tree(n);
+				if (n > 0) annRpBuild(*trees[t], pa, 0, n, dd, leaf_size, rng);
+			}
+			catch (...) {
+				#pragma omp atomic write
+				failed = 1;
+			}
+		}
+		if (failed) throw std::bad_alloc();
+	}
+	catch (...) {
+		if (trees != NULL) {
+			for (int t = 0; t < n_trees; t++) delete trees[t];
+		}
+		delete [] trees;
+		delete [] deleted;
+		throw;
+	}
+}
+
+ANNrp_forest::~ANNrp_forest()			// destructor
+{
+	for (int t = 0; t < n_trees; t++) delete trees[t];
+	delete [] trees;
+	delete [] deleted;
+	delete [] mark;
+	delete [] cand;
+	if (search_mk != NULL) delete search_mk;
+}
+
+ANNbool ANNrp_forest::annDeletePt(		// remove point from the forest
+	ANNidx				idx)			// index of point to remove
+{
+	if (idx < 0 || idx >= n_pts || deleted[idx]) return ANNfalse;
+	deleted[idx] = ANNtrue;
+	n_live--;
+	return ANNtrue;
+}
+
+//----------------------------------------------------------------------
+//	Searching
+//		Candidates() puts the union of the query's leaves in cand and
+//		returns their number.  The candidates are then ranked by their
+//		exact distances to the query.
+//----------------------------------------------------------------------
+
+int ANNrp_forest::Candidates(			// collect candidates for query
+	ANNpoint			q)				// query point
+{
+	if (mark == NULL) {					// first search
+		mark = new unsigned[n_pts];
+		fill(mark, mark + n_pts, 0u);
+		cand = new ANNidx[n_pts];
+	}
+	if (++mark_tag == 0) {				// marks wrapped around
+		fill(mark, mark + n_pts, 0u);
+		mark_tag = 1;
+	}
+
+	int n_cand = 0;
+	for (int t = 0; t < n_trees; t++) {
+		const ANNrp_node &leaf = trees[t]->leaf(q, dim);
+		for (int i = leaf.lo; i < leaf.hi; i++) {
+			ANNidx p = trees[t]->pidx[i];
+			if (mark[p] == mark_tag) continue;
+			mark[p] = mark_tag;
+			cand[n_cand++] = p;
+		}
+	}
+	return n_cand;
+}
+
+void ANNrp_forest::annkSearch(			// approx k near neighbor search
+	ANNpoint			q,				// query point
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	ANNdistArray		dd,				// dist to near neighbors (returned)
+	double				eps)			// error bound (ignored)
+{
+	if (k > n_pts) {					// too many near neighbors?
+		annError("Requesting more near neighbors than data points", ANNabort);
+	}
+
+	ANNmin_k &mk = *annReuseMinK(search_mk, k);	// k-limited priority queue
+	int n_found = 0;
+	if (n_pts > 0) {
+		int n_cand = Candidates(q);
+		for (int i = 0; i < n_cand; i++) {	// rank the candidates
+			ANNidx p = cand[i];
+			if (deleted[p] || p == ANNexcludeIdx) continue;
+			ANNdist sqDist = annDist(dim, pts[p], q);
+			if (ANN_ALLOW_SELF_MATCH || sqDist != 0) {
+				mk.insert(sqDist, p);
+				n_found++;
+			}
+		}
+	}
+
+	if (n_found < k) {					// too few found, scan all points
+		annReuseMinK(search_mk, k);
+		for (int i = 0; i < n_pts; i++) {
+			if (deleted[i] || i == ANNexcludeIdx) continue;
+			ANNdist sqDist = annDist(dim, pts[i], q);
+			if (ANN_ALLOW_SELF_MATCH || sqDist != 0)
+				mk.insert(sqDist, i);
+		}
+	}
+
+	for (int i = 0; i < k; i++) {		// extract the k closest points
+		dd[i] = mk.ith_smallest_key(i);
+		nn_idx[i] = mk.ith_smallest_info(i);
+	}
+}
+
+int ANNrp_forest::annkFRSearch(			// approx fixed-radius kNN search
+	ANNpoint			q,				// query point
+	ANNdist				sqRad,			// squared radius
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor array (returned)
+	ANNdistArray		dd,				// dist to near neighbors (returned)
+	double				eps)			// error bound (ignored)
+{
+	ANNmin_k &mk = *annReuseMinK(search_mk, k);	// k-limited priority queue
+	int pts_in_range = 0;				// number of points in query range
+	if (n_pts > 0) {
+		int n_cand = Candidates(q);
+		for (int i = 0; i < n_cand; i++) {
+			ANNidx p = cand[i];
+			if (deleted[p] || p == ANNexcludeIdx) continue;
+			ANNdist sqDist = annDist(dim, pts[p], q);
+			if (sqDist <= sqRad &&		// within radius bound
+				(ANN_ALLOW_SELF_MATCH || sqDist != 0)) { // ...and no self match
+				mk.insert(sqDist, p);
+				pts_in_range++;
+			}
+		}
+	}
+	for (int i = 0; i < k; i++) {		// extract the k closest points
+		if (dd != NULL)
+			dd[i] = mk.ith_smallest_key(i);
+		if (nn_idx != NULL)
+			nn_idx[i] = mk.ith_smallest_info(i);
+	}
+	return pts_in_range;
+}
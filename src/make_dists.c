@@ -0,0 +1,353 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#include "make_dists.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <R.h>
+#include <Rinternals.h>
+#include "error.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Data points are processed in blocks of this many points. A block of
+// the output matrix stays in cache while all columns are written to it,
+// and the covariance is accumulated block by block.
+static const size_t DIST_MAKE_BLOCK_SIZE = 256;
+
+// Loops over fewer data points than this are not run in parallel
+static const size_t DIST_MAKE_PAR_MIN_POINTS = 16384;
+
+
+static inline int idist_num_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+
+static inline int idist_thread_num(void)
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+
+// `R_data` is either a numeric or logical matrix with data points as rows,
+// or a list of numeric or logical columns of equal length (the columns of
+// a data frame). The columns are copied directly into a new matrix with
+// data points as columns, without forming the transposed matrix first.
+// Returns `R_NilValue` if the data contain NAs.
+SEXP dist_make_data_matrix(const SEXP R_data)
+{
+	const bool is_list = (TYPEOF(R_data) == VECSXP);
+	size_t num_data_points;
+	int num_dimensions;
+	if (is_list) {
+		num_dimensions = (int) xlength(R_data);
+		idist_assert(num_dimensions > 0);
+		num_data_points = (size_t) xlength(VECTOR_ELT(R_data, 0));
+	} else {
+		idist_assert(isMatrix(R_data));
+		num_data_points = (size_t) INTEGER(getAttrib(R_data, R_DimSymbol))[0];
+		num_dimensions = INTEGER(getAttrib(R_data, R_DimSymbol))[1];
+	}
+
+	const double** const real_columns = (const double**) R_alloc((size_t) num_dimensions, sizeof(const double*));
+	const int** const int_columns = (const int**) R_alloc((size_t) num_dimensions, sizeof(const int*));
+	for (int c = 0; c < num_dimensions; ++c) {
+		const SEXP R_column = is_list ? VECTOR_ELT(R_data, c) : R_data;
+		const size_t offset = is_list ? 0 : (size_t) c * num_data_points;
+		if (is_list) idist_assert((size_t) xlength(R_column) == num_data_points);
+		real_columns[c] = NULL;
+		int_columns[c] = NULL;
+		if (TYPEOF(R_column) == REALSXP) {
+			real_columns[c] = REAL(R_column) + offset;
+		} else if (TYPEOF(R_column) == INTSXP) {
+			int_columns[c] = INTEGER(R_column) + offset;
+		} else {
+			idist_assert(TYPEOF(R_column) == LGLSXP);
+			int_columns[c] = LOGICAL(R_column) + offset;
+		}
+	}
+
+	SEXP R_data_matrix = PROTECT(allocMatrix(REALSXP, num_dimensions, (int) num_data_points));
+	double* const data_matrix = REAL(R_data_matrix);
+
+	const size_t num_blocks = (num_data_points + DIST_MAKE_BLOCK_SIZE - 1) / DIST_MAKE_BLOCK_SIZE;
+	int has_na = 0;
+
+	#pragma omp parallel for schedule(static) reduction(|:has_na) if(num_data_points >= DIST_MAKE_PAR_MIN_POINTS)
+	for (size_t b = 0; b < num_blocks; ++b) {
+		const size_t block_start = b * DIST_MAKE_BLOCK_SIZE;
+		const size_t block_stop = (block_start + DIST_MAKE_BLOCK_SIZE < num_data_points) ?
+			block_start + DIST_MAKE_BLOCK_SIZE : num_data_points;
+		for (int c = 0; c < num_dimensions; ++c) {
+			double* write = data_matrix + block_start * (size_t) num_dimensions + c;
+			if (real_columns[c] != NULL) {
+				const double* const column = real_columns[c];
+				for (size_t i = block_start; i < block_stop; ++i, write += num_dimensions) {
+					has_na |= ISNAN(column[i]);
+					*write = column[i];
+				}
+			} else {
+				const int* const column = int_columns[c];
+				for (size_t i = block_start; i < block_stop; ++i, write += num_dimensions) {
+					has_na |= (column[i] == NA_INTEGER);
+					*write = (double) column[i];
+				}
+			}
+		}
+	}
+
+	UNPROTECT(1);
+	return has_na ? R_NilValue : R_data_matrix;
+}
+
+
+// Computes the covariance matrix of the data points in `R_data_matrix`
+// (points as columns), as `stats::var` does for the transposed matrix.
+// The mean and co-moments of each block of points are found with two
+// passes over the block (which is in cache), and the blocks are merged
+// with the pairwise update of Chan, Golub and LeVeque, so the data are
+// read from memory only once. If `R_diagonal` is `TRUE`, only the
+// variances are computed and the other entries are zero.
+SEXP dist_data_covariance(const SEXP R_data_matrix,
+                          const SEXP R_diagonal)
+{
+	idist_assert(isMatrix(R_data_matrix) && isReal(R_data_matrix));
+	idist_assert(isLogical(R_diagonal));
+
+	const int num_dimensions = INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[0];
+	const size_t num_data_points = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[1];
+	const double* const data_matrix = REAL(R_data_matrix);
+	const bool diagonal = asLogical(R_diagonal);
+	idist_assert(num_data_points >= 2);
+
+	const size_t d = (size_t) num_dimensions;
+	const size_t len_comoments = diagonal ? d : d * d;
+	const size_t num_blocks = (num_data_points + DIST_MAKE_BLOCK_SIZE - 1) / DIST_MAKE_BLOCK_SIZE;
+	const int num_threads = (num_data_points >= DIST_MAKE_PAR_MIN_POINTS) ? idist_num_threads() : 1;
+
+	// For each thread: number of points, means, co-moments, and scratch for
+	// the means and co-moments of the current block
+	const size_t len_thread_acc = 2 * d + 2 * len_comoments;
+	double* const acc = (double*) R_alloc((size_t) num_threads * len_thread_acc, sizeof(double));
+	size_t* const acc_count = (size_t*) R_alloc((size_t) num_threads, sizeof(size_t));
+	memset(acc, 0, (size_t) num_threads * len_thread_acc * sizeof(double));
+	memset(acc_count, 0, (size_t) num_threads * sizeof(size_t));
+
+	#pragma omp parallel num_threads(num_threads)
+	{
+		const int thread = idist_thread_num();
+		double* const mean = acc + (size_t) thread * len_thread_acc;
+		double* const comoment = mean + d;
+		double* const block_mean = comoment + len_comoments;
+		double* const block_comoment = block_mean + d;
+
+		#pragma omp for schedule(static)
+		for (size_t b = 0; b < num_blocks; ++b) {
+			const size_t block_start = b * DIST_MAKE_BLOCK_SIZE;
+			const size_t block_stop = (block_start + DIST_MAKE_BLOCK_SIZE < num_data_points) ?
+				block_start + DIST_MAKE_BLOCK_SIZE : num_data_points;
+			const size_t block_count = block_stop - block_start;
+
+			memset(block_mean, 0, d * sizeof(double));
+			memset(block_comoment, 0, len_comoments * sizeof(double));
+			for (size_t i = block_start; i < block_stop; ++i) {
+				const double* const point = data_matrix + i * d;
+				for (size_t j = 0; j < d; ++j) block_mean[j] += point[j];
+			}
+			for (size_t j = 0; j < d; ++j) block_mean[j] /= (double) block_count;
+			for (size_t i = block_start; i < block_stop; ++i) {
+				const double* const point = data_matrix + i * d;
+				if (diagonal) {
+					for (size_t j = 0; j < d; ++j) {
+						const double diff = point[j] - block_mean[j];
+						block_comoment[j] += diff * diff;
+					}
+				} else {
+					for (size_t j = 0; j < d; ++j) {
+						const double diff_j = point[j] - block_mean[j];
+						for (size_t l = j; l < d; ++l) {
+							block_comoment[j * d + l] += diff_j * (point[l] - block_mean[l]);
+						}
+					}
+				}
+			}
+
+			// Merge the block into the thread's accumulator
+			const size_t count = acc_count[thread];
+			const size_t new_count = count + block_count;
+			const double scale = (double) count * (double) block_count / (double) new_count;
+			for (size_t j = 0; j < d; ++j) {
+				const double delta_j = block_mean[j] - mean[j];
+				if (diagonal) {
+					comoment[j] += block_comoment[j] + delta_j * delta_j * scale;
+				} else {
+					for (size_t l = j; l < d; ++l) {
+						comoment[j * d + l] += block_comoment[j * d + l] + delta_j * (block_mean[l] - mean[l]) * scale;
+					}
+				}
+			}
+			for (size_t j = 0; j < d; ++j) {
+				mean[j] += (block_mean[j] - mean[j]) * (double) block_count / (double) new_count;
+			}
+			acc_count[thread] = new_count;
+		}
+	}
+
+	// Merge the threads in order, so the result does not depend on timing
+	double* const mean = acc;
+	double* const comoment = acc + d;
+	for (int t = 1; t < num_threads; ++t) {
+		const double* const t_mean = acc + (size_t) t * len_thread_acc;
+		const double* const t_comoment = t_mean + d;
+		const size_t count = acc_count[0];
+		const size_t t_count = acc_count[t];
+		if (t_count == 0) continue;
+		const size_t new_count = count + t_count;
+		const double scale = (double) count * (double) t_count / (double) new_count;
+		for (size_t j = 0; j < d; ++j) {
+			const double delta_j = t_mean[j] - mean[j];
+			if (diagonal) {
+				comoment[j] += t_comoment[j] + delta_j * delta_j * scale;
+			} else {
+				for (size_t l = j; l < d; ++l) {
+					comoment[j * d + l] += t_comoment[j * d + l] + delta_j * (t_mean[l] - mean[l]) * scale;
+				}
+			}
+		}
+		for (size_t j = 0; j < d; ++j) {
+			mean[j] += (t_mean[j] - mean[j]) * (double) t_count / (double) new_count;
+		}
+		acc_count[0] = new_count;
+	}
+
+	SEXP R_covariance = PROTECT(allocMatrix(REALSXP, num_dimensions, num_dimensions));
+	double* const covariance = REAL(R_covariance);
+	memset(covariance, 0, d * d * sizeof(double));
+	const double denominator = (double) (num_data_points - 1);
+	for (size_t j = 0; j < d; ++j) {
+		if (diagonal) {
+			covariance[j * d + j] = comoment[j] / denominator;
+		} else {
+			for (size_t l = j; l < d; ++l) {
+				covariance[j * d + l] = covariance[l * d + j] = comoment[j * d + l] / denominator;
+			}
+		}
+	}
+
+	UNPROTECT(1);
+	return R_covariance;
+}
+
+
+// Replaces each data point `x` in `R_data_matrix` (points as columns) by
+// `transform %*% x`. `R_transform` must be upper triangular, which lets
+// each point be overwritten in place: the i-th new coordinate only
+// depends on the old coordinates i and above.
+SEXP dist_transform_data_matrix(const SEXP R_data_matrix,
+                                const SEXP R_transform)
+{
+	idist_assert(isMatrix(R_data_matrix) && isReal(R_data_matrix));
+	idist_assert(isMatrix(R_transform) && isReal(R_transform));
+
+	const int num_dimensions = INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[0];
+	const size_t num_data_points = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[1];
+	idist_assert(INTEGER(getAttrib(R_transform, R_DimSymbol))[0] == num_dimensions);
+	idist_assert(INTEGER(getAttrib(R_transform, R_DimSymbol))[1] == num_dimensions);
+
+	const size_t d = (size_t) num_dimensions;
+	const double* const transform = REAL(R_transform);
+	double* const data_matrix = REAL(R_data_matrix);
+
+	// Copy the upper triangle row by row, so rows are read contiguously
+	double* const rows = (double*) R_alloc(d * (d + 1) / 2, sizeof(double));
+	double* write = rows;
+	for (size_t j = 0; j < d; ++j) {
+		for (size_t l = 0; l < j; ++l) {
+			idist_assert(transform[l * d + j] == 0.0);
+		}
+		for (size_t l = j; l < d; ++l) {
+			*(write++) = transform[l * d + j];
+		}
+	}
+
+	#pragma omp parallel for schedule(static) if(num_data_points >= DIST_MAKE_PAR_MIN_POINTS)
+	for (size_t i = 0; i < num_data_points; ++i) {
+		double* const point = data_matrix + i * d;
+		const double* row = rows;
+		for (size_t j = 0; j < d; ++j) {
+			double value = 0.0;
+			for (size_t l = j; l < d; ++l, ++row) {
+				value += *row * point[l];
+			}
+			point[j] = value;
+		}
+	}
+
+	return R_data_matrix;
+}
+
+
+// Scales each data point in `R_data_matrix` (points as columns) to unit
+// length in place, so that the squared Euclidean distance between two
+// points is twice their cosine distance. Returns `R_NilValue` if a data
+// point has length zero, as its angle to other points is undefined.
+SEXP dist_normalize_data_points(const SEXP R_data_matrix)
+{
+	idist_assert(isMatrix(R_data_matrix) && isReal(R_data_matrix));
+
+	const size_t d = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[0];
+	const size_t num_data_points = (size_t) INTEGER(getAttrib(R_data_matrix, R_DimSymbol))[1];
+	double* const data_matrix = REAL(R_data_matrix);
+
+	size_t num_zero_points = 0;
+	#pragma omp parallel for schedule(static) reduction(+:num_zero_points) if(num_data_points >= DIST_MAKE_PAR_MIN_POINTS)
+	for (size_t i = 0; i < num_data_points; ++i) {
+		double* const point = data_matrix + i * d;
+		double sq_length = 0.0;
+		for (size_t j = 0; j < d; ++j) {
+			sq_length += point[j] * point[j];
+		}
+		if (sq_length > 0.0) {
+			const double scale = 1.0 / sqrt(sq_length);
+			for (size_t j = 0; j < d; ++j) {
+				point[j] *= scale;
+			}
+		} else {
+			++num_zero_points;
+		}
+	}
+
+	return (num_zero_points > 0) ? R_NilValue : R_data_matrix;
+}
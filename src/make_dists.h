@@ -0,0 +1,37 @@
+/* =============================================================================
+ * distances -- R package with tools for distance metrics
+ * https://github.com/fsavje/distances
+ *
+ * Copyright (C) 2017  Fredrik Savje -- http://fredriksavje.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see http://www.gnu.org/licenses/
+ * ========================================================================== */
+
+#ifndef DIST_MAKE_DISTS_HG
+#define DIST_MAKE_DISTS_HG
+
+#include <R.h>
+#include <Rinternals.h>
+
+SEXP dist_make_data_matrix(SEXP R_data);
+
+SEXP dist_data_covariance(SEXP R_data_matrix,
+                          SEXP R_diagonal);
+
+SEXP dist_transform_data_matrix(SEXP R_data_matrix,
+                                SEXP R_transform);
+
+SEXP dist_normalize_data_points(SEXP R_data_matrix);
+
+#endif // ifndef DIST_MAKE_DISTS_HG
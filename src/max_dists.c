@@ -27,6 +27,8 @@
 #include <R.h>
 #include <Rinternals.h>
 #include "error.h"
+#include "gower.h"
+#include "hamming.h"
 #include "internal.h"
 #include "utils.h"
 
@@ -38,32 +40,49 @@ struct idist_MaxSearch {
 	SEXP R_distances;
 	size_t len_search_indices;
 	const int* search_indices;
+	int index_base;
 };
 
 
+// The signature of distances 0.1.12 and earlier, with labels
 SEXP dist_max_distance_search(const SEXP R_distances,
                               const SEXP R_query_indices,
                               const SEXP R_search_indices)
+{
+	SEXP R_true = PROTECT(ScalarLogical(1));
+	SEXP R_out_max_indices = dist_max_distance_search_opt(R_distances, R_query_indices, R_search_indices, R_true);
+	UNPROTECT(1);
+	return R_out_max_indices;
+}
+
+
+SEXP dist_max_distance_search_opt(const SEXP R_distances,
+                                  const SEXP R_query_indices,
+                                  const SEXP R_search_indices,
+                                  const SEXP R_labels)
 {
 	idist_assert(idist_check_distance_object(R_distances));
 	idist_assert(isNull(R_query_indices) || isInteger(R_query_indices));
 	idist_assert(isNull(R_search_indices) || isInteger(R_search_indices));
+	idist_assert(isLogical(R_labels));
 
 	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
 
-	SEXP R_query_indices_local = PROTECT(translate_R_index_vector(R_query_indices, num_data_points));
-	const size_t len_query_indices = isInteger(R_query_indices_local) ? (size_t) xlength(R_query_indices_local) : (size_t) num_data_points;
-	const int* const query_indices = isInteger(R_query_indices_local) ? INTEGER(R_query_indices_local) : NULL;
+	const int* const query_indices = get_R_index_subset(R_query_indices, num_data_points);
+	const size_t len_query_indices = (query_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_query_indices);
 
-	SEXP R_search_indices_local = PROTECT(translate_R_index_vector(R_search_indices, num_data_points));
-	const size_t len_search_indices = isInteger(R_search_indices_local) ? (size_t) xlength(R_search_indices_local) : (size_t) num_data_points;
-	const int* const search_indices = isInteger(R_search_indices_local) ? INTEGER(R_search_indices_local) : NULL;
+	const int* const search_indices = get_R_index_subset(R_search_indices, num_data_points);
+	const size_t len_search_indices = (search_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_search_indices);
 
 	idist_MaxSearch* max_dist_object;
-	idist_init_max_distance_search(R_distances,
-	                               len_search_indices,
-	                               search_indices,
-	                               &max_dist_object);
+	if (!idist_init_max_distance_search(R_distances,
+	                                    len_search_indices,
+	                                    search_indices,
+	                                    &max_dist_object)) {
+		idist_error("Could not allocate the search object.");
+	}
+	// Both index vectors are read as R indices
+	max_dist_object->index_base = 1;
 
 	SEXP R_out_max_indices = PROTECT(allocVector(INTSXP, (R_xlen_t) len_query_indices));
 	int* const out_max_indices = INTEGER(R_out_max_indices);
@@ -83,9 +102,11 @@ SEXP dist_max_distance_search(const SEXP R_distances,
 		++(*write);
 	}
 
-	setAttrib(R_out_max_indices, R_NamesSymbol, get_labels(R_distances, R_query_indices));
+	if (asLogical(R_labels)) {
+		setAttrib(R_out_max_indices, R_NamesSymbol, get_labels(R_distances, R_query_indices));
+	}
 
-	UNPROTECT(4);
+	UNPROTECT(2);
 	return R_out_max_indices;
 }
 
@@ -108,65 +129,125 @@ bool idist_init_max_distance_search(const SEXP R_distances,
 		.R_distances = R_distances,
 		.len_search_indices = len_search_indices,
 		.search_indices = search_indices,
+		.index_base = 0,
 	};
 
 	return true;
 }
 
 
-bool idist_max_distance_search(idist_MaxSearch* const max_dist_object,
-                               const size_t len_query_indices,
-                               const int query_indices[const],
-                               int out_max_indices[const],
-                               double out_max_dists[const])
+// Inlined once for each metric by passing `metric` as a constant
+// (see `get_dists.c`)
+static inline void idist_max_dist_loop(const double* const raw_data_matrix,
+                                       const int num_dimensions,
+                                       const int num_data_points,
+                                       const int num_queries,
+                                       const int query_indices[const],
+                                       const size_t len_search_indices,
+                                       const int search_indices[const],
+                                       const int index_base,
+                                       const idist_Metric metric,
+                                       const double p,
+                                       int out_max_indices[const],
+                                       double out_max_dists[const])
 {
-	idist_assert(max_dist_object != NULL);
-	idist_assert(max_dist_object->max_dist_version == DIST_MAXDIST_STRUCT_VERSION);
-	idist_assert(out_max_indices != NULL);
-	idist_assert(out_max_dists != NULL);
-
-	SEXP R_distances = max_dist_object->R_distances;
-	idist_assert(idist_check_distance_object(R_distances));
-
-	const double* const raw_data_matrix = REAL(R_distances);
-	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
-	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
-	const size_t len_search_indices = max_dist_object->len_search_indices;
-	const int* const search_indices = max_dist_object->search_indices;
-
-	const int num_queries = (query_indices == NULL) ? num_data_points : (int) len_query_indices;
-
 	double tmp_dist;
 	double max_dist;
 
 	if (search_indices == NULL) {
 		for (int q = 0; q < num_queries; ++q) {
-			const int query = (query_indices == NULL) ? q : query_indices[q];
+			const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
 			max_dist = -1.0;
 			for (int s = 0; s < num_data_points; ++s) {
-				tmp_dist = sqrt(idist_get_sq_dist(raw_data_matrix, num_dimensions, query, s));
+				tmp_dist = idist_get_pow_dist(raw_data_matrix, num_dimensions, query, s, metric, p);
 				if (max_dist < tmp_dist) {
 					max_dist = tmp_dist;
 					out_max_indices[q] = s;
 				}
 			}
-			out_max_dists[q] = sqrt(max_dist);
+			out_max_dists[q] = idist_pow_to_dist(max_dist, metric, p);
 		}
 
 	} else {
 		for (int q = 0; q < num_queries; ++q) {
-			const int query = (query_indices == NULL) ? q : query_indices[q];
+			const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
 			max_dist = -1.0;
 			for (size_t s = 0; s < len_search_indices; ++s) {
-				tmp_dist = sqrt(idist_get_sq_dist(raw_data_matrix, num_dimensions, query, search_indices[s]));
+				const int point = search_indices[s] - index_base;
+				tmp_dist = idist_get_pow_dist(raw_data_matrix, num_dimensions, query, point, metric, p);
 				if (max_dist < tmp_dist) {
 					max_dist = tmp_dist;
-					out_max_indices[q] = search_indices[s];
+					out_max_indices[q] = point;
 				}
 			}
-			out_max_dists[q] = sqrt(max_dist);
+			out_max_dists[q] = idist_pow_to_dist(max_dist, metric, p);
 		}
 	}
+}
+
+
+bool idist_max_distance_search(idist_MaxSearch* const max_dist_object,
+                               const size_t len_query_indices,
+                               const int query_indices[const],
+                               int out_max_indices[const],
+                               double out_max_dists[const])
+{
+	idist_assert(max_dist_object != NULL);
+	idist_assert(max_dist_object->max_dist_version == DIST_MAXDIST_STRUCT_VERSION);
+	idist_assert(out_max_indices != NULL);
+	idist_assert(out_max_dists != NULL);
+
+	SEXP R_distances = max_dist_object->R_distances;
+	idist_assert(idist_check_distance_object(R_distances));
+
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+	const size_t len_search_indices = max_dist_object->len_search_indices;
+	const int* const search_indices = max_dist_object->search_indices;
+	const int index_base = max_dist_object->index_base;
+	const int num_queries = (query_indices == NULL) ? num_data_points : (int) len_query_indices;
+
+	if (idist_get_metric(R_distances) == IDIST_METRIC_HAMMING) {
+		idist_hamming_max_dist(R_distances, num_queries, query_indices, len_search_indices, search_indices,
+		                       index_base, out_max_indices, out_max_dists);
+		return true;
+	}
+	if (idist_get_metric(R_distances) == IDIST_METRIC_GOWER) {
+		idist_gower_max_dist(R_distances, num_queries, query_indices, len_search_indices, search_indices,
+		                     index_base, out_max_indices, out_max_dists);
+		return true;
+	}
+
+	const double* const raw_data_matrix = REAL(R_distances);
+	const int num_dimensions = INTEGER(getAttrib(R_distances, R_DimSymbol))[0];
+	const double p = idist_get_minkowski_p(R_distances);
+
+	switch (idist_get_metric(R_distances)) {
+	case IDIST_METRIC_MANHATTAN:
+		idist_max_dist_loop(raw_data_matrix, num_dimensions, num_data_points, num_queries, query_indices,
+		                    len_search_indices, search_indices, index_base, IDIST_METRIC_MANHATTAN, p,
+		                    out_max_indices, out_max_dists);
+		break;
+	case IDIST_METRIC_MAXIMUM:
+		idist_max_dist_loop(raw_data_matrix, num_dimensions, num_data_points, num_queries, query_indices,
+		                    len_search_indices, search_indices, index_base, IDIST_METRIC_MAXIMUM, p,
+		                    out_max_indices, out_max_dists);
+		break;
+	case IDIST_METRIC_COSINE:
+		idist_max_dist_loop(raw_data_matrix, num_dimensions, num_data_points, num_queries, query_indices,
+		                    len_search_indices, search_indices, index_base, IDIST_METRIC_COSINE, p,
+		                    out_max_indices, out_max_dists);
+		break;
+	case IDIST_METRIC_MINKOWSKI:
+		idist_max_dist_loop(raw_data_matrix, num_dimensions, num_data_points, num_queries, query_indices,
+		                    len_search_indices, search_indices, index_base, IDIST_METRIC_MINKOWSKI, p,
+		                    out_max_indices, out_max_dists);
+		break;
+	default:
+		idist_max_dist_loop(raw_data_matrix, num_dimensions, num_data_points, num_queries, query_indices,
+		                    len_search_indices, search_indices, index_base, IDIST_METRIC_EUCLIDEAN, p,
+		                    out_max_indices, out_max_dists);
+		break;
+	}
 
 	return true;
 }
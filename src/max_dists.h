@@ -32,6 +32,11 @@ SEXP dist_max_distance_search(SEXP R_distances,
                               SEXP R_query_indices,
                               SEXP R_search_indices);
 
+SEXP dist_max_distance_search_opt(SEXP R_distances,
+                                  SEXP R_query_indices,
+                                  SEXP R_search_indices,
+                                  SEXP R_labels);
+
 bool idist_init_max_distance_search(SEXP R_distances,
                                     size_t len_search_indices,
                                     const int search_indices[],
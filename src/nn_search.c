@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <R.h>
 #include <Rinternals.h>
 #include "error.h"
@@ -29,94 +30,494 @@
 #include "utils.h"
 
 
+// Options of the search index from the arguments of `nearest_neighbor_search`,
+// with search and query indices read as R indices
+static idist_NNSearchOptions idist_nn_search_options_from_R(const SEXP R_index,
+                                                    const SEXP R_index_options,
+                                                    const SEXP R_rotate)
+{
+	idist_assert(isString(R_index));
+	idist_assert(isInteger(R_index_options));
+	idist_assert(isLogical(R_rotate));
+
+	idist_NNSearchOptions options = idist_nn_search_default_options();
+	options.rotate = asLogical(R_rotate);
+	if (strcmp(CHAR(asChar(R_index)), "ball_tree") == 0) {
+		options.index = IDIST_NN_INDEX_BALL_TREE;
+	} else if (strcmp(CHAR(asChar(R_index)), "hnsw") == 0) {
+		idist_assert(xlength(R_index_options) == 3);
+		options.index = IDIST_NN_INDEX_HNSW;
+		options.hnsw_m = INTEGER(R_index_options)[0];
+		options.hnsw_ef_construction = INTEGER(R_index_options)[1];
+		options.hnsw_ef = INTEGER(R_index_options)[2];
+	} else if (strcmp(CHAR(asChar(R_index)), "rp_forest") == 0) {
+		idist_assert(xlength(R_index_options) == 2);
+		options.index = IDIST_NN_INDEX_RP_FOREST;
+		options.rp_num_trees = INTEGER(R_index_options)[0];
+		options.rp_leaf_size = INTEGER(R_index_options)[1];
+	} else if (strcmp(CHAR(asChar(R_index)), "pq") == 0) {
+		idist_assert(xlength(R_index_options) == 2);
+		options.index = IDIST_NN_INDEX_PQ;
+		options.pq_num_subspaces = INTEGER(R_index_options)[0];
+		options.pq_rerank = INTEGER(R_index_options)[1];
+	}
+	options.index_base = 1;
+
+	return options;
+}
+
+
+// Translates the neighbors in `nn_indices` (as written by
+// `idist_nearest_neighbor_search_na`) to R indices in `out_nn_indices`,
+// which may be `nn_indices` itself
+static void idist_nn_indices_to_R(const size_t len_nn_indices,
+                                  const int nn_indices[const],
+                                  int out_nn_indices[const])
+{
+	for (size_t i = 0; i < len_nn_indices; ++i) {
+		out_nn_indices[i] = (nn_indices[i] == NA_INTEGER) ? NA_INTEGER : nn_indices[i] + 1;
+	}
+}
+
+
+// State of `dist_nearest_neighbor_search_chunks` passed to the callbacks
+typedef struct idist_NNChunksCall {
+	idist_NNSearch* nn_search_object;
+	SEXP R_distances;
+	SEXP R_callback;
+	bool labels;
+	size_t len_query_indices;
+	const int* query_indices;
+	uint32_t k;
+	bool radius_search;
+	double radius;
+	size_t chunk_size;
+} idist_NNChunksCall;
+
+
+// Passes the neighbors of a chunk of queries to the R callback together
+// with the (R) indices of the queries
+static bool idist_nn_chunk_to_R(const size_t first_query,
+                                const size_t num_chunk_queries,
+                                const int chunk_nn_indices[const],
+                                void* const callback_data)
+{
+	const idist_NNChunksCall* const call = callback_data;
+
+	SEXP R_chunk_queries = PROTECT(allocVector(INTSXP, (R_xlen_t) num_chunk_queries));
+	int* const chunk_queries = INTEGER(R_chunk_queries);
+	for (size_t q = 0; q < num_chunk_queries; ++q) {
+		chunk_queries[q] = (call->query_indices == NULL) ? (int) (first_query + q + 1) : call->query_indices[first_query + q];
+	}
+
+	SEXP R_chunk_nn_indices = PROTECT(allocMatrix(INTSXP, call->k, num_chunk_queries));
+	idist_nn_indices_to_R(call->k * num_chunk_queries, chunk_nn_indices, INTEGER(R_chunk_nn_indices));
+
+	if (call->labels) {
+		SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
+		SET_VECTOR_ELT(dimnames, 0, R_NilValue);
+		SET_VECTOR_ELT(dimnames, 1, get_labels(call->R_distances, R_chunk_queries));
+		setAttrib(R_chunk_nn_indices, R_DimNamesSymbol, dimnames);
+		UNPROTECT(1);
+	}
+
+	SEXP R_call = PROTECT(lang3(call->R_callback, R_chunk_nn_indices, R_chunk_queries));
+	eval(R_call, R_GlobalEnv);
+
+	UNPROTECT(3);
+	return true;
+}
+
+
+static SEXP idist_nn_chunks_run(void* const data)
+{
+	idist_NNChunksCall* const call = data;
+	if (!idist_nearest_neighbor_search_chunks(call->nn_search_object,
+	                                          call->len_query_indices,
+	                                          call->query_indices,
+	                                          call->k,
+	                                          call->radius_search,
+	                                          call->radius,
+	                                          call->chunk_size,
+	                                          idist_nn_chunk_to_R,
+	                                          call)) {
+		idist_error("Nearest neighbor search failed.");
+	}
+	return R_NilValue;
+}
+
+
+// Also called when the R callback throws an error
+static void idist_nn_chunks_close(void* const data)
+{
+	idist_NNChunksCall* const call = data;
+	idist_close_nearest_neighbor_search(&call->nn_search_object);
+}
+
+
+// The signature of distances 0.1.12 and earlier: a kd-tree search with
+// labels that may return the query as its own neighbor
 SEXP dist_nearest_neighbor_search(const SEXP R_distances,
                                   const SEXP R_k,
                                   const SEXP R_query_indices,
                                   const SEXP R_search_indices,
                                   const SEXP R_radius)
+{
+	SEXP R_false = PROTECT(ScalarLogical(0));
+	SEXP R_index = PROTECT(mkString("kd_tree"));
+	SEXP R_index_options = PROTECT(allocVector(INTSXP, 0));
+	SEXP R_true = PROTECT(ScalarLogical(1));
+	SEXP R_out_nn_indices = dist_nearest_neighbor_search_opt(R_distances,
+	                                                         R_k,
+	                                                         R_query_indices,
+	                                                         R_search_indices,
+	                                                         R_radius,
+	                                                         R_false,
+	                                                         R_index,
+	                                                         R_index_options,
+	                                                         R_false,
+	                                                         R_true);
+	UNPROTECT(4);
+	return R_out_nn_indices;
+}
+
+
+SEXP dist_nearest_neighbor_search_opt(const SEXP R_distances,
+                                      const SEXP R_k,
+                                      const SEXP R_query_indices,
+                                      const SEXP R_search_indices,
+                                      const SEXP R_radius,
+                                      const SEXP R_exclude_self,
+                                      const SEXP R_index,
+                                      const SEXP R_index_options,
+                                      const SEXP R_rotate,
+                                      const SEXP R_labels)
 {
 	idist_assert(idist_check_distance_object(R_distances));
 	idist_assert(isInteger(R_k));
 	idist_assert(isNull(R_query_indices) || isInteger(R_query_indices));
 	idist_assert(isNull(R_search_indices) || isInteger(R_search_indices));
 	idist_assert(isNull(R_radius) || isReal(R_radius));
+	idist_assert(isLogical(R_exclude_self));
+	idist_assert(isString(R_index));
+	idist_assert(isInteger(R_index_options));
+	idist_assert(isLogical(R_rotate));
+	idist_assert(isLogical(R_labels));
 
 	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
 
 	const uint32_t k = (uint32_t) asInteger(R_k);
 
-	SEXP R_query_indices_local = PROTECT(translate_R_index_vector(R_query_indices, num_data_points));
-	const size_t len_query_indices = isInteger(R_query_indices_local) ? (size_t) xlength(R_query_indices_local) : (size_t) num_data_points;
-	const int* const query_indices = isInteger(R_query_indices_local) ? INTEGER(R_query_indices_local) : NULL;
+	const int* const query_indices = get_R_index_subset(R_query_indices, num_data_points);
+	const size_t len_query_indices = (query_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_query_indices);
 
-	SEXP R_search_indices_local = PROTECT(translate_R_index_vector(R_search_indices, num_data_points));
-	const size_t len_search_indices = isInteger(R_search_indices_local) ? (size_t) xlength(R_search_indices_local) : (size_t) num_data_points;
-	const int* const search_indices = isInteger(R_search_indices_local) ? INTEGER(R_search_indices_local) : NULL;
+	const int* const search_indices = get_R_index_subset(R_search_indices, num_data_points);
+	const size_t len_search_indices = (search_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_search_indices);
 
 	const bool radius_search = isReal(R_radius);
 	const double radius = radius_search ? asReal(R_radius) : 0.0;
 	if (radius_search) idist_assert(radius > 0.0);
 
+	idist_NNSearchOptions options = idist_nn_search_options_from_R(R_index, R_index_options, R_rotate);
+	options.exclude_self = asLogical(R_exclude_self);
+
 	idist_NNSearch* nn_search_object;
-	idist_init_nearest_neighbor_search(R_distances,
-	                                   len_search_indices,
-	                                   search_indices,
-	                                   &nn_search_object);
+	if (!idist_init_nearest_neighbor_search_opt(R_distances,
+	                                            len_search_indices,
+	                                            search_indices,
+	                                            &options,
+	                                            &nn_search_object)) {
+		idist_error("Could not allocate the search object.");
+	}
 
+	// Results are written in place, with NAs for failed queries
 	size_t out_num_ok_queries;
-	SEXP R_out_query_indices = PROTECT(allocVector(INTSXP, (R_xlen_t) len_query_indices));
-	int* const out_query_indices = INTEGER(R_out_query_indices);
 	SEXP R_out_nn_indices = PROTECT(allocMatrix(INTSXP, k, len_query_indices));
 	int* const out_nn_indices = INTEGER(R_out_nn_indices);
 
-	idist_nearest_neighbor_search(nn_search_object,
-	                              len_query_indices,
-	                              query_indices,
-	                              k,
-	                              radius_search,
-	                              radius,
-	                              &out_num_ok_queries,
-	                              out_query_indices,
-	                              out_nn_indices);
+	const bool search_ok = idist_nearest_neighbor_search_na(nn_search_object,
+	                                                        len_query_indices,
+	                                                        query_indices,
+	                                                        k,
+	                                                        radius_search,
+	                                                        radius,
+	                                                        &out_num_ok_queries,
+	                                                        out_nn_indices);
 
 	idist_close_nearest_neighbor_search(&nn_search_object);
+	if (!search_ok) idist_error("Nearest neighbor search failed.");
 
-	if (out_num_ok_queries < len_query_indices) {
-		SEXP R_tmp_nn_indices = R_out_nn_indices;
-		R_out_nn_indices = PROTECT(allocMatrix(INTSXP, k, len_query_indices));
-		const int* ok_query = out_query_indices;
-		const int* const ok_query_stop = ok_query + out_num_ok_queries;
-		const int* read = INTEGER(R_tmp_nn_indices);
-		int* write = INTEGER(R_out_nn_indices);
-
-		for (size_t q = 0; q < len_query_indices; ++q) {
-			const int query = (query_indices == NULL) ? (int) q : query_indices[q];
-			const int* const write_stop = write + k;
-			if ((ok_query != ok_query_stop) && (*ok_query == query)) {
-				for (; write != write_stop; ++read, ++write) {
-					*write = *read + 1;
-				}
-				ok_query++;
-			} else {
-				for (; write != write_stop; ++write) {
-					*write = NA_INTEGER;
-				}
-			}
-		}
-	} else {
-		PROTECT(R_out_nn_indices);
-		int* write = INTEGER(R_out_nn_indices);
-		const int* const write_stop = write + k * len_query_indices;
-		for (; write != write_stop; ++write) {
-			*write = *write + 1;
-		}
+	idist_nn_indices_to_R(k * len_query_indices, out_nn_indices, out_nn_indices);
+
+	if (asLogical(R_labels)) {
+		SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
+		SET_VECTOR_ELT(dimnames, 0, R_NilValue);
+		SET_VECTOR_ELT(dimnames, 1, get_labels(R_distances, R_query_indices));
+		setAttrib(R_out_nn_indices, R_DimNamesSymbol, dimnames);
+		UNPROTECT(1);
+	}
+
+	UNPROTECT(1);
+	return R_out_nn_indices;
+}
+
+
+SEXP dist_nearest_neighbor_search_chunks(const SEXP R_distances,
+                                         const SEXP R_k,
+                                         const SEXP R_query_indices,
+                                         const SEXP R_search_indices,
+                                         const SEXP R_radius,
+                                         const SEXP R_exclude_self,
+                                         const SEXP R_index,
+                                         const SEXP R_index_options,
+                                         const SEXP R_rotate,
+                                         const SEXP R_labels,
+                                         const SEXP R_chunk_size,
+                                         const SEXP R_callback)
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(isInteger(R_k));
+	idist_assert(isNull(R_query_indices) || isInteger(R_query_indices));
+	idist_assert(isNull(R_search_indices) || isInteger(R_search_indices));
+	idist_assert(isNull(R_radius) || isReal(R_radius));
+	idist_assert(isLogical(R_exclude_self));
+	idist_assert(isLogical(R_labels));
+	idist_assert(isInteger(R_chunk_size));
+	idist_assert(isFunction(R_callback));
+
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+
+	const int* const search_indices = get_R_index_subset(R_search_indices, num_data_points);
+	const size_t len_search_indices = (search_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_search_indices);
+
+	idist_NNChunksCall call;
+	call.R_distances = R_distances;
+	call.R_callback = R_callback;
+	call.labels = asLogical(R_labels);
+	call.query_indices = get_R_index_subset(R_query_indices, num_data_points);
+	call.len_query_indices = (call.query_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_query_indices);
+	call.k = (uint32_t) asInteger(R_k);
+	call.radius_search = isReal(R_radius);
+	call.radius = call.radius_search ? asReal(R_radius) : 0.0;
+	if (call.radius_search) idist_assert(call.radius > 0.0);
+	call.chunk_size = (size_t) asInteger(R_chunk_size);
+	idist_assert(call.chunk_size > 0);
+
+	idist_NNSearchOptions options = idist_nn_search_options_from_R(R_index, R_index_options, R_rotate);
+	options.exclude_self = asLogical(R_exclude_self);
+
+	if (!idist_init_nearest_neighbor_search_opt(R_distances,
+	                                            len_search_indices,
+	                                            search_indices,
+	                                            &options,
+	                                            &call.nn_search_object)) {
+		idist_error("Could not allocate the search object.");
+	}
+
+	R_ExecWithCleanup(idist_nn_chunks_run, &call, idist_nn_chunks_close, &call);
+
+	return R_NilValue;
+}
+
+
+SEXP dist_nearest_neighbor_search_points(const SEXP R_distances,
+                                         const SEXP R_k,
+                                         const SEXP R_query_points,
+                                         const SEXP R_search_indices,
+                                         const SEXP R_radius,
+                                         const SEXP R_index,
+                                         const SEXP R_index_options,
+                                         const SEXP R_rotate)
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(idist_get_metric(R_distances) != IDIST_METRIC_HAMMING);
+	idist_assert(idist_get_metric(R_distances) != IDIST_METRIC_GOWER);
+	idist_assert(isInteger(R_k));
+	idist_assert(isMatrix(R_query_points) && isReal(R_query_points));
+	idist_assert(isNull(R_search_indices) || isInteger(R_search_indices));
+	idist_assert(isNull(R_radius) || isReal(R_radius));
+
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+	idist_assert(INTEGER(getAttrib(R_query_points, R_DimSymbol))[0] == INTEGER(getAttrib(R_distances, R_DimSymbol))[0]);
+	const size_t num_query_points = (size_t) INTEGER(getAttrib(R_query_points, R_DimSymbol))[1];
+
+	const uint32_t k = (uint32_t) asInteger(R_k);
+
+	const int* const search_indices = get_R_index_subset(R_search_indices, num_data_points);
+	const size_t len_search_indices = (search_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_search_indices);
+
+	const bool radius_search = isReal(R_radius);
+	const double radius = radius_search ? asReal(R_radius) : 0.0;
+	if (radius_search) idist_assert(radius > 0.0);
+
+	const idist_NNSearchOptions options = idist_nn_search_options_from_R(R_index, R_index_options, R_rotate);
+
+	idist_NNSearch* nn_search_object;
+	if (!idist_init_nearest_neighbor_search_opt(R_distances,
+	                                            len_search_indices,
+	                                            search_indices,
+	                                            &options,
+	                                            &nn_search_object)) {
+		idist_error("Could not allocate the search object.");
 	}
 
-	SEXP dimnames = PROTECT(allocVector(VECSXP, 2));
-	SET_VECTOR_ELT(dimnames, 0, R_NilValue);
-	SET_VECTOR_ELT(dimnames, 1, get_labels(R_distances, R_query_indices));
-	setAttrib(R_out_nn_indices, R_DimNamesSymbol, dimnames);
+	size_t out_num_ok_queries;
+	SEXP R_out_nn_indices = PROTECT(allocMatrix(INTSXP, k, num_query_points));
+	int* const out_nn_indices = INTEGER(R_out_nn_indices);
+
+	const bool search_ok = idist_nearest_neighbor_search_points_na(nn_search_object,
+	                                                               num_query_points,
+	                                                               REAL(R_query_points),
+	                                                               k,
+	                                                               radius_search,
+	                                                               radius,
+	                                                               &out_num_ok_queries,
+	                                                               out_nn_indices);
 
-	UNPROTECT(6);
+	idist_close_nearest_neighbor_search(&nn_search_object);
+	if (!search_ok) idist_error("Nearest neighbor search failed.");
+
+	idist_nn_indices_to_R(k * num_query_points, out_nn_indices, out_nn_indices);
+
+	UNPROTECT(1);
 	return R_out_nn_indices;
 }
+
+
+SEXP dist_count_within_radius(const SEXP R_distances,
+                              const SEXP R_radius,
+                              const SEXP R_query_indices,
+                              const SEXP R_search_indices,
+                              const SEXP R_exclude_self,
+                              const SEXP R_labels)
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(isReal(R_radius));
+	idist_assert(isNull(R_query_indices) || isInteger(R_query_indices));
+	idist_assert(isNull(R_search_indices) || isInteger(R_search_indices));
+	idist_assert(isLogical(R_exclude_self));
+	idist_assert(isLogical(R_labels));
+
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+
+	const double radius = asReal(R_radius);
+	idist_assert(radius > 0.0);
+
+	const int* const query_indices = get_R_index_subset(R_query_indices, num_data_points);
+	const size_t len_query_indices = (query_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_query_indices);
+
+	const int* const search_indices = get_R_index_subset(R_search_indices, num_data_points);
+	const size_t len_search_indices = (search_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_search_indices);
+
+	idist_NNSearchOptions options = idist_nn_search_default_options();
+	options.exclude_self = asLogical(R_exclude_self);
+	options.index_base = 1;
+
+	idist_NNSearch* nn_search_object;
+	if (!idist_init_nearest_neighbor_search_opt(R_distances,
+	                                            len_search_indices,
+	                                            search_indices,
+	                                            &options,
+	                                            &nn_search_object)) {
+		idist_error("Could not allocate the search object.");
+	}
+
+	SEXP R_out_counts = PROTECT(allocVector(INTSXP, (R_xlen_t) len_query_indices));
+
+	const bool count_ok = idist_count_within_radius(nn_search_object,
+	                                                len_query_indices,
+	                                                query_indices,
+	                                                radius,
+	                                                INTEGER(R_out_counts));
+
+	idist_close_nearest_neighbor_search(&nn_search_object);
+	if (!count_ok) idist_error("Radius count failed.");
+
+	if (asLogical(R_labels)) {
+		setAttrib(R_out_counts, R_NamesSymbol, get_labels(R_distances, R_query_indices));
+	}
+
+	UNPROTECT(1);
+	return R_out_counts;
+}
+
+
+SEXP dist_kernel_sums(const SEXP R_distances,
+                      const SEXP R_bandwidth,
+                      const SEXP R_kernel,
+                      const SEXP R_weights,
+                      const SEXP R_query_indices,
+                      const SEXP R_search_indices,
+                      const SEXP R_exclude_self,
+                      const SEXP R_tolerance,
+                      const SEXP R_labels)
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	idist_assert(isReal(R_bandwidth));
+	idist_assert(isString(R_kernel));
+	idist_assert(isNull(R_weights) || isReal(R_weights));
+	idist_assert(isNull(R_query_indices) || isInteger(R_query_indices));
+	idist_assert(isNull(R_search_indices) || isInteger(R_search_indices));
+	idist_assert(isLogical(R_exclude_self));
+	idist_assert(isReal(R_tolerance));
+	idist_assert(isLogical(R_labels));
+
+	const int num_data_points = INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
+
+	const double bandwidth = asReal(R_bandwidth);
+	idist_assert(bandwidth > 0.0);
+	const double tolerance = asReal(R_tolerance);
+	idist_assert(tolerance >= 0.0);
+
+	const idist_NNKernel kernel = (strcmp(CHAR(asChar(R_kernel)), "epanechnikov") == 0) ?
+		IDIST_NN_KERNEL_EPANECHNIKOV : IDIST_NN_KERNEL_GAUSSIAN;
+
+	const double* weights = NULL;
+	if (isReal(R_weights)) {
+		idist_assert(xlength(R_weights) == num_data_points);
+		weights = REAL(R_weights);
+		for (int i = 0; i < num_data_points; ++i) {
+			idist_assert(!ISNAN(weights[i]));
+		}
+	}
+
+	const int* const query_indices = get_R_index_subset(R_query_indices, num_data_points);
+	const size_t len_query_indices = (query_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_query_indices);
+
+	const int* const search_indices = get_R_index_subset(R_search_indices, num_data_points);
+	const size_t len_search_indices = (search_indices == NULL) ? (size_t) num_data_points : (size_t) xlength(R_search_indices);
+
+	idist_NNSearchOptions options = idist_nn_search_default_options();
+	options.exclude_self = asLogical(R_exclude_self);
+	options.index_base = 1;
+
+	idist_NNSearch* nn_search_object;
+	if (!idist_init_nearest_neighbor_search_opt(R_distances,
+	                                            len_search_indices,
+	                                            search_indices,
+	                                            &options,
+	                                            &nn_search_object)) {
+		idist_error("Could not allocate the search object.");
+	}
+
+	SEXP R_out_sums = PROTECT(allocVector(REALSXP, (R_xlen_t) len_query_indices));
+
+	const bool sums_ok = idist_kernel_sums(nn_search_object,
+	                                       len_query_indices,
+	                                       query_indices,
+	                                       kernel,
+	                                       bandwidth,
+	                                       weights,
+	                                       tolerance,
+	                                       REAL(R_out_sums));
+
+	idist_close_nearest_neighbor_search(&nn_search_object);
+	if (!sums_ok) idist_error("Kernel sums failed.");
+
+	if (asLogical(R_labels)) {
+		setAttrib(R_out_sums, R_NamesSymbol, get_labels(R_distances, R_query_indices));
+	}
+
+	UNPROTECT(1);
+	return R_out_sums;
+}
@@ -33,17 +33,118 @@ extern "C" {
 
 typedef struct idist_NNSearch idist_NNSearch;
 
+typedef enum {
+	IDIST_NN_QUERY_ORDER_AUTO,
+	IDIST_NN_QUERY_ORDER_INPUT,
+	IDIST_NN_QUERY_ORDER_MORTON,
+	IDIST_NN_QUERY_ORDER_HILBERT
+} idist_NNQueryOrder;
+
+typedef enum {
+	IDIST_NN_INDEX_KD_TREE,
+	IDIST_NN_INDEX_BALL_TREE,
+	IDIST_NN_INDEX_HNSW,
+	IDIST_NN_INDEX_RP_FOREST,
+	IDIST_NN_INDEX_PQ
+} idist_NNIndex;
+
+typedef enum {
+	IDIST_NN_KERNEL_GAUSSIAN,
+	IDIST_NN_KERNEL_EPANECHNIKOV
+} idist_NNKernel;
+
+typedef struct idist_NNSearchOptions {
+	idist_NNIndex index;
+	bool exclude_self;
+	idist_NNQueryOrder query_order;
+	bool rotate;
+	int hnsw_m;
+	int hnsw_ef_construction;
+	int hnsw_ef;
+	int rp_num_trees;
+	int rp_leaf_size;
+	int pq_num_subspaces;
+	int pq_rerank;
+	// Search and query indices are read as `index - index_base`, so R
+	// indices can be passed with `index_base = 1`. Indices written by the
+	// searches, and those passed to remove and insert, are 0-based.
+	int index_base;
+} idist_NNSearchOptions;
+
+typedef bool (*idist_NNChunkCallback)(size_t first_query,
+                                      size_t num_chunk_queries,
+                                      const int chunk_nn_indices[],
+                                      void* callback_data);
+
 SEXP dist_nearest_neighbor_search(SEXP R_distances,
                                   SEXP R_k,
                                   SEXP R_query_indices,
                                   SEXP R_search_indices,
                                   SEXP R_radius);
 
+SEXP dist_nearest_neighbor_search_opt(SEXP R_distances,
+                                      SEXP R_k,
+                                      SEXP R_query_indices,
+                                      SEXP R_search_indices,
+                                      SEXP R_radius,
+                                      SEXP R_exclude_self,
+                                      SEXP R_index,
+                                      SEXP R_index_options,
+                                      SEXP R_rotate,
+                                      SEXP R_labels);
+
+SEXP dist_nearest_neighbor_search_chunks(SEXP R_distances,
+                                         SEXP R_k,
+                                         SEXP R_query_indices,
+                                         SEXP R_search_indices,
+                                         SEXP R_radius,
+                                         SEXP R_exclude_self,
+                                         SEXP R_index,
+                                         SEXP R_index_options,
+                                         SEXP R_rotate,
+                                         SEXP R_labels,
+                                         SEXP R_chunk_size,
+                                         SEXP R_callback);
+
+SEXP dist_nearest_neighbor_search_points(SEXP R_distances,
+                                         SEXP R_k,
+                                         SEXP R_query_points,
+                                         SEXP R_search_indices,
+                                         SEXP R_radius,
+                                         SEXP R_index,
+                                         SEXP R_index_options,
+                                         SEXP R_rotate);
+
+SEXP dist_count_within_radius(SEXP R_distances,
+                              SEXP R_radius,
+                              SEXP R_query_indices,
+                              SEXP R_search_indices,
+                              SEXP R_exclude_self,
+                              SEXP R_labels);
+
+SEXP dist_kernel_sums(SEXP R_distances,
+                      SEXP R_bandwidth,
+                      SEXP R_kernel,
+                      SEXP R_weights,
+                      SEXP R_query_indices,
+                      SEXP R_search_indices,
+                      SEXP R_exclude_self,
+                      SEXP R_tolerance,
+                      SEXP R_labels);
+
+idist_NNSearchOptions idist_nn_search_default_options(void);
+
 bool idist_init_nearest_neighbor_search(SEXP R_distances,
                                         size_t len_search_indices,
                                         const int search_indices[],
                                         idist_NNSearch** out_nn_search_object);
 
+bool idist_init_nearest_neighbor_search_opt(SEXP R_distances,
+                                            size_t len_search_indices,
+                                            const int search_indices[],
+                                            const idist_NNSearchOptions* options,
+                                            idist_NNSearch** out_nn_search_object);
+
 bool idist_nearest_neighbor_search(idist_NNSearch* nn_search_object,
                                    size_t len_query_indices,
                                    const int query_indices[],
@@ -54,8 +155,69 @@ bool idist_nearest_neighbor_search(idist_NNSearch* nn_search_object,
                                    int out_query_indices[],
                                    int out_nn_indices[]);
 
+bool idist_nearest_neighbor_search_na(idist_NNSearch* nn_search_object,
+                                      size_t len_query_indices,
+                                      const int query_indices[],
+                                      uint32_t k,
+                                      bool radius_search,
+                                      double radius,
+                                      size_t* out_num_ok_queries,
+                                      int out_nn_indices[]);
+
+bool idist_nearest_neighbor_search_chunks(idist_NNSearch* nn_search_object,
+                                          size_t len_query_indices,
+                                          const int query_indices[],
+                                          uint32_t k,
+                                          bool radius_search,
+                                          double radius,
+                                          size_t chunk_size,
+                                          idist_NNChunkCallback chunk_callback,
+                                          void* callback_data);
+
+bool idist_nearest_neighbor_search_points(idist_NNSearch* nn_search_object,
+                                          size_t num_query_points,
+                                          const double query_points[],
+                                          uint32_t k,
+                                          bool radius_search,
+                                          double radius,
+                                          size_t* out_num_ok_queries,
+                                          int out_query_indices[],
+                                          int out_nn_indices[]);
+
+bool idist_nearest_neighbor_search_points_na(idist_NNSearch* nn_search_object,
+                                             size_t num_query_points,
+                                             const double query_points[],
+                                             uint32_t k,
+                                             bool radius_search,
+                                             double radius,
+                                             size_t* out_num_ok_queries,
+                                             int out_nn_indices[]);
+
+bool idist_count_within_radius(idist_NNSearch* nn_search_object,
+                               size_t len_query_indices,
+                               const int query_indices[],
+                               double radius,
+                               int out_counts[]);
+
+bool idist_kernel_sums(idist_NNSearch* nn_search_object,
+                       size_t len_query_indices,
+                       const int query_indices[],
+                       idist_NNKernel kernel,
+                       double bandwidth,
+                       const double weights[],
+                       double tolerance,
+                       double out_sums[]);
+
 bool idist_close_nearest_neighbor_search(idist_NNSearch** out_nn_search_object);
 
+bool idist_nearest_neighbor_search_remove(idist_NNSearch* nn_search_object,
+                                          size_t len_remove_indices,
+                                          const int remove_indices[]);
+
+bool idist_nearest_neighbor_search_insert(idist_NNSearch* nn_search_object,
+                                          size_t len_insert_indices,
+                                          const int insert_indices[]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,17 +18,30 @@
  * along with this program. If not, see http://www.gnu.org/licenses/
  * ========================================================================== */
 
+// Pass the lengths of character arguments to LAPACK
+#define USE_FC_LEN_T
 #include "nn_search.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <cstddef>
+#include <stdint.h>
 #include <R.h>
 #include <Rinternals.h>
+#include <R_ext/BLAS.h>
+#include <R_ext/Lapack.h>
 // R defines `length` which collides with the ANN library
 // We don't use it, so we'll remove it
 #undef length
 #include "libann/include/ANN/ANN.h"
 #include "error.h"
+#include "gower.h"
+#include "hamming.h"
 #include "utils.h"
 
+#ifndef FCONE
+	#define FCONE
+#endif
 
 #ifdef DIST_ANN_BDTREE
 	#define ANNpointSetConstructor ANNbd_tree
@@ -40,10 +53,109 @@
 	#define DIST_ANN_EPS 0.0
 #endif
 
+// Points per leaf bucket. Buckets with at least four points are
+// scanned with the blocked leaf kernel in libann.
+#ifndef DIST_ANN_BUCKET_SIZE
+	#define DIST_ANN_BUCKET_SIZE 8
+#endif
+
+
+// Search sets that have been modified are rebuilt once fewer than half
+// of their points remain, unless they are smaller than this
+#ifndef DIST_ANN_REBUILD_MIN_POINTS
+	#define DIST_ANN_REBUILD_MIN_POINTS 64
+#endif
+
+
+// Batches with at least this many queries are run in Hilbert curve order
+// when the query order is `IDIST_NN_QUERY_ORDER_AUTO`
+#ifndef DIST_ANN_QUERY_ORDER_MIN_QUERIES
+	#define DIST_ANN_QUERY_ORDER_MIN_QUERIES 1024
+#endif
+
+
+// The query scratch is allocated for this many queries when the search
+// object is made, and grown when a larger batch is searched. Hamming and
+// Gower scans, which run the queries in the caller's order, are run in
+// chunks of this many queries.
+#ifndef DIST_ANN_QUERY_CHUNK
+	#define DIST_ANN_QUERY_CHUNK 4096
+#endif
+
 
 static int idist_ann_open_search_objects = 0;
 
-static const int32_t IDIST_ANN_NN_SEARCH_STRUCT_VERSION = 155294001;
+static const int32_t IDIST_ANN_NN_SEARCH_STRUCT_VERSION = 155294009;
+
+// A search set that has been modified with `idist_nearest_neighbor_search_insert`
+// or `idist_nearest_neighbor_search_remove` is stored in blocks. Block 0
+// holds the original tree, and block `b > 0` holds at most 2^(b - 1)
+// inserted points (the logarithmic method). Insertions merge the smaller
+// occupied blocks into the first free block that is large enough.
+// Removed points are deleted from their tree, and a block is rebuilt
+// from its remaining points when fewer than half are left.
+static const int IDIST_ANN_MAX_BLOCKS = 33;
+
+struct idist_ANNBlock {
+	ANNpoint* points;
+	int* indices;
+	ANNpointSet* tree;
+	int num_points;
+	int num_live;
+};
+
+struct idist_ANNDynamic {
+	int* block_of;
+	int* local_of;
+	int num_live;
+	idist_ANNBlock blocks[IDIST_ANN_MAX_BLOCKS];
+	int* merge_indices;
+	ANNdist* merge_dists;
+	uint32_t len_merge_scratch;
+};
+
+// Queries are sorted by their position along a space-filling curve over
+// the bounding box of the batch. The key uses the dimensions with the
+// largest spread, at most `IDIST_ANN_CURVE_MAX_DIMS` of them, so that it
+// fits in 64 bits.
+static const int IDIST_ANN_CURVE_MAX_DIMS = 8;
+static const int IDIST_ANN_CURVE_MAX_BITS = 16;
+
+// The covariance matrix for `rotate` is accumulated over chunks of this
+// many points
+static const int IDIST_ANN_PCA_CHUNK = 256;
+
+struct idist_ANNQueryKey {
+	uint64_t key;
+	int position;
+};
+
+// Scratch for a batch of queries: the curve keys and order, which
+// queries succeeded, the bounding box, the indices of a chunk of scanned
+// queries and, if the data are rotated, the rotated query points
+struct idist_ANNQueryScratch {
+	idist_ANNQueryKey* keys;
+	int* order;
+	unsigned char* ok;
+	size_t len_order;
+	double* box;
+	int* indices;
+	double* rotated;
+	size_t len_rotated;
+};
+
+// Data points with Hamming or Gower distances are searched by scanning
+// the search set (see `hamming.c` and `gower.c`) instead of a tree.
+// Removed points are marked and skipped, and the set is compacted once
+// fewer than half of its points remain. Inserted points are appended.
+struct idist_ScanSet {
+	int* points;
+	unsigned char* removed;
+	int* slot_of;
+	size_t num_points;
+	size_t num_live;
+	size_t capacity;
+};
 
 struct idist_NNSearch {
 	int32_t nn_search_version;
@@ -51,32 +163,284 @@ struct idist_NNSearch {
 	const int* search_indices;
 	ANNpoint* search_points;
 	ANNpointSet* search_tree;
+	ANNdist* dist_scratch;
+	uint32_t len_dist_scratch;
+	idist_ANNDynamic* dynamic;
+	idist_NNSearchOptions options;
+	double* rotated_data;
+	double* rotation;
+	int* search_position;
+	idist_ANNQueryScratch query_scratch;
+	idist_Metric metric;
+	double minkowski_p;
+	idist_ScanSet* scan;
 };
 
 
+static double* idist_ann_data_matrix(const idist_NNSearch* nn_search_object);
+
+static bool idist_ann_init_scan(SEXP R_distances,
+                                size_t num_search_points,
+                                const int search_indices[],
+                                const idist_NNSearchOptions* options,
+                                idist_NNSearch** out_nn_search_object);
+
+static bool idist_ann_scan_search(idist_NNSearch* nn_search_object,
+                                  int num_queries,
+                                  const int query_indices[],
+                                  uint32_t k,
+                                  bool radius_search,
+                                  double radius,
+                                  bool fill_na,
+                                  size_t* out_num_ok_queries,
+                                  int out_query_indices[],
+                                  int out_nn_indices[]);
+
+static bool idist_ann_scan_append(idist_ScanSet* scan,
+                                  size_t len_points,
+                                  const int points[],
+                                  int index_base);
+
+static double idist_ann_set_metric(const idist_NNSearch* nn_search_object,
+                                   double radius);
+
+static double* idist_ann_pca_rotate(const double* raw_data_matrix,
+                                    int num_dimensions,
+                                    int num_data_points,
+                                    size_t num_search_points,
+                                    const int search_indices[],
+                                    int index_base,
+                                    double** out_rotation);
+
+static ANNpointSet* idist_ann_new_tree(const idist_NNSearchOptions* options,
+                                       ANNpoint* points,
+                                       int num_points,
+                                       int num_dimensions);
+
+static void idist_ann_free_block(idist_ANNBlock* block);
+
+static bool idist_ann_build_block(const idist_NNSearchOptions* options,
+                               const double* raw_data_matrix,
+                               int num_dimensions,
+                               int num_points,
+                               int* indices,
+                               idist_ANNBlock* out_block);
+
+static bool idist_ann_make_dynamic(idist_NNSearch* nn_search_object);
+
+static bool idist_ann_rebuild_block(const idist_NNSearchOptions* options,
+                                 idist_ANNDynamic* dynamic,
+                                 int block,
+                                 const double* raw_data_matrix,
+                                 int num_dimensions);
+
+static bool idist_ann_search(idist_NNSearch* nn_search_object,
+                             const double query_matrix[],
+                             int num_queries,
+                             const int query_indices[],
+                             bool exclude_self,
+                             uint32_t k,
+                             bool radius_search,
+                             double radius,
+                             bool fill_na,
+                             size_t* out_num_ok_queries,
+                             int out_query_indices[],
+                             int out_nn_indices[]);
+
+static bool idist_ann_dynamic_search(idist_NNSearch* nn_search_object,
+                                     const double query_matrix[],
+                                     int num_queries,
+                                     const int query_indices[],
+                                     bool exclude_self,
+                                     uint32_t k,
+                                     bool radius_search,
+                                     double radius,
+                                     bool fill_na,
+                                     const int query_order[],
+                                     unsigned char query_ok[],
+                                     size_t* out_num_ok_queries,
+                                     int out_query_indices[],
+                                     int out_nn_indices[]);
+
+static bool idist_ann_alloc_query_scratch(idist_NNSearch* nn_search_object);
+
+static const int* idist_ann_chunk_indices(idist_NNSearch* nn_search_object,
+                                          const int query_indices[],
+                                          int num_queries,
+                                          int first,
+                                          int len_chunk);
+
+static void idist_ann_order_queries(idist_NNSearch* nn_search_object,
+                                    const double query_matrix[],
+                                    int num_queries,
+                                    const int query_indices[],
+                                    const int** out_query_order,
+                                    unsigned char** out_query_ok);
+
+static size_t idist_ann_gather_results(int num_queries,
+                                       const int query_indices[],
+                                       int index_base,
+                                       uint32_t k,
+                                       const unsigned char query_ok[],
+                                       int out_query_indices[],
+                                       int out_nn_indices[]);
+
+static size_t idist_ann_fill_failed(int num_queries,
+                                    uint32_t k,
+                                    const unsigned char query_ok[],
+                                    int out_nn_indices[]);
+
+static bool idist_ann_search_indices(idist_NNSearch* nn_search_object,
+                                     size_t len_query_indices,
+                                     const int query_indices[],
+                                     uint32_t k,
+                                     bool radius_search,
+                                     double radius,
+                                     bool fill_na,
+                                     size_t* out_num_ok_queries,
+                                     int out_query_indices[],
+                                     int out_nn_indices[]);
+
+static bool idist_ann_search_points(idist_NNSearch* nn_search_object,
+                                    size_t num_query_points,
+                                    const double query_points[],
+                                    uint32_t k,
+                                    bool radius_search,
+                                    double radius,
+                                    bool fill_na,
+                                    size_t* out_num_ok_queries,
+                                    int out_query_indices[],
+                                    int out_nn_indices[]);
+
+
+idist_NNSearchOptions idist_nn_search_default_options(void)
+{
+	idist_NNSearchOptions options;
+	options.index = IDIST_NN_INDEX_KD_TREE;
+	options.exclude_self = false;
+	options.query_order = IDIST_NN_QUERY_ORDER_AUTO;
+	options.rotate = false;
+	options.hnsw_m = 16;
+	options.hnsw_ef_construction = 200;
+	options.hnsw_ef = 50;
+	options.rp_num_trees = 20;
+	options.rp_leaf_size = 64;
+	options.pq_num_subspaces = 0;
+	options.pq_rerank = 100;
+	options.index_base = 0;
+	return options;
+}
+
+
 bool idist_init_nearest_neighbor_search(SEXP R_distances,
                                         const size_t len_search_indices,
                                         const int* const search_indices,
                                         idist_NNSearch** const out_nn_search_object)
+{
+	return idist_init_nearest_neighbor_search_opt(R_distances,
+	                                              len_search_indices,
+	                                              search_indices,
+	                                              NULL,
+	                                              out_nn_search_object);
+}
+
+
+bool idist_init_nearest_neighbor_search_opt(SEXP R_distances,
+                                            const size_t len_search_indices,
+                                            const int* const search_indices,
+                                            const idist_NNSearchOptions* const options,
+                                            idist_NNSearch** const out_nn_search_object)
 {
 	idist_assert(idist_ann_open_search_objects >= 0);
 	idist_assert(idist_check_distance_object(R_distances));
 	idist_assert(out_nn_search_object != NULL);
 
-	double* const raw_data_matrix = REAL(R_distances);
+	// Callers find no search object on every failure path
+	*out_nn_search_object = NULL;
+
+	const idist_NNSearchOptions use_options = (options == NULL) ? idist_nn_search_default_options() : *options;
+	idist_assert(use_options.index != IDIST_NN_INDEX_HNSW ||
+	             (use_options.hnsw_m >= 2 && use_options.hnsw_ef_construction >= 1 && use_options.hnsw_ef >= 1));
+	idist_assert(use_options.index != IDIST_NN_INDEX_RP_FOREST ||
+	             (use_options.rp_num_trees >= 1 && use_options.rp_leaf_size >= 1));
+	idist_assert(use_options.index != IDIST_NN_INDEX_PQ ||
+	             (use_options.pq_num_subspaces >= 0 && use_options.pq_rerank >= 1));
+
+	// Other metrics than the Euclidean are searched with kd-trees in the
+	// original coordinates. Cosine distances are searched as Euclidean
+	// distances between the stored unit-length data points.
+	const idist_Metric metric = idist_get_metric(R_distances);
+	idist_assert(metric == IDIST_METRIC_EUCLIDEAN || metric == IDIST_METRIC_COSINE ||
+	             (use_options.index == IDIST_NN_INDEX_KD_TREE && !use_options.rotate));
+
 	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
 	const int num_data_points = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1];
 
 	const size_t num_search_points = (search_indices == NULL) ? static_cast<size_t>(num_data_points) : len_search_indices;
 
+	if (metric == IDIST_METRIC_HAMMING || metric == IDIST_METRIC_GOWER) {
+		return idist_ann_init_scan(R_distances,
+		                           num_search_points,
+		                           search_indices,
+		                           &use_options,
+		                           out_nn_search_object);
+	}
+
+	// The search structure and the queries use the rotated copy of the
+	// data matrix when it exists
+	double* rotated_data = NULL;
+	double* rotation = NULL;
+	if (use_options.rotate) {
+		rotated_data = idist_ann_pca_rotate(REAL(R_distances),
+		                                    num_dimensions,
+		                                    num_data_points,
+		                                    num_search_points,
+		                                    search_indices,
+		                                    use_options.index_base,
+		                                    &rotation);
+		if (rotated_data == NULL) return false;
+	}
+	double* const raw_data_matrix = (rotated_data == NULL) ? REAL(R_distances) : rotated_data;
+
 	ANNpoint* search_points;
 	try {
 		*out_nn_search_object = new idist_NNSearch;
+	} catch (...) {
+		delete[] rotated_data;
+		delete[] rotation;
+		return false;
+	}
+	try {
 		search_points = new ANNpoint[num_search_points];
 	} catch (...) {
+		delete[] rotated_data;
+		delete[] rotation;
+		delete *out_nn_search_object;
+		*out_nn_search_object = NULL;
 		return false;
 	}
 
+	// Excluding the query requires its position in the search set
+	int* search_position = NULL;
+	if (use_options.exclude_self && search_indices != NULL) {
+		try {
+			search_position = new int[num_data_points];
+		} catch (...) {
+			delete[] search_points;
+			delete[] rotated_data;
+			delete[] rotation;
+			delete *out_nn_search_object;
+			*out_nn_search_object = NULL;
+			return false;
+		}
+		for (int i = 0; i < num_data_points; ++i) {
+			search_position[i] = ANN_NULL_IDX;
+		}
+		for (size_t i = 0; i < num_search_points; ++i) {
+			search_position[search_indices[i] - use_options.index_base] = static_cast<int>(i);
+		}
+	}
+
 	if (search_indices == NULL) {
 		double* search_point = raw_data_matrix;
 		for (size_t i = 0; i < num_search_points; ++i, search_point += num_dimensions) {
@@ -84,17 +448,21 @@ bool idist_init_nearest_neighbor_search(SEXP R_distances,
 		}
 	} else if (search_indices != NULL) {
 		for (size_t i = 0; i < num_search_points; ++i) {
-			search_points[i] = raw_data_matrix + search_indices[i] * num_dimensions;
+			search_points[i] = raw_data_matrix + (search_indices[i] - use_options.index_base) * num_dimensions;
 		}
 	}
 
 	ANNpointSet* search_tree;
 	try {
-		search_tree = new ANNpointSetConstructor(search_points,
-		                                         static_cast<int>(num_search_points),
-		                                         num_dimensions);
+		search_tree = idist_ann_new_tree(&use_options,
+		                                 search_points,
+		                                 static_cast<int>(num_search_points),
+		                                 num_dimensions);
 	} catch (...) {
+		delete[] search_position;
 		delete[] search_points;
+		delete[] rotated_data;
+		delete[] rotation;
 		delete *out_nn_search_object;
 		*out_nn_search_object = NULL;
 		return false;
@@ -106,9 +474,33 @@ bool idist_init_nearest_neighbor_search(SEXP R_distances,
 	(*out_nn_search_object)->R_distances = R_distances;
 	(*out_nn_search_object)->search_indices = search_indices;
 	(*out_nn_search_object)->search_points = search_points;
+	(*out_nn_search_object)->dist_scratch = NULL;
+	(*out_nn_search_object)->len_dist_scratch = 0;
 	(*out_nn_search_object)->search_tree = search_tree;
+	(*out_nn_search_object)->dynamic = NULL;
+	(*out_nn_search_object)->options = use_options;
+	(*out_nn_search_object)->rotated_data = rotated_data;
+	(*out_nn_search_object)->rotation = rotation;
+	(*out_nn_search_object)->search_position = search_position;
+	(*out_nn_search_object)->query_scratch.keys = NULL;
+	(*out_nn_search_object)->query_scratch.order = NULL;
+	(*out_nn_search_object)->query_scratch.ok = NULL;
+	(*out_nn_search_object)->query_scratch.len_order = 0;
+	(*out_nn_search_object)->query_scratch.box = NULL;
+	(*out_nn_search_object)->query_scratch.indices = NULL;
+	(*out_nn_search_object)->query_scratch.rotated = NULL;
+	(*out_nn_search_object)->query_scratch.len_rotated = 0;
+	(*out_nn_search_object)->metric = metric;
+	(*out_nn_search_object)->minkowski_p = idist_get_minkowski_p(R_distances);
+	(*out_nn_search_object)->scan = NULL;
 
 	++idist_ann_open_search_objects;
+
+	if (!idist_ann_alloc_query_scratch(*out_nn_search_object)) {
+		idist_close_nearest_neighbor_search(out_nn_search_object);
+		return false;
+	}
+
 	return true;
 }
 
@@ -122,6 +514,162 @@ bool idist_nearest_neighbor_search(idist_NNSearch* const nn_search_object,
                                    size_t* const out_num_ok_queries,
                                    int* const out_query_indices,
                                    int* const out_nn_indices)
+{
+	return idist_ann_search_indices(nn_search_object,
+	                                len_query_indices,
+	                                query_indices,
+	                                k,
+	                                radius_search,
+	                                radius,
+	                                false,
+	                                out_num_ok_queries,
+	                                out_query_indices,
+	                                out_nn_indices);
+}
+
+
+// As `idist_nearest_neighbor_search`, but the neighbors of the `q`th
+// query are always written to `out_nn_indices[q * k]` to
+// `out_nn_indices[q * k + k - 1]`, and they are all NA_INTEGER if the
+// search failed. Nothing is moved after the search, so the output can be
+// the caller's final result.
+bool idist_nearest_neighbor_search_na(idist_NNSearch* const nn_search_object,
+                                      const size_t len_query_indices,
+                                      const int* const query_indices,
+                                      const uint32_t k,
+                                      const bool radius_search,
+                                      const double radius,
+                                      size_t* const out_num_ok_queries,
+                                      int* const out_nn_indices)
+{
+	return idist_ann_search_indices(nn_search_object,
+	                                len_query_indices,
+	                                query_indices,
+	                                k,
+	                                radius_search,
+	                                radius,
+	                                true,
+	                                out_num_ok_queries,
+	                                NULL,
+	                                out_nn_indices);
+}
+
+
+// Runs the queries in chunks of `chunk_size` queries and passes the
+// neighbors of each chunk to `chunk_callback` as soon as they are found,
+// laid out as by `idist_nearest_neighbor_search_na`. The callback also
+// gets the position of the chunk's first query, and it can stop the
+// search by returning false (in which case this returns false). Only one
+// chunk of results is kept in memory. If `query_indices` is NULL, the
+// queries are data points 0 to `len_query_indices - 1`.
+bool idist_nearest_neighbor_search_chunks(idist_NNSearch* const nn_search_object,
+                                          const size_t len_query_indices,
+                                          const int* const query_indices,
+                                          const uint32_t k,
+                                          const bool radius_search,
+                                          const double radius,
+                                          const size_t chunk_size,
+                                          const idist_NNChunkCallback chunk_callback,
+                                          void* const callback_data)
+{
+	idist_assert(k > 0);
+	idist_assert(chunk_size > 0);
+	idist_assert(chunk_callback != NULL);
+
+	// R_alloc memory is released even if the callback throws an R error
+	const size_t len_buffer = std::min(len_query_indices, chunk_size);
+	int* const chunk_queries = (query_indices == NULL) ? reinterpret_cast<int*>(R_alloc(len_buffer + 1, sizeof(int))) : NULL;
+	int* const chunk_nn_indices = reinterpret_cast<int*>(R_alloc(len_buffer * k + 1, sizeof(int)));
+
+	for (size_t first_query = 0; first_query < len_query_indices; first_query += chunk_size) {
+		const size_t num_chunk_queries = std::min(len_query_indices - first_query, chunk_size);
+		const int* chunk = chunk_queries;
+		if (query_indices != NULL) {
+			chunk = query_indices + first_query;
+		} else {
+			for (size_t q = 0; q < num_chunk_queries; ++q) {
+				chunk_queries[q] = static_cast<int>(first_query + q) + nn_search_object->options.index_base;
+			}
+		}
+
+		size_t num_ok_queries;
+		if (!idist_nearest_neighbor_search_na(nn_search_object,
+		                                      num_chunk_queries,
+		                                      chunk,
+		                                      k,
+		                                      radius_search,
+		                                      radius,
+		                                      &num_ok_queries,
+		                                      chunk_nn_indices)) {
+			return false;
+		}
+		if (!chunk_callback(first_query, num_chunk_queries, chunk_nn_indices, callback_data)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// `query_points` holds `num_query_points` points as columns in the
+// coordinates of the data matrix of the search object's `distances`
+// object (see `coerce_query_data` in R). The points are not in the
+// search set, so the search object's `exclude_self` is ignored.
+// `out_query_indices` gets the positions of the successful queries in
+// `query_points`.
+bool idist_nearest_neighbor_search_points(idist_NNSearch* const nn_search_object,
+                                          const size_t num_query_points,
+                                          const double* const query_points,
+                                          const uint32_t k,
+                                          const bool radius_search,
+                                          const double radius,
+                                          size_t* const out_num_ok_queries,
+                                          int* const out_query_indices,
+                                          int* const out_nn_indices)
+{
+	return idist_ann_search_points(nn_search_object,
+	                               num_query_points,
+	                               query_points,
+	                               k,
+	                               radius_search,
+	                               radius,
+	                               false,
+	                               out_num_ok_queries,
+	                               out_query_indices,
+	                               out_nn_indices);
+}
+
+
+// `idist_nearest_neighbor_search_points` with the output of
+// `idist_nearest_neighbor_search_na`
+bool idist_nearest_neighbor_search_points_na(idist_NNSearch* const nn_search_object,
+                                             const size_t num_query_points,
+                                             const double* const query_points,
+                                             const uint32_t k,
+                                             const bool radius_search,
+                                             const double radius,
+                                             size_t* const out_num_ok_queries,
+                                             int* const out_nn_indices)
+{
+	return idist_ann_search_points(nn_search_object,
+	                               num_query_points,
+	                               query_points,
+	                               k,
+	                               radius_search,
+	                               radius,
+	                               true,
+	                               out_num_ok_queries,
+	                               NULL,
+	                               out_nn_indices);
+}
+
+
+bool idist_count_within_radius(idist_NNSearch* const nn_search_object,
+                               const size_t len_query_indices,
+                               const int* const query_indices,
+                               const double radius,
+                               int* const out_counts)
 {
 	idist_assert(idist_ann_open_search_objects > 0);
 	idist_assert(nn_search_object != NULL);
@@ -130,94 +678,200 @@ bool idist_nearest_neighbor_search(idist_NNSearch* const nn_search_object,
 	SEXP R_distances = nn_search_object->R_distances;
 	idist_assert(idist_check_distance_object(R_distances));
 
-	ANNpointSet* const search_tree = nn_search_object->search_tree;
-	idist_assert(search_tree != NULL);
+	idist_assert(radius > 0.0);
+	idist_assert(out_counts != NULL);
+	idist_assert(nn_search_object->metric == IDIST_METRIC_EUCLIDEAN ||
+	             nn_search_object->metric == IDIST_METRIC_COSINE);
+
+	const int num_queries = (query_indices == NULL) ? INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1] : (int) len_query_indices;
 
+	const bool exclude_self = nn_search_object->options.exclude_self;
 	const int* const search_indices = nn_search_object->search_indices;
+	const int* const search_position = nn_search_object->search_position;
+	const int index_base = nn_search_object->options.index_base;
+	idist_ANNDynamic* const dynamic = nn_search_object->dynamic;
+	idist_assert(dynamic != NULL || nn_search_object->search_tree != NULL);
 
-	idist_assert(k > 0);
-	idist_assert(!radius_search || (radius > 0.0));
-	idist_assert(out_num_ok_queries != NULL);
-	idist_assert(out_nn_indices != NULL);
+	double* const raw_data_matrix = idist_ann_data_matrix(nn_search_object);
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+	const double radius_sq = idist_ann_set_metric(nn_search_object, radius);
 
-	const int k_int = static_cast<int>(k);
+	// Counts are written at each query's position, so reordered
+	// queries need no gathering
+	const int* query_order;
+	unsigned char* query_ok;
+	idist_ann_order_queries(nn_search_object, raw_data_matrix, num_queries, query_indices, &query_order, &query_ok);
 
-	double* const raw_data_matrix = REAL(R_distances);
-	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
-	const int num_data_points = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1];
+	for (int i = 0; i < num_queries; ++i) {
+		const int q = (query_order == NULL) ? i : query_order[i];
+		const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+		const ANNpoint query_point = raw_data_matrix + query * num_dimensions;
 
-	const int num_queries = (query_indices == NULL) ? num_data_points : (int) len_query_indices;
+		if (dynamic == NULL) {
+			if (exclude_self) {
+				annExcludeIdx((search_indices == NULL) ? query : search_position[query]);
+			}
+			out_counts[q] = nn_search_object->search_tree->annCountRange(query_point, radius_sq);
+		} else {
+			// Sum over the blocks, excluding the query in its own block
+			int exclude_block = -1;
+			if (exclude_self && dynamic->block_of[query] >= 0) {
+				exclude_block = dynamic->block_of[query];
+			}
+			int count = 0;
+			for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+				const idist_ANNBlock* const block = &dynamic->blocks[b];
+				if (block->tree == NULL || block->num_live == 0) continue;
+				annExcludeIdx((b == exclude_block) ? dynamic->local_of[query] : ANN_NULL_IDX);
+				count += block->tree->annCountRange(query_point, radius_sq);
+			}
+			out_counts[q] = count;
+		}
+	}
 
-	ANNdist* dist_scratch;
-	try {
-		dist_scratch = new ANNdist[k];
-	} catch (...) {
+	annExcludeIdx(ANN_NULL_IDX);
+
+	return true;
+}
+
+
+bool idist_kernel_sums(idist_NNSearch* const nn_search_object,
+                       const size_t len_query_indices,
+                       const int* const query_indices,
+                       const idist_NNKernel kernel,
+                       const double bandwidth,
+                       const double* const weights,
+                       const double tolerance,
+                       double* const out_sums)
+{
+	idist_assert(idist_ann_open_search_objects > 0);
+	idist_assert(nn_search_object != NULL);
+	idist_assert(nn_search_object->nn_search_version == IDIST_ANN_NN_SEARCH_STRUCT_VERSION);
+
+	SEXP R_distances = nn_search_object->R_distances;
+	idist_assert(idist_check_distance_object(R_distances));
+
+	idist_assert(kernel == IDIST_NN_KERNEL_GAUSSIAN || kernel == IDIST_NN_KERNEL_EPANECHNIKOV);
+	idist_assert(bandwidth > 0.0);
+	idist_assert(tolerance >= 0.0);
+	idist_assert(out_sums != NULL);
+	idist_assert(nn_search_object->metric == IDIST_METRIC_EUCLIDEAN);
+
+	// Kernel sums need the weights of the trees' nodes
+	if (nn_search_object->options.index != IDIST_NN_INDEX_KD_TREE &&
+	        nn_search_object->options.index != IDIST_NN_INDEX_BALL_TREE) {
 		return false;
 	}
 
-	size_t num_ok_queries = 0;
+	const int num_queries = (query_indices == NULL) ? INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1] : (int) len_query_indices;
 
-	if (!radius_search) {
-		int* write_nnidx = out_nn_indices;
-		for (int q = 0; q < num_queries; ++q) {
-			const int query = (query_indices == NULL) ? q : query_indices[q];
-			const ANNpoint query_point = raw_data_matrix + query * num_dimensions;
-			search_tree->annkSearch(query_point,    // pointer to query point
-			                        k_int,          // number of neighbors
-			                        write_nnidx,    // pointer to start of index result
-			                        dist_scratch,   // pointer to start of distance result
-			                        DIST_ANN_EPS);  // error margin
-			if (search_indices == NULL) {
-				// Sequential indices, all done
-				write_nnidx += k;
-			} else {
-				// Not sequential indices, translate to original indices
-				const int* const write_nnidx_stop = write_nnidx + k;
-				for (; write_nnidx != write_nnidx_stop; ++write_nnidx) {
-					*write_nnidx = search_indices[*write_nnidx];
-				}
-			}
-			if (out_query_indices != NULL) {
-				out_query_indices[num_ok_queries] = query;
+	const bool exclude_self = nn_search_object->options.exclude_self;
+	const int* const search_indices = nn_search_object->search_indices;
+	const int* const search_position = nn_search_object->search_position;
+	const int index_base = nn_search_object->options.index_base;
+	idist_ANNDynamic* const dynamic = nn_search_object->dynamic;
+	idist_assert(dynamic != NULL || nn_search_object->search_tree != NULL);
+
+	// The trees take weights by their own point indices. These are the
+	// data point indices only for a static tree over all data points.
+	ANNdist* local_weights = NULL;
+	if (weights != NULL && (dynamic != NULL || search_indices != NULL)) {
+		size_t len_local = 0;
+		if (dynamic == NULL) {
+			len_local = static_cast<size_t>(nn_search_object->search_tree->nPoints());
+		} else {
+			for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+				if (dynamic->blocks[b].tree != NULL) len_local += static_cast<size_t>(dynamic->blocks[b].num_points);
 			}
-			++num_ok_queries;
 		}
+		try {
+			local_weights = new ANNdist[len_local + 1];
+		} catch (...) {
+			return false;
+		}
+	}
 
+	const ANNkernel ann_kernel = (kernel == IDIST_NN_KERNEL_GAUSSIAN) ? ANN_KERN_GAUSS : ANN_KERN_EPAN;
+	if (dynamic == NULL) {
+		ANNdistArray tree_weights = const_cast<double*>(weights);
+		if (local_weights != NULL) {
+			const int num_points = nn_search_object->search_tree->nPoints();
+			for (int i = 0; i < num_points; ++i) {
+				local_weights[i] = weights[search_indices[i] - index_base];
+			}
+			tree_weights = local_weights;
+		}
+		static_cast<ANNkd_tree*>(nn_search_object->search_tree)->annSetWeights(tree_weights);
 	} else {
-		// radius_search == TRUE
-		const double radius_sq = radius * radius;
-		int* write_nnidx = out_nn_indices;
-		for (int q = 0; q < num_queries; ++q) {
-			const int query = (query_indices == NULL) ? q : query_indices[q];
-			const ANNpoint query_point = raw_data_matrix + query * num_dimensions;
-			const int num_found = search_tree->annkFRSearch(query_point,              // pointer to query point
-			                                                radius_sq,                // squared caliper
-			                                                k_int,                    // number of neighbors
-			                                                write_nnidx,              // pointer to start of index result
-			                                                dist_scratch,             // pointer to start of distance result
-			                                                DIST_ANN_EPS);            // error margin
-			if (num_found >= k_int) {
-				if (search_indices == NULL) {
-					// Sequential indices, all done
-					write_nnidx += k;
-				} else {
-					// Not sequential indices, translate to original indices
-					const int* const write_nnidx_stop = write_nnidx + k;
-					for (; write_nnidx != write_nnidx_stop; ++write_nnidx) {
-						*write_nnidx = search_indices[*write_nnidx];
-					}
-				}
-				if (out_query_indices != NULL) {
-					out_query_indices[num_ok_queries] = query;
+		ANNdist* write = local_weights;
+		for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+			const idist_ANNBlock* const block = &dynamic->blocks[b];
+			if (block->tree == NULL) continue;
+			ANNdistArray tree_weights = NULL;
+			if (local_weights != NULL) {
+				for (int i = 0; i < block->num_points; ++i) {
+					write[i] = weights[block->indices[i]];
 				}
-				++num_ok_queries;
+				tree_weights = write;
+				write += block->num_points;
 			}
+			static_cast<ANNkd_tree*>(block->tree)->annSetWeights(tree_weights);
 		}
 	}
 
-	delete[] dist_scratch;
+	double* const raw_data_matrix = idist_ann_data_matrix(nn_search_object);
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+	const double bandwidth_sq = bandwidth * bandwidth;
+
+	// Sums are written at each query's position, so reordered
+	// queries need no gathering
+	const int* query_order;
+	unsigned char* query_ok;
+	idist_ann_order_queries(nn_search_object, raw_data_matrix, num_queries, query_indices, &query_order, &query_ok);
+
+	for (int i = 0; i < num_queries; ++i) {
+		const int q = (query_order == NULL) ? i : query_order[i];
+		const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+		const ANNpoint query_point = raw_data_matrix + query * num_dimensions;
+
+		if (dynamic == NULL) {
+			if (exclude_self) {
+				annExcludeIdx((search_indices == NULL) ? query : search_position[query]);
+			}
+			ANNkd_tree* const tree = static_cast<ANNkd_tree*>(nn_search_object->search_tree);
+			out_sums[q] = tree->annKernelSum(query_point, ann_kernel, bandwidth_sq, tolerance);
+		} else {
+			// Sum over the blocks, excluding the query in its own block
+			int exclude_block = -1;
+			if (exclude_self && dynamic->block_of[query] >= 0) {
+				exclude_block = dynamic->block_of[query];
+			}
+			double sum = 0.0;
+			for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+				const idist_ANNBlock* const block = &dynamic->blocks[b];
+				if (block->tree == NULL || block->num_live == 0) continue;
+				annExcludeIdx((b == exclude_block) ? dynamic->local_of[query] : ANN_NULL_IDX);
+				ANNkd_tree* const tree = static_cast<ANNkd_tree*>(block->tree);
+				sum += tree->annKernelSum(query_point, ann_kernel, bandwidth_sq, tolerance);
+			}
+			out_sums[q] = sum;
+		}
+	}
+
+	annExcludeIdx(ANN_NULL_IDX);
+
+	// The trees may not keep pointers to the weights after the call
+	if (dynamic == NULL) {
+		static_cast<ANNkd_tree*>(nn_search_object->search_tree)->annSetWeights(NULL);
+	} else {
+		for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+			if (dynamic->blocks[b].tree != NULL) {
+				static_cast<ANNkd_tree*>(dynamic->blocks[b].tree)->annSetWeights(NULL);
+			}
+		}
+	}
+	delete[] local_weights;
 
-	*out_num_ok_queries = num_ok_queries;
 	return true;
 }
 
@@ -232,6 +886,34 @@ bool idist_close_nearest_neighbor_search(idist_NNSearch** const out_nn_search_ob
 		idist_assert((*out_nn_search_object)->nn_search_version == IDIST_ANN_NN_SEARCH_STRUCT_VERSION);
 		delete (*out_nn_search_object)->search_tree;
 		delete[] (*out_nn_search_object)->search_points;
+		delete[] (*out_nn_search_object)->rotated_data;
+		delete[] (*out_nn_search_object)->rotation;
+		delete[] (*out_nn_search_object)->dist_scratch;
+		delete[] (*out_nn_search_object)->search_position;
+		delete[] (*out_nn_search_object)->query_scratch.keys;
+		delete[] (*out_nn_search_object)->query_scratch.order;
+		delete[] (*out_nn_search_object)->query_scratch.ok;
+		delete[] (*out_nn_search_object)->query_scratch.box;
+		delete[] (*out_nn_search_object)->query_scratch.indices;
+		delete[] (*out_nn_search_object)->query_scratch.rotated;
+		idist_ScanSet* const scan = (*out_nn_search_object)->scan;
+		if (scan != NULL) {
+			delete[] scan->points;
+			delete[] scan->removed;
+			delete[] scan->slot_of;
+			delete scan;
+		}
+		idist_ANNDynamic* const dynamic = (*out_nn_search_object)->dynamic;
+		if (dynamic != NULL) {
+			for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+				idist_ann_free_block(&dynamic->blocks[b]);
+			}
+			delete[] dynamic->block_of;
+			delete[] dynamic->local_of;
+			delete[] dynamic->merge_indices;
+			delete[] dynamic->merge_dists;
+			delete dynamic;
+		}
 		delete *out_nn_search_object;
 		*out_nn_search_object = NULL;
 	}
@@ -246,3 +928,1468 @@ bool idist_close_nearest_neighbor_search(idist_NNSearch** const out_nn_search_ob
 
 	return true;
 }
+
+
+// Removes points from the search set. Returns false, leaving the set
+// unchanged, if a point is not in the set or is repeated in
+// `remove_indices`.
+bool idist_nearest_neighbor_search_remove(idist_NNSearch* const nn_search_object,
+                                          const size_t len_remove_indices,
+                                          const int* const remove_indices)
+{
+	idist_assert(idist_ann_open_search_objects > 0);
+	idist_assert(nn_search_object != NULL);
+	idist_assert(nn_search_object->nn_search_version == IDIST_ANN_NN_SEARCH_STRUCT_VERSION);
+	idist_assert(remove_indices != NULL || len_remove_indices == 0);
+
+	SEXP R_distances = nn_search_object->R_distances;
+	idist_assert(idist_check_distance_object(R_distances));
+	const int num_data_points = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1];
+
+	idist_ScanSet* const scan = nn_search_object->scan;
+	if (scan != NULL) {
+		// Check the points before removing any; slots of checked points
+		// are marked as -2 - slot
+		size_t num_checked = 0;
+		for (; num_checked < len_remove_indices; ++num_checked) {
+			const int point = remove_indices[num_checked];
+			idist_assert(point >= 0 && point < num_data_points);
+			if (scan->slot_of[point] < 0) break;
+			scan->slot_of[point] = -2 - scan->slot_of[point];
+		}
+		for (size_t i = 0; i < num_checked; ++i) {
+			scan->slot_of[remove_indices[i]] = -2 - scan->slot_of[remove_indices[i]];
+		}
+		if (num_checked < len_remove_indices) return false;
+
+		for (size_t i = 0; i < len_remove_indices; ++i) {
+			const int point = remove_indices[i];
+			const int slot = scan->slot_of[point];
+			scan->removed[slot] = 1;
+			scan->slot_of[point] = -1;
+			--scan->num_live;
+		}
+		if (scan->num_points >= DIST_ANN_REBUILD_MIN_POINTS &&
+		        2 * scan->num_live < scan->num_points) {
+			// Compact the set in place, keeping the order of the points
+			size_t write = 0;
+			for (size_t s = 0; s < scan->num_points; ++s) {
+				if (scan->removed[s]) continue;
+				scan->points[write] = scan->points[s];
+				scan->removed[write] = 0;
+				scan->slot_of[scan->points[write]] = static_cast<int>(write);
+				++write;
+			}
+			idist_assert(write == scan->num_live);
+			scan->num_points = write;
+		}
+		return true;
+	}
+
+	const double* const raw_data_matrix = idist_ann_data_matrix(nn_search_object);
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+
+	if (!idist_ann_make_dynamic(nn_search_object)) return false;
+	idist_ANNDynamic* const dynamic = nn_search_object->dynamic;
+
+	// Check the points before removing any; blocks of checked points are
+	// marked as -2 - block
+	size_t num_checked = 0;
+	for (; num_checked < len_remove_indices; ++num_checked) {
+		const int point = remove_indices[num_checked];
+		idist_assert(point >= 0 && point < num_data_points);
+		if (dynamic->block_of[point] < 0) break;
+		dynamic->block_of[point] = -2 - dynamic->block_of[point];
+	}
+	for (size_t i = 0; i < num_checked; ++i) {
+		dynamic->block_of[remove_indices[i]] = -2 - dynamic->block_of[remove_indices[i]];
+	}
+	if (num_checked < len_remove_indices) return false;
+
+	for (size_t i = 0; i < len_remove_indices; ++i) {
+		const int point = remove_indices[i];
+		const int block = dynamic->block_of[point];
+		const ANNbool removed = dynamic->blocks[block].tree->annDeletePt(dynamic->local_of[point]);
+		idist_assert(removed);
+		dynamic->block_of[point] = -1;
+		--dynamic->blocks[block].num_live;
+		--dynamic->num_live;
+	}
+
+	for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+		idist_ANNBlock* const block = &dynamic->blocks[b];
+		if (block->tree == NULL) continue;
+		if (block->num_live == 0) {
+			idist_ann_free_block(block);
+		} else if (block->num_points >= DIST_ANN_REBUILD_MIN_POINTS &&
+		           2 * block->num_live < block->num_points) {
+			if (!idist_ann_rebuild_block(&nn_search_object->options, dynamic, b, raw_data_matrix, num_dimensions)) return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Inserts points into the search set. Returns false, leaving the set
+// unchanged, if a point is already in the set or is repeated in
+// `insert_indices`.
+bool idist_nearest_neighbor_search_insert(idist_NNSearch* const nn_search_object,
+                                          const size_t len_insert_indices,
+                                          const int* const insert_indices)
+{
+	idist_assert(idist_ann_open_search_objects > 0);
+	idist_assert(nn_search_object != NULL);
+	idist_assert(nn_search_object->nn_search_version == IDIST_ANN_NN_SEARCH_STRUCT_VERSION);
+	idist_assert(insert_indices != NULL || len_insert_indices == 0);
+
+	SEXP R_distances = nn_search_object->R_distances;
+	idist_assert(idist_check_distance_object(R_distances));
+	const int num_data_points = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1];
+
+	if (len_insert_indices == 0) return true;
+
+	idist_ScanSet* const scan = nn_search_object->scan;
+	if (scan != NULL) {
+		// Checked points are marked as -2
+		size_t num_checked = 0;
+		for (; num_checked < len_insert_indices; ++num_checked) {
+			const int point = insert_indices[num_checked];
+			idist_assert(point >= 0 && point < num_data_points);
+			if (scan->slot_of[point] != -1) break;
+			scan->slot_of[point] = -2;
+		}
+		for (size_t i = 0; i < num_checked; ++i) {
+			scan->slot_of[insert_indices[i]] = -1;
+		}
+		if (num_checked < len_insert_indices) return false;
+		return idist_ann_scan_append(scan, len_insert_indices, insert_indices, 0);
+	}
+
+	const double* const raw_data_matrix = idist_ann_data_matrix(nn_search_object);
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+
+	if (!idist_ann_make_dynamic(nn_search_object)) return false;
+	idist_ANNDynamic* const dynamic = nn_search_object->dynamic;
+
+	// Checked points are marked as -2
+	size_t num_checked = 0;
+	for (; num_checked < len_insert_indices; ++num_checked) {
+		const int point = insert_indices[num_checked];
+		idist_assert(point >= 0 && point < num_data_points);
+		if (dynamic->block_of[point] != -1) break;
+		dynamic->block_of[point] = -2;
+	}
+	for (size_t i = 0; i < num_checked; ++i) {
+		dynamic->block_of[insert_indices[i]] = -1;
+	}
+	if (num_checked < len_insert_indices) return false;
+
+	// Find the first free block that can hold the new points together
+	// with the live points of all occupied blocks before it
+	size_t num_points = len_insert_indices;
+	int target = 1;
+	while (dynamic->blocks[target].tree != NULL ||
+	       num_points > (static_cast<size_t>(1) << (target - 1))) {
+		if (dynamic->blocks[target].tree != NULL) {
+			num_points += static_cast<size_t>(dynamic->blocks[target].num_live);
+		}
+		++target;
+		idist_assert(target < IDIST_ANN_MAX_BLOCKS);
+	}
+
+	int* indices;
+	try {
+		indices = new int[num_points];
+	} catch (...) {
+		return false;
+	}
+
+	size_t write = 0;
+	for (size_t i = 0; i < len_insert_indices; ++i) {
+		indices[write++] = insert_indices[i];
+	}
+	for (int b = 1; b < target; ++b) {
+		const idist_ANNBlock* const block = &dynamic->blocks[b];
+		for (int l = 0; l < block->num_points && block->tree != NULL; ++l) {
+			const int point = block->indices[l];
+			if (dynamic->block_of[point] == b && dynamic->local_of[point] == l) {
+				indices[write++] = point;
+			}
+		}
+	}
+	idist_assert(write == num_points);
+
+	idist_ANNBlock new_block;
+	if (!idist_ann_build_block(&nn_search_object->options, raw_data_matrix, num_dimensions, static_cast<int>(num_points), indices, &new_block)) {
+		delete[] indices;
+		return false;
+	}
+
+	for (int b = 1; b < target; ++b) {
+		idist_ann_free_block(&dynamic->blocks[b]);
+	}
+	dynamic->blocks[target] = new_block;
+	for (int l = 0; l < new_block.num_points; ++l) {
+		dynamic->block_of[indices[l]] = target;
+		dynamic->local_of[indices[l]] = l;
+	}
+	dynamic->num_live += static_cast<int>(len_insert_indices);
+
+	return true;
+}
+
+
+static double* idist_ann_data_matrix(const idist_NNSearch* const nn_search_object)
+{
+	if (nn_search_object->rotated_data != NULL) {
+		return nn_search_object->rotated_data;
+	}
+	return REAL(nn_search_object->R_distances);
+}
+
+
+// Selects the metric of the search object in libann, which is reset to
+// the Euclidean metric after each batch of searches. Returns `radius`
+// raised to the power that libann compares distances with.
+static double idist_ann_set_metric(const idist_NNSearch* const nn_search_object,
+                                   const double radius)
+{
+	const double p = nn_search_object->minkowski_p;
+	switch (nn_search_object->metric) {
+	case IDIST_METRIC_MANHATTAN:
+		annSetMetric(ANN_METRIC_L1);
+		return radius;
+	case IDIST_METRIC_MAXIMUM:
+		annSetMetric(ANN_METRIC_LINF);
+		return radius;
+	case IDIST_METRIC_MINKOWSKI:
+		annSetMetric(ANN_METRIC_LP, p);
+		return pow(radius, p);
+	case IDIST_METRIC_COSINE:
+		annSetMetric(ANN_METRIC_L2);
+		return 2.0 * radius;
+	default:
+		annSetMetric(ANN_METRIC_L2);
+		return radius * radius;
+	}
+}
+
+
+static bool idist_ann_init_scan(const SEXP R_distances,
+                                const size_t num_search_points,
+                                const int* const search_indices,
+                                const idist_NNSearchOptions* const options,
+                                idist_NNSearch** const out_nn_search_object)
+{
+	const int num_data_points = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1];
+
+	idist_ScanSet* scan;
+	try {
+		scan = new idist_ScanSet;
+	} catch (...) {
+		return false;
+	}
+	scan->points = NULL;
+	scan->removed = NULL;
+	scan->num_points = 0;
+	scan->num_live = 0;
+	scan->capacity = 0;
+	try {
+		scan->slot_of = new int[num_data_points];
+	} catch (...) {
+		delete scan;
+		return false;
+	}
+	std::fill(scan->slot_of, scan->slot_of + num_data_points, -1);
+
+	if (!idist_ann_scan_append(scan, num_search_points, search_indices, options->index_base)) {
+		delete[] scan->slot_of;
+		delete scan;
+		return false;
+	}
+
+	try {
+		*out_nn_search_object = new idist_NNSearch;
+	} catch (...) {
+		delete[] scan->points;
+		delete[] scan->removed;
+		delete[] scan->slot_of;
+		delete scan;
+		return false;
+	}
+
+	(*out_nn_search_object)->nn_search_version = IDIST_ANN_NN_SEARCH_STRUCT_VERSION;
+	(*out_nn_search_object)->R_distances = R_distances;
+	(*out_nn_search_object)->search_indices = search_indices;
+	(*out_nn_search_object)->search_points = NULL;
+	(*out_nn_search_object)->dist_scratch = NULL;
+	(*out_nn_search_object)->len_dist_scratch = 0;
+	(*out_nn_search_object)->search_tree = NULL;
+	(*out_nn_search_object)->dynamic = NULL;
+	(*out_nn_search_object)->options = *options;
+	(*out_nn_search_object)->rotated_data = NULL;
+	(*out_nn_search_object)->rotation = NULL;
+	(*out_nn_search_object)->search_position = NULL;
+	(*out_nn_search_object)->query_scratch.keys = NULL;
+	(*out_nn_search_object)->query_scratch.order = NULL;
+	(*out_nn_search_object)->query_scratch.ok = NULL;
+	(*out_nn_search_object)->query_scratch.len_order = 0;
+	(*out_nn_search_object)->query_scratch.box = NULL;
+	(*out_nn_search_object)->query_scratch.indices = NULL;
+	(*out_nn_search_object)->query_scratch.rotated = NULL;
+	(*out_nn_search_object)->query_scratch.len_rotated = 0;
+	(*out_nn_search_object)->metric = idist_get_metric(R_distances);
+	(*out_nn_search_object)->minkowski_p = 2.0;
+	(*out_nn_search_object)->scan = scan;
+
+	++idist_ann_open_search_objects;
+
+	if (!idist_ann_alloc_query_scratch(*out_nn_search_object)) {
+		idist_close_nearest_neighbor_search(out_nn_search_object);
+		return false;
+	}
+
+	return true;
+}
+
+
+// Appends `points` (or `0, ..., len_points - 1` if NULL) to the set,
+// reading them as `points[i] - index_base`
+static bool idist_ann_scan_append(idist_ScanSet* const scan,
+                                  const size_t len_points,
+                                  const int* const points,
+                                  const int index_base)
+{
+	const size_t num_points = scan->num_points + len_points;
+	if (num_points > scan->capacity) {
+		const size_t capacity = std::max(2 * scan->capacity, num_points);
+		int* new_points;
+		unsigned char* new_removed;
+		try {
+			new_points = new int[capacity];
+		} catch (...) {
+			return false;
+		}
+		try {
+			new_removed = new unsigned char[capacity];
+		} catch (...) {
+			delete[] new_points;
+			return false;
+		}
+		std::copy(scan->points, scan->points + scan->num_points, new_points);
+		std::copy(scan->removed, scan->removed + scan->num_points, new_removed);
+		delete[] scan->points;
+		delete[] scan->removed;
+		scan->points = new_points;
+		scan->removed = new_removed;
+		scan->capacity = capacity;
+	}
+
+	for (size_t i = 0; i < len_points; ++i) {
+		const size_t slot = scan->num_points + i;
+		const int point = (points == NULL) ? static_cast<int>(i) : points[i] - index_base;
+		scan->points[slot] = point;
+		scan->removed[slot] = 0;
+		scan->slot_of[point] = static_cast<int>(slot);
+	}
+	scan->num_points = num_points;
+	scan->num_live += len_points;
+
+	return true;
+}
+
+
+static bool idist_ann_search_indices(idist_NNSearch* const nn_search_object,
+                                     const size_t len_query_indices,
+                                     const int* const query_indices,
+                                     const uint32_t k,
+                                     const bool radius_search,
+                                     const double radius,
+                                     const bool fill_na,
+                                     size_t* const out_num_ok_queries,
+                                     int* const out_query_indices,
+                                     int* const out_nn_indices)
+{
+	idist_assert(idist_ann_open_search_objects > 0);
+	idist_assert(nn_search_object != NULL);
+	idist_assert(nn_search_object->nn_search_version == IDIST_ANN_NN_SEARCH_STRUCT_VERSION);
+
+	SEXP R_distances = nn_search_object->R_distances;
+	idist_assert(idist_check_distance_object(R_distances));
+
+	idist_assert(k > 0);
+	idist_assert(!radius_search || (radius > 0.0));
+	idist_assert(out_num_ok_queries != NULL);
+	idist_assert(out_nn_indices != NULL);
+
+	const int num_queries = (query_indices == NULL) ? INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[1] : (int) len_query_indices;
+
+	if (nn_search_object->scan == NULL) {
+		return idist_ann_search(nn_search_object,
+		                        idist_ann_data_matrix(nn_search_object),
+		                        num_queries,
+		                        query_indices,
+		                        nn_search_object->options.exclude_self,
+		                        k,
+		                        radius_search,
+		                        radius,
+		                        fill_na,
+		                        out_num_ok_queries,
+		                        out_query_indices,
+		                        out_nn_indices);
+	}
+
+	// Scans are run in chunks with translated query indices, and the
+	// results of each chunk are written after those of the previous ones
+	size_t num_ok_queries = 0;
+	for (int first = 0; first < num_queries; first += DIST_ANN_QUERY_CHUNK) {
+		const int len_chunk = std::min(num_queries - first, DIST_ANN_QUERY_CHUNK);
+		const int* const chunk_indices = idist_ann_chunk_indices(nn_search_object, query_indices, num_queries, first, len_chunk);
+		const size_t write_at = fill_na ? static_cast<size_t>(first) : num_ok_queries;
+		size_t num_ok_chunk;
+		if (!idist_ann_scan_search(nn_search_object,
+		                           len_chunk,
+		                           chunk_indices,
+		                           k,
+		                           radius_search,
+		                           radius,
+		                           fill_na,
+		                           &num_ok_chunk,
+		                           (out_query_indices == NULL) ? NULL : out_query_indices + num_ok_queries,
+		                           out_nn_indices + write_at * k)) {
+			return false;
+		}
+		num_ok_queries += num_ok_chunk;
+	}
+
+	*out_num_ok_queries = num_ok_queries;
+	return true;
+}
+
+
+static bool idist_ann_search_points(idist_NNSearch* const nn_search_object,
+                                    const size_t num_query_points,
+                                    const double* const query_points,
+                                    const uint32_t k,
+                                    const bool radius_search,
+                                    const double radius,
+                                    const bool fill_na,
+                                    size_t* const out_num_ok_queries,
+                                    int* const out_query_indices,
+                                    int* const out_nn_indices)
+{
+	idist_assert(idist_ann_open_search_objects > 0);
+	idist_assert(nn_search_object != NULL);
+	idist_assert(nn_search_object->nn_search_version == IDIST_ANN_NN_SEARCH_STRUCT_VERSION);
+	idist_assert(nn_search_object->scan == NULL);
+
+	SEXP R_distances = nn_search_object->R_distances;
+	idist_assert(idist_check_distance_object(R_distances));
+
+	idist_assert(query_points != NULL || num_query_points == 0);
+	idist_assert(k > 0);
+	idist_assert(!radius_search || (radius > 0.0));
+	idist_assert(out_num_ok_queries != NULL);
+	idist_assert(out_nn_indices != NULL);
+
+	int num_queries = static_cast<int>(num_query_points);
+	int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+
+	// Queries are rotated in the same way as the data points. The scratch
+	// for the rotated queries only grows.
+	const double* query_matrix = query_points;
+	if (nn_search_object->rotation != NULL && num_queries > 0) {
+		idist_ANNQueryScratch* const scratch = &nn_search_object->query_scratch;
+		if (scratch->len_rotated < num_query_points) {
+			delete[] scratch->rotated;
+			scratch->rotated = NULL;
+			scratch->len_rotated = 0;
+			try {
+				scratch->rotated = new double[num_query_points * static_cast<size_t>(num_dimensions)];
+			} catch (...) {
+				return false;
+			}
+			scratch->len_rotated = num_query_points;
+		}
+		const double one = 1.0;
+		const double zero = 0.0;
+		F77_CALL(dgemm)("T", "N", &num_dimensions, &num_queries, &num_dimensions, &one,
+		                nn_search_object->rotation, &num_dimensions, query_points, &num_dimensions,
+		                &zero, scratch->rotated, &num_dimensions FCONE FCONE);
+		query_matrix = scratch->rotated;
+	}
+
+	return idist_ann_search(nn_search_object,
+	                        query_matrix,
+	                        num_queries,
+	                        NULL,
+	                        false,
+	                        k,
+	                        radius_search,
+	                        radius,
+	                        fill_na,
+	                        out_num_ok_queries,
+	                        out_query_indices,
+	                        out_nn_indices);
+}
+
+
+static bool idist_ann_scan_search(idist_NNSearch* const nn_search_object,
+                                  const int num_queries,
+                                  const int* const query_indices,
+                                  const uint32_t k,
+                                  const bool radius_search,
+                                  const double radius,
+                                  const bool fill_na,
+                                  size_t* const out_num_ok_queries,
+                                  int* const out_query_indices,
+                                  int* const out_nn_indices)
+{
+	const idist_ScanSet* const scan = nn_search_object->scan;
+	unsigned char* const query_ok = nn_search_object->query_scratch.ok;
+
+	const unsigned char* const removed = (scan->num_live < scan->num_points) ? scan->removed : NULL;
+	bool ok;
+	if (nn_search_object->metric == IDIST_METRIC_HAMMING) {
+		ok = idist_hamming_nn_search(nn_search_object->R_distances,
+		                             scan->num_points,
+		                             scan->points,
+		                             removed,
+		                             num_queries,
+		                             query_indices,
+		                             k,
+		                             radius_search,
+		                             radius,
+		                             nn_search_object->options.exclude_self,
+		                             query_ok,
+		                             out_nn_indices);
+	} else {
+		ok = idist_gower_nn_search(nn_search_object->R_distances,
+		                           scan->num_points,
+		                           scan->points,
+		                           removed,
+		                           num_queries,
+		                           query_indices,
+		                           k,
+		                           radius_search,
+		                           radius,
+		                           nn_search_object->options.exclude_self,
+		                           query_ok,
+		                           out_nn_indices);
+	}
+	if (ok && fill_na) {
+		*out_num_ok_queries = idist_ann_fill_failed(num_queries, k, query_ok, out_nn_indices);
+	} else if (ok) {
+		*out_num_ok_queries = idist_ann_gather_results(num_queries,
+		                                               query_indices,
+		                                               0,
+		                                               k,
+		                                               query_ok,
+		                                               out_query_indices,
+		                                               out_nn_indices);
+	}
+
+	return ok;
+}
+
+
+// Rotates all data points into the principal components of the search
+// points, ordered by decreasing variance. Rotations preserve distances,
+// but tree cells then follow the directions in which the data vary, and
+// partial distances in the leaves grow quickly. The covariance matrix
+// is accumulated over chunks of centered points. The rotation matrix
+// (principal components as columns) is written to `out_rotation`, so
+// that points outside the data can be rotated in the same way. Returns
+// NULL if memory cannot be allocated or the eigendecomposition fails.
+static double* idist_ann_pca_rotate(const double* const raw_data_matrix,
+                                    const int num_dimensions,
+                                    const int num_data_points,
+                                    const size_t num_search_points,
+                                    const int* const search_indices,
+                                    const int index_base,
+                                    double** const out_rotation)
+{
+	const size_t dims = static_cast<size_t>(num_dimensions);
+	double* workspace;
+	double* rotation;
+	try {
+		workspace = new double[dims * (3 + dims + IDIST_ANN_PCA_CHUNK)];
+	} catch (...) {
+		return NULL;
+	}
+	try {
+		rotation = new double[dims * dims];
+	} catch (...) {
+		delete[] workspace;
+		return NULL;
+	}
+	double* const mean = workspace;
+	double* const eigenvalues = mean + dims;
+	double* const covariance = eigenvalues + dims;
+	double* const chunk = covariance + dims * dims;
+	double* const work_query = chunk + dims * IDIST_ANN_PCA_CHUNK;
+
+	std::fill(mean, mean + dims, 0.0);
+	for (size_t i = 0; i < num_search_points; ++i) {
+		const double* const point = raw_data_matrix + dims * static_cast<size_t>((search_indices == NULL) ? static_cast<int>(i) : search_indices[i] - index_base);
+		for (size_t d = 0; d < dims; ++d) mean[d] += point[d];
+	}
+	for (size_t d = 0; d < dims && num_search_points > 0; ++d) {
+		mean[d] /= static_cast<double>(num_search_points);
+	}
+
+	const double one = 1.0;
+	const double zero = 0.0;
+	std::fill(covariance, covariance + dims * dims, 0.0);
+	for (size_t start = 0; start < num_search_points; start += IDIST_ANN_PCA_CHUNK) {
+		const int len_chunk = static_cast<int>(std::min(num_search_points - start, static_cast<size_t>(IDIST_ANN_PCA_CHUNK)));
+		for (int c = 0; c < len_chunk; ++c) {
+			const size_t i = start + static_cast<size_t>(c);
+			const double* const point = raw_data_matrix + dims * static_cast<size_t>((search_indices == NULL) ? static_cast<int>(i) : search_indices[i] - index_base);
+			for (size_t d = 0; d < dims; ++d) chunk[dims * c + d] = point[d] - mean[d];
+		}
+		F77_CALL(dsyrk)("U", "N", &num_dimensions, &len_chunk, &one, chunk, &num_dimensions,
+		                &one, covariance, &num_dimensions FCONE FCONE);
+	}
+
+	// Eigenvectors overwrite the covariance matrix, by increasing eigenvalue
+	int info;
+	int len_work = -1;
+	F77_CALL(dsyev)("V", "U", &num_dimensions, covariance, &num_dimensions, eigenvalues,
+	                work_query, &len_work, &info FCONE FCONE);
+	len_work = (info == 0) ? static_cast<int>(work_query[0]) : 0;
+	double* work = NULL;
+	if (info == 0) {
+		try {
+			work = new double[len_work];
+		} catch (...) {
+			delete[] workspace;
+			delete[] rotation;
+			return NULL;
+		}
+		F77_CALL(dsyev)("V", "U", &num_dimensions, covariance, &num_dimensions, eigenvalues,
+		                work, &len_work, &info FCONE FCONE);
+		delete[] work;
+	}
+	if (info != 0) {
+		delete[] workspace;
+		delete[] rotation;
+		return NULL;
+	}
+	for (size_t c = 0; c < dims; ++c) {
+		std::copy(covariance + dims * (dims - 1 - c), covariance + dims * (dims - c), rotation + dims * c);
+	}
+
+	double* rotated_data;
+	try {
+		rotated_data = new double[dims * static_cast<size_t>(num_data_points)];
+	} catch (...) {
+		delete[] workspace;
+		delete[] rotation;
+		return NULL;
+	}
+	if (num_data_points > 0) {
+		F77_CALL(dgemm)("T", "N", &num_dimensions, &num_data_points, &num_dimensions, &one,
+		                rotation, &num_dimensions, raw_data_matrix, &num_dimensions,
+		                &zero, rotated_data, &num_dimensions FCONE FCONE);
+	}
+
+	delete[] workspace;
+	*out_rotation = rotation;
+	return rotated_data;
+}
+
+
+// Throws if the index cannot be allocated
+static ANNpointSet* idist_ann_new_tree(const idist_NNSearchOptions* const options,
+                                       ANNpoint* const points,
+                                       const int num_points,
+                                       const int num_dimensions)
+{
+	switch (options->index) {
+	case IDIST_NN_INDEX_BALL_TREE:
+		return new ANNball_tree(points, num_points, num_dimensions, DIST_ANN_BUCKET_SIZE);
+	case IDIST_NN_INDEX_HNSW:
+		return new ANNhnsw(points,
+		                   num_points,
+		                   num_dimensions,
+		                   options->hnsw_m,
+		                   options->hnsw_ef_construction,
+		                   options->hnsw_ef);
+	case IDIST_NN_INDEX_RP_FOREST:
+		return new ANNrp_forest(points,
+		                        num_points,
+		                        num_dimensions,
+		                        options->rp_num_trees,
+		                        options->rp_leaf_size);
+	case IDIST_NN_INDEX_PQ:
+		return new ANNpq(points,
+		                 num_points,
+		                 num_dimensions,
+		                 options->pq_num_subspaces,
+		                 options->pq_rerank);
+	default:
+		idist_assert(options->index == IDIST_NN_INDEX_KD_TREE);
+		return new ANNpointSetConstructor(points, num_points, num_dimensions, DIST_ANN_BUCKET_SIZE);
+	}
+}
+
+
+static void idist_ann_free_block(idist_ANNBlock* const block)
+{
+	delete block->tree;
+	delete[] block->points;
+	delete[] block->indices;
+	block->points = NULL;
+	block->indices = NULL;
+	block->tree = NULL;
+	block->num_points = 0;
+	block->num_live = 0;
+}
+
+
+// Takes ownership of `indices` on success
+static bool idist_ann_build_block(const idist_NNSearchOptions* const options,
+                               const double* const raw_data_matrix,
+                               const int num_dimensions,
+                               const int num_points,
+                               int* const indices,
+                               idist_ANNBlock* const out_block)
+{
+	ANNpoint* points;
+	try {
+		points = new ANNpoint[num_points];
+	} catch (...) {
+		return false;
+	}
+	for (int l = 0; l < num_points; ++l) {
+		points[l] = const_cast<double*>(raw_data_matrix) + indices[l] * num_dimensions;
+	}
+
+	ANNpointSet* tree;
+	try {
+		tree = idist_ann_new_tree(options, points, num_points, num_dimensions);
+	} catch (...) {
+		delete[] points;
+		return false;
+	}
+
+	out_block->points = points;
+	out_block->indices = indices;
+	out_block->tree = tree;
+	out_block->num_points = num_points;
+	out_block->num_live = num_points;
+	return true;
+}
+
+
+// Moves the search set into block 0 the first time it is modified
+static bool idist_ann_make_dynamic(idist_NNSearch* const nn_search_object)
+{
+	if (nn_search_object->dynamic != NULL) return true;
+
+	const int num_data_points = INTEGER(Rf_getAttrib(nn_search_object->R_distances, R_DimSymbol))[1];
+	const int num_search_points = nn_search_object->search_tree->nPoints();
+	const int* const search_indices = nn_search_object->search_indices;
+
+	idist_ANNDynamic* dynamic = NULL;
+	int* indices = NULL;
+	try {
+		dynamic = new idist_ANNDynamic;
+		dynamic->block_of = NULL;
+		dynamic->local_of = NULL;
+		dynamic->block_of = new int[num_data_points];
+		dynamic->local_of = new int[num_data_points];
+		indices = new int[num_search_points];
+	} catch (...) {
+		if (dynamic != NULL) {
+			delete[] dynamic->block_of;
+			delete[] dynamic->local_of;
+		}
+		delete dynamic;
+		return false;
+	}
+
+	for (int i = 0; i < num_data_points; ++i) {
+		dynamic->block_of[i] = -1;
+	}
+	for (int l = 0; l < num_search_points; ++l) {
+		const int point = (search_indices == NULL) ? l : search_indices[l] - nn_search_object->options.index_base;
+		if (dynamic->block_of[point] != -1) {
+			// Repeated search indices cannot be removed one at a time
+			delete[] dynamic->block_of;
+			delete[] dynamic->local_of;
+			delete dynamic;
+			delete[] indices;
+			return false;
+		}
+		indices[l] = point;
+		dynamic->block_of[point] = 0;
+		dynamic->local_of[point] = l;
+	}
+
+	for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+		dynamic->blocks[b].points = NULL;
+		dynamic->blocks[b].indices = NULL;
+		dynamic->blocks[b].tree = NULL;
+		dynamic->blocks[b].num_points = 0;
+		dynamic->blocks[b].num_live = 0;
+	}
+	dynamic->blocks[0].points = nn_search_object->search_points;
+	dynamic->blocks[0].indices = indices;
+	dynamic->blocks[0].tree = nn_search_object->search_tree;
+	dynamic->blocks[0].num_points = num_search_points;
+	dynamic->blocks[0].num_live = num_search_points;
+	dynamic->num_live = num_search_points;
+	dynamic->merge_indices = NULL;
+	dynamic->merge_dists = NULL;
+	dynamic->len_merge_scratch = 0;
+
+	nn_search_object->search_points = NULL;
+	nn_search_object->search_tree = NULL;
+	nn_search_object->search_indices = NULL;
+	nn_search_object->dynamic = dynamic;
+
+	return true;
+}
+
+
+static bool idist_ann_rebuild_block(const idist_NNSearchOptions* const options,
+                                 idist_ANNDynamic* const dynamic,
+                                 const int block,
+                                 const double* const raw_data_matrix,
+                                 const int num_dimensions)
+{
+	idist_ANNBlock* const old_block = &dynamic->blocks[block];
+
+	int* indices;
+	try {
+		indices = new int[old_block->num_live];
+	} catch (...) {
+		return false;
+	}
+
+	int write = 0;
+	for (int l = 0; l < old_block->num_points; ++l) {
+		const int point = old_block->indices[l];
+		if (dynamic->block_of[point] == block && dynamic->local_of[point] == l) {
+			indices[write++] = point;
+		}
+	}
+	idist_assert(write == old_block->num_live);
+
+	idist_ANNBlock new_block;
+	if (!idist_ann_build_block(options, raw_data_matrix, num_dimensions, write, indices, &new_block)) {
+		delete[] indices;
+		return false;
+	}
+
+	idist_ann_free_block(old_block);
+	*old_block = new_block;
+	for (int l = 0; l < new_block.num_points; ++l) {
+		dynamic->local_of[indices[l]] = l;
+	}
+
+	return true;
+}
+
+
+// Searches the tree of the search object for the points in `query_matrix`
+// at `query_indices` (or its first `num_queries` points if NULL), which
+// are read as `query_indices[q] - index_base`
+static bool idist_ann_search(idist_NNSearch* const nn_search_object,
+                             const double* const query_matrix,
+                             const int num_queries,
+                             const int* const query_indices,
+                             const bool exclude_self,
+                             const uint32_t k,
+                             const bool radius_search,
+                             const double radius,
+                             const bool fill_na,
+                             size_t* const out_num_ok_queries,
+                             int* const out_query_indices,
+                             int* const out_nn_indices)
+{
+	SEXP R_distances = nn_search_object->R_distances;
+	const int index_base = nn_search_object->options.index_base;
+
+	// When queries are reordered, results are written at each query's
+	// position and gathered in the caller's order at the end. With
+	// `fill_na`, they are always written at the queries' positions and
+	// stay there.
+	const int* query_order;
+	unsigned char* query_ok;
+	idist_ann_order_queries(nn_search_object, query_matrix, num_queries, query_indices, &query_order, &query_ok);
+
+	if (nn_search_object->dynamic != NULL) {
+		return idist_ann_dynamic_search(nn_search_object,
+		                                query_matrix,
+		                                num_queries,
+		                                query_indices,
+		                                exclude_self,
+		                                k,
+		                                radius_search,
+		                                radius,
+		                                fill_na,
+		                                query_order,
+		                                query_ok,
+		                                out_num_ok_queries,
+		                                out_query_indices,
+		                                out_nn_indices);
+	}
+
+	ANNpointSet* const search_tree = nn_search_object->search_tree;
+	idist_assert(search_tree != NULL);
+
+	const int* const search_indices = nn_search_object->search_indices;
+	const int num_search_points = search_tree->nPoints();
+	const int* const search_position = nn_search_object->search_position;
+
+	const int k_int = static_cast<int>(k);
+
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+
+	// Distance scratch is kept with the search object and only grows
+	if (nn_search_object->len_dist_scratch < k) {
+		delete[] nn_search_object->dist_scratch;
+		nn_search_object->dist_scratch = NULL;
+		nn_search_object->len_dist_scratch = 0;
+		try {
+			nn_search_object->dist_scratch = new ANNdist[k];
+		} catch (...) {
+			return false;
+		}
+		nn_search_object->len_dist_scratch = k;
+	}
+	ANNdist* const dist_scratch = nn_search_object->dist_scratch;
+
+	size_t num_ok_queries = 0;
+	const double radius_pow = idist_ann_set_metric(nn_search_object, radius);
+
+	if (!radius_search) {
+		int* write_nnidx = out_nn_indices;
+		for (int i = 0; i < num_queries; ++i) {
+			const int q = (query_order == NULL) ? i : query_order[i];
+			const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+			if (query_order != NULL || fill_na) write_nnidx = out_nn_indices + static_cast<size_t>(q) * k;
+			const ANNpoint query_point = const_cast<ANNpoint>(query_matrix) + static_cast<size_t>(query) * num_dimensions;
+			int exclude = ANN_NULL_IDX;
+			if (exclude_self) {
+				exclude = (search_indices == NULL) ? query : search_position[query];
+				// All other search points must be found
+				if (exclude != ANN_NULL_IDX && k_int == num_search_points) {
+					if (fill_na) std::fill(write_nnidx, write_nnidx + k, NA_INTEGER);
+					continue;
+				}
+			}
+			annExcludeIdx(exclude);
+			search_tree->annkSearch(query_point,    // pointer to query point
+			                        k_int,          // number of neighbors
+			                        write_nnidx,    // pointer to start of index result
+			                        dist_scratch,   // pointer to start of distance result
+			                        DIST_ANN_EPS);  // error margin
+			if (search_indices == NULL) {
+				// Sequential indices, all done
+				write_nnidx += k;
+			} else {
+				// Not sequential indices, translate to original indices
+				const int* const write_nnidx_stop = write_nnidx + k;
+				for (; write_nnidx != write_nnidx_stop; ++write_nnidx) {
+					*write_nnidx = search_indices[*write_nnidx] - index_base;
+				}
+			}
+			if (query_order != NULL) {
+				query_ok[q] = 1;
+			} else {
+				if (out_query_indices != NULL) {
+					out_query_indices[num_ok_queries] = query;
+				}
+				++num_ok_queries;
+			}
+		}
+
+	} else {
+		// radius_search == TRUE
+		int* write_nnidx = out_nn_indices;
+		for (int i = 0; i < num_queries; ++i) {
+			const int q = (query_order == NULL) ? i : query_order[i];
+			const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+			const ANNpoint query_point = const_cast<ANNpoint>(query_matrix) + static_cast<size_t>(query) * num_dimensions;
+			if (query_order != NULL || fill_na) write_nnidx = out_nn_indices + static_cast<size_t>(q) * k;
+			if (exclude_self) {
+				annExcludeIdx((search_indices == NULL) ? query : search_position[query]);
+			}
+			const int num_found = search_tree->annkFRSearch(query_point,              // pointer to query point
+			                                                radius_pow,               // powered caliper
+			                                                k_int,                    // number of neighbors
+			                                                write_nnidx,              // pointer to start of index result
+			                                                dist_scratch,             // pointer to start of distance result
+			                                                DIST_ANN_EPS);            // error margin
+			if (num_found >= k_int) {
+				if (search_indices == NULL) {
+					// Sequential indices, all done
+					write_nnidx += k;
+				} else {
+					// Not sequential indices, translate to original indices
+					const int* const write_nnidx_stop = write_nnidx + k;
+					for (; write_nnidx != write_nnidx_stop; ++write_nnidx) {
+						*write_nnidx = search_indices[*write_nnidx] - index_base;
+					}
+				}
+				if (query_order != NULL) {
+					query_ok[q] = 1;
+				} else {
+					if (out_query_indices != NULL) {
+						out_query_indices[num_ok_queries] = query;
+					}
+					++num_ok_queries;
+				}
+			} else if (fill_na) {
+				std::fill(write_nnidx, write_nnidx + k, NA_INTEGER);
+			}
+		}
+	}
+
+	annExcludeIdx(ANN_NULL_IDX);
+	annSetMetric(ANN_METRIC_L2);
+
+	if (query_order != NULL && fill_na) {
+		num_ok_queries = idist_ann_fill_failed(num_queries, k, query_ok, out_nn_indices);
+	} else if (query_order != NULL) {
+		num_ok_queries = idist_ann_gather_results(num_queries,
+		                                          query_indices,
+		                                          index_base,
+		                                          k,
+		                                          query_ok,
+		                                          out_query_indices,
+		                                          out_nn_indices);
+	}
+
+	*out_num_ok_queries = num_ok_queries;
+	return true;
+}
+
+
+// Searches every block and merges the results. Ties are broken in favor
+// of lower blocks, and within a block as the tree does.
+static bool idist_ann_dynamic_search(idist_NNSearch* const nn_search_object,
+                                     const double* const query_matrix,
+                                     const int num_queries,
+                                     const int* const query_indices,
+                                     const bool exclude_self,
+                                     const uint32_t k,
+                                     const bool radius_search,
+                                     const double radius,
+                                     const bool fill_na,
+                                     const int* const query_order,
+                                     unsigned char* const query_ok,
+                                     size_t* const out_num_ok_queries,
+                                     int* const out_query_indices,
+                                     int* const out_nn_indices)
+{
+	idist_ANNDynamic* const dynamic = nn_search_object->dynamic;
+	idist_assert(radius_search || (k <= static_cast<uint32_t>(dynamic->num_live)));
+
+	SEXP R_distances = nn_search_object->R_distances;
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+	const int index_base = nn_search_object->options.index_base;
+
+	// Scratch for one block's result, the merged result and the merge output
+	if (dynamic->len_merge_scratch < k) {
+		delete[] dynamic->merge_indices;
+		delete[] dynamic->merge_dists;
+		dynamic->merge_indices = NULL;
+		dynamic->merge_dists = NULL;
+		dynamic->len_merge_scratch = 0;
+		try {
+			dynamic->merge_indices = new int[3 * static_cast<size_t>(k)];
+			dynamic->merge_dists = new ANNdist[3 * static_cast<size_t>(k)];
+		} catch (...) {
+			delete[] dynamic->merge_indices;
+			dynamic->merge_indices = NULL;
+			return false;
+		}
+		dynamic->len_merge_scratch = k;
+	}
+
+	int* block_idx = dynamic->merge_indices;
+	ANNdist* block_dist = dynamic->merge_dists;
+	int* best_idx = block_idx + k;
+	ANNdist* best_dist = block_dist + k;
+	int* tmp_idx = best_idx + k;
+	ANNdist* tmp_dist = best_dist + k;
+
+	const double radius_pow = idist_ann_set_metric(nn_search_object, radius);
+	size_t num_ok_queries = 0;
+	int* write_nnidx = out_nn_indices;
+
+	for (int i = 0; i < num_queries; ++i) {
+		const int q = (query_order == NULL) ? i : query_order[i];
+		const int query = (query_indices == NULL) ? q : query_indices[q] - index_base;
+		const ANNpoint query_point = const_cast<ANNpoint>(query_matrix) + static_cast<size_t>(query) * num_dimensions;
+		if (query_order != NULL || fill_na) write_nnidx = out_nn_indices + static_cast<size_t>(q) * k;
+
+		// Block and position of the query when it is excluded
+		int exclude_block = -1;
+		int exclude_local = ANN_NULL_IDX;
+		if (exclude_self && dynamic->block_of[query] >= 0) {
+			exclude_block = dynamic->block_of[query];
+			exclude_local = dynamic->local_of[query];
+		}
+
+		uint32_t num_best = 0;
+		int num_found = 0;
+		for (int b = 0; b < IDIST_ANN_MAX_BLOCKS; ++b) {
+			const idist_ANNBlock* const block = &dynamic->blocks[b];
+			const int num_live = (b == exclude_block) ? block->num_live - 1 : block->num_live;
+			if (block->tree == NULL || num_live == 0) continue;
+
+			annExcludeIdx((b == exclude_block) ? exclude_local : ANN_NULL_IDX);
+			const int k_block = (num_live < static_cast<int>(k)) ? num_live : static_cast<int>(k);
+			int num_block;
+			if (!radius_search) {
+				block->tree->annkSearch(query_point, k_block, block_idx, block_dist, DIST_ANN_EPS);
+				num_block = k_block;
+			} else {
+				const int block_found = block->tree->annkFRSearch(query_point, radius_pow, k_block,
+				                                                  block_idx, block_dist, DIST_ANN_EPS);
+				num_found += block_found;
+				num_block = (block_found < k_block) ? block_found : k_block;
+			}
+
+			// Merge sorted results, keeping at most k
+			uint32_t i = 0, j = 0, w = 0;
+			while (w < k && (i < num_best || j < static_cast<uint32_t>(num_block))) {
+				if (j == static_cast<uint32_t>(num_block) || (i < num_best && best_dist[i] <= block_dist[j])) {
+					tmp_idx[w] = best_idx[i];
+					tmp_dist[w++] = best_dist[i++];
+				} else {
+					tmp_idx[w] = block->indices[block_idx[j]];
+					tmp_dist[w++] = block_dist[j++];
+				}
+			}
+			int* swap_idx = best_idx; best_idx = tmp_idx; tmp_idx = swap_idx;
+			ANNdist* swap_dist = best_dist; best_dist = tmp_dist; tmp_dist = swap_dist;
+			num_best = w;
+		}
+
+		// Fewer than k points are found when the radius is too small or
+		// when the query is excluded and every other point is requested
+		if (num_best == k) {
+			idist_assert(!radius_search || num_found >= static_cast<int>(k));
+			for (uint32_t j = 0; j < k; ++j) {
+				write_nnidx[j] = best_idx[j];
+			}
+			write_nnidx += k;
+			if (query_order != NULL) {
+				query_ok[q] = 1;
+			} else {
+				if (out_query_indices != NULL) {
+					out_query_indices[num_ok_queries] = query;
+				}
+				++num_ok_queries;
+			}
+		} else if (fill_na) {
+			std::fill(write_nnidx, write_nnidx + k, NA_INTEGER);
+		}
+	}
+
+	annExcludeIdx(ANN_NULL_IDX);
+	annSetMetric(ANN_METRIC_L2);
+
+	if (query_order != NULL && fill_na) {
+		num_ok_queries = idist_ann_fill_failed(num_queries, k, query_ok, out_nn_indices);
+	} else if (query_order != NULL) {
+		num_ok_queries = idist_ann_gather_results(num_queries,
+		                                          query_indices,
+		                                          index_base,
+		                                          k,
+		                                          query_ok,
+		                                          out_query_indices,
+		                                          out_nn_indices);
+	}
+
+	*out_num_ok_queries = num_ok_queries;
+	return true;
+}
+
+
+// Index along the Hilbert curve of a point with `num_dims` coordinates
+// of `num_bits` bits each, using Skilling's transpose algorithm
+// (AIP Conf. Proc. 707, 2004). The coordinates are overwritten.
+static uint64_t idist_ann_hilbert_key(uint32_t* const x,
+                                      const int num_dims,
+                                      const int num_bits)
+{
+	const uint32_t top = static_cast<uint32_t>(1) << (num_bits - 1);
+
+	// Inverse undo excess work
+	for (uint32_t bit = top; bit > 1; bit >>= 1) {
+		const uint32_t lower = bit - 1;
+		for (int d = 0; d < num_dims; ++d) {
+			if (x[d] & bit) {
+				x[0] ^= lower;
+			} else {
+				const uint32_t t = (x[0] ^ x[d]) & lower;
+				x[0] ^= t;
+				x[d] ^= t;
+			}
+		}
+	}
+
+	// Gray encode
+	for (int d = 1; d < num_dims; ++d) {
+		x[d] ^= x[d - 1];
+	}
+	uint32_t t = 0;
+	for (uint32_t bit = top; bit > 1; bit >>= 1) {
+		if (x[num_dims - 1] & bit) t ^= bit - 1;
+	}
+	for (int d = 0; d < num_dims; ++d) {
+		x[d] ^= t;
+	}
+
+	// Interleave the transposed bits
+	uint64_t key = 0;
+	for (int b = num_bits - 1; b >= 0; --b) {
+		for (int d = 0; d < num_dims; ++d) {
+			key = (key << 1) | ((x[d] >> b) & 1);
+		}
+	}
+	return key;
+}
+
+
+// Index along the Z-order curve: the coordinates' bits interleaved
+static uint64_t idist_ann_morton_key(const uint32_t* const x,
+                                     const int num_dims,
+                                     const int num_bits)
+{
+	uint64_t key = 0;
+	for (int b = num_bits - 1; b >= 0; --b) {
+		for (int d = 0; d < num_dims; ++d) {
+			key = (key << 1) | ((x[d] >> b) & 1);
+		}
+	}
+	return key;
+}
+
+
+static bool idist_ann_key_less(const idist_ANNQueryKey& a,
+                               const idist_ANNQueryKey& b)
+{
+	return (a.key < b.key) || (a.key == b.key && a.position < b.position);
+}
+
+
+// Allocates the query scratch of a new search object. Returns false if
+// memory cannot be allocated; the object is then closed by the caller.
+static bool idist_ann_alloc_query_scratch(idist_NNSearch* const nn_search_object)
+{
+	const size_t num_dimensions = static_cast<size_t>(INTEGER(Rf_getAttrib(nn_search_object->R_distances, R_DimSymbol))[0]);
+	idist_ANNQueryScratch* const scratch = &nn_search_object->query_scratch;
+	try {
+		scratch->keys = new idist_ANNQueryKey[DIST_ANN_QUERY_CHUNK];
+		scratch->order = new int[DIST_ANN_QUERY_CHUNK];
+		scratch->ok = new unsigned char[DIST_ANN_QUERY_CHUNK];
+		scratch->len_order = DIST_ANN_QUERY_CHUNK;
+		scratch->box = new double[2 * num_dimensions];
+		scratch->indices = new int[DIST_ANN_QUERY_CHUNK];
+		if (nn_search_object->rotation != NULL) {
+			scratch->rotated = new double[num_dimensions * DIST_ANN_QUERY_CHUNK];
+			scratch->len_rotated = DIST_ANN_QUERY_CHUNK;
+		}
+	} catch (...) {
+		return false;
+	}
+	return true;
+}
+
+
+// Indices of the queries `first` to `first + len_chunk - 1` of a scanned
+// batch with `query_indices` (or the first `num_queries` data points if
+// NULL), as 0-based data point indices. Returns NULL if the chunk is the
+// whole of such a batch.
+static const int* idist_ann_chunk_indices(idist_NNSearch* const nn_search_object,
+                                          const int* const query_indices,
+                                          const int num_queries,
+                                          const int first,
+                                          const int len_chunk)
+{
+	const int index_base = nn_search_object->options.index_base;
+	if (query_indices != NULL && index_base == 0) return query_indices + first;
+	if (query_indices == NULL && len_chunk == num_queries) return NULL;
+	int* const chunk_indices = nn_search_object->query_scratch.indices;
+	for (int i = 0; i < len_chunk; ++i) {
+		chunk_indices[i] = (query_indices == NULL) ? first + i : query_indices[first + i] - index_base;
+	}
+	return chunk_indices;
+}
+
+
+// Decides the order in which the batch's queries are run. The whole
+// batch is ordered at once, so the scratch is grown to the batch if
+// needed. Sets `*out_query_order` to NULL when the queries are run in
+// the caller's order, which they also are if the scratch cannot be grown.
+static void idist_ann_order_queries(idist_NNSearch* const nn_search_object,
+                                    const double* const query_matrix,
+                                    const int num_queries,
+                                    const int* const query_indices,
+                                    const int** const out_query_order,
+                                    unsigned char** const out_query_ok)
+{
+	*out_query_order = NULL;
+	*out_query_ok = NULL;
+
+	idist_NNQueryOrder curve = nn_search_object->options.query_order;
+	if (curve == IDIST_NN_QUERY_ORDER_AUTO) {
+		curve = (num_queries >= DIST_ANN_QUERY_ORDER_MIN_QUERIES) ? IDIST_NN_QUERY_ORDER_HILBERT : IDIST_NN_QUERY_ORDER_INPUT;
+	}
+	if (curve == IDIST_NN_QUERY_ORDER_INPUT || num_queries < 2) return;
+	idist_assert(curve == IDIST_NN_QUERY_ORDER_MORTON || curve == IDIST_NN_QUERY_ORDER_HILBERT);
+
+	idist_ANNQueryScratch* const scratch = &nn_search_object->query_scratch;
+	if (scratch->len_order < static_cast<size_t>(num_queries)) {
+		idist_ANNQueryKey* keys = NULL;
+		int* order = NULL;
+		unsigned char* ok = NULL;
+		try {
+			keys = new idist_ANNQueryKey[num_queries];
+			order = new int[num_queries];
+			ok = new unsigned char[num_queries];
+		} catch (...) {
+			delete[] keys;
+			delete[] order;
+			return;
+		}
+		delete[] scratch->keys;
+		delete[] scratch->order;
+		delete[] scratch->ok;
+		scratch->keys = keys;
+		scratch->order = order;
+		scratch->ok = ok;
+		scratch->len_order = static_cast<size_t>(num_queries);
+	}
+
+	SEXP R_distances = nn_search_object->R_distances;
+	const int num_dimensions = INTEGER(Rf_getAttrib(R_distances, R_DimSymbol))[0];
+	const int index_base = nn_search_object->options.index_base;
+
+	// Bounding box of the queries
+	double lo[IDIST_ANN_CURVE_MAX_DIMS];
+	double scale[IDIST_ANN_CURVE_MAX_DIMS];
+	int key_dims[IDIST_ANN_CURVE_MAX_DIMS];
+	int num_key_dims = 0;
+	{
+		double* const box_lo = scratch->box;
+		double* const box_hi = box_lo + num_dimensions;
+		for (int d = 0; d < num_dimensions; ++d) {
+			box_lo[d] = box_hi[d] = query_matrix[static_cast<size_t>((query_indices == NULL) ? 0 : query_indices[0] - index_base) * num_dimensions + d];
+		}
+		for (int q = 1; q < num_queries; ++q) {
+			const double* const point = query_matrix + static_cast<size_t>((query_indices == NULL) ? q : query_indices[q] - index_base) * num_dimensions;
+			for (int d = 0; d < num_dimensions; ++d) {
+				if (point[d] < box_lo[d]) box_lo[d] = point[d];
+				if (point[d] > box_hi[d]) box_hi[d] = point[d];
+			}
+		}
+
+		// Keep the dimensions with the largest spread
+		for (int d = 0; d < num_dimensions; ++d) {
+			const double spread = box_hi[d] - box_lo[d];
+			if (!(spread > 0.0 && spread <= DBL_MAX)) continue;
+			int pos = num_key_dims;
+			if (pos == IDIST_ANN_CURVE_MAX_DIMS) {
+				if (spread <= box_hi[key_dims[pos - 1]] - box_lo[key_dims[pos - 1]]) continue;
+				--pos;
+			} else {
+				++num_key_dims;
+			}
+			for (; pos > 0 && spread > box_hi[key_dims[pos - 1]] - box_lo[key_dims[pos - 1]]; --pos) {
+				key_dims[pos] = key_dims[pos - 1];
+			}
+			key_dims[pos] = d;
+		}
+
+		for (int j = 0; j < num_key_dims; ++j) {
+			lo[j] = box_lo[key_dims[j]];
+			scale[j] = 1.0 / (box_hi[key_dims[j]] - box_lo[key_dims[j]]);
+		}
+	}
+
+	// All queries at the same point
+	if (num_key_dims == 0) return;
+
+	int num_bits = 64 / num_key_dims;
+	if (num_bits > IDIST_ANN_CURVE_MAX_BITS) num_bits = IDIST_ANN_CURVE_MAX_BITS;
+	const double max_cell = static_cast<double>((static_cast<uint32_t>(1) << num_bits) - 1);
+
+	uint32_t cell[IDIST_ANN_CURVE_MAX_DIMS];
+	for (int q = 0; q < num_queries; ++q) {
+		const double* const point = query_matrix + static_cast<size_t>((query_indices == NULL) ? q : query_indices[q] - index_base) * num_dimensions;
+		for (int j = 0; j < num_key_dims; ++j) {
+			cell[j] = static_cast<uint32_t>((point[key_dims[j]] - lo[j]) * scale[j] * max_cell);
+		}
+		scratch->keys[q].key = (curve == IDIST_NN_QUERY_ORDER_HILBERT) ?
+			idist_ann_hilbert_key(cell, num_key_dims, num_bits) :
+			idist_ann_morton_key(cell, num_key_dims, num_bits);
+		scratch->keys[q].position = q;
+	}
+	std::sort(scratch->keys, scratch->keys + num_queries, idist_ann_key_less);
+
+	for (int i = 0; i < num_queries; ++i) {
+		scratch->order[i] = scratch->keys[i].position;
+		scratch->ok[i] = 0;
+	}
+
+	*out_query_order = scratch->order;
+	*out_query_ok = scratch->ok;
+}
+
+
+// Results of reordered queries are written at the queries' positions.
+// This moves the successful ones to the front in the caller's order.
+static size_t idist_ann_gather_results(const int num_queries,
+                                       const int* const query_indices,
+                                       const int index_base,
+                                       const uint32_t k,
+                                       const unsigned char* const query_ok,
+                                       int* const out_query_indices,
+                                       int* const out_nn_indices)
+{
+	size_t num_ok_queries = 0;
+	for (int q = 0; q < num_queries; ++q) {
+		if (!query_ok[q]) continue;
+		const int* const read = out_nn_indices + static_cast<size_t>(q) * k;
+		int* const write = out_nn_indices + num_ok_queries * k;
+		if (write != read) {
+			std::copy(read, read + k, write);
+		}
+		if (out_query_indices != NULL) {
+			out_query_indices[num_ok_queries] = (query_indices == NULL) ? q : query_indices[q] - index_base;
+		}
+		++num_ok_queries;
+	}
+	return num_ok_queries;
+}
+
+
+// Sets the neighbors of the failed queries to NA_INTEGER, leaving all
+// results at the queries' positions
+static size_t idist_ann_fill_failed(const int num_queries,
+                                    const uint32_t k,
+                                    const unsigned char* const query_ok,
+                                    int* const out_nn_indices)
+{
+	size_t num_ok_queries = 0;
+	for (int q = 0; q < num_queries; ++q) {
+		if (query_ok[q]) {
+			++num_ok_queries;
+		} else {
+			int* const write = out_nn_indices + static_cast<size_t>(q) * k;
+			std::fill(write, write + k, NA_INTEGER);
+		}
+	}
+	return num_ok_queries;
+}
@@ -39,23 +39,87 @@ SEXP dist_num_data_points(const SEXP R_distances)
 }
 
 
+// Objects without a "metric" attribute are Euclidean. Minkowski objects
+// store the exponent in "minkowski_p". Cosine objects store data points
+// scaled to unit length. Hamming objects are raw matrices of bits packed
+// into 64-bit words (see `hamming.c`), with the number of coordinates in
+// "num_bits" and no normalization or weights. Gower objects store numeric
+// coordinates scaled to the unit interval, the minimum and maximum of
+// each numeric coordinate in "ranges", and the codes of categorical
+// coordinates in "categories" (see `gower.c`), with no normalization or
+// weights.
+static bool idist_check_metric(const SEXP R_distances)
+{
+	SEXP R_metric = getAttrib(R_distances, install("metric"));
+	if (isNull(R_metric)) return true;
+	if (!isString(R_metric) || xlength(R_metric) != 1) return false;
+
+	const char* const metric = CHAR(STRING_ELT(R_metric, 0));
+	if (strcmp(metric, "minkowski") == 0) {
+		SEXP R_p = getAttrib(R_distances, install("minkowski_p"));
+		return isReal(R_p) && (xlength(R_p) == 1) && (REAL(R_p)[0] >= 1.0);
+	}
+	return (strcmp(metric, "euclidean") == 0) ||
+		(strcmp(metric, "manhattan") == 0) ||
+		(strcmp(metric, "maximum") == 0) ||
+		(strcmp(metric, "cosine") == 0) ||
+		(strcmp(metric, "hamming") == 0) ||
+		(strcmp(metric, "gower") == 0);
+}
+
+
+static bool idist_check_metric_is(const SEXP R_distances,
+                                  const char* const metric)
+{
+	SEXP R_metric = getAttrib(R_distances, install("metric"));
+	return isString(R_metric) && (xlength(R_metric) == 1) &&
+		(strcmp(CHAR(STRING_ELT(R_metric, 0)), metric) == 0);
+}
+
+
+static bool idist_check_gower(const SEXP R_distances)
+{
+	SEXP R_categories = getAttrib(R_distances, install("categories"));
+	SEXP R_ranges = getAttrib(R_distances, install("ranges"));
+	const int* const dims = INTEGER(getAttrib(R_distances, R_DimSymbol));
+
+	return isReal(R_distances) &&
+		isMatrix(R_categories) &&
+		isInteger(R_categories) &&
+		(INTEGER(getAttrib(R_categories, R_DimSymbol))[1] == dims[1]) &&
+		isMatrix(R_ranges) &&
+		isReal(R_ranges) &&
+		(INTEGER(getAttrib(R_ranges, R_DimSymbol))[0] == 2) &&
+		(INTEGER(getAttrib(R_ranges, R_DimSymbol))[1] == dims[0]);
+}
+
+
 bool idist_check_distance_object(const SEXP R_distances)
 {
 	SEXP R_class = getAttrib(R_distances, R_ClassSymbol);
 	SEXP R_ids = getAttrib(R_distances, install("ids"));
 	SEXP R_normalization = getAttrib(R_distances, install("normalization"));
 	SEXP R_weights = getAttrib(R_distances, install("weights"));
+	SEXP R_num_bits = getAttrib(R_distances, install("num_bits"));
 
 	return isString(R_class) &&
 		(strcmp(CHAR(asChar(R_class)), "distances") == 0) &&
 		isMatrix(R_distances) &&
-		isReal(R_distances) &&
 		(isNull(R_ids) ||
 			(isString(R_ids) && ((int) xlength(R_ids) == INTEGER(getAttrib(R_distances, R_DimSymbol))[1]))) &&
-		isMatrix(R_normalization) &&
-		isReal(R_normalization) &&
-		isMatrix(R_weights) &&
-		isReal(R_weights);
+		idist_check_metric(R_distances) &&
+		(idist_check_metric_is(R_distances, "gower") ? idist_check_gower(R_distances) :
+		idist_check_metric_is(R_distances, "hamming") ?
+			((TYPEOF(R_distances) == RAWSXP) &&
+				(INTEGER(getAttrib(R_distances, R_DimSymbol))[0] % 8 == 0) &&
+				isInteger(R_num_bits) && (xlength(R_num_bits) == 1) &&
+				(INTEGER(R_num_bits)[0] >= 0) &&
+				((INTEGER(R_num_bits)[0] + 63) / 64 * 8 == INTEGER(getAttrib(R_distances, R_DimSymbol))[0])) :
+			(isReal(R_distances) &&
+				isMatrix(R_normalization) &&
+				isReal(R_normalization) &&
+				isMatrix(R_weights) &&
+				isReal(R_weights)));
 }
 
 
@@ -64,3 +128,28 @@ int idist_num_data_points(const SEXP R_distances)
 	idist_assert(idist_check_distance_object(R_distances));
 	return INTEGER(getAttrib(R_distances, R_DimSymbol))[1];
 }
+
+
+idist_Metric idist_get_metric(const SEXP R_distances)
+{
+	idist_assert(idist_check_distance_object(R_distances));
+	SEXP R_metric = getAttrib(R_distances, install("metric"));
+	if (isNull(R_metric)) return IDIST_METRIC_EUCLIDEAN;
+
+	const char* const metric = CHAR(STRING_ELT(R_metric, 0));
+	if (strcmp(metric, "manhattan") == 0) return IDIST_METRIC_MANHATTAN;
+	if (strcmp(metric, "maximum") == 0) return IDIST_METRIC_MAXIMUM;
+	if (strcmp(metric, "minkowski") == 0) return IDIST_METRIC_MINKOWSKI;
+	if (strcmp(metric, "cosine") == 0) return IDIST_METRIC_COSINE;
+	if (strcmp(metric, "hamming") == 0) return IDIST_METRIC_HAMMING;
+	if (strcmp(metric, "gower") == 0) return IDIST_METRIC_GOWER;
+	return IDIST_METRIC_EUCLIDEAN;
+}
+
+
+// The exponent of Minkowski distances, and 2 for other metrics
+double idist_get_minkowski_p(const SEXP R_distances)
+{
+	if (idist_get_metric(R_distances) != IDIST_METRIC_MINKOWSKI) return 2.0;
+	return REAL(getAttrib(R_distances, install("minkowski_p")))[0];
+}
@@ -29,6 +29,16 @@
 extern "C" {
 #endif
 
+typedef enum {
+	IDIST_METRIC_EUCLIDEAN,
+	IDIST_METRIC_MANHATTAN,
+	IDIST_METRIC_MAXIMUM,
+	IDIST_METRIC_MINKOWSKI,
+	IDIST_METRIC_COSINE,
+	IDIST_METRIC_HAMMING,
+	IDIST_METRIC_GOWER
+} idist_Metric;
+
 SEXP dist_check_distance_object(SEXP R_distances);
 
 SEXP dist_num_data_points(SEXP R_distances);
@@ -37,6 +47,10 @@ bool idist_check_distance_object(SEXP R_distances);
 
 int idist_num_data_points(SEXP R_distances);
 
+idist_Metric idist_get_metric(SEXP R_distances);
+
+double idist_get_minkowski_p(SEXP R_distances);
+
 #ifdef __cplusplus
 }
 #endif